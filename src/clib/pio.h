@@ -350,6 +350,10 @@ typedef struct var_desc_t
     /* The PIO data type (PIO_INT, PIO_FLOAT, etc.) */
     int pio_type;
 
+    /* The number of dimensions of the var in the file, -1 if not
+     * known yet (cached by write_darray_multi()) */
+    int ndims;
+
     /* The size of the data type (2 for PIO_SHORT, 4 for PIO_INT, etc.) */
     PIO_Offset type_size;
 
@@ -394,7 +398,7 @@ typedef struct io_region
 {
     /** The offset from the beginning of the data buffer to the
      * beginning of this region.  */
-    int loffset;
+    PIO_Offset loffset;
 
     /** Start array for this region. */
     PIO_Offset *start;
@@ -416,7 +420,15 @@ enum PIO_REARR_COMM_TYPE
     PIO_REARR_COMM_P2P = (0),
 
     /** Collective */
-    PIO_REARR_COMM_COLL
+    PIO_REARR_COMM_COLL,
+
+    /** Neighborhood collective (over a distributed graph
+     * communicator that only includes the tasks exchanging data) */
+    PIO_REARR_COMM_NEIGHBOR,
+
+    /** Point to point, with the same flow control options as
+     * PIO_REARR_COMM_P2P, but only over the tasks exchanging data */
+    PIO_REARR_COMM_SPARSE
 };
 
 /**
@@ -479,6 +491,223 @@ typedef struct rearr_opt
     rearr_comm_fc_opt_t io2comp;
 } rearr_opt_t;
 
+/**
+ * Cached communication plan for the data rearrangement.
+ *
+ * A plan holds the pio_swapm() arguments (counts, displacements and
+ * committed MPI datatypes) used to rearrange a given number of
+ * variables with an I/O decomposition. Plans are created the first
+ * time a (nvars, send buffer) combination is seen and are reused on
+ * subsequent calls. At most PIO_MAX_REARR_PLANS plans, the most
+ * recently used ones, are kept per decomposition and direction.
+ */
+typedef struct rearr_comm_plan
+{
+    /** Number of variables exchanged using this plan. */
+    int nvars;
+
+    /** Whether the send buffer was available when the plan was
+     * created (no send types are created without a send buffer). */
+    bool has_sbuf;
+
+    /** Number of tasks in the communicator used for the exchange,
+     * the length of all the arrays below. */
+    int ntasks;
+
+    /** Send counts for pio_swapm(). */
+    int *sendcounts;
+
+    /** Receive counts for pio_swapm(). */
+    int *recvcounts;
+
+    /** Send displacements for pio_swapm(). */
+    int *sdispls;
+
+    /** Receive displacements for pio_swapm(). */
+    int *rdispls;
+
+    /** Send MPI datatypes for pio_swapm(). */
+    MPI_Datatype *sendtypes;
+
+    /** Receive MPI datatypes for pio_swapm(). */
+    MPI_Datatype *recvtypes;
+
+    /** True if the datatypes were created (and need to be freed)
+     * by the plan, false if they are borrowed from the io_desc_t. */
+    bool owns_types;
+
+    /** True if the plan exchanges packed data (contiguous messages
+     * in the packed buffers, see PIOc_set_rearr_pack()). */
+    bool packed;
+
+    /** Number of exchanges in progress using the plan (see
+     * rearrange_comp2io_start()), a plan in use is not freed when
+     * the least recently used plans are evicted. */
+    int nusers;
+
+    /** Pointer to the next plan in the list. */
+    struct rearr_comm_plan *next;
+} rearr_comm_plan_t;
+
+/**
+ * Precomputed gather (scatter) list used to pack (unpack) the data
+ * exchanged by the rearranger into (from) a contiguous buffer, see
+ * PIOc_set_rearr_pack(). The elements of all the messages are listed
+ * in the order they are packed, message after message.
+ */
+typedef struct rearr_pack_list
+{
+    /** Number of (nonempty) messages. */
+    int nmsgs;
+
+    /** Array (length nmsgs) of the ranks, in the rearranger
+     * communicator, of the tasks the messages are exchanged with. */
+    int *task;
+
+    /** Array (length nmsgs + 1) of the offsets (in elements) of the
+     * messages in the packed data. The last one is the total number
+     * of elements. */
+    PIO_Offset *start;
+
+    /** If true, the elements are copied in runs of consecutive
+     * indices, otherwise one by one. */
+    bool use_runs;
+
+    /** Array (length start[nmsgs]) of the indices of the elements in
+     * the unpacked buffer. NULL if use_runs is true. */
+    PIO_Offset *index;
+
+    /** Array (length nmsgs + 1) of the first run of each
+     * message. NULL if use_runs is false. */
+    PIO_Offset *run_first;
+
+    /** Array of the index of the first element of each run. NULL if
+     * use_runs is false. */
+    PIO_Offset *run_index;
+
+    /** Array of the number of elements of each run. NULL if use_runs
+     * is false. */
+    int *run_len;
+} rearr_pack_list_t;
+
+/** The maximum number of nonblocking rearrangements that can be in
+ * progress at the same time on an iosystem (see
+ * PIOc_write_darray_nb()). */
+#define PIO_MAX_NB_REARR 64
+
+/** The maximum number of communication plans cached for each
+ * direction of the data rearrangement of an I/O decomposition (see
+ * rearr_comm_plan_t). */
+#define PIO_MAX_REARR_PLANS 16
+
+/**
+ * State of a nonblocking exchange of data started with
+ * pio_swapm_start().
+ */
+typedef struct pio_swapm_req
+{
+    /** Buffers, counts, displacements and datatypes of the exchange
+     * (borrowed, see pio_swapm()). */
+    void *sendbuf;
+    int *sendcounts;
+    int *sdispls;
+    MPI_Datatype *sendtypes;
+    void *recvbuf;
+    int *recvcounts;
+    int *rdispls;
+    MPI_Datatype *recvtypes;
+
+    /** Communicator of the exchange. */
+    MPI_Comm comm;
+
+    /** Flow control options of the exchange. */
+    rearr_comm_fc_opt_t fc;
+
+    /** Tag of the data messages, handshake messages use tag + 1. */
+    int tag;
+
+    /** Request of the collective exchange (MPI_Ialltoallw()) used
+     * without flow control. */
+    MPI_Request coll_req;
+
+    /** Number of tasks exchanged with (point to point). */
+    int steps;
+
+    /** Ranks of the tasks exchanged with, in pair() order. */
+    int *swapids;
+
+    /** Requests (one per step) for the data and handshake
+     * messages. */
+    MPI_Request *rcvids;
+    MPI_Request *sndids;
+    MPI_Request *hs_rcvids;
+    MPI_Request *hs_sndids;
+
+    /** Buffers (one per step) for the handshake messages received
+     * and sent. */
+    int *hs;
+
+    /** Max number of receives pending at one time. */
+    int maxreq;
+
+    /** Number of receives pending. */
+    int npend;
+
+    /** Next step for which a receive is posted. */
+    int rstep;
+
+    /** Number of sends waiting for a handshake. */
+    int nsendwait;
+
+    /** True when the exchange is complete. */
+    bool complete;
+} pio_swapm_req_t;
+
+/**
+ * A nonblocking write of a distributed array, started with
+ * PIOc_write_darray_nb().
+ */
+typedef struct darray_nb_req
+{
+    /** ID of the request, as returned to the user. */
+    int id;
+
+    /** ID of the variable written. */
+    int varid;
+
+    /** ID of the decomposition. */
+    int ioid;
+
+    /** Length of the user array. */
+    PIO_Offset arraylen;
+
+    /** The user array, must not be modified until the request is
+     * complete. */
+    void *array;
+
+    /** Record number, -1 for non record variables. */
+    int frame;
+
+    /** Fill value (one element of the decomposition type). */
+    void *fillvalue;
+
+    /** Buffer for the data rearranged on the IO tasks. */
+    void *iobuf;
+
+    /** Slot (tag) used for the nonblocking rearrangement, see
+     * PIO_MAX_NB_REARR. */
+    int slot;
+
+    /** State of the nonblocking rearrangement. */
+    pio_swapm_req_t *xreq;
+
+    /** Communication plan used by the nonblocking rearrangement. */
+    rearr_comm_plan_t *plan;
+
+    /** Pointer to the next request of the file. */
+    struct darray_nb_req *next;
+} darray_nb_req_t;
+
 /**
  * IO descriptor structure.
  *
@@ -601,6 +830,91 @@ typedef struct io_desc_t
      * group. */
     MPI_Comm subset_comm;
 
+    /** List of cached communication plans used to rearrange data
+     * from compute to IO tasks (one plan per number of variables). */
+    rearr_comm_plan_t *comp2io_plans;
+
+    /** List of cached communication plans used to rearrange data
+     * from IO to compute tasks. */
+    rearr_comm_plan_t *io2comp_plans;
+
+    /** Pack list of the data on the compute tasks (the send side
+     * when writing), used when the data is packed by the
+     * rearranger. NULL until first used. */
+    rearr_pack_list_t *spack;
+
+    /** Pack list of the data on the IO tasks (the receive side when
+     * writing). NULL until first used. */
+    rearr_pack_list_t *rpack;
+
+    /** Distributed graph communicator, created from the communication
+     * pattern of this decomposition, used with the
+     * PIO_REARR_COMM_NEIGHBOR rearranger comm type. MPI_COMM_NULL if
+     * not used. */
+    MPI_Comm neigh_comm;
+
+    /** Communicator of the compute tasks on this (shared memory)
+     * node, used by the PIO_REARR_BOX_HIER rearranger. MPI_COMM_NULL
+     * if not used. Rank 0 is the node leader. */
+    MPI_Comm node_comm;
+
+    /** Number of data elements aggregated on the node leader (the
+     * sum of ndof over all tasks in node_comm). */
+    int node_ndof;
+
+    /** Offset of the data of this task in the data aggregated on the
+     * node leader. */
+    int node_offset;
+
+    /** Shared memory window, allocated by the node leader, used to
+     * aggregate the data of the node. MPI_WIN_NULL if not
+     * allocated. */
+    MPI_Win node_win;
+
+    /** Pointer to the shared memory (of node_win) on the node
+     * leader. */
+    void *node_buf;
+
+    /** Number of variables that fit in node_buf. */
+    int node_buf_nvars;
+
+    /** State of the rearranger autotuner, NULL if the rearranger
+     * options are not being tuned (or the tuning is complete). */
+    struct rearr_autotune *autotune;
+
+    /** Number of neighbors (sources and destinations) of this task in
+     * neigh_comm. */
+    int nneighbors;
+
+    /** Array (length nneighbors) of the ranks, in the communicator
+     * used by the rearranger, of the neighbors in neigh_comm. */
+    int *neighbors;
+
+    /** The ID of the IO system of this decomposition. */
+    int iosysid;
+
+    /** Hash of the arguments used to create this decomposition, used
+     * by PIOc_InitDecomp() to find an identical decomposition. */
+    unsigned long long dedup_hash;
+
+    /** The iosystem rearranger options, subset partition method and
+     * box rearranger blocksize when this decomposition was created,
+     * compared (with the map) before reusing it for an identical
+     * decomposition, since they are only included in dedup_hash. */
+    rearr_opt_t dedup_rearr_opts;
+    int dedup_subset_partition;
+    int dedup_blocksize;
+
+    /** Copies (length ndims) of the iostart/iocount arrays provided to
+     * PIOc_InitDecomp(), or NULL if not provided. */
+    PIO_Offset *dedup_iostart;
+    PIO_Offset *dedup_iocount;
+
+    /** Number of references to this decomposition, i.e. the number
+     * of PIOc_InitDecomp() calls that returned it minus the number of
+     * PIOc_freedecomp() calls on it. */
+    int refcnt;
+
 #if PIO_SAVE_DECOMPS
     /* Indicates whether this iodesc has been saved to disk (the
      * decomposition is dumped to disk)
@@ -736,6 +1050,54 @@ typedef struct iosystem_desc_t
     /** Rearranger options. */
     rearr_opt_t rearr_opts;
 
+    /** If true, the rearranger options of the decompositions created
+     * on this iosystem are tuned online (see
+     * PIOc_set_rearr_autotune()). */
+    bool rearr_autotune;
+
+    /** If true, the rearrangers pack the data exchanged into
+     * contiguous buffers instead of using MPI derived datatypes (see
+     * PIOc_set_rearr_pack()). */
+    bool rearr_pack;
+
+    /** If true, the data written to files (with PnetCDF) is flushed
+     * to disk by a thread in the background, see
+     * PIOc_set_bg_flush(). */
+    bool bg_flush;
+
+    /** The method used to partition the computation tasks among the
+     * IO tasks with the subset rearranger (see
+     * PIO_SUBSET_PARTITION). */
+    int subset_partition;
+
+    /** The policy used to decide when the data written to files is
+     * flushed (see PIO_FLUSH_POLICY). */
+    int flush_policy;
+
+    /** The max imbalance of the data volume received by the IO tasks
+     * of the subset rearranger decompositions created on this
+     * iosystem, the max volume divided by the average volume. Only
+     * set on the IO tasks. */
+    double subset_imbalance;
+
+    /** The method used to place the IO tasks (see
+     * PIO_IOTASK_PLACEMENT). */
+    int iotask_placement;
+
+    /** The number of (shared memory) nodes spanned by the
+     * computation tasks. */
+    int num_nodes;
+
+    /** The number of nodes with at least one IO task. */
+    int num_io_nodes;
+
+    /** The maximum number of IO tasks on a node. */
+    int max_iotasks_per_node;
+
+    /** Slots (bits) used by the nonblocking rearrangements in
+     * progress, see PIO_MAX_NB_REARR. */
+    unsigned long long nb_rearr_slots;
+
 #ifdef _ADIOS2
     /* ADIOS handle */
     adios2_adios *adiosH;
@@ -748,6 +1110,21 @@ typedef struct iosystem_desc_t
     struct iosystem_desc_t *next;
 } iosystem_desc_t;
 
+/**
+ * Least squares fit of the cost of a kind of flush, t = lat + b *
+ * tpb for a flush of b bytes, from the flushes measured (see
+ * PIO_FLUSH_POLICY_MODEL). The sums are decayed as new samples are
+ * added, so the fit follows changes of the bandwidth.
+ */
+typedef struct pio_cost_fit
+{
+    /** Number of samples added. */
+    int nsamples;
+
+    /** Decayed sums of 1, b, t, b * b and b * t over the samples. */
+    double sn, sb, st, sbb, sbt;
+} pio_cost_fit;
+
 /**
  * The multi buffer holds data from one or more variables. Data are
  * accumulated in the multi-buffer.
@@ -780,11 +1157,32 @@ typedef struct wmulti_buffer
     /** Array of fill values used for each var. */
     void *fillvalue;
 
-    /** Pointer to the data. */
-    void *data;
+    /** Number of arrays held by each segment allocated for the
+     * data, 0 until the first segment is allocated. */
+    int seg_arrays;
+
+    /** Number of segments. */
+    int nsegs;
+
+    /** Array (length nsegs) of pointers to the segments of the
+     * data. The arrays are held in the order they were written, a
+     * segment allocated for the data holds up to seg_arrays arrays
+     * (so the data is cached without copying the arrays already
+     * cached when the buffer grows). A segment can also be an array
+     * registered with PIOc_write_darray_nocopy(), the data stays in
+     * the memory of the caller. */
+    void **segs;
+
+    /** Array (length nsegs) of the number of arrays held by each
+     * segment. */
+    int *seg_nvars;
+
+    /** Array (length nsegs), true for the segments that are arrays
+     * registered with PIOc_write_darray_nocopy(). */
+    bool *seg_user;
 
-    /** Pointer to the next multi-buffer in the list. */
-    struct wmulti_buffer *next;
+    /** Number of arrays registered with PIOc_write_darray_nocopy(). */
+    int nuser;
 } wmulti_buffer;
 
 #ifdef _ADIOS2
@@ -934,9 +1332,27 @@ typedef struct file_desc_t
     /** Mode used when file was opened. */
     int mode;
 
-    /** The wmulti_buffer is used to aggregate multiple variables with
-     * the same communication pattern prior to a write. */
-    struct wmulti_buffer buffer;
+    /** The wmulti_buffers are used to aggregate multiple variables
+     * with the same communication pattern prior to a write. Array
+     * (length nwmbs) of the buffers of the file in the order they
+     * were created, which is the order they are flushed in. */
+    struct wmulti_buffer **wmbs;
+
+    /** Number of write multi buffers of the file. */
+    int nwmbs;
+
+    /** Number of elements allocated for wmbs. */
+    int wmbs_size;
+
+    /** Table (length wmb_table_len) to look up the write multi
+     * buffers by decomposition, see pio_get_wmb(). The buffer for the
+     * record (non-record) variables of decomposition ioid is at index
+     * 2 * (ioid - PIO_IODESC_START_ID) + 1 (+ 0), NULL if there is no
+     * such buffer. */
+    struct wmulti_buffer **wmb_table;
+
+    /** Length of wmb_table. */
+    int wmb_table_len;
 
     /* Bytes pending to be read on this file*/
     PIO_Offset rb_pend;
@@ -947,6 +1363,42 @@ typedef struct file_desc_t
     /** Data buffer per IO decomposition for this file. */
     void *iobuf[PIO_IODESC_MAX_IDS];
 
+    /** Limit (in bytes) on the data of this file cached on this task
+     * before it is flushed to disk, see PIOc_set_file_buffer_size(). */
+    PIO_Offset buffer_size_limit;
+
+    /** Bytes of data cached in the write multi buffers of this file
+     * on this task. */
+    PIO_Offset wmb_usage;
+
+    /** Bytes of rearranged data (iobuf and fill buffers) of this file
+     * on this task waiting for the PnetCDF requests that write it. */
+    PIO_Offset iobuf_usage;
+
+    /** Cost of moving the data cached in the write multi buffers of
+     * this file to the IO tasks, measured on this task. */
+    pio_cost_fit rearr_cost;
+
+    /** Cost of waiting for the data of this file to be written to
+     * disk, measured on this task (IO tasks only). */
+    pio_cost_fit disk_cost;
+
+    /** Seconds waited for the data to be written to disk since the
+     * last reset, to leave the disk flushes out of rearr_cost. */
+    double disk_wait;
+
+    /** List of nonblocking writes in progress (oldest first), see
+     * PIOc_write_darray_nb(). */
+    darray_nb_req_t *nb_reqs;
+
+    /** ID of the next nonblocking write. */
+    int nb_req_next_id;
+
+    /** The flush to disk of this file running in the background, see
+     * PIOc_set_bg_flush(). NULL if no flush was run in the
+     * background. */
+    struct bg_flush *bg_flush;
+
     /** I/O statistics associated with this file */
     struct spio_io_fstats_summary *io_fstats;
 
@@ -989,7 +1441,66 @@ enum PIO_REARRANGERS
     PIO_REARR_BOX = 1,
 
     /** Subset rearranger. */
-    PIO_REARR_SUBSET = 2
+    PIO_REARR_SUBSET = 2,
+
+    /** Hierarchical (node-aware) box rearranger. Data is aggregated
+     * on a leader task on each (shared memory) node before being
+     * exchanged with the IO tasks using the box rearranger. */
+    PIO_REARR_BOX_HIER = 3
+};
+
+/**
+ * These are the supported methods to place the IO tasks among the
+ * computation tasks in PIOc_Init_Intracomm() (see
+ * PIOc_set_iotask_placement()).
+ */
+enum PIO_IOTASK_PLACEMENT
+{
+    /** Use the user provided stride and base. */
+    PIO_IOTASK_PLACEMENT_STRIDE = 0,
+
+    /** Spread the IO tasks evenly across the (shared memory) nodes,
+     * ignoring the user provided stride and base. */
+    PIO_IOTASK_PLACEMENT_NODE = 1
+};
+
+/**
+ * These are the supported methods to partition the computation tasks
+ * among the IO tasks with the subset rearranger (see
+ * PIOc_set_subset_partition()). Each IO task receives the data of a
+ * group of computation tasks.
+ */
+enum PIO_SUBSET_PARTITION
+{
+    /** Assign the same number of (consecutive) computation tasks to
+     * each IO task. */
+    PIO_SUBSET_PARTITION_RANK = 0,
+
+    /** Assign groups of consecutive computation tasks with near-equal
+     * data volumes to the IO tasks. */
+    PIO_SUBSET_PARTITION_VOLUME = 1,
+
+    /** Assign groups of computation tasks with near-equal data
+     * volumes to the IO tasks, with the computation tasks ordered by
+     * the lowest global offset in their decomposition maps, so that
+     * the data received by an IO task is contiguous. */
+    PIO_SUBSET_PARTITION_VOLUME_LOCALITY = 2
+};
+
+/**
+ * These are the supported policies to decide when the data cached
+ * for writing is flushed (see PIOc_set_flush_policy()).
+ */
+enum PIO_FLUSH_POLICY
+{
+    /** Flush when the buffer size limits are reached. */
+    PIO_FLUSH_POLICY_LEGACY = 0,
+
+    /** Also flush before the limits are reached, when the flush costs
+     * predicted from the flushes measured so far say that flushing
+     * now costs (per byte) about as little as flushing at the
+     * limit. */
+    PIO_FLUSH_POLICY_MODEL = 1
 };
 
 /**
@@ -1047,6 +1558,11 @@ extern "C" {
 
     /* Write a decomposition file. */
     int PIOc_write_decomp(const char *file, int iosysid, int ioid, MPI_Comm comm);
+    int PIOc_save_decomp_plan(int iosysid, int ioid, const char *filename);
+    int PIOc_load_decomp_plan(int iosysid, const char *filename, int pio_type, int ndims,
+                              const int *gdimlen, int maplen, const PIO_Offset *compmap,
+                              int *ioidp, const int *rearranger, const PIO_Offset *iostart,
+                              const PIO_Offset *iocount, bool *loadedp);
 
     /* Write a decomposition file using netCDF. */
     int PIOc_write_nc_decomp(int iosysid, const char *filename, int cmode, int ioid,
@@ -1083,6 +1599,11 @@ extern "C" {
                             int max_pend_req_c2i,
                             bool enable_hs_i2c, bool enable_isend_i2c,
                             int max_pend_req_i2c);
+    int PIOc_set_rearr_autotune(int iosysid, bool enable);
+    int PIOc_set_rearr_pack(int iosysid, bool enable);
+    int PIOc_set_bg_flush(int iosysid, bool enable);
+    int PIOc_set_subset_partition(int iosysid, int partition);
+    int PIOc_set_flush_policy(int iosysid, int policy);
     /* Distributed data. */
     int PIOc_advanceframe(int ncid, int varid);
     int PIOc_setframe(int ncid, int varid, int frame);
@@ -1090,6 +1611,13 @@ extern "C" {
                           void *fillvalue);
     int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars, PIO_Offset arraylen,
                                 void *array, const int *frame, void **fillvalue, bool flushtodisk);
+    int PIOc_write_darray_nb(int ncid, int varid, int ioid, PIO_Offset arraylen, void *array,
+                             void *fillvalue, int *request);
+    int PIOc_test_darray(int ncid, int request, int *flag);
+    int PIOc_wait_darray(int ncid, int request);
+    int PIOc_write_darray_nocopy(int ncid, int varid, int ioid, PIO_Offset arraylen, void *array,
+                                 void *fillvalue);
+    int PIOc_darray_complete(int ncid);
     int PIOc_read_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *array);
     int PIOc_get_local_array_size(int ioid);
 
@@ -1113,10 +1641,13 @@ extern "C" {
     int PIOc_inq_unlimdims(int ncid, int *nunlimdimsp, int *unlimdimidsp);
     int PIOc_inq_type(int ncid, nc_type xtype, char *name, PIO_Offset *sizep);
     int PIOc_set_blocksize(int newblocksize);
+    int PIOc_set_iotask_placement(int placement, int max_iotasks_per_node);
     int PIOc_File_is_Open(int ncid);
 
     /* Set the IO node data buffer size limit. */
     PIO_Offset PIOc_set_buffer_size_limit(PIO_Offset limit);
+    int PIOc_set_file_buffer_size(int ncid, PIO_Offset limit);
+    PIO_Offset PIOc_set_rearr_setup_buffer_limit(PIO_Offset limit);
 
     /* Set the error hanlding for a file. */
     int PIOc_Set_File_Error_Handling(int ncid, int method);
@@ -0,0 +1,475 @@
+/**
+ * @file
+ * Memory management of the buffers used to cache and rearrange the
+ * data written and read (bget(), brel()).
+ *
+ * The sizes allocated are rounded up to size classes, four per power
+ * of two from 2^PIO_ARENA_MIN_SHIFT to 2^PIO_ARENA_MAX_SHIFT bytes,
+ * and the blocks freed are kept on a free list per class, so that
+ * bget() and brel() do not search for a block:
+ * <ul>
+ * <li>Blocks up to PIO_ARENA_SLAB_MAX_SZ bytes are carved from slabs
+ * of PIO_ARENA_SLAB_SZ bytes. The slabs are kept until
+ * pio_arena_trim() finds all their blocks free.
+ * <li>Larger blocks (the cached arrays and the IO buffers) are
+ * obtained from the system one at a time, backed by huge pages when
+ * they are large enough, and cached on the free list of their class
+ * while the memory cached stays below the buffer limit.
+ * <li>Blocks larger than the largest class are obtained from the
+ * system for one allocation and returned when freed.
+ * </ul>
+ *
+ * With PIO_USE_MALLOC every block is obtained with malloc() and
+ * returned with free(), only the statistics are kept.
+ *
+ * The arena is shared by all the iosystems, and is thread-safe when
+ * the library is built with pthreads (PIO_USE_PTHREADS).
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <pio_config.h>
+#include <pio.h>
+#include <pio_internal.h>
+#include <string.h>
+#if !PIO_USE_MALLOC
+#include <sys/mman.h>
+#endif
+#if PIO_USE_PTHREADS
+#include <pthread.h>
+#endif
+
+/* The smallest size class is 2^PIO_ARENA_MIN_SHIFT bytes (including
+ * the block header). */
+#define PIO_ARENA_MIN_SHIFT 6
+
+/* The largest size class is 2^PIO_ARENA_MAX_SHIFT bytes. */
+#define PIO_ARENA_MAX_SHIFT 26
+
+/* There are 2^PIO_ARENA_CLASS_SHIFT size classes per power of two. */
+#define PIO_ARENA_CLASS_SHIFT 2
+
+/* The number of size classes. */
+#define PIO_ARENA_NCLASSES (((PIO_ARENA_MAX_SHIFT - PIO_ARENA_MIN_SHIFT) << PIO_ARENA_CLASS_SHIFT) + 1)
+
+/* The size of the slabs the small blocks are carved from. */
+#define PIO_ARENA_SLAB_SZ ((bufsize)1 << 20)
+
+/* The largest block carved from a slab. */
+#define PIO_ARENA_SLAB_MAX_SZ ((bufsize)1 << 16)
+
+/* Blocks obtained from the system of at least this size are backed
+ * by huge pages (if the system supports it). */
+#define PIO_ARENA_HUGE_PAGE_SZ ((bufsize)1 << 21)
+
+/* The class of the blocks obtained from the system for a single
+ * allocation. */
+#define PIO_ARENA_DIRECT -1
+
+/* How the memory of a block was obtained. */
+#define PIO_ARENA_SLAB 0
+#define PIO_ARENA_MALLOC 1
+#define PIO_ARENA_MMAP 2
+
+/* The header in front of each block. */
+typedef struct pio_arena_hdr
+{
+    /* The size class, PIO_ARENA_DIRECT for blocks obtained from the
+     * system for this allocation. */
+    int cls;
+
+    /* How the memory was obtained (PIO_ARENA_SLAB, PIO_ARENA_MALLOC
+     * or PIO_ARENA_MMAP). */
+    int how;
+
+    /* The size requested. */
+    bufsize size;
+} pio_arena_hdr;
+
+/* The size of the block header, the blocks (and the data following
+ * the headers) are aligned to 16 bytes. */
+#define PIO_ARENA_HDR_SZ ((bufsize)((sizeof(pio_arena_hdr) + 15) / 16 * 16))
+
+/* Pointer to the link to the next block on a free list, stored in the
+ * data of the free block. */
+#define PIO_ARENA_NEXT(h) (*(pio_arena_hdr **)((char *)(h) + PIO_ARENA_HDR_SZ))
+
+#if PIO_USE_PTHREADS
+static pthread_mutex_t arena_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define ARENA_LOCK() pthread_mutex_lock(&arena_mutex)
+#define ARENA_UNLOCK() pthread_mutex_unlock(&arena_mutex)
+#else
+#define ARENA_LOCK()
+#define ARENA_UNLOCK()
+#endif /* PIO_USE_PTHREADS */
+
+/* The state of the arena. */
+static struct
+{
+    /* Free lists, one per size class. */
+    pio_arena_hdr *free[PIO_ARENA_NCLASSES];
+
+    /* List of the slabs, linked through their first bytes. */
+    void *slabs;
+
+    /* The unused part of the last slab. */
+    char *slab_next;
+    char *slab_end;
+
+    /* Number of blocks carved from the slabs in use. */
+    long nslab_blocks;
+
+    /* The buffer limit, see pio_arena_init(). */
+    bufsize limit;
+
+    /* Bytes of the free blocks cached, not carved from slabs. */
+    bufsize cached;
+
+    /* Statistics, see pio_arena_stats_t. */
+    bufsize curalloc;
+    bufsize peakalloc;
+    bufsize sysalloc;
+    long nget;
+    long nrel;
+} arena;
+
+#if !PIO_USE_MALLOC
+/* Get the size class of blocks of (at least) len bytes, including
+ * the header. len must not be larger than the largest class. With
+ * PIO_USE_MALLOC all the blocks are allocated directly. */
+static int arena_size_class(bufsize len)
+{
+    bufsize step;
+    int p = PIO_ARENA_MIN_SHIFT;
+
+    if (len <= ((bufsize)1 << PIO_ARENA_MIN_SHIFT))
+        return 0;
+
+    /* Find p, 2^p < len <= 2^(p + 1), the classes between 2^p and
+     * 2^(p + 1) are step bytes apart. */
+    while (((bufsize)1 << (p + 1)) < len)
+        p++;
+    step = (bufsize)1 << (p - PIO_ARENA_CLASS_SHIFT);
+
+    return ((p - PIO_ARENA_MIN_SHIFT) << PIO_ARENA_CLASS_SHIFT) +
+        (int)((len - ((bufsize)1 << p) + step - 1) / step);
+}
+#endif /* !PIO_USE_MALLOC */
+
+/* Get the size of the blocks of a size class, including the
+ * header. */
+static bufsize arena_class_size(int cls)
+{
+    int p = PIO_ARENA_MIN_SHIFT + (cls >> PIO_ARENA_CLASS_SHIFT);
+    bufsize q = cls & ((1 << PIO_ARENA_CLASS_SHIFT) - 1);
+
+    return (((bufsize)1 << PIO_ARENA_CLASS_SHIFT) + q) << (p - PIO_ARENA_CLASS_SHIFT);
+}
+
+/* Get len bytes from the system, how gets the way the memory was
+ * obtained. Returns NULL if out of memory. */
+static void *arena_sys_alloc(bufsize len, int *how)
+{
+    void *p;
+
+#if !PIO_USE_MALLOC && defined(MAP_ANONYMOUS)
+    if (len >= PIO_ARENA_HUGE_PAGE_SZ)
+    {
+        p = mmap(NULL, (size_t)len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED)
+        {
+#ifdef MADV_HUGEPAGE
+            /* Not fatal, the memory is backed by normal pages. */
+            madvise(p, (size_t)len, MADV_HUGEPAGE);
+#endif
+            *how = PIO_ARENA_MMAP;
+            return p;
+        }
+    }
+#endif /* !PIO_USE_MALLOC && defined(MAP_ANONYMOUS) */
+
+    p = malloc((size_t)len);
+    *how = PIO_ARENA_MALLOC;
+
+    return p;
+}
+
+/* Return len bytes obtained with arena_sys_alloc() to the system. */
+static void arena_sys_free(void *p, bufsize len, int how)
+{
+#if !PIO_USE_MALLOC && defined(MAP_ANONYMOUS)
+    if (how == PIO_ARENA_MMAP)
+    {
+        munmap(p, (size_t)len);
+        return;
+    }
+#endif /* !PIO_USE_MALLOC && defined(MAP_ANONYMOUS) */
+    free(p);
+}
+
+/* Carve a block of len bytes from the last slab, get a new slab if
+ * the last one is full. Returns NULL if out of memory. Called with
+ * the arena locked. */
+static pio_arena_hdr *arena_slab_get(bufsize len)
+{
+    pio_arena_hdr *h;
+
+    if (arena.slab_end - arena.slab_next < len)
+    {
+        char *slab;
+        int how;
+
+        /* The rest of the last slab is lost. */
+        if (!(slab = arena_sys_alloc(PIO_ARENA_SLAB_SZ, &how)))
+            return NULL;
+        *(void **)slab = arena.slabs;
+        arena.slabs = slab;
+        arena.slab_next = slab + PIO_ARENA_HDR_SZ;
+        arena.slab_end = slab + PIO_ARENA_SLAB_SZ;
+        arena.sysalloc += PIO_ARENA_SLAB_SZ;
+    }
+
+    h = (pio_arena_hdr *)arena.slab_next;
+    arena.slab_next += len;
+    h->how = PIO_ARENA_SLAB;
+
+    return h;
+}
+
+/**
+ * Initialize the buffer arena. This may be called more than once
+ * (once per iosystem), the last limit set is used.
+ *
+ * @param limit the buffer limit in bytes. The free blocks cached for
+ * reuse are limited to this size, and the memory available reported
+ * by pio_arena_stats() is relative to it.
+ */
+void pio_arena_init(bufsize limit)
+{
+    ARENA_LOCK();
+    arena.limit = limit;
+    ARENA_UNLOCK();
+}
+
+/**
+ * Get the statistics of the buffer arena.
+ *
+ * @param stats pointer that gets the statistics.
+ */
+void pio_arena_stats(pio_arena_stats_t *stats)
+{
+    assert(stats);
+
+    ARENA_LOCK();
+    stats->curalloc = arena.curalloc;
+    stats->peakalloc = arena.peakalloc;
+    stats->sysalloc = arena.sysalloc;
+    stats->maxfree = max(0, arena.limit - arena.curalloc);
+    stats->frag = (arena.sysalloc > 0) ?
+        (double)(arena.sysalloc - arena.curalloc) / arena.sysalloc : 0;
+    stats->nget = arena.nget;
+    stats->nrel = arena.nrel;
+    ARENA_UNLOCK();
+}
+
+/**
+ * Return the free blocks cached by the buffer arena to the system,
+ * and the slabs if none of their blocks is in use.
+ */
+void pio_arena_trim(void)
+{
+    ARENA_LOCK();
+    for (int cls = 0; cls < PIO_ARENA_NCLASSES; cls++)
+    {
+        bufsize len = arena_class_size(cls);
+
+        if (len <= PIO_ARENA_SLAB_MAX_SZ)
+            continue;
+        while (arena.free[cls])
+        {
+            pio_arena_hdr *h = arena.free[cls];
+
+            arena.free[cls] = PIO_ARENA_NEXT(h);
+            arena.sysalloc -= len;
+            arena_sys_free(h, len, h->how);
+        }
+    }
+    arena.cached = 0;
+
+    if (!arena.nslab_blocks)
+    {
+        while (arena.slabs)
+        {
+            void *slab = arena.slabs;
+
+            arena.slabs = *(void **)slab;
+            arena.sysalloc -= PIO_ARENA_SLAB_SZ;
+            free(slab);
+        }
+        for (int cls = 0; cls < PIO_ARENA_NCLASSES &&
+                 arena_class_size(cls) <= PIO_ARENA_SLAB_MAX_SZ; cls++)
+            arena.free[cls] = NULL;
+        arena.slab_next = arena.slab_end = NULL;
+    }
+    ARENA_UNLOCK();
+}
+
+/**
+ * Allocate a buffer.
+ *
+ * @param size the size of the buffer in bytes.
+ * @returns pointer to the buffer, NULL if out of memory.
+ */
+void *bget(bufsize size)
+{
+    pio_arena_hdr *h = NULL;
+    bufsize len = PIO_ARENA_HDR_SZ + size;
+    int cls = PIO_ARENA_DIRECT;
+    int how;
+
+    if (size < 0)
+        return NULL;
+
+#if !PIO_USE_MALLOC
+    if (len <= ((bufsize)1 << PIO_ARENA_MAX_SHIFT))
+    {
+        cls = arena_size_class(len);
+        len = arena_class_size(cls);
+    }
+#endif /* !PIO_USE_MALLOC */
+
+    ARENA_LOCK();
+    if (cls != PIO_ARENA_DIRECT && (h = arena.free[cls]))
+    {
+        /* Reuse a free block. */
+        arena.free[cls] = PIO_ARENA_NEXT(h);
+        if (h->how != PIO_ARENA_SLAB)
+            arena.cached -= len;
+    }
+    else if (cls != PIO_ARENA_DIRECT && len <= PIO_ARENA_SLAB_MAX_SZ)
+    {
+        h = arena_slab_get(len);
+    }
+    else if ((h = arena_sys_alloc(len, &how)))
+    {
+        h->how = how;
+        arena.sysalloc += len;
+    }
+
+    if (h)
+    {
+        h->cls = cls;
+        h->size = size;
+        if (h->how == PIO_ARENA_SLAB)
+            arena.nslab_blocks++;
+        arena.curalloc += size;
+        arena.peakalloc = max(arena.peakalloc, arena.curalloc);
+        arena.nget++;
+    }
+    ARENA_UNLOCK();
+
+    return h ? (char *)h + PIO_ARENA_HDR_SZ : NULL;
+}
+
+/**
+ * Allocate a buffer initialized to zero.
+ *
+ * @param size the size of the buffer in bytes.
+ * @returns pointer to the buffer, NULL if out of memory.
+ */
+void *bgetz(bufsize size)
+{
+    void *buf = bget(size);
+
+    if (buf)
+        memset(buf, 0, size);
+
+    return buf;
+}
+
+/**
+ * Change the size of a buffer, the buffer is only moved if its block
+ * is too small for the new size.
+ *
+ * @param buffer pointer to the buffer, may be NULL.
+ * @param newsize the new size of the buffer in bytes.
+ * @returns pointer to the buffer, NULL if out of memory (the buffer
+ * passed is not released in this case).
+ */
+void *bgetr(void *buffer, bufsize newsize)
+{
+    pio_arena_hdr *h;
+    void *nbuf;
+
+    if (!buffer)
+        return bget(newsize);
+
+    /* The blocks of the size classes have room to grow, the blocks
+     * obtained for one allocation are released with the size
+     * requested, and must keep it. */
+    h = (pio_arena_hdr *)((char *)buffer - PIO_ARENA_HDR_SZ);
+    if (h->cls == PIO_ARENA_DIRECT && newsize == h->size)
+        return buffer;
+    if (h->cls != PIO_ARENA_DIRECT && newsize >= 0 &&
+        newsize <= arena_class_size(h->cls) - PIO_ARENA_HDR_SZ)
+    {
+        ARENA_LOCK();
+        arena.curalloc += newsize - h->size;
+        arena.peakalloc = max(arena.peakalloc, arena.curalloc);
+        h->size = newsize;
+        ARENA_UNLOCK();
+        return buffer;
+    }
+
+    if (!(nbuf = bget(newsize)))
+        return NULL;
+    memcpy(nbuf, buffer, min(h->size, newsize));
+    brel(buffer);
+
+    return nbuf;
+}
+
+/**
+ * Release a buffer allocated with bget(), bgetz() or bgetr().
+ *
+ * @param buf pointer to the buffer, may be NULL.
+ */
+void brel(void *buf)
+{
+    pio_arena_hdr *h;
+    bufsize len;
+
+    if (!buf)
+        return;
+    h = (pio_arena_hdr *)((char *)buf - PIO_ARENA_HDR_SZ);
+
+    ARENA_LOCK();
+    arena.curalloc -= h->size;
+    arena.nrel++;
+    if (h->cls == PIO_ARENA_DIRECT)
+    {
+        len = PIO_ARENA_HDR_SZ + h->size;
+        arena.sysalloc -= len;
+        arena_sys_free(h, len, h->how);
+    }
+    else
+    {
+        len = arena_class_size(h->cls);
+        if (h->how == PIO_ARENA_SLAB || arena.cached + len <= arena.limit)
+        {
+            /* Keep the block for reuse. */
+            PIO_ARENA_NEXT(h) = arena.free[h->cls];
+            arena.free[h->cls] = h;
+            if (h->how == PIO_ARENA_SLAB)
+                arena.nslab_blocks--;
+            else
+                arena.cached += len;
+        }
+        else
+        {
+            arena.sysalloc -= len;
+            arena_sys_free(h, len, h->how);
+        }
+    }
+    ARENA_UNLOCK();
+}
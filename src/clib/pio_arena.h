@@ -0,0 +1,48 @@
+/*
+
+  Interface definitions for pio_arena.c, the memory management of the
+  buffers used to cache and rearrange the data written and read.
+
+*/
+#ifndef _PIO_ARENA_H_
+#define _PIO_ARENA_H_
+
+typedef long bufsize;
+
+/** Statistics of the buffer arena, see pio_arena_stats(). */
+typedef struct pio_arena_stats_t
+{
+    /** Bytes currently allocated (the sizes requested). */
+    bufsize curalloc;
+
+    /** Maximum of curalloc since the arena was initialized. */
+    bufsize peakalloc;
+
+    /** Bytes currently held from the system, for the allocated blocks
+     * and the free blocks cached for reuse. */
+    bufsize sysalloc;
+
+    /** Bytes that can still be allocated before the buffer limit
+     * (see pio_arena_init()) is reached. */
+    bufsize maxfree;
+
+    /** Fraction of the memory held from the system that is not
+     * allocated (lost to size class rounding, or cached free). */
+    double frag;
+
+    /** Number of bget() calls. */
+    long nget;
+
+    /** Number of brel() calls. */
+    long nrel;
+} pio_arena_stats_t;
+
+void    pio_arena_init(bufsize limit);
+void    pio_arena_stats(pio_arena_stats_t *stats);
+void    pio_arena_trim(void);
+void   *bget(bufsize size);
+void   *bgetz(bufsize size);
+void   *bgetr(void *buffer, bufsize newsize);
+void    brel(void *buf);
+
+#endif
@@ -0,0 +1,196 @@
+/**
+ * @file
+ * Conversion of distributed array data from the type of the data in
+ * memory to the type of the variable in the file (pio_convert()).
+ *
+ * The conversion of each pair of numeric types is done by a kernel,
+ * a loop with no branches and no function calls so that the compiler
+ * vectorizes it. The kernels are selected from a table indexed by the
+ * types converted from and to. Like netCDF and pnetcdf, the values
+ * out of the range of the type converted to are replaced by the fill
+ * value of that type and PIO_ERANGE is returned, and the fill value
+ * of the type converted from is converted to the fill value of the
+ * type converted to.
+ */
+#include <pio_config.h>
+#include <pio.h>
+#include <pio_internal.h>
+#include <float.h>
+#include <limits.h>
+
+/** Number of types that can be converted. */
+#define PIO_CONV_NTYPES 10
+
+/* The range checks of a value v, of kind S (signed integer), U
+ * (unsigned integer) or F (floating point), converted to a type of
+ * kind S, U or F with the range [lo, hi]. The checks do not short
+ * circuit, so that they do not branch. The checks of the floating
+ * point values do not let NaN through to an integer type, and let
+ * NaN through to a floating point type. */
+#define PIO_CONV_IN_S_S(v, lo, hi) (((long long)(v) >= (long long)(lo)) & ((long long)(v) <= (long long)(hi)))
+#define PIO_CONV_IN_S_U(v, lo, hi) (((v) >= 0) & ((unsigned long long)(v) <= (unsigned long long)(hi)))
+#define PIO_CONV_IN_S_F(v, lo, hi) 1
+#define PIO_CONV_IN_U_S(v, lo, hi) ((unsigned long long)(v) <= (unsigned long long)(hi))
+#define PIO_CONV_IN_U_U(v, lo, hi) ((unsigned long long)(v) <= (unsigned long long)(hi))
+#define PIO_CONV_IN_U_F(v, lo, hi) 1
+#define PIO_CONV_IN_F_S(v, lo, hi) (((double)(v) >= (double)(lo)) & ((double)(v) < (double)(hi) + 1.0))
+#define PIO_CONV_IN_F_U(v, lo, hi) (((double)(v) >= (double)(lo)) & ((double)(v) < (double)(hi) + 1.0))
+#define PIO_CONV_IN_F_F(v, lo, hi) (!(((double)(v) > (double)(hi)) | ((double)(v) < (double)(lo))))
+
+/** A conversion kernel, returns the number of values out of range. */
+typedef PIO_Offset (*pio_conv_fn)(const void *src, void *dst, PIO_Offset n,
+                                  const void *src_fill, const void *dst_fill);
+
+/* Define the kernel converting n values of ftype to ttype. The values
+ * are converted only when they are in range, the others are replaced
+ * with the fill value by a select, so that the loop vectorizes. */
+#define PIO_CONV_KERNEL(fname, ftype, fkind, tname, ttype, tkind, tmin, tmax) \
+static PIO_Offset conv_##fname##_##tname(const void *src, void *dst, PIO_Offset n, \
+                                         const void *src_fill, const void *dst_fill) \
+{ \
+    const ftype *restrict s = src; \
+    ttype *restrict d = dst; \
+    const int has_fill = (src_fill != NULL); \
+    const ftype sfill = has_fill ? *(const ftype *)src_fill : (ftype)0; \
+    const ttype dfill = *(const ttype *)dst_fill; \
+    PIO_Offset nerange = 0; \
+    for (PIO_Offset i = 0; i < n; i++) \
+    { \
+        ftype v = s[i]; \
+        int isfill = has_fill & (v == sfill); \
+        int inrange = PIO_CONV_IN_##fkind##_##tkind(v, tmin, tmax); \
+        ttype c = (ttype)(inrange ? v : (ftype)0); \
+        d[i] = (inrange & !isfill) ? c : dfill; \
+        nerange += !(inrange | isfill); \
+    } \
+    return nerange; \
+}
+
+/* Define the kernels converting ftype to each of the types. */
+#define PIO_CONV_KERNELS_FROM(fname, ftype, fkind) \
+    PIO_CONV_KERNEL(fname, ftype, fkind, byte, signed char, S, SCHAR_MIN, SCHAR_MAX) \
+    PIO_CONV_KERNEL(fname, ftype, fkind, short, short, S, SHRT_MIN, SHRT_MAX) \
+    PIO_CONV_KERNEL(fname, ftype, fkind, int, int, S, INT_MIN, INT_MAX) \
+    PIO_CONV_KERNEL(fname, ftype, fkind, float, float, F, -FLT_MAX, FLT_MAX) \
+    PIO_CONV_KERNEL(fname, ftype, fkind, double, double, F, -DBL_MAX, DBL_MAX) \
+    PIO_CONV_KERNEL(fname, ftype, fkind, ubyte, unsigned char, U, 0, UCHAR_MAX) \
+    PIO_CONV_KERNEL(fname, ftype, fkind, ushort, unsigned short, U, 0, USHRT_MAX) \
+    PIO_CONV_KERNEL(fname, ftype, fkind, uint, unsigned int, U, 0, UINT_MAX) \
+    PIO_CONV_KERNEL(fname, ftype, fkind, int64, long long, S, LLONG_MIN, LLONG_MAX) \
+    PIO_CONV_KERNEL(fname, ftype, fkind, uint64, unsigned long long, U, 0, ULLONG_MAX)
+
+PIO_CONV_KERNELS_FROM(byte, signed char, S)
+PIO_CONV_KERNELS_FROM(short, short, S)
+PIO_CONV_KERNELS_FROM(int, int, S)
+PIO_CONV_KERNELS_FROM(float, float, F)
+PIO_CONV_KERNELS_FROM(double, double, F)
+PIO_CONV_KERNELS_FROM(ubyte, unsigned char, U)
+PIO_CONV_KERNELS_FROM(ushort, unsigned short, U)
+PIO_CONV_KERNELS_FROM(uint, unsigned int, U)
+PIO_CONV_KERNELS_FROM(int64, long long, S)
+PIO_CONV_KERNELS_FROM(uint64, unsigned long long, U)
+
+/* The kernels converting fname to each of the types, in the order of
+ * conv_type_index(). */
+#define PIO_CONV_ROW(fname) \
+    {conv_##fname##_byte, conv_##fname##_short, conv_##fname##_int, \
+     conv_##fname##_float, conv_##fname##_double, conv_##fname##_ubyte, \
+     conv_##fname##_ushort, conv_##fname##_uint, conv_##fname##_int64, \
+     conv_##fname##_uint64}
+
+/** The kernels, indexed by the types converted from and to. */
+static const pio_conv_fn conv_table[PIO_CONV_NTYPES][PIO_CONV_NTYPES] = {
+    PIO_CONV_ROW(byte), PIO_CONV_ROW(short), PIO_CONV_ROW(int), PIO_CONV_ROW(float),
+    PIO_CONV_ROW(double), PIO_CONV_ROW(ubyte), PIO_CONV_ROW(ushort), PIO_CONV_ROW(uint),
+    PIO_CONV_ROW(int64), PIO_CONV_ROW(uint64)};
+
+/**
+ * Get the index of a type in conv_table.
+ *
+ * @param type the PIO type.
+ * @returns the index, -1 if the type can not be converted (PIO_CHAR,
+ * PIO_STRING and user defined types).
+ */
+static int conv_type_index(int type)
+{
+    switch (type)
+    {
+    case PIO_BYTE:
+        return 0;
+    case PIO_SHORT:
+        return 1;
+    case PIO_INT:
+        return 2;
+    case PIO_FLOAT:
+        return 3;
+    case PIO_DOUBLE:
+        return 4;
+    case PIO_UBYTE:
+        return 5;
+    case PIO_USHORT:
+        return 6;
+    case PIO_UINT:
+        return 7;
+    case PIO_INT64:
+        return 8;
+    case PIO_UINT64:
+        return 9;
+    default:
+        return -1;
+    }
+}
+
+/**
+ * Check if the data of a type can be converted to another type by
+ * pio_convert().
+ *
+ * @param from_type the PIO type of the data.
+ * @param to_type the PIO type the data is converted to.
+ * @returns true if both types are numeric types.
+ */
+bool pio_convert_supported(int from_type, int to_type)
+{
+    return conv_type_index(from_type) >= 0 && conv_type_index(to_type) >= 0;
+}
+
+/**
+ * Convert data from one numeric type to another. The values equal to
+ * src_fill are converted to dst_fill, and the values out of the range
+ * of to_type are replaced by dst_fill.
+ *
+ * @param from_type the PIO type of the data in src.
+ * @param to_type the PIO type of the data in dst.
+ * @param src the n values to convert.
+ * @param dst the buffer for the n converted values. It must not
+ * overlap src.
+ * @param n the number of values.
+ * @param src_fill pointer to the fill value of the data in src (one
+ * value of from_type), NULL if the data has no fill value.
+ * @param dst_fill pointer to the fill value of the data in dst (one
+ * value of to_type).
+ * @param nerange pointer that gets the number of values out of the
+ * range of to_type. Ignored if NULL.
+ * @returns 0 for success, PIO_ERANGE if some values were out of the
+ * range of to_type (all the values are converted), PIO_EBADTYPE if
+ * the types can not be converted.
+ */
+int pio_convert(int from_type, int to_type, const void *src, void *dst, PIO_Offset n,
+                const void *src_fill, const void *dst_fill, PIO_Offset *nerange)
+{
+    int from = conv_type_index(from_type);
+    int to = conv_type_index(to_type);
+    PIO_Offset nbad;
+
+    pioassert((src && dst && dst_fill) || n == 0, "invalid input", __FILE__, __LINE__);
+
+    if (from < 0 || to < 0)
+        return PIO_EBADTYPE;
+
+    nbad = n > 0 ? conv_table[from][to](src, dst, n, src_fill, dst_fill) : 0;
+    LOG((3, "pio_convert from_type = %d to_type = %d n = %lld nerange = %lld", from_type,
+         to_type, (long long int)n, (long long int)nbad));
+    if (nerange)
+        *nerange = nbad;
+
+    return nbad ? PIO_ERANGE : PIO_NOERR;
+}
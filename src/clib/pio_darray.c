@@ -37,7 +37,9 @@ PIO_Offset maxusage = 0;
  * Set the PIO IO node data buffer size limit.
  *
  * The pio_buffer_size_limit will only apply to files opened after
- * the setting is changed.
+ * the setting is changed. It is the default limit on the data cached
+ * by each file, use PIOc_set_file_buffer_size() to change the limit
+ * of an open file.
  *
  * @param limit the size of the buffer on the IO nodes
  * @return The previous limit setting.
@@ -53,6 +55,49 @@ PIO_Offset PIOc_set_buffer_size_limit(PIO_Offset limit)
     return oldsize;
 }
 
+/**
+ * Set the limit on the data of a file cached on this task.
+ *
+ * The data written to the file with PIOc_write_darray() (and the
+ * data rearranged on the IO tasks, waiting to be written by PnetCDF)
+ * is cached until this limit is reached, and then flushed to disk.
+ * Each file has its own limit, initialized with the limit set by
+ * PIOc_set_buffer_size_limit() when the file is opened, so a large
+ * file (e.g. a restart file) does not force the data of the other
+ * open files to disk. Files written often with little data can be
+ * given a smaller limit, files written once with a lot of data a
+ * larger one.
+ *
+ * This function is not collective, the tasks may set different
+ * limits. The data is flushed when any task has reached its limit of
+ * the file, the IO tasks use the smallest limit of the IO tasks for
+ * the data waiting to be written by PnetCDF. With async IO the limit
+ * only applies to the compute tasks.
+ *
+ * @param ncid the ncid of the open file.
+ * @param limit the limit in bytes, must be > 0.
+ * @returns 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+int PIOc_set_file_buffer_size(int ncid, PIO_Offset limit)
+{
+    file_desc_t *file;
+    int ierr;
+
+    if ((ierr = pio_get_file(ncid, &file)))
+        return pio_err(NULL, NULL, ierr, __FILE__, __LINE__,
+                        "Setting the buffer size limit of file (ncid=%d) failed. Invalid file id", ncid);
+
+    if (limit <= 0)
+        return pio_err(file->iosystem, file, PIO_EINVAL, __FILE__, __LINE__,
+                        "Setting the buffer size limit of file (%s, ncid=%d) failed. Invalid limit (%lld bytes), the limit must be > 0", pio_get_fname_from_file(file), ncid, (long long int)limit);
+
+    LOG((2, "PIOc_set_file_buffer_size ncid = %d limit = %lld", ncid, (long long int)limit));
+    file->buffer_size_limit = limit;
+
+    return PIO_NOERR;
+}
+
 /**
  * Write one or more arrays with the same IO decomposition to the
  * file.
@@ -103,26 +148,147 @@ PIO_Offset PIOc_set_buffer_size_limit(PIO_Offset limit)
  * @param fillvalue pointer an array (of length nvars) of pointers to
  * the fill value to be used for missing data.
  * @param flushtodisk non-zero to cause buffers to be flushed to disk.
- * @return 0 for success, error code otherwise.
+ * @return 0 for success, PIO_ERANGE if some values were out of the
+ * range of the types of the variables in the file (with pnetcdf the
+ * data is converted to the types of the variables, the values out of
+ * range are written as fill values), error code otherwise.
  * @ingroup PIO_write_darray
  * @author Jim Edwards, Ed Hartnett
  */
 int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
                             PIO_Offset arraylen, void *array, const int *frame,
                             void **fillvalue, bool flushtodisk)
+{
+    return write_darray_multi(ncid, varids, ioid, nvars, arraylen, array, frame,
+                              fillvalue, flushtodisk, false, NULL);
+}
+
+/**
+ * Allocate the buffer (file->iobuf) that holds the data of nvars
+ * variables, with decomposition iodesc, rearranged on the IO tasks
+ * for writing. With the box rearrangers the buffer is initialized
+ * with the fill values of the variables, if the decomposition does
+ * not cover the whole array.
+ *
+ * For netcdf serial writes we collect the data on io nodes and then
+ * move that data one node at a time to the io master node and
+ * write. The buffer size on io task 0 must be as large as the largest
+ * used to accommodate this serial io method (iodesc->maxiobuflen is
+ * used to calculate it).
+ *
+ * @param file pointer to the file info.
+ * @param iodesc pointer to the decomposition info.
+ * @param nvars number of variables.
+ * @param fillvalue pointer to an array (of length nvars) of fill
+ * values (ignored if the decomposition does not need fill values).
+ * @param iobufp pointer that gets the buffer (NULL if the buffer is
+ * not needed on this task).
+ * @returns 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+int alloc_write_iobuf(file_desc_t *file, io_desc_t *iodesc, int nvars, void *fillvalue,
+                      void **iobufp)
+{
+    iosystem_desc_t *ios;
+    size_t rlen = 0;       /* Total data buffer size. */
+
+    pioassert(file && file->iosystem && iodesc && nvars > 0 && iobufp, "invalid input",
+              __FILE__, __LINE__);
+    ios = file->iosystem;
+    *iobufp = NULL;
+
+    /* Determine total size of aggregated data (all vars/records). */
+    if ((file->iotype == PIO_IOTYPE_NETCDF || file->iotype == PIO_IOTYPE_NETCDF4C) && ios->iomaster == MPI_ROOT)
+        rlen = iodesc->maxiobuflen * nvars;
+    else
+        rlen = iodesc->llen * nvars;
+
+    if (rlen > 0)
+    {
+        /* Allocate memory for the buffer for all vars/records. */
+        if (!(*iobufp = bget(iodesc->mpitype_size * rlen)))
+            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
+                            "Allocating buffer for writing multiple variables to file (%s, ncid=%d) failed. Out of memory (Trying to allocate %lld bytes for rearranged data for multiple variables with the same decomposition)", pio_get_fname_from_file(file), file->pio_ncid, (unsigned long long)(iodesc->mpitype_size * rlen));
+        LOG((3, "allocated %lld bytes for variable buffer", rlen * iodesc->mpitype_size));
+
+        /* If fill values are desired, and we're using the BOX
+         * rearranger, insert fill values. */
+        if (iodesc->needsfill && (iodesc->rearranger == PIO_REARR_BOX ||
+                                  iodesc->rearranger == PIO_REARR_BOX_HIER))
+        {
+            PIO_Offset localiobuflen = rlen / nvars;
+            LOG((3, "inserting fill values iodesc->maxiobuflen = %lld, localiobuflen = %lld", iodesc->maxiobuflen, localiobuflen));
+            for (int nv = 0; nv < nvars; nv++)
+                for (PIO_Offset i = 0; i < localiobuflen; i++)
+                    memcpy(&((char *)*iobufp)[iodesc->mpitype_size * (i + nv * localiobuflen)],
+                           &((char *)fillvalue)[nv * iodesc->mpitype_size], iodesc->mpitype_size);
+        }
+    }
+    else if (file->iotype == PIO_IOTYPE_PNETCDF && ios->ioproc)
+    {
+	/* this assures that iobuf is allocated on all iotasks thus
+	 assuring that the flush_output_buffer call above is called
+	 collectively (from all iotasks) */
+        if (!(*iobufp = bget(1)))
+            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
+                            "Allocating buffer for writing multiple variables to file (%s, ncid=%d) failed. Out of memory (Trying to allocate 1 byte)", pio_get_fname_from_file(file), file->pio_ncid);
+        LOG((3, "allocated token for variable buffer"));
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Write one or more arrays with the same IO decomposition to the
+ * file. This implements PIOc_write_darray_multi(), see its
+ * documentation for details.
+ *
+ * The data may already be rearranged (moved from the compute tasks
+ * to the IO tasks), this is used by flush_buffers() to rearrange the
+ * data of several decompositions in one exchange. In this case the
+ * data is written from iobuf (allocated with alloc_write_iobuf())
+ * and array is not used. Rearranged data is only supported without
+ * async.
+ *
+ * @param ncid identifies the netCDF file.
+ * @param varids an array of length nvars containing the variable ids to
+ * be written.
+ * @param ioid the I/O description ID as passed back by
+ * PIOc_InitDecomp().
+ * @param nvars the number of variables to be written with this
+ * call.
+ * @param arraylen the length of the array to be written.
+ * @param array pointer to the data to be written.
+ * @param frame an array of length nvars with the frame or record
+ * dimension for each of the nvars variables in IOBUF. NULL if this
+ * iodesc contains non-record vars.
+ * @param fillvalue pointer an array (of length nvars) of pointers to
+ * the fill value to be used for missing data.
+ * @param flushtodisk non-zero to cause buffers to be flushed to disk.
+ * @param rearranged true if the data is already rearranged in iobuf.
+ * @param iobuf the rearranged data, if rearranged is true. The
+ * buffer is owned (released) by the file after this call.
+ * @return 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+int write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
+                       PIO_Offset arraylen, void *array, const int *frame,
+                       void **fillvalue, bool flushtodisk, bool rearranged, void *iobuf)
 {
     iosystem_desc_t *ios;  /* Pointer to io system information. */
     file_desc_t *file;     /* Pointer to file information. */
     io_desc_t *iodesc;     /* Pointer to IO description information. */
-    size_t rlen = 0;       /* Total data buffer size. */
     var_desc_t *vdesc0;    /* Array of var_desc structure for each var. */
     int fndims = 0;        /* Number of dims in the var in the file. */
     int mpierr = MPI_SUCCESS;  /* Return code from MPI function calls. */
     int ierr = PIO_NOERR;              /* Return code. */
+    int erange = PIO_NOERR;    /* PIO_ERANGE if values were out of range. */
 
     GPTLstart("PIO:PIOc_write_darray_multi");
-    /* Get the file info. */
-    if ((ierr = pio_get_file(ncid, &file)))
+    /* Get the file info. A flush of the file running in the
+     * background is only waited for before the data is written, the
+     * data is rearranged while the flush is in flight. */
+    if ((ierr = pio_get_file_nowait(ncid, &file)))
     {
         GPTLstop("PIO:PIOc_write_darray_multi");
         return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
@@ -186,15 +352,17 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
         return pio_err(ios, file, PIO_EBADID, __FILE__, __LINE__,
                         "Writing multiple variables to file (%s, ncid=%d) failed. Invalid arguments, invalid PIO decomposition id (%d) provided", pio_get_fname_from_file(file), ncid, ioid);
     }
-    pioassert(iodesc->rearranger == PIO_REARR_BOX || iodesc->rearranger == PIO_REARR_SUBSET,
-              "unknown rearranger", __FILE__, __LINE__);
+    pioassert(iodesc->rearranger == PIO_REARR_BOX || iodesc->rearranger == PIO_REARR_SUBSET ||
+              iodesc->rearranger == PIO_REARR_BOX_HIER, "unknown rearranger", __FILE__, __LINE__);
 
     /* Get a pointer to the variable info for the first variable. */
     vdesc0 = &file->varlist[varids[0]];
 
     /* Run these on all tasks if async is not in use, but only on
-     * non-IO tasks if async is in use. */
-    if (!ios->async || !ios->ioproc)
+     * non-IO tasks if async is in use. The number of dims of the var
+     * is cached, so that the next writes do not access the file (and
+     * wait for a flush running in the background). */
+    if ((!ios->async || !ios->ioproc) && vdesc0->ndims < 0)
     {
         /* Get the number of dims for this var. */
         LOG((3, "about to call PIOc_inq_varndims varids[0] = %d", varids[0]));
@@ -213,7 +381,10 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
         spio_ltimer_start(file->io_fstats->wr_timer_name);
         spio_ltimer_start(file->io_fstats->tot_timer_name);
         LOG((3, "called PIOc_inq_varndims varids[0] = %d fndims = %d", varids[0], fndims));
+        vdesc0->ndims = fndims;
     }
+    else if (!ios->async || !ios->ioproc)
+        fndims = vdesc0->ndims;
 
     /* If async is in use, and this is not an IO task, bcast the parameters. */
     if (ios->async)
@@ -264,11 +435,36 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
         LOG((3, "shared fndims = %d", fndims));
     }
 
-    /* if the buffer is already in use in pnetcdf we need to flush first */
-    if (file->iotype == PIO_IOTYPE_PNETCDF && file->iobuf[ioid - PIO_IODESC_START_ID])
+    if (rearranged)
     {
-        ierr = flush_output_buffer(file, true, 0);
-        if (ierr != PIO_NOERR)
+        /* The data was already rearranged into iobuf. */
+        pioassert(!ios->async && !file->iobuf[ioid - PIO_IODESC_START_ID], "buffer overwrite",
+                  __FILE__, __LINE__);
+        file->iobuf[ioid - PIO_IODESC_START_ID] = iobuf;
+    }
+    else
+    {
+        /* if the buffer is already in use in pnetcdf we need to flush first */
+        if (file->iotype == PIO_IOTYPE_PNETCDF && file->iobuf[ioid - PIO_IODESC_START_ID])
+        {
+            ierr = flush_output_buffer(file, true, 0);
+            if (ierr != PIO_NOERR)
+            {
+                GPTLstop("PIO:PIOc_write_darray_multi");
+                spio_ltimer_stop(ios->io_fstats->wr_timer_name);
+                spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+                spio_ltimer_stop(file->io_fstats->wr_timer_name);
+                spio_ltimer_stop(file->io_fstats->tot_timer_name);
+                return pio_err(ios, file, ierr, __FILE__, __LINE__,
+                                "Writing multiple variables to file (%s, ncid=%d) failed. Flushing data to disk (PIO_IOTYPE_PNETCDF) failed", pio_get_fname_from_file(file), ncid);
+            }
+        }
+
+        pioassert(!file->iobuf[ioid - PIO_IODESC_START_ID], "buffer overwrite",__FILE__, __LINE__);
+
+        /* Allocate iobuf. */
+        if ((ierr = alloc_write_iobuf(file, iodesc, nvars, fillvalue,
+                                      &file->iobuf[ioid - PIO_IODESC_START_ID])))
         {
             GPTLstop("PIO:PIOc_write_darray_multi");
             spio_ltimer_stop(ios->io_fstats->wr_timer_name);
@@ -276,22 +472,14 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
             spio_ltimer_stop(file->io_fstats->wr_timer_name);
             spio_ltimer_stop(file->io_fstats->tot_timer_name);
             return pio_err(ios, file, ierr, __FILE__, __LINE__,
-                            "Writing multiple variables to file (%s, ncid=%d) failed. Flushing data to disk (PIO_IOTYPE_PNETCDF) failed", pio_get_fname_from_file(file), ncid);
+                            "Writing multiple variables to file (%s, ncid=%d) failed. Allocating buffer for rearranged data failed", pio_get_fname_from_file(file), ncid);
         }
     }
 
-    pioassert(!file->iobuf[ioid - PIO_IODESC_START_ID], "buffer overwrite",__FILE__, __LINE__);
-
-    /* Determine total size of aggregated data (all vars/records).
-     * For netcdf serial writes we collect the data on io nodes and
-     * then move that data one node at a time to the io master node
-     * and write. The buffer size on io task 0 must be as large as
-     * the largest used to accommodate this serial io method (use
-     * iodesc->maxiobuflen to calculate it). */
-   if ((file->iotype == PIO_IOTYPE_NETCDF || file->iotype == PIO_IOTYPE_NETCDF4C) && ios->iomaster == MPI_ROOT)
-       rlen = iodesc->maxiobuflen * nvars;
-   else
-       rlen = iodesc->llen * nvars;
+    /* For PNETCDF the iobuf is cached until flush_output_buffer(),
+     * count it against the buffer size limit of the file. */
+    if (file->iotype == PIO_IOTYPE_PNETCDF)
+        file->iobuf_usage += (PIO_Offset)iodesc->llen * nvars * iodesc->mpitype_size;
 
 #ifdef PIO_MICRO_TIMING
     bool var_mtimer_was_running[nvars];
@@ -332,54 +520,9 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
     }
 #endif
 
-    /* Allocate iobuf. */
-    if (rlen > 0)
-    {
-        /* Allocate memory for the buffer for all vars/records. */
-        if (!(file->iobuf[ioid - PIO_IODESC_START_ID] = bget(iodesc->mpitype_size * rlen)))
-        {
-            GPTLstop("PIO:PIOc_write_darray_multi");
-            spio_ltimer_stop(ios->io_fstats->wr_timer_name);
-            spio_ltimer_stop(ios->io_fstats->tot_timer_name);
-            spio_ltimer_stop(file->io_fstats->wr_timer_name);
-            spio_ltimer_stop(file->io_fstats->tot_timer_name);
-            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
-                            "Writing multiple variables to file (%s, ncid=%d) failed. Out of memory (Trying to allocate %lld bytes for rearranged data for multiple variables with the same decomposition)", pio_get_fname_from_file(file), ncid, (unsigned long long)(iodesc->mpitype_size * rlen));
-        }
-        LOG((3, "allocated %lld bytes for variable buffer", rlen * iodesc->mpitype_size));
-
-        /* If fill values are desired, and we're using the BOX
-         * rearranger, insert fill values. */
-        if (iodesc->needsfill && iodesc->rearranger == PIO_REARR_BOX)
-        {
-            PIO_Offset localiobuflen = rlen / nvars;
-            LOG((3, "inserting fill values iodesc->maxiobuflen = %lld, localiobuflen = %lld", iodesc->maxiobuflen, localiobuflen));
-            for (int nv = 0; nv < nvars; nv++)
-                for (PIO_Offset i = 0; i < localiobuflen; i++)
-                    memcpy(&((char *)file->iobuf[ioid - PIO_IODESC_START_ID])[iodesc->mpitype_size * (i + nv * localiobuflen)],
-                           &((char *)fillvalue)[nv * iodesc->mpitype_size], iodesc->mpitype_size);
-        }
-    }
-    else if (file->iotype == PIO_IOTYPE_PNETCDF && ios->ioproc)
-    {
-	/* this assures that iobuf is allocated on all iotasks thus
-	 assuring that the flush_output_buffer call above is called
-	 collectively (from all iotasks) */
-        if (!(file->iobuf[ioid - PIO_IODESC_START_ID] = bget(1)))
-        {
-            GPTLstop("PIO:PIOc_write_darray_multi");
-            spio_ltimer_stop(ios->io_fstats->wr_timer_name);
-            spio_ltimer_stop(ios->io_fstats->tot_timer_name);
-            spio_ltimer_stop(file->io_fstats->wr_timer_name);
-            spio_ltimer_stop(file->io_fstats->tot_timer_name);
-            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
-                            "Writing multiple variables to file (%s, ncid=%d) failed. Out of memory (Trying to allocate 1 byte)", pio_get_fname_from_file(file), ncid);
-        }
-        LOG((3, "allocated token for variable buffer"));
-    }
-
     /* Move data from compute to IO tasks. */
-    if ((ierr = rearrange_comp2io(ios, iodesc, array, file->iobuf[ioid - PIO_IODESC_START_ID], nvars)))
+    if (!rearranged &&
+        (ierr = rearrange_comp2io(ios, iodesc, array, file->iobuf[ioid - PIO_IODESC_START_ID], nvars)))
     {
         GPTLstop("PIO:PIOc_write_darray_multi");
         spio_ltimer_stop(ios->io_fstats->wr_timer_name);
@@ -499,14 +642,39 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
         }
     }
 #endif
+    /* With pnetcdf the fill values for the holes in a SUBSET
+     * decomposition are written in the same requests as the data. */
+    bool merge_fill = (file->iotype == PIO_IOTYPE_PNETCDF &&
+                       iodesc->rearranger == PIO_REARR_SUBSET && iodesc->needsfill);
+
+    /* The underlying library is not called on the file while it is
+     * flushed in the background, wait for the flush. Its result is
+     * reported by the next flush of the file (see bg_flush_wait()). */
+    bg_flush_join(file);
+
     /* Write the darray based on the iotype. */
     LOG((2, "about to write darray for iotype = %d", file->iotype));
     switch (file->iotype)
     {
     case PIO_IOTYPE_NETCDF4P:
     case PIO_IOTYPE_PNETCDF:
-        if ((ierr = write_darray_multi_par(file, nvars, fndims, varids, iodesc,
-                                           DARRAY_DATA, frame)))
+#ifdef _PNETCDF
+        if (merge_fill)
+            ierr = write_darray_multi_par_fill(file, nvars, fndims, varids, iodesc,
+                                               fillvalue, frame);
+        else
+#endif /* _PNETCDF */
+            ierr = write_darray_multi_par(file, nvars, fndims, varids, iodesc,
+                                          DARRAY_DATA, fillvalue, frame);
+        /* The values out of the range of the types of the variables
+         * were written as fill values, the write goes on and
+         * PIO_ERANGE is returned at the end, as netCDF does. */
+        if (ierr == PIO_ERANGE)
+        {
+            erange = ierr;
+            ierr = PIO_NOERR;
+        }
+        if (ierr)
         {
             GPTLstop("PIO:PIOc_write_darray_multi");
             spio_ltimer_stop(ios->io_fstats->wr_timer_name);
@@ -564,7 +732,7 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
      * points. This is generally faster than the netcdf method of
      * filling the entire array with missing values before overwriting
      * those values later. */
-    if (iodesc->rearranger == PIO_REARR_SUBSET && iodesc->needsfill)
+    if (iodesc->rearranger == PIO_REARR_SUBSET && iodesc->needsfill && !merge_fill)
     {
         LOG((2, "nvars = %d holegridsize = %ld iodesc->needsfill = %d\n", nvars,
              iodesc->holegridsize, iodesc->needsfill));
@@ -572,17 +740,21 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
 	pioassert(!vdesc0->fillbuf, "buffer overwrite",__FILE__, __LINE__);
 
         /* Get a buffer. */
-	if (ios->io_rank == 0)
-	    vdesc0->fillbuf = bget(iodesc->maxholegridsize * iodesc->mpitype_size * nvars);
-	else if (iodesc->holegridsize > 0)
-	    vdesc0->fillbuf = bget(iodesc->holegridsize * iodesc->mpitype_size * nvars);
+        PIO_Offset fillbuf_sz = (PIO_Offset)((ios->io_rank == 0) ? iodesc->maxholegridsize :
+                                             iodesc->holegridsize) * iodesc->mpitype_size * nvars;
+	if (ios->io_rank == 0 || iodesc->holegridsize > 0)
+	    vdesc0->fillbuf = bget(fillbuf_sz);
+
+        /* For PNETCDF the fillbuf is cached until flush_output_buffer(). */
+        if (file->iotype == PIO_IOTYPE_PNETCDF && vdesc0->fillbuf)
+            file->iobuf_usage += fillbuf_sz;
 
         /* copying the fill value into the data buffer for the box
          * rearranger. This will be overwritten with data where
          * provided. */
         for (int nv = 0; nv < nvars; nv++)
             for (int i = 0; i < iodesc->holegridsize; i++)
-                memcpy(&((char *)vdesc0->fillbuf)[iodesc->mpitype_size * (i + nv * iodesc->holegridsize)],
+                memcpy(&((char *)vdesc0->fillbuf)[iodesc->mpitype_size * (i + (PIO_Offset)nv * iodesc->holegridsize)],
                        &((char *)fillvalue)[iodesc->mpitype_size * nv], iodesc->mpitype_size);
 
         /* Write the darray based on the iotype. */
@@ -591,7 +763,7 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
         case PIO_IOTYPE_PNETCDF:
         case PIO_IOTYPE_NETCDF4P:
             if ((ierr = write_darray_multi_par(file, nvars, fndims, varids, iodesc,
-                                               DARRAY_FILL, frame)))
+                                               DARRAY_FILL, fillvalue, frame)))
             {
                 GPTLstop("PIO:PIOc_write_darray_multi");
                 spio_ltimer_stop(ios->io_fstats->wr_timer_name);
@@ -675,7 +847,7 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
     spio_ltimer_stop(ios->io_fstats->tot_timer_name);
     spio_ltimer_stop(file->io_fstats->wr_timer_name);
     spio_ltimer_stop(file->io_fstats->tot_timer_name);
-    return PIO_NOERR;
+    return erange;
 }
 
 /**
@@ -724,6 +896,7 @@ int find_var_fillvalue(file_desc_t *file, int varid, var_desc_t *vdesc)
 }
 
 /* Check if the write multi buffer requires a flush
+ * file : The file the data is written to
  * wmb : A write multi buffer that might already contain data
  * arraylen : The length of the new array that needs to be cached in this wmb
  *            (The array is not cached yet)
@@ -737,43 +910,72 @@ int find_var_fillvalue(file_desc_t *file, int varid, var_desc_t *vdesc)
  * rearranged data until the write completes)
  * Returns 2 if a disk flush is required, 1 if an I/O flush is required, 0 otherwise
  */
-static int PIO_wmb_needs_flush(wmulti_buffer *wmb, int arraylen, io_desc_t *iodesc)
+static int PIO_wmb_needs_flush(file_desc_t *file, wmulti_buffer *wmb, int arraylen,
+                               io_desc_t *iodesc)
 {
-    bufsize curalloc, totfree, maxfree;
-    long nget, nrel;
+    pio_arena_stats_t stats;
     const int NEEDS_DISK_FLUSH=2, NEEDS_IO_FLUSH=1, NO_FLUSH=0;
 
-    assert(wmb && iodesc);
-    /* Find out how much free, contiguous space is available. */
-    bstats(&curalloc, &totfree, &maxfree, &nget, &nrel);
+    assert(file && wmb && iodesc);
+    /* Find out how much space is available. */
+    pio_arena_stats(&stats);
 
-    LOG((2, "maxfree = %ld wmb->num_arrays = %d (1 + wmb->num_arrays) *"
-         " arraylen * iodesc->mpitype_size = %ld totfree = %ld\n",
-          maxfree, wmb->num_arrays,
-         (1 + wmb->num_arrays) * arraylen * iodesc->mpitype_size, totfree));
+    LOG((2, "maxfree = %ld wmb->num_arrays = %d wmb->nsegs = %d curalloc = %ld frag = %f wmb_usage = %lld iobuf_usage = %lld\n",
+          stats.maxfree, wmb->num_arrays, wmb->nsegs, stats.curalloc, stats.frag,
+          (long long int)file->wmb_usage, (long long int)file->iobuf_usage));
 
-    /* We have exceeded the set buffer write cache limit, write data to
-     * disk
+    /* We have exceeded the write cache limit of this file, write data
+     * to disk. Only the data of this file is counted, the buffers of
+     * a flush running in the background (see PIOc_set_bg_flush()) are
+     * not counted either.
      */
-    if(curalloc >= pio_buffer_size_limit)
+    if(file->wmb_usage + file->iobuf_usage >= file->buffer_size_limit)
     {
         return NEEDS_DISK_FLUSH;
     }
 
+    /* With the model policy, flush before the limit when the flushes
+     * measured so far predict that flushing now is about as cheap per
+     * byte as flushing at the limit. The flushes write the data of
+     * this buffer, so it must hold data. The data waiting to be
+     * written to disk is only known on the IO tasks, the decision is
+     * shared with the other tasks by the caller. */
+    if (file->iosystem->flush_policy == PIO_FLUSH_POLICY_MODEL && wmb->num_arrays > 0)
+    {
+        PIO_Offset wmb_bytes = (PIO_Offset)wmb->num_arrays * wmb->arraylen * iodesc->mpitype_size;
+
+        if (pio_cost_fit_flush_now(&file->disk_cost, file->iobuf_usage, file->buffer_size_limit))
+        {
+            LOG((2, "flush policy model: disk flush of %lld bytes", (long long int)file->iobuf_usage));
+            return NEEDS_DISK_FLUSH;
+        }
+        if (pio_cost_fit_flush_now(&file->rearr_cost, wmb_bytes, file->buffer_size_limit))
+        {
+            LOG((2, "flush policy model: I/O flush of %lld bytes", (long long int)wmb_bytes));
+            return NEEDS_IO_FLUSH;
+        }
+    }
+
+    /* The arrays are cached in segments (see PIOc_write_darray()),
+     * only a new segment needs contiguous memory. No memory is
+     * needed if the last segment has room for this array. */
+    if (arraylen <= 0 || (wmb->nsegs > 0 && !wmb->seg_user[wmb->nsegs - 1] &&
+                          wmb->seg_nvars[wmb->nsegs - 1] < wmb->seg_arrays))
+        return NO_FLUSH;
+
     PIO_Offset array_sz_bytes = arraylen * iodesc->mpitype_size;
-    /* Total cache size required to cache this array
-     * - including existing data cached in wmb
-     * Note that all the arrays are cached in an wmb in a single
-     * contiguous block of memory.
-     */
-    PIO_Offset wmb_req_cache_sz = (1 + wmb->num_arrays) * array_sz_bytes;
-    /* maxfree is the maximum amount of contiguous memory available.
-     * if maxfree <= 110% of the current size of wmb cache, it is close
+    int seg_arrays = (wmb->seg_arrays == 0) ? max(1, PIO_WMB_SEG_SIZE / array_sz_bytes) :
+        wmb->seg_arrays;
+    /* Cache size required for the new segment */
+    PIO_Offset wmb_req_cache_sz = seg_arrays * array_sz_bytes;
+    /* maxfree is the amount of memory available below the buffer
+     * limit (see pio_arena_stats()).
+     * if maxfree <= 110% of the size of the new segment, it is close
      * to being exhausted/filled, flush so that we have enough space
      * to satisfy future requests
      * FIXME: What is the logic for using 110% here?
      */ 
-    if(maxfree <= 1.1 * wmb_req_cache_sz)
+    if(stats.maxfree <= 1.1 * wmb_req_cache_sz)
     {
         return NEEDS_IO_FLUSH;
     }
@@ -1316,62 +1518,94 @@ static int PIOc_write_darray_adios(file_desc_t *file, int varid, int ioid,
 #endif
 
 /**
- * Write a distributed array to the output file.
- *
- * This routine aggregates output on the compute nodes and only sends
- * it to the IO nodes when the compute buffer is full or when a flush
- * is triggered.
+ * Copy the default fill value of the type of a decomposition (one
+ * element of iodesc->mpitype) to a buffer. This is used when the
+ * caller of PIOc_write_darray() does not provide a fill value.
  *
- * Internally, this function will:
- * <ul>
- * <li>Locate info about this file, decomposition, and variable.
- * <li>If we don't have a fillvalue for this variable, determine one
- * and remember it for future calls.
- * <li>Initialize or find the multi_buffer for this record/var.
- * <li>Find out how much free space is available in the multi buffer
- * and flush if needed.
- * <li>Store the new user data in the mutli buffer.
- * <li>If needed (only for subset rearranger), fill in gaps in data
- * with fillvalue.
- * <li>Remember the frame value (i.e. record number) of this data if
- * there is one.
- * </ul>
- *
- * NOTE: The write multi buffer wmulti_buffer is the cache on compute
- * nodes that will collect and store multiple variables before sending
- * them to the io nodes. Aggregating variables in this way leads to a
- * considerable savings in communication expense. Variables in the wmb
- * array must have the same decomposition and base data size and we
- * also need to keep track of whether each is a recordvar (has an
- * unlimited dimension) or not.
+ * @param iodesc pointer to the decomposition.
+ * @param buf the buffer, at least iodesc->mpitype_size bytes.
+ * @returns 0 for success, PIO_EBADTYPE for an unsupported type.
+ */
+static int copy_default_fillvalue(io_desc_t *iodesc, void *buf)
+{
+    void *fill;
+    signed char byte_fill = PIO_FILL_BYTE;
+    char char_fill = PIO_FILL_CHAR;
+    short short_fill = PIO_FILL_SHORT;
+    int int_fill = PIO_FILL_INT;
+    float float_fill = PIO_FILL_FLOAT;
+    double double_fill = PIO_FILL_DOUBLE;
+#ifdef _NETCDF4
+    unsigned char ubyte_fill = PIO_FILL_UBYTE;
+    unsigned short ushort_fill = PIO_FILL_USHORT;
+    unsigned int uint_fill = PIO_FILL_UINT;
+    long long int64_fill = PIO_FILL_INT64;
+    long long uint64_fill = PIO_FILL_UINT64;
+#endif /* _NETCDF4 */
+    MPI_Datatype vtype = (MPI_Datatype)iodesc->mpitype;
+    LOG((3, "caller did not provide fill value vtype = %d", vtype));
+
+    /* This must be done with an if statement, not a case, or
+     * openmpi will not build. */
+    if (vtype == MPI_BYTE)
+        fill = &byte_fill;
+    else if (vtype == MPI_CHAR)
+        fill = &char_fill;
+    else if (vtype == MPI_SHORT)
+        fill = &short_fill;
+    else if (vtype == MPI_INT)
+        fill = &int_fill;
+    else if (vtype == MPI_FLOAT)
+        fill = &float_fill;
+    else if (vtype == MPI_DOUBLE)
+        fill = &double_fill;
+#ifdef _NETCDF4
+    else if (vtype == MPI_UNSIGNED_CHAR)
+        fill = &ubyte_fill;
+    else if (vtype == MPI_UNSIGNED_SHORT)
+        fill = &ushort_fill;
+    else if (vtype == MPI_UNSIGNED)
+        fill = &uint_fill;
+    else if (vtype == MPI_LONG_LONG)
+        fill = &int64_fill;
+    else if (vtype == MPI_UNSIGNED_LONG_LONG)
+        fill = &uint64_fill;
+#endif /* _NETCDF4 */
+    else
+        return PIO_EBADTYPE;
+
+    memcpy(buf, fill, iodesc->mpitype_size);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Write a distributed array to the output file, see
+ * PIOc_write_darray() and PIOc_write_darray_nocopy().
  *
  * @param ncid the ncid of the open netCDF file.
  * @param varid the ID of the variable that these data will be written
  * to.
  * @param ioid the I/O description ID as passed back by
  * PIOc_InitDecomp().
- * @param arraylen the length of the array to be written. This should
- * be at least the length of the local component of the distrubited
- * array. (Any values beyond length of the local component will be
- * ignored.)
+ * @param arraylen the length of the array to be written.
  * @param array pointer to an array of length arraylen with the data
- * to be written. This is a pointer to the distributed portion of the
- * array that is on this task.
+ * to be written.
  * @param fillvalue pointer to the fill value to be used for missing
  * data.
+ * @param nocopy if true, the array is registered in the write multi
+ * buffer instead of being copied to it.
  * @returns 0 for success, non-zero error code for failure.
  * @ingroup PIO_write_darray
- * @author Jim Edwards, Ed Hartnett
  */
-int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *array,
-                      void *fillvalue)
+static int write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *array,
+                        void *fillvalue, bool nocopy)
 {
     iosystem_desc_t *ios;  /* Pointer to io system information. */
     file_desc_t *file;     /* Info about file we are writing to. */
     io_desc_t *iodesc;     /* The IO description. */
     var_desc_t *vdesc;     /* Info about the var being written. */
     void *bufptr;          /* A data buffer. */
-    MPI_Datatype vtype;    /* The MPI type of the variable. */
     wmulti_buffer *wmb;    /* The write multi buffer for one or more vars. */
     int recordvar;         /* Non-zero if this is a record variable. */
     int needsflush = 0;    /* True if we need to flush buffer. */
@@ -1381,14 +1615,16 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
 #endif
     int mpierr = MPI_SUCCESS;  /* Return code from MPI functions. */
     int ierr = PIO_NOERR;  /* Return code. */
+    int erange = PIO_NOERR; /* PIO_ERANGE if flushed values were out of range. */
 
     GPTLstart("PIO:PIOc_write_darray");
     GPTLstart("PIO:write_total");
     LOG((1, "PIOc_write_darray ncid = %d varid = %d ioid = %d arraylen = %d",
          ncid, varid, ioid, arraylen));
 
-    /* Get the file info. */
-    if ((ierr = pio_get_file(ncid, &file)))
+    /* Get the file info. The data is only cached here, so a flush of
+     * the file running in the background is not waited for. */
+    if ((ierr = pio_get_file_nowait(ncid, &file)))
     {
         GPTLstop("PIO:PIOc_write_darray");
         GPTLstop("PIO:write_total");
@@ -1401,6 +1637,17 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
     ios = file->iosystem;
     assert(ios);
 
+    /* Progress the nonblocking writes in progress. */
+    if (file->nb_reqs && (ierr = darray_nb_progress(file)))
+    {
+        GPTLstop("PIO:PIOc_write_darray");
+        GPTLstop("PIO:write_total");
+        spio_ltimer_stop(file->io_fstats->wr_timer_name);
+        spio_ltimer_stop(file->io_fstats->tot_timer_name);
+        return pio_err(ios, file, ierr, __FILE__, __LINE__,
+                        "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Progressing the nonblocking writes in progress failed", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid);
+    }
+
     spio_ltimer_start(ios->io_fstats->wr_timer_name);
     spio_ltimer_start(ios->io_fstats->tot_timer_name);
 
@@ -1590,11 +1837,9 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
     recordvar = vdesc->record >= 0 ? 1 : 0;
     LOG((3, "recordvar = %d looking for multibuffer", recordvar));
 
-    /* Move to end of list or the entry that matches this ioid. */
-    for (wmb = &file->buffer; wmb->next; wmb = wmb->next)
-        if (wmb->ioid == ioid && wmb->recordvar == recordvar)
-            break;
-    LOG((3, "wmb->ioid = %d wmb->recordvar = %d", wmb->ioid, wmb->recordvar));
+    /* Find the buffer of this decomposition, if any. */
+    wmb = pio_get_wmb(file, ioid, recordvar);
+    LOG((3, "wmb found = %d", wmb ? 1 : 0));
 
 #ifdef _ADIOS2
     if (file->iotype == PIO_IOTYPE_ADIOS)
@@ -1613,11 +1858,11 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
 #endif
 
     /* If we did not find an existing wmb entry, create a new wmb. */
-    if (wmb->ioid != ioid || wmb->recordvar != recordvar)
+    if (!wmb)
     {
         /* Allocate a buffer. */
         LOG((3, "allocating multi-buffer"));
-        if (!(wmb->next = calloc(1, sizeof(wmulti_buffer))))
+        if ((ierr = pio_add_wmb(file, ioid, recordvar, &wmb)))
         {
             GPTLstop("PIO:PIOc_write_darray");
             GPTLstop("PIO:write_total");
@@ -1625,27 +1870,18 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
             spio_ltimer_stop(ios->io_fstats->tot_timer_name);
             spio_ltimer_stop(file->io_fstats->wr_timer_name);
             spio_ltimer_stop(file->io_fstats->tot_timer_name);
-            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
-                            "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Out of memory allocating %lld bytes for a write multi buffer to cache user data", pio_get_fname_from_file(file), varid, pio_get_fname_from_file(file), file->pio_ncid, (unsigned long long) sizeof(wmulti_buffer));
+            return pio_err(ios, file, ierr, __FILE__, __LINE__,
+                            "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Out of memory allocating %lld bytes for a write multi buffer to cache user data", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid, (unsigned long long) sizeof(wmulti_buffer));
         }
         LOG((3, "allocated multi-buffer"));
 
-        /* Set pointer to newly allocated buffer and initialize.*/
-        wmb = wmb->next;
-        wmb->recordvar = recordvar;
-        wmb->next = NULL;
-        wmb->ioid = ioid;
-        wmb->num_arrays = 0;
         wmb->arraylen = arraylen;
-        wmb->vid = NULL;
-        wmb->data = NULL;
-        wmb->frame = NULL;
-        wmb->fillvalue = NULL;
     }
     LOG((2, "wmb->num_arrays = %d arraylen = %d iodesc->mpitype_size = %d\n",
          wmb->num_arrays, arraylen, iodesc->mpitype_size));
 
-    needsflush = PIO_wmb_needs_flush(wmb, arraylen, iodesc);
+    /* A registered array needs no memory in the buffer. */
+    needsflush = PIO_wmb_needs_flush(file, wmb, nocopy ? 0 : arraylen, iodesc);
     assert(needsflush >= 0);
 
 #if PIO_LIMIT_CACHED_IO_REGIONS
@@ -1707,12 +1943,10 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
     /* Flush data if needed. */
     if (needsflush > 0)
     {
-#if !PIO_USE_MALLOC
 #ifdef PIO_ENABLE_LOGGING
         /* Collect a debug report about buffer. */
         cn_buffer_report(ios, true);
 #endif /* PIO_ENABLE_LOGGING */
-#endif /* !PIO_USE_MALLOC */
 
         /* Flush buffer to I/O processes - rearrange data and
          * start writing data from the I/O processes
@@ -1724,7 +1958,15 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
         spio_ltimer_stop(ios->io_fstats->tot_timer_name);
         spio_ltimer_stop(file->io_fstats->wr_timer_name);
         spio_ltimer_stop(file->io_fstats->tot_timer_name);
-        if ((ierr = flush_buffer(ncid, wmb, (needsflush == 2))))
+        /* Values out of range were written as fill values, the data
+         * of this call is still cached and PIO_ERANGE is returned
+         * at the end. */
+        if ((ierr = flush_buffer(ncid, wmb, (needsflush == 2))) == PIO_ERANGE)
+        {
+            erange = ierr;
+            ierr = PIO_NOERR;
+        }
+        if (ierr)
         {
             GPTLstop("PIO:PIOc_write_darray");
             GPTLstop("PIO:write_total");
@@ -1752,10 +1994,36 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
     mtimer_async_event_in_progress(file->varlist[varid].wr_mtimer, true);
 #endif
 
-    /* Get memory for data. */
-    if (arraylen > 0)
-    {
-        if (!(wmb->data = bgetr(wmb->data, (1 + wmb->num_arrays) * arraylen * iodesc->mpitype_size)))
+    /* Get memory for data. The data is cached in segments, a new
+     * segment is allocated when the last one is full (or is a
+     * registered array). A registered array is a segment of its
+     * own. */
+    if (arraylen > 0 && (nocopy || wmb->nsegs == 0 || wmb->seg_user[wmb->nsegs - 1] ||
+                         wmb->seg_nvars[wmb->nsegs - 1] == wmb->seg_arrays))
+    {
+        PIO_Offset array_sz_bytes = arraylen * iodesc->mpitype_size;
+        void **segs;
+        int *seg_nvars;
+        bool *seg_user;
+
+        if (!nocopy && wmb->seg_arrays == 0)
+            wmb->seg_arrays = max(1, PIO_WMB_SEG_SIZE / array_sz_bytes);
+
+        /* Grow the segment arrays one at a time, each array is only
+         * replaced when its realloc succeeds, so the buffer is left
+         * valid (with nsegs segments) if one fails. */
+        if ((segs = realloc(wmb->segs, sizeof(void *) * (1 + wmb->nsegs))))
+            wmb->segs = segs;
+        if (segs && (seg_nvars = realloc(wmb->seg_nvars, sizeof(int) * (1 + wmb->nsegs))))
+            wmb->seg_nvars = seg_nvars;
+        else
+            seg_nvars = NULL;
+        if (seg_nvars && (seg_user = realloc(wmb->seg_user, sizeof(bool) * (1 + wmb->nsegs))))
+            wmb->seg_user = seg_user;
+        else
+            seg_user = NULL;
+        if (!seg_user ||
+            !(wmb->segs[wmb->nsegs] = nocopy ? array : bget(wmb->seg_arrays * array_sz_bytes)))
         {
             GPTLstop("PIO:PIOc_write_darray");
             GPTLstop("PIO:write_total");
@@ -1764,9 +2032,15 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
             spio_ltimer_stop(file->io_fstats->wr_timer_name);
             spio_ltimer_stop(file->io_fstats->tot_timer_name);
             return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
-                            "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Out of memory allocating space (realloc %lld bytes) to cache user data", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid, (long long int )((1 + wmb->num_arrays) * arraylen * iodesc->mpitype_size));
+                            "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Out of memory allocating space (%lld bytes) to cache user data", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid, (long long int)(wmb->seg_arrays * array_sz_bytes));
         }
-        LOG((2, "got %ld bytes for data", (1 + wmb->num_arrays) * arraylen * iodesc->mpitype_size));
+        wmb->seg_nvars[wmb->nsegs] = 0;
+        wmb->seg_user[wmb->nsegs] = nocopy;
+        wmb->nsegs++;
+        if (!nocopy)
+            file->wmb_usage += wmb->seg_arrays * array_sz_bytes;
+        LOG((2, "got %lld bytes for data segment %d", nocopy ? 0 : (long long int)(wmb->seg_arrays * array_sz_bytes),
+             wmb->nsegs - 1));
     }
 
     /* vid is an array of variable ids in the wmb list, grow the list
@@ -1829,50 +2103,8 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
         }
         else
         {
-            void *fill;
-            signed char byte_fill = PIO_FILL_BYTE;
-            char char_fill = PIO_FILL_CHAR;
-            short short_fill = PIO_FILL_SHORT;
-            int int_fill = PIO_FILL_INT;
-            float float_fill = PIO_FILL_FLOAT;
-            double double_fill = PIO_FILL_DOUBLE;
-#ifdef _NETCDF4
-            unsigned char ubyte_fill = PIO_FILL_UBYTE;
-            unsigned short ushort_fill = PIO_FILL_USHORT;
-            unsigned int uint_fill = PIO_FILL_UINT;
-            long long int64_fill = PIO_FILL_INT64;
-            long long uint64_fill = PIO_FILL_UINT64;
-#endif /* _NETCDF4 */
-            vtype = (MPI_Datatype)iodesc->mpitype;
-            LOG((3, "caller did not provide fill value vtype = %d", vtype));
-
-            /* This must be done with an if statement, not a case, or
-             * openmpi will not build. */
-            if (vtype == MPI_BYTE)
-                fill = &byte_fill;
-            else if (vtype == MPI_CHAR)
-                fill = &char_fill;
-            else if (vtype == MPI_SHORT)
-                fill = &short_fill;
-            else if (vtype == MPI_INT)
-                fill = &int_fill;
-            else if (vtype == MPI_FLOAT)
-                fill = &float_fill;
-            else if (vtype == MPI_DOUBLE)
-                fill = &double_fill;
-#ifdef _NETCDF4
-            else if (vtype == MPI_UNSIGNED_CHAR)
-                fill = &ubyte_fill;
-            else if (vtype == MPI_UNSIGNED_SHORT)
-                fill = &ushort_fill;
-            else if (vtype == MPI_UNSIGNED)
-                fill = &uint_fill;
-            else if (vtype == MPI_LONG_LONG)
-                fill = &int64_fill;
-            else if (vtype == MPI_UNSIGNED_LONG_LONG)
-                fill = &uint64_fill;
-#endif /* _NETCDF4 */
-            else
+            if ((ierr = copy_default_fillvalue(iodesc,
+                                               (char *)wmb->fillvalue + iodesc->mpitype_size * wmb->num_arrays)))
             {
                 GPTLstop("PIO:PIOc_write_darray");
                 GPTLstop("PIO:write_total");
@@ -1880,12 +2112,9 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
                 spio_ltimer_stop(ios->io_fstats->tot_timer_name);
                 spio_ltimer_stop(file->io_fstats->wr_timer_name);
                 spio_ltimer_stop(file->io_fstats->tot_timer_name);
-                return pio_err(ios, file, PIO_EBADTYPE, __FILE__, __LINE__,
+                return pio_err(ios, file, ierr, __FILE__, __LINE__,
                                 "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Unable to find a default fillvalue for variable, unsupported variable type", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid);
             }
-
-            memcpy((char *)wmb->fillvalue + iodesc->mpitype_size * wmb->num_arrays,
-                   fill, iodesc->mpitype_size);
             LOG((3, "copied fill value"));
         }
     }
@@ -1896,13 +2125,21 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
     LOG((3, "wmb->num_arrays = %d wmb->vid[wmb->num_arrays] = %d", wmb->num_arrays,
          wmb->vid[wmb->num_arrays]));
 
-    /* Copy the user-provided data to the buffer. */
-    bufptr = (void *)((char *)wmb->data + arraylen * iodesc->mpitype_size * wmb->num_arrays);
+    /* Copy the user-provided data to the buffer, unless the array is
+     * registered. */
     if (arraylen > 0)
     {
-        memcpy(bufptr, array, arraylen * iodesc->mpitype_size);
-        LOG((3, "copied %ld bytes of user data", arraylen * iodesc->mpitype_size));
+        if (!nocopy)
+        {
+            bufptr = (void *)((char *)wmb->segs[wmb->nsegs - 1] +
+                              arraylen * iodesc->mpitype_size * wmb->seg_nvars[wmb->nsegs - 1]);
+            memcpy(bufptr, array, arraylen * iodesc->mpitype_size);
+            LOG((3, "copied %ld bytes of user data", arraylen * iodesc->mpitype_size));
+        }
+        wmb->seg_nvars[wmb->nsegs - 1]++;
     }
+    if (nocopy)
+        wmb->nuser++;
 
     /* Add the unlimited dimension value of this variable to the frame
      * array in wmb. */
@@ -1928,6 +2165,431 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
     spio_ltimer_stop(ios->io_fstats->tot_timer_name);
     spio_ltimer_stop(file->io_fstats->wr_timer_name);
     spio_ltimer_stop(file->io_fstats->tot_timer_name);
+    return erange;
+}
+
+/**
+ * Write a distributed array to the output file.
+ *
+ * This routine aggregates output on the compute nodes and only sends
+ * it to the IO nodes when the compute buffer is full or when a flush
+ * is triggered.
+ *
+ * Internally, this function will:
+ * <ul>
+ * <li>Locate info about this file, decomposition, and variable.
+ * <li>If we don't have a fillvalue for this variable, determine one
+ * and remember it for future calls.
+ * <li>Initialize or find the multi_buffer for this record/var.
+ * <li>Find out how much free space is available in the multi buffer
+ * and flush if needed.
+ * <li>Store the new user data in the mutli buffer.
+ * <li>If needed (only for subset rearranger), fill in gaps in data
+ * with fillvalue.
+ * <li>Remember the frame value (i.e. record number) of this data if
+ * there is one.
+ * </ul>
+ *
+ * NOTE: The write multi buffer wmulti_buffer is the cache on compute
+ * nodes that will collect and store multiple variables before sending
+ * them to the io nodes. Aggregating variables in this way leads to a
+ * considerable savings in communication expense. Variables in the wmb
+ * array must have the same decomposition and base data size and we
+ * also need to keep track of whether each is a recordvar (has an
+ * unlimited dimension) or not.
+ *
+ * @param ncid the ncid of the open netCDF file.
+ * @param varid the ID of the variable that these data will be written
+ * to.
+ * @param ioid the I/O description ID as passed back by
+ * PIOc_InitDecomp().
+ * @param arraylen the length of the array to be written. This should
+ * be at least the length of the local component of the distrubited
+ * array. (Any values beyond length of the local component will be
+ * ignored.)
+ * @param array pointer to an array of length arraylen with the data
+ * to be written. This is a pointer to the distributed portion of the
+ * array that is on this task.
+ * @param fillvalue pointer to the fill value to be used for missing
+ * data.
+ * @returns 0 for success, PIO_ERANGE if the cached data flushed by
+ * this call had values out of the range of the types of the
+ * variables in the file (see PIOc_write_darray_multi()), the data of
+ * this call is still cached, non-zero error code for failure.
+ * @ingroup PIO_write_darray
+ * @author Jim Edwards, Ed Hartnett
+ */
+int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *array,
+                      void *fillvalue)
+{
+    return write_darray(ncid, varid, ioid, arraylen, array, fillvalue, false);
+}
+
+/**
+ * Write a distributed array to the output file, without copying the
+ * array.
+ *
+ * This works like PIOc_write_darray(), but the array is registered
+ * in the write multi buffer instead of being copied to it: the data
+ * is sent to the IO tasks straight from the array when the buffer is
+ * flushed. The caller must not modify or free the array until
+ * PIOc_darray_complete() (or PIOc_sync() or PIOc_closefile()) is
+ * called on the file. The registered arrays do not use the memory of
+ * the buffer pool, so they are not counted in the cache limits (see
+ * PIOc_set_buffer_size_limit() and PIOc_set_file_buffer_size()).
+ *
+ * Like PIOc_write_darray(), this function is collective.
+ *
+ * @param ncid the ncid of the open netCDF file.
+ * @param varid the ID of the variable that these data will be written
+ * to.
+ * @param ioid the I/O description ID as passed back by
+ * PIOc_InitDecomp().
+ * @param arraylen the length of the array to be written. This should
+ * be at least the length of the local component of the distrubited
+ * array. (Any values beyond length of the local component will be
+ * ignored.)
+ * @param array pointer to an array of length arraylen with the data
+ * to be written.
+ * @param fillvalue pointer to the fill value to be used for missing
+ * data.
+ * @returns 0 for success, non-zero error code for failure.
+ * @ingroup PIO_write_darray
+ */
+int PIOc_write_darray_nocopy(int ncid, int varid, int ioid, PIO_Offset arraylen, void *array,
+                             void *fillvalue)
+{
+    return write_darray(ncid, varid, ioid, arraylen, array, fillvalue, true);
+}
+
+/**
+ * Complete the writes of the arrays registered with
+ * PIOc_write_darray_nocopy() on a file: the data of the write multi
+ * buffers holding registered arrays is sent to the IO tasks, and the
+ * arrays can be modified or freed by the caller when this function
+ * returns. The data may not be written to disk yet. This function is
+ * collective.
+ *
+ * @param ncid the ncid of the open netCDF file.
+ * @returns 0 for success, PIO_ERANGE if some values were out of the
+ * range of the types of the variables (see
+ * PIOc_write_darray_multi()), non-zero error code for failure.
+ * @ingroup PIO_write_darray
+ */
+int PIOc_darray_complete(int ncid)
+{
+    iosystem_desc_t *ios;
+    file_desc_t *file;
+    int erange = PIO_NOERR; /* PIO_ERANGE if values were out of range. */
+    int ierr;
+
+    LOG((1, "PIOc_darray_complete ncid = %d", ncid));
+
+    if ((ierr = pio_get_file_nowait(ncid, &file)))
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Completing the writes of the registered arrays failed. Invalid file id (ncid=%d) provided", ncid);
+    assert(file);
+    ios = file->iosystem;
+    assert(ios);
+
+    /* Only the compute tasks hold write multi buffers. */
+    if (ios->async && ios->ioproc)
+        return PIO_NOERR;
+
+    GPTLstart("PIO:PIOc_darray_complete");
+    for (int i = 0; i < file->nwmbs; i++)
+    {
+        if (file->wmbs[i]->nuser == 0)
+            continue;
+        /* The arrays are released even if some values were out of
+         * range, complete the other buffers too. */
+        if ((ierr = flush_buffer(ncid, file->wmbs[i], false)) == PIO_ERANGE)
+        {
+            erange = ierr;
+            ierr = PIO_NOERR;
+        }
+        if (ierr)
+        {
+            GPTLstop("PIO:PIOc_darray_complete");
+            return pio_err(ios, file, ierr, __FILE__, __LINE__,
+                            "Completing the writes of the registered arrays on file (%s, ncid=%d) failed. Flushing the write multi buffer of the arrays (ioid=%d) to the I/O processes failed", pio_get_fname_from_file(file), file->pio_ncid, file->wmbs[i]->ioid);
+        }
+    }
+    GPTLstop("PIO:PIOc_darray_complete");
+
+    return erange;
+}
+
+/**
+ * Start writing a distributed array to the output file, without
+ * blocking.
+ *
+ * Unlike PIOc_write_darray(), the data is not cached on the compute
+ * tasks: the rearrangement of the data (the move from the compute
+ * tasks to the IO tasks) is started with nonblocking MPI calls,
+ * following the comp2io flow control options of the decomposition,
+ * and the function returns. The rearrangement is progressed by the
+ * later calls to PIOc_write_darray(), PIOc_write_darray_nb() and
+ * PIOc_test_darray() on the file, so computation can overlap with
+ * the data movement. PIOc_wait_darray() completes the rearrangement
+ * and writes the data to the file. The array must not be modified
+ * until PIOc_test_darray() reports that the request is complete, or
+ * PIOc_wait_darray() returns.
+ *
+ * Like PIOc_write_darray(), this function is collective. All the
+ * requests must be waited for in the same order on all tasks,
+ * the requests of a file that are not waited for are completed
+ * when the file is synced or closed. The decomposition must not be
+ * freed while a request using it is in progress. At most
+ * PIO_MAX_NB_REARR requests can be in progress on an iosystem, the
+ * oldest request of the file is completed first if needed.
+ *
+ * With async, ADIOS or the hierarchical box rearranger the data is
+ * written with PIOc_write_darray() instead (the data is cached and
+ * the array can be reused), and the request returned is
+ * PIO_REQ_NULL.
+ *
+ * @param ncid the ncid of the open netCDF file.
+ * @param varid the ID of the variable that these data will be written
+ * to.
+ * @param ioid the I/O description ID as passed back by
+ * PIOc_InitDecomp().
+ * @param arraylen the length of the array to be written. This should
+ * be at least the length of the local component of the distrubited
+ * array. (Any values beyond length of the local component will be
+ * ignored.)
+ * @param array pointer to an array of length arraylen with the data
+ * to be written.
+ * @param fillvalue pointer to the fill value to be used for missing
+ * data.
+ * @param request pointer that gets the ID of the request.
+ * @returns 0 for success, non-zero error code for failure.
+ * @ingroup PIO_write_darray
+ */
+int PIOc_write_darray_nb(int ncid, int varid, int ioid, PIO_Offset arraylen, void *array,
+                         void *fillvalue, int *request)
+{
+    iosystem_desc_t *ios;  /* Pointer to io system information. */
+    file_desc_t *file;     /* Info about file we are writing to. */
+    io_desc_t *iodesc;     /* The IO description. */
+    var_desc_t *vdesc;     /* Info about the var being written. */
+    darray_nb_req_t *req;  /* The new request. */
+    darray_nb_req_t **last;
+    int slot;
+    int ierr;
+
+    LOG((1, "PIOc_write_darray_nb ncid = %d varid = %d ioid = %d arraylen = %d",
+         ncid, varid, ioid, arraylen));
+
+    /* Get the file info. */
+    if ((ierr = pio_get_file_nowait(ncid, &file)))
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Writing variable (varid=%d) failed on file. Invalid file id (ncid=%d) provided", varid, ncid);
+    assert(file);
+    ios = file->iosystem;
+    assert(ios);
+
+    if (!request)
+        return pio_err(ios, file, PIO_EINVAL, __FILE__, __LINE__,
+                        "Writing variable (varid=%d) to file (%s, ncid=%d) failed. Invalid pointer to the request (NULL) provided", varid, pio_get_fname_from_file(file), file->pio_ncid);
+    *request = PIO_REQ_NULL;
+
+    if (!(file->mode & PIO_WRITE))
+        return pio_err(ios, file, PIO_EPERM, __FILE__, __LINE__,
+                        "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. The file was not opened for writing, try reopening the file in write mode (use the PIO_WRITE flag)", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid);
+    if (varid < 0 || varid >= PIO_MAX_VARS)
+        return pio_err(ios, file, PIO_EINVAL, __FILE__, __LINE__,
+                        "Writing variable (varid=%d) to file (%s, ncid=%d) failed. Invalid variable id", varid, pio_get_fname_from_file(file), file->pio_ncid);
+    if (!(iodesc = pio_get_iodesc_from_id(ioid)))
+        return pio_err(ios, file, PIO_EBADID, __FILE__, __LINE__,
+                        "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Invalid I/O descriptor id (ioid=%d) provided", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid, ioid);
+
+    /* The data can only be rearranged without blocking when all the
+     * tasks are involved in the write, and without the node
+     * aggregation of the hierarchical box rearranger. */
+    if (ios->async || file->iotype == PIO_IOTYPE_ADIOS ||
+        iodesc->rearranger == PIO_REARR_BOX_HIER)
+        return PIOc_write_darray(ncid, varid, ioid, arraylen, array, fillvalue);
+
+    if (arraylen < iodesc->ndof)
+        return pio_err(ios, file, PIO_EINVAL, __FILE__, __LINE__,
+                        "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. The local array size (arraylen=%lld) is smaller than expected, the I/O decomposition (ioid=%d) requires a local array of size = %lld", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid, (long long int) arraylen, ioid, (long long int) iodesc->ndof);
+    if (arraylen > iodesc->ndof)
+        arraylen = iodesc->ndof;
+
+    GPTLstart("PIO:PIOc_write_darray_nb");
+
+    /* Progress the requests in progress. */
+    if ((ierr = darray_nb_progress(file)))
+    {
+        GPTLstop("PIO:PIOc_write_darray_nb");
+        return pio_err(ios, file, ierr, __FILE__, __LINE__,
+                        "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Progressing the nonblocking writes in progress failed", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid);
+    }
+
+    /* Get a slot for the rearrangement, all tasks pick the same
+     * slot. */
+    while (!~ios->nb_rearr_slots && file->nb_reqs)
+    {
+        if ((ierr = darray_nb_wait(file, file->nb_reqs)))
+        {
+            GPTLstop("PIO:PIOc_write_darray_nb");
+            return pio_err(ios, file, ierr, __FILE__, __LINE__,
+                            "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Completing the oldest nonblocking write failed", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid);
+        }
+    }
+    for (slot = 0; slot < PIO_MAX_NB_REARR; slot++)
+        if (!(ios->nb_rearr_slots & (1ULL << slot)))
+            break;
+    if (slot == PIO_MAX_NB_REARR)
+    {
+        GPTLstop("PIO:PIOc_write_darray_nb");
+        return pio_err(ios, file, PIO_EINVAL, __FILE__, __LINE__,
+                        "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Too many nonblocking writes (max = %d) in progress on other files", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid, PIO_MAX_NB_REARR);
+    }
+
+    /* Get the var description, the type length is needed for the
+     * I/O statistics. */
+    vdesc = &(file->varlist[varid]);
+    if (vdesc->pio_type == PIO_NAT)
+        ierr = PIOc_inq_vartype(ncid, varid, &vdesc->pio_type);
+    if (ierr == PIO_NOERR && vdesc->type_size == 0)
+        ierr = PIOc_inq_type(ncid, vdesc->pio_type, NULL, &vdesc->type_size);
+    if (ierr != PIO_NOERR)
+    {
+        GPTLstop("PIO:PIOc_write_darray_nb");
+        return pio_err(ios, file, ierr, __FILE__, __LINE__,
+                        "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Inquiring variable data type failed", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid);
+    }
+    ios->io_fstats->wb += vdesc->type_size * iodesc->llen;
+    file->io_fstats->wb += vdesc->type_size * iodesc->llen;
+
+    if (!(req = calloc(1, sizeof(darray_nb_req_t))))
+    {
+        GPTLstop("PIO:PIOc_write_darray_nb");
+        return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
+                        "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Out of memory allocating %lld bytes for the nonblocking write request", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid, (unsigned long long)sizeof(darray_nb_req_t));
+    }
+    req->varid = varid;
+    req->ioid = ioid;
+    req->arraylen = arraylen;
+    req->array = array;
+    req->frame = vdesc->record;
+    req->slot = slot;
+
+    /* If we need a fill value, use the one the user passed, otherwise
+     * use the default fill value of the netCDF type. */
+    if (iodesc->needsfill)
+    {
+        if (!(req->fillvalue = bget(iodesc->mpitype_size)))
+            ierr = PIO_ENOMEM;
+        else if (fillvalue)
+            memcpy(req->fillvalue, fillvalue, iodesc->mpitype_size);
+        else
+            ierr = copy_default_fillvalue(iodesc, req->fillvalue);
+    }
+
+    /* Allocate the buffer for the rearranged data, and start moving
+     * the data from compute to IO tasks. */
+    if (ierr == PIO_NOERR)
+        ierr = alloc_write_iobuf(file, iodesc, 1, req->fillvalue, &req->iobuf);
+    if (ierr == PIO_NOERR)
+        ierr = rearrange_comp2io_start(ios, iodesc, array, req->iobuf, 1, slot, &req->xreq,
+                                       &req->plan);
+    if (ierr != PIO_NOERR)
+    {
+        if (req->fillvalue)
+            brel(req->fillvalue);
+        if (req->iobuf)
+            brel(req->iobuf);
+        free(req);
+        GPTLstop("PIO:PIOc_write_darray_nb");
+        return pio_err(ios, file, ierr, __FILE__, __LINE__,
+                        "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Starting the rearrangement of the data failed", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid);
+    }
+    ios->nb_rearr_slots |= 1ULL << slot;
+
+    /* Add the request at the end of the list of the file. */
+    req->id = file->nb_req_next_id++;
+    for (last = &file->nb_reqs; *last; last = &(*last)->next)
+        ;
+    *last = req;
+    *request = req->id;
+
+    GPTLstop("PIO:PIOc_write_darray_nb");
+    return PIO_NOERR;
+}
+
+/**
+ * Progress a nonblocking write started with PIOc_write_darray_nb(),
+ * and check if the rearrangement of its data is complete. This
+ * function is not collective.
+ *
+ * @param ncid the ncid of the open netCDF file.
+ * @param request the ID of the request. PIO_REQ_NULL and the ID of
+ * a request already waited for are complete.
+ * @param flag pointer that gets 1 if the array of the request can be
+ * modified, 0 otherwise.
+ * @returns 0 for success, non-zero error code for failure.
+ * @ingroup PIO_write_darray
+ */
+int PIOc_test_darray(int ncid, int request, int *flag)
+{
+    file_desc_t *file;
+    darray_nb_req_t *req;
+    int ierr;
+
+    if ((ierr = pio_get_file_nowait(ncid, &file)))
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Testing nonblocking write (request=%d) failed. Invalid file id (ncid=%d) provided", request, ncid);
+    if (!flag)
+        return pio_err(file->iosystem, file, PIO_EINVAL, __FILE__, __LINE__,
+                        "Testing nonblocking write (request=%d) on file (%s, ncid=%d) failed. Invalid pointer to the flag (NULL) provided", request, pio_get_fname_from_file(file), file->pio_ncid);
+
+    if ((ierr = darray_nb_progress(file)))
+        return pio_err(file->iosystem, file, ierr, __FILE__, __LINE__,
+                        "Testing nonblocking write (request=%d) on file (%s, ncid=%d) failed. Progressing the nonblocking writes in progress failed", request, pio_get_fname_from_file(file), file->pio_ncid);
+
+    *flag = 1;
+    for (req = file->nb_reqs; req; req = req->next)
+        if (req->id == request)
+            *flag = req->xreq->complete;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Complete a nonblocking write started with PIOc_write_darray_nb():
+ * wait for the rearrangement of the data, and write the data to the
+ * file. This function is collective, the requests must be waited for
+ * in the same order on all tasks.
+ *
+ * @param ncid the ncid of the open netCDF file.
+ * @param request the ID of the request. Nothing is done for
+ * PIO_REQ_NULL or the ID of a request already waited for.
+ * @returns 0 for success, non-zero error code for failure.
+ * @ingroup PIO_write_darray
+ */
+int PIOc_wait_darray(int ncid, int request)
+{
+    file_desc_t *file;
+    darray_nb_req_t *req;
+    int ierr;
+
+    if ((ierr = pio_get_file_nowait(ncid, &file)))
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Waiting for nonblocking write (request=%d) failed. Invalid file id (ncid=%d) provided", request, ncid);
+
+    for (req = file->nb_reqs; req; req = req->next)
+        if (req->id == request)
+            break;
+    if (!req)
+        return PIO_NOERR;
+
+    if ((ierr = darray_nb_wait(file, req)))
+        return pio_err(file->iosystem, file, ierr, __FILE__, __LINE__,
+                        "Waiting for nonblocking write (request=%d) on file (%s, ncid=%d) failed", request, pio_get_fname_from_file(file), file->pio_ncid);
+
     return PIO_NOERR;
 }
 
@@ -1990,8 +2652,8 @@ int PIOc_read_darray(int ncid, int varid, int ioid, PIO_Offset arraylen,
         return pio_err(ios, file, PIO_EBADID, __FILE__, __LINE__,
                         "Reading variable (%s, varid=%d) from file (%s, ncid=%d)failed. Invalid arguments provided, I/O descriptor id (ioid=%d) is invalid", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid, ioid);
     }
-    pioassert(iodesc->rearranger == PIO_REARR_BOX || iodesc->rearranger == PIO_REARR_SUBSET,
-              "unknown rearranger", __FILE__, __LINE__);
+    pioassert(iodesc->rearranger == PIO_REARR_BOX || iodesc->rearranger == PIO_REARR_SUBSET ||
+              iodesc->rearranger == PIO_REARR_BOX_HIER, "unknown rearranger", __FILE__, __LINE__);
 
     /* Get var description. */
     vdesc = &(file->varlist[varid]);
@@ -17,6 +17,9 @@
 #include "pio_timer.h"
 #endif
 #include "spio_io_summary.h"
+#if PIO_BG_FLUSH
+#include <pthread.h>
+#endif
 
 /* 10MB default limit. */
 extern PIO_Offset pio_buffer_size_limit;
@@ -27,25 +30,13 @@ bufsize pio_cnbuffer_limit = 0;
 /* Maximum buffer usage. */
 extern PIO_Offset maxusage;
 
-/* handler for freeing the memory buffer pool */
-void bpool_free(void *p)
-{
-  free(p);
-}
-
-/* Handler for allocating more memory for the bget buffer pool */
-void *bpool_alloc(bufsize sz)
-{
-  void *p = malloc((size_t ) sz);
-  return p;
-}
-
 /**
  * Initialize the compute buffer to size pio_cnbuffer_limit.
  *
- * This routine initializes the compute buffer pool if the bget memory
- * management is used. If malloc is used (that is, PIO_USE_MALLOC is
- * non zero), this function does nothing.
+ * This routine sets the buffer limit of the arena the buffers are
+ * allocated from (see pio_arena.c). If malloc is used (that is,
+ * PIO_USE_MALLOC is non zero), the limit is only used for the buffer
+ * statistics.
  *
  * @param ios pointer to the iosystem descriptor which will use the
  * new buffer.
@@ -54,16 +45,12 @@ void *bpool_alloc(bufsize sz)
  */
 int compute_buffer_init(iosystem_desc_t *ios)
 {
-    /* Default block size increment = 32 MB */
-    const bufsize DEFAULT_BUF_INC_SZ = (bufsize ) (32L * 1024L * 1024L);
-    bufsize bpool_block_inc_sz = (bufsize )((pio_buffer_size_limit > 0) ? pio_buffer_size_limit : DEFAULT_BUF_INC_SZ);
-    LOG((2, "Initializing buffer pool with block increment = %lld bytes", (long long int) bpool_block_inc_sz));
-    pio_cnbuffer_limit = bpool_block_inc_sz;
-#if PIO_USE_MALLOC
-    bpool(NULL, pio_cnbuffer_limit);
-#else
-    bectl(NULL, bpool_alloc, bpool_free, pio_cnbuffer_limit);
-#endif /* PIO_USE_MALLOC */
+    /* Default buffer limit = 32 MB */
+    const bufsize DEFAULT_BUF_LIMIT = (bufsize ) (32L * 1024L * 1024L);
+    bufsize buf_limit = (bufsize )((pio_buffer_size_limit > 0) ? pio_buffer_size_limit : DEFAULT_BUF_LIMIT);
+    LOG((2, "Initializing buffer arena with limit = %lld bytes", (long long int) buf_limit));
+    pio_cnbuffer_limit = buf_limit;
+    pio_arena_init(pio_cnbuffer_limit);
     LOG((2, "compute_buffer_init complete"));
 
     return PIO_NOERR;
@@ -146,6 +133,258 @@ int find_start_count(int ndims, const int *dimlen, int fndims, var_desc_t *vdesc
     return PIO_NOERR;
 }
 
+#ifdef _PNETCDF
+/**
+ * Make room for a new pnetcdf request in the request arrays of a
+ * variable (vdesc->request and vdesc->request_sz), the arrays grow
+ * by PIO_REQUEST_ALLOC_CHUNK requests.
+ *
+ * @param vdesc pointer to the var info.
+ * @returns 0 for success, PIO_ENOMEM if out of memory.
+ */
+static int reserve_var_request(var_desc_t *vdesc)
+{
+    int *request;
+    PIO_Offset *request_sz;
+
+    if (vdesc->nreqs % PIO_REQUEST_ALLOC_CHUNK)
+        return PIO_NOERR;
+
+    if (!(request = realloc(vdesc->request, sizeof(int) * (vdesc->nreqs + PIO_REQUEST_ALLOC_CHUNK))))
+        return PIO_ENOMEM;
+    vdesc->request = request;
+    if (!(request_sz = realloc(vdesc->request_sz, sizeof(PIO_Offset) *
+                               (vdesc->nreqs + PIO_REQUEST_ALLOC_CHUNK))))
+        return PIO_ENOMEM;
+    vdesc->request_sz = request_sz;
+
+    for (int i = vdesc->nreqs; i < vdesc->nreqs + PIO_REQUEST_ALLOC_CHUNK; i++)
+    {
+        vdesc->request[i] = PIO_REQ_NULL;
+        vdesc->request_sz[i] = 0;
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Check if the rearranged data of a variable is converted, on the IO
+ * tasks, from the type of the decomposition to the type of the
+ * variable in the file before it is written with pnetcdf. The data
+ * is converted when the types differ and are both numeric, and the
+ * type and the fill value of the variable are known.
+ *
+ * @param iodesc pointer to the decomposition.
+ * @param vdesc pointer to the var info.
+ * @returns true if the data of the variable is converted.
+ */
+static bool convert_var_data(io_desc_t *iodesc, var_desc_t *vdesc)
+{
+    return vdesc->pio_type != iodesc->piotype && vdesc->type_size > 0 && vdesc->fillvalue &&
+        pio_convert_supported(iodesc->piotype, vdesc->pio_type);
+}
+
+/**
+ * Get the types of the data of the variables written with pnetcdf,
+ * the type of the variable in the file if its data is converted (see
+ * convert_var_data()), the type of the decomposition otherwise.
+ *
+ * @param file pointer to the file.
+ * @param nvars the number of variables.
+ * @param varids the IDs of the variables.
+ * @param iodesc pointer to the decomposition.
+ * @param vtype array that gets the MPI types of the variables.
+ * @param vsize array that gets the sizes of the MPI types.
+ * @param nconv pointer that gets the number of variables converted.
+ * @returns 0 for success, error code otherwise.
+ */
+static int get_var_data_types(file_desc_t *file, int nvars, const int *varids,
+                              io_desc_t *iodesc, MPI_Datatype *vtype, int *vsize, int *nconv)
+{
+    int ierr;
+
+    *nconv = 0;
+    for (int nv = 0; nv < nvars; nv++)
+    {
+        var_desc_t *vdesc = file->varlist + varids[nv];
+
+        vtype[nv] = iodesc->mpitype;
+        vsize[nv] = iodesc->mpitype_size;
+        if (convert_var_data(iodesc, vdesc))
+        {
+            if ((ierr = find_mpi_type(vdesc->pio_type, &vtype[nv], &vsize[nv])))
+                return ierr;
+            (*nconv)++;
+        }
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Convert n values of the rearranged data of a variable to the type
+ * of the variable in the file. The values equal to the fill value of
+ * the data are converted to the fill value of the variable. As with
+ * pnetcdf, the values out of the range of the type of the variable
+ * are written as its fill value, they are counted in nerange and
+ * reported once the data is written (see report_erange()).
+ *
+ * @param iodesc pointer to the decomposition.
+ * @param vdesc pointer to the var info.
+ * @param src the data to convert.
+ * @param dst the buffer for the converted data.
+ * @param n the number of values.
+ * @param fillvalue pointer to the fill value of the data, NULL if
+ * the data has no fill value.
+ * @param nerange pointer to the number of values out of range, the
+ * values out of range of this call are added to it.
+ * @returns 0 for success, error code otherwise.
+ */
+static int convert_data(io_desc_t *iodesc, var_desc_t *vdesc, const void *src, void *dst,
+                        PIO_Offset n, const void *fillvalue, PIO_Offset *nerange)
+{
+    PIO_Offset nbad;
+    int ierr;
+
+    ierr = pio_convert(iodesc->piotype, vdesc->pio_type, src, dst, n, fillvalue,
+                       vdesc->fillvalue, &nbad);
+    if (ierr == PIO_ERANGE)
+    {
+        LOG((1, "%lld values of variable %s out of range of type %d written as fill value",
+             (long long int)nbad, vdesc->vname, vdesc->pio_type));
+        *nerange += nbad;
+        ierr = PIO_NOERR;
+    }
+
+    return ierr;
+}
+
+/**
+ * Report the values out of the range of the types of the variables
+ * found when converting the data written with pnetcdf (see
+ * convert_data()). The data is only converted on the IO tasks, the
+ * number of values out of range is summed over all tasks so that
+ * all tasks return PIO_ERANGE, like netCDF does for the values out
+ * of range. This is called on all tasks. Without async whether the
+ * data of a variable is converted is known on all tasks (see
+ * convert_var_data()), and the reduction is skipped when no data is
+ * converted, the usual case. With async the IO tasks may not know
+ * the types of the variables that the compute tasks know, and the
+ * values out of range are only logged.
+ *
+ * @param file pointer to the file.
+ * @param nvars the number of variables written.
+ * @param varids the IDs of the variables.
+ * @param iodesc pointer to the decomposition.
+ * @param nerange the number of values out of range on this task.
+ * @returns 0 if no values were out of range, PIO_ERANGE if some
+ * were, error code otherwise.
+ */
+static int report_erange(file_desc_t *file, int nvars, const int *varids, io_desc_t *iodesc,
+                         PIO_Offset nerange)
+{
+    bool converted = false;
+    int mpierr;
+
+    if (file->iosystem->async)
+        return PIO_NOERR;
+
+    for (int nv = 0; nv < nvars && !converted; nv++)
+        converted = convert_var_data(iodesc, file->varlist + varids[nv]);
+    if (!converted)
+        return PIO_NOERR;
+
+    if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &nerange, 1, MPI_OFFSET, MPI_SUM,
+                                file->iosystem->my_comm)))
+        return check_mpi(NULL, file, mpierr, __FILE__, __LINE__);
+
+    if (nerange > 0)
+        return pio_err(NULL, file, PIO_ERANGE, __FILE__, __LINE__,
+                       "Writing variables (number of variables = %d) to file (%s, ncid=%d) using PIO_IOTYPE_PNETCDF iotype, %lld values out of the range of the types of the variables were written as fill values", nvars, pio_get_fname_from_file(file), file->pio_ncid, (long long int)nerange);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Convert the rearranged data of the variables written with pnetcdf
+ * to the types of the variables in the file (see
+ * convert_var_data()). The data of the variables is copied to a new
+ * buffer, laid out one variable after the other with the sizes of
+ * vtype, that replaces file->iobuf[] and is freed in
+ * flush_output_buffer().
+ *
+ * @param file pointer to the file.
+ * @param nvars the number of variables.
+ * @param varids the IDs of the variables.
+ * @param iodesc pointer to the decomposition.
+ * @param fillvalue pointer to the fill values of the data (nvars
+ * values), NULL if the data has no fill values.
+ * @param vtype array that gets the MPI types of the variables.
+ * @param vsize array that gets the sizes of the MPI types.
+ * @param voffset array that gets the offsets (in bytes) of the data
+ * of the variables in file->iobuf[].
+ * @param nerange pointer that gets the number of values out of the
+ * range of the types of the variables.
+ * @returns 0 for success, error code otherwise.
+ */
+static int convert_iobuf(file_desc_t *file, int nvars, const int *varids, io_desc_t *iodesc,
+                         const void *fillvalue, MPI_Datatype *vtype, int *vsize,
+                         PIO_Offset *voffset, PIO_Offset *nerange)
+{
+    void **iobuf = &file->iobuf[iodesc->ioid - PIO_IODESC_START_ID];
+    PIO_Offset llen = iodesc->llen;
+    PIO_Offset bufsz = 0;
+    char *buf;
+    int nconv;
+    int ierr;
+
+    *nerange = 0;
+    if ((ierr = get_var_data_types(file, nvars, varids, iodesc, vtype, vsize, &nconv)))
+        return ierr;
+
+    for (int nv = 0; nv < nvars; nv++)
+    {
+        voffset[nv] = bufsz;
+        bufsz += llen * vsize[nv];
+    }
+
+    if (!nconv || !*iobuf)
+        return PIO_NOERR;
+
+    GPTLstart("PIO:convert_iobuf");
+    if (!(buf = bget(max(bufsz, 1))))
+    {
+        GPTLstop("PIO:convert_iobuf");
+        return PIO_ENOMEM;
+    }
+
+    for (int nv = 0; nv < nvars && ierr == PIO_NOERR; nv++)
+    {
+        var_desc_t *vdesc = file->varlist + varids[nv];
+        const char *src = (const char *)*iobuf + nv * llen * iodesc->mpitype_size;
+
+        if (convert_var_data(iodesc, vdesc))
+            ierr = convert_data(iodesc, vdesc, src, buf + voffset[nv], llen,
+                                fillvalue ? (const char *)fillvalue + nv * iodesc->mpitype_size : NULL,
+                                nerange);
+        else
+            memcpy(buf + voffset[nv], src, llen * vsize[nv]);
+    }
+
+    if (ierr == PIO_NOERR)
+    {
+        brel(*iobuf);
+        *iobuf = buf;
+        file->iobuf_usage += bufsz - llen * nvars * iodesc->mpitype_size;
+    }
+    else
+        brel(buf);
+    GPTLstop("PIO:convert_iobuf");
+
+    return ierr;
+}
+#endif /* _PNETCDF */
+
 /**
  * Write a set of one or more aggregated arrays to output file. This
  * function is only used with parallel-netcdf and netcdf-4 parallel
@@ -158,6 +397,11 @@ int find_start_count(int ndims, const int *dimlen, int fndims, var_desc_t *vdesc
  * @param vid: an array of the variable ids to be written.
  * @param iodesc pointer to the io_desc_t info.
  * @param fill Non-zero if this write is fill data.
+ * @param fillvalue pointer to the fill values of the variables
+ * (nvars values), NULL if the data has no fill values. With pnetcdf
+ * the data is converted to the types of the variables in the file
+ * (see convert_iobuf()), and the fill values of the data are
+ * converted to the fill values of the variables.
  * @param frame the record dimension for each of the nvars variables
  * in iobuf. NULL if this iodesc contains non-record vars.
  * @return 0 for success, error code otherwise.
@@ -165,11 +409,15 @@ int find_start_count(int ndims, const int *dimlen, int fndims, var_desc_t *vdesc
  * @author Jim Edwards, Ed Hartnett
  */
 int write_darray_multi_par(file_desc_t *file, int nvars, int fndims, const int *varids,
-                           io_desc_t *iodesc, int fill, const int *frame)
+                           io_desc_t *iodesc, int fill, const void *fillvalue,
+                           const int *frame)
 {
     iosystem_desc_t *ios;  /* Pointer to io system information. */
     var_desc_t *vdesc;     /* Pointer to var info struct. */
-    int dsize;             /* Data size (for one region). */
+    PIO_Offset dsize;      /* Data size (for one region). */
+#ifdef _PNETCDF
+    PIO_Offset nerange = 0; /* Number of values out of range of the types of the vars. */
+#endif /* _PNETCDF */
     int ierr = PIO_NOERR;
 
     /* Check inputs. */
@@ -204,11 +452,35 @@ int write_darray_multi_par(file_desc_t *file, int nvars, int fndims, const int *
         size_t count[fndims];
         PIO_Offset *startlist[num_regions]; /* Array of start arrays for ncmpi_iput_varn(). */
         PIO_Offset *countlist[num_regions]; /* Array of count  arrays for ncmpi_iput_varn(). */
+#ifdef _PNETCDF
+        MPI_Datatype vtype[nvars];  /* MPI types of the data of the variables. */
+        int vsize[nvars];           /* Sizes of the MPI types. */
+        PIO_Offset voffset[nvars];  /* Offsets of the data of the variables in iobuf. */
+
+        /* Convert the data to the types of the variables in the file. */
+        if (file->iotype == PIO_IOTYPE_PNETCDF && !fill)
+        {
+            if ((ierr = convert_iobuf(file, nvars, varids, iodesc, fillvalue, vtype, vsize,
+                                      voffset, &nerange)))
+                ierr = pio_err(ios, file, ierr, __FILE__, __LINE__,
+                                "Writing variables (number of variables = %d) to file (%s, ncid=%d) using PIO_IOTYPE_PNETCDF iotype failed. Converting the data to the types of the variables failed", nvars, pio_get_fname_from_file(file), file->pio_ncid);
+            iobuf = file->iobuf[iodesc->ioid - PIO_IODESC_START_ID];
+        }
+        else
+        {
+            for (int nv = 0; nv < nvars; nv++)
+            {
+                vtype[nv] = iodesc->mpitype;
+                vsize[nv] = iodesc->mpitype_size;
+                voffset[nv] = nv * iodesc->mpitype_size * llen;
+            }
+        }
+#endif /* _PNETCDF */
 
         LOG((3, "num_regions = %d", num_regions));
 
         /* Process each region of data to be written. */
-        for (int regioncnt = 0; regioncnt < num_regions; regioncnt++)
+        for (int regioncnt = 0; regioncnt < num_regions && ierr == PIO_NOERR; regioncnt++)
         {
             /* Fill the start/count arrays. */
             if ((ierr = find_start_count(iodesc->ndims, iodesc->dimlen, fndims, vdesc, region, start, count)))
@@ -302,7 +574,7 @@ int write_darray_multi_par(file_desc_t *file, int nvars, int fndims, const int *
                 dsize = 1;
                 for (int i = 0; i < fndims; i++)
                     dsize *= count[i];
-                LOG((3, "dsize = %d", dsize));
+                LOG((3, "dsize = %lld", dsize));
 
                 /* For pnetcdf's ncmpi_iput_varn() function, we need
                  * to provide arrays of arrays for start/count. */
@@ -350,42 +622,20 @@ int write_darray_multi_par(file_desc_t *file, int nvars, int fndims, const int *
                                 startlist[rc][0] = frame[nv];
 
                         /* Get a pointer to the data. */
-                        bufptr = (void *)((char *)iobuf + nv * iodesc->mpitype_size * llen);
+                        bufptr = (void *)((char *)iobuf + voffset[nv]);
 
-                        if (vdesc->nreqs % PIO_REQUEST_ALLOC_CHUNK == 0)
+                        if ((ierr = reserve_var_request(vdesc)))
                         {
-                            if (!(vdesc->request = realloc(vdesc->request, sizeof(int) *
-                                                           (vdesc->nreqs + PIO_REQUEST_ALLOC_CHUNK))))
-                            {
-                                ierr = pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
-                                          "Writing variables (number of variables = %d) to file (%s, ncid=%d) using PIO_IOTYPE_PNETCDF iotype failed. Out of memory reallocing buffer (%lld bytes) for array to store pnetcdf request handles", nvars, pio_get_fname_from_file(file), file->pio_ncid, (long long int) (sizeof(int) * (vdesc->nreqs + PIO_REQUEST_ALLOC_CHUNK)));
-                                break;
-                            }
-
-                            vdesc->request_sz = realloc(vdesc->request_sz,
-                                                  sizeof(PIO_Offset) *
-                                                  (vdesc->nreqs +
-                                                    PIO_REQUEST_ALLOC_CHUNK));
-                            if(vdesc->request_sz == NULL)
-                            {
-                                ierr = pio_err(ios, file, PIO_ENOMEM,
-                                          __FILE__, __LINE__,
-                                          "Writing variables (number of variables = %d) to file (%s, ncid=%d) using PIO_IOTYPE_PNETCDF iotype failed. Out of memory reallocing buffer (%lld bytes) for array to store pending pnetcdf request sizes", nvars, pio_get_fname_from_file(file), file->pio_ncid, (long long int) (sizeof(PIO_Offset) * (vdesc->nreqs + PIO_REQUEST_ALLOC_CHUNK)));
-                                break;
-                            }
-
-                            for (int i = vdesc->nreqs; i < vdesc->nreqs + PIO_REQUEST_ALLOC_CHUNK; i++)
-                            {
-                                vdesc->request[i] = PIO_REQ_NULL;
-                                vdesc->request_sz[i] = 0;
-                            }
+                            ierr = pio_err(ios, file, ierr, __FILE__, __LINE__,
+                                      "Writing variables (number of variables = %d) to file (%s, ncid=%d) using PIO_IOTYPE_PNETCDF iotype failed. Out of memory reallocing buffers (%lld requests) for arrays to store pnetcdf request handles and sizes", nvars, pio_get_fname_from_file(file), file->pio_ncid, (long long int) (vdesc->nreqs + PIO_REQUEST_ALLOC_CHUNK));
+                            break;
                         }
 
                         /* Write, in non-blocking fashion, a list of subarrays. */
                         LOG((3, "about to call ncmpi_iput_varn() varids[%d] = %d rrcnt = %d, llen = %d",
                              nv, varids[nv], rrcnt, llen));
                         ierr = ncmpi_iput_varn(file->fh, varids[nv], rrcnt, startlist, countlist,
-                                               bufptr, llen, iodesc->mpitype, vdesc->request + vdesc->nreqs);
+                                               bufptr, llen, vtype[nv], vdesc->request + vdesc->nreqs);
                         if (ierr != PIO_NOERR)
                         {
                             ierr = pio_err(ios, file, ierr, __FILE__, __LINE__,
@@ -396,7 +646,7 @@ int write_darray_multi_par(file_desc_t *file, int nvars, int fndims, const int *
                         /* PIO_REQ_NULL == NC_REQ_NULL */
                         if (vdesc->request[vdesc->nreqs] != PIO_REQ_NULL)
                         {
-                            vdesc->request_sz[vdesc->nreqs] = llen * iodesc->mpitype_size;
+                            vdesc->request_sz[vdesc->nreqs] = llen * vsize[nv];
                         }
 
                         /* Ensure that we increment the number of requests
@@ -428,7 +678,7 @@ int write_darray_multi_par(file_desc_t *file, int nvars, int fndims, const int *
             if (ierr != PIO_NOERR)
             {
                 ierr = pio_err(ios, file, ierr, __FILE__, __LINE__,
-                                "Writing variables (number of variables = %d) to file (%s, ncid=%d) failed. Writing region of data at offset = %d failed", nvars, pio_get_fname_from_file(file), file->pio_ncid, region->loffset);
+                                "Writing variables (number of variables = %d) to file (%s, ncid=%d) failed. Writing region of data at offset = %lld failed", nvars, pio_get_fname_from_file(file), file->pio_ncid, region->loffset);
                 break;
             }
             /* Go to next region. */
@@ -440,12 +690,335 @@ int write_darray_multi_par(file_desc_t *file, int nvars, int fndims, const int *
     /* Check the return code from the netCDF/pnetcdf call. */
     ierr = check_netcdf(NULL, file, ierr, __FILE__,__LINE__);
 
+#ifdef _PNETCDF
+    /* The data is written even if some values were out of range,
+     * report them after the write. */
+    if (file->iotype == PIO_IOTYPE_PNETCDF && !fill)
+    {
+        int ret = report_erange(file, nvars, varids, iodesc, nerange);
+        if (ierr == PIO_NOERR)
+            ierr = ret;
+    }
+#endif /* _PNETCDF */
+
     /* Stop timing this function. */
     GPTLstop("PIO:write_darray_multi_par");
 
     return ierr;
 }
 
+#ifdef _PNETCDF
+/** A region written by write_darray_multi_par_fill(). */
+typedef struct merged_region
+{
+    /** Number of dimensions of start/count. */
+    int ndims;
+
+    /** The start of the region in the file. */
+    PIO_Offset *start;
+
+    /** The count of the region in the file. */
+    PIO_Offset *count;
+
+    /** Number of elements in the region. */
+    PIO_Offset dsize;
+
+    /** Offset of the data of the region in the rearranged data of a
+     * variable, -1 for a fill region. */
+    PIO_Offset loffset;
+} merged_region;
+
+/**
+ * Compare the starts of two regions (qsort() comparison function),
+ * the regions are ordered as they are laid out in the file.
+ *
+ * @param a pointer to the first merged_region.
+ * @param b pointer to the second merged_region.
+ * @returns -1, 0 or 1 if the first region starts before, at or
+ * after the second one.
+ */
+static int compare_merged_region(const void *a, const void *b)
+{
+    const merged_region *ra = a;
+    const merged_region *rb = b;
+
+    for (int i = 0; i < ra->ndims; i++)
+    {
+        if (ra->start[i] < rb->start[i])
+            return -1;
+        if (ra->start[i] > rb->start[i])
+            return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Write a set of one or more aggregated arrays, and the fill values
+ * for the holes in the decomposition (the parts of the arrays not
+ * written by any task), to an output file using pnetcdf. This is
+ * used instead of write_darray_multi_par() with DARRAY_DATA and
+ * DARRAY_FILL when iodesc->needsfill is set with the SUBSET
+ * rearranger.
+ *
+ * The data regions (iodesc->firstregion) and the fill regions
+ * (iodesc->fillregion) are merged into a single list of regions,
+ * sorted by their start in the file, and the data and fill values
+ * are copied into one contiguous buffer per variable, converted to
+ * the type of the variable in the file (see convert_var_data()). Each
+ * variable is then written with a single ncmpi_iput_varn() request.
+ * The merged buffer replaces the rearranged data in file->iobuf[] and
+ * is freed in flush_output_buffer().
+ *
+ * @param file a pointer to the open file descriptor for the file
+ * that will be written to
+ * @param nvars the number of variables to be written with this
+ * decomposition.
+ * @param fndims the number of dimensions of the variables in the
+ * file.
+ * @param varids an array of the variable ids to be written.
+ * @param iodesc pointer to the io_desc_t info.
+ * @param fillvalue pointer to the fill values of the variables
+ * (nvars values).
+ * @param frame the record dimension for each of the nvars variables
+ * in iobuf. NULL if this iodesc contains non-record vars.
+ * @return 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+int write_darray_multi_par_fill(file_desc_t *file, int nvars, int fndims, const int *varids,
+                                io_desc_t *iodesc, const void *fillvalue, const int *frame)
+{
+    iosystem_desc_t *ios;  /* Pointer to io system information. */
+    var_desc_t *vdesc;     /* Pointer to var info struct. */
+    PIO_Offset nerange = 0; /* Number of values out of range of the types of the vars. */
+    int ierr = PIO_NOERR;
+
+    /* Check inputs. */
+    pioassert(file && file->iosystem && varids && varids[0] >= 0 && varids[0] <= PIO_MAX_VARS &&
+              iodesc && fillvalue && file->iotype == PIO_IOTYPE_PNETCDF, "invalid input",
+              __FILE__, __LINE__);
+
+    LOG((1, "write_darray_multi_par_fill nvars = %d iodesc->maxregions = %d "
+         "iodesc->maxfillregions = %d iodesc->llen = %d iodesc->holegridsize = %d", nvars,
+         iodesc->maxregions, iodesc->maxfillregions, iodesc->llen, iodesc->holegridsize));
+
+    /* Start timing this function. */
+    GPTLstart("PIO:write_darray_multi_par_fill");
+
+    /* Get pointer to iosystem. */
+    ios = file->iosystem;
+
+    /* Point to var description scruct for first var. */
+    vdesc = file->varlist + varids[0];
+
+    /* If this is an IO task write the data and the fill values. */
+    if (ios->ioproc)
+    {
+        int ioid = iodesc->ioid - PIO_IODESC_START_ID;
+        /* The region arrays have at least one element, a zero length
+         * array is not valid. */
+        int maxregions = max(iodesc->maxregions + iodesc->maxfillregions, 1);
+        PIO_Offset llen = iodesc->llen + iodesc->holegridsize;
+        size_t tsize = iodesc->mpitype_size;
+        MPI_Datatype vtype[nvars];  /* MPI types of the data of the variables. */
+        int vsize[nvars];           /* Sizes of the MPI types. */
+        PIO_Offset voffset[nvars];  /* Offsets of the data of the variables in buf. */
+        PIO_Offset bufsz = 0;
+        int nconv = 0;
+        merged_region regions[maxregions];
+        PIO_Offset *startlist[maxregions]; /* Array of start arrays for ncmpi_iput_varn(). */
+        PIO_Offset *countlist[maxregions]; /* Array of count arrays for ncmpi_iput_varn(). */
+        PIO_Offset *startcount = NULL;
+        size_t start[fndims];
+        size_t count[fndims];
+        char *buf = NULL;
+        int rrcnt = 0; /* Number of subarray requests. */
+
+        if (!(startcount = malloc(2 * maxregions * fndims * sizeof(PIO_Offset))))
+            ierr = pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
+                           "Writing variables (number of variables = %d) to file (%s, ncid=%d) using PIO_IOTYPE_PNETCDF iotype failed. Out of memory allocating buffer (%lld bytes) for arrays to store starts/counts of I/O regions written out to file", nvars, pio_get_fname_from_file(file), file->pio_ncid, (long long int) (2 * maxregions * fndims * sizeof(PIO_Offset)));
+
+        /* Collect the data regions, then the fill regions, skipping
+         * the empty ones. */
+        for (int fill = 0; fill < 2 && ierr == PIO_NOERR; fill++)
+        {
+            int num_regions = fill ? iodesc->maxfillregions : iodesc->maxregions;
+            io_region *region = fill ? iodesc->fillregion : iodesc->firstregion;
+
+            for (int regioncnt = 0; regioncnt < num_regions; regioncnt++)
+            {
+                merged_region *mr = regions + rrcnt;
+
+                if ((ierr = find_start_count(iodesc->ndims, iodesc->dimlen, fndims, vdesc,
+                                             region, start, count)))
+                {
+                    ierr = pio_err(ios, file, ierr, __FILE__, __LINE__,
+                                   "Writing variables (number of variables = %d) to file (%s, ncid=%d) failed. Internal error, finding start/count for the I/O regions written out from the I/O process failed", nvars, pio_get_fname_from_file(file), file->pio_ncid);
+                    break;
+                }
+
+                mr->ndims = fndims;
+                mr->start = startcount + 2 * rrcnt * fndims;
+                mr->count = mr->start + fndims;
+                mr->dsize = 1;
+                for (int i = 0; i < fndims; i++)
+                {
+                    mr->start[i] = start[i];
+                    mr->count[i] = count[i];
+                    mr->dsize *= count[i];
+                }
+                mr->loffset = (fill || !region) ? -1 : region->loffset;
+                if (mr->dsize > 0)
+                    rrcnt++;
+
+                /* Go to next region. */
+                if (region)
+                    region = region->next;
+            }
+        }
+
+        /* Order the regions as they are laid out in the file. */
+        if (ierr == PIO_NOERR)
+        {
+            qsort(regions, rrcnt, sizeof(merged_region), compare_merged_region);
+            for (int rc = 0; rc < rrcnt; rc++)
+            {
+                startlist[rc] = regions[rc].start;
+                countlist[rc] = regions[rc].count;
+            }
+        }
+
+        /* Get the types of the data of the variables in the file. */
+        if (ierr == PIO_NOERR &&
+            (ierr = get_var_data_types(file, nvars, varids, iodesc, vtype, vsize, &nconv)))
+            ierr = pio_err(ios, file, ierr, __FILE__, __LINE__,
+                           "Writing variables (number of variables = %d) to file (%s, ncid=%d) using PIO_IOTYPE_PNETCDF iotype failed. Finding the types of the variables failed", nvars, pio_get_fname_from_file(file), file->pio_ncid);
+        for (int nv = 0; nv < nvars && ierr == PIO_NOERR; nv++)
+        {
+            voffset[nv] = bufsz;
+            bufsz += llen * vsize[nv];
+        }
+        LOG((3, "nconv = %d bufsz = %lld", nconv, (long long int)bufsz));
+
+        /* Copy the data and the fill values of the regions, in file
+         * order, into one contiguous buffer per variable. The buffer
+         * is allocated on all IO tasks so that flush_output_buffer()
+         * is called collectively. */
+        if (ierr == PIO_NOERR && !(buf = bget(max(bufsz, 1))))
+            ierr = pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
+                           "Writing variables (number of variables = %d) to file (%s, ncid=%d) using PIO_IOTYPE_PNETCDF iotype failed. Out of memory allocating buffer (%lld bytes) for data and fill values of the variables", nvars, pio_get_fname_from_file(file), file->pio_ncid, (long long int) bufsz);
+
+        if (ierr == PIO_NOERR)
+        {
+            const char *iobuf = file->iobuf[ioid];
+
+            for (int nv = 0; nv < nvars && ierr == PIO_NOERR; nv++)
+            {
+                var_desc_t *vd = file->varlist + varids[nv];
+                bool convert = convert_var_data(iodesc, vd);
+                const char *vfill = (const char *)fillvalue + nv * tsize;
+                char *bufptr = buf + voffset[nv];
+
+                /* The holes get the fill value of the variable. */
+                if (convert)
+                    vfill = vd->fillvalue;
+
+                for (int rc = 0; rc < rrcnt && ierr == PIO_NOERR; rc++)
+                {
+                    merged_region *mr = regions + rc;
+
+                    if (mr->loffset < 0)
+                        for (PIO_Offset i = 0; i < mr->dsize; i++)
+                            memcpy(bufptr + i * vsize[nv], vfill, vsize[nv]);
+                    else if (convert)
+                        ierr = convert_data(iodesc, vd, iobuf + (nv * iodesc->llen + mr->loffset) * tsize,
+                                            bufptr, mr->dsize, (const char *)fillvalue + nv * tsize,
+                                            &nerange);
+                    else
+                        memcpy(bufptr, iobuf + (nv * iodesc->llen + mr->loffset) * tsize,
+                               mr->dsize * tsize);
+                    bufptr += mr->dsize * vsize[nv];
+                }
+            }
+
+            /* The merged buffer replaces the rearranged data, and is
+             * freed in flush_output_buffer(). */
+            if (ierr == PIO_NOERR)
+            {
+                brel(file->iobuf[ioid]);
+                file->iobuf[ioid] = buf;
+                file->iobuf_usage += bufsz - (PIO_Offset)iodesc->llen * nvars * tsize;
+            }
+            else
+            {
+                brel(buf);
+                ierr = pio_err(ios, file, ierr, __FILE__, __LINE__,
+                               "Writing variables (number of variables = %d) to file (%s, ncid=%d) using PIO_IOTYPE_PNETCDF iotype failed. Converting the data to the types of the variables failed", nvars, pio_get_fname_from_file(file), file->pio_ncid);
+            }
+        }
+
+        /* For each variable to be written. */
+        for (int nv = 0; nv < nvars && ierr == PIO_NOERR; nv++)
+        {
+            /* Get the var info. */
+            vdesc = file->varlist + varids[nv];
+
+            /* If this is a record (or quasi-record) var, set the start for
+             * the record dimension. */
+            if (vdesc->record >= 0 && fndims > 1)
+                for (int rc = 0; rc < rrcnt; rc++)
+                    startlist[rc][0] = frame[nv];
+
+            if ((ierr = reserve_var_request(vdesc)))
+            {
+                ierr = pio_err(ios, file, ierr, __FILE__, __LINE__,
+                               "Writing variables (number of variables = %d) to file (%s, ncid=%d) using PIO_IOTYPE_PNETCDF iotype failed. Out of memory reallocing buffers (%lld requests) for arrays to store pnetcdf request handles and sizes", nvars, pio_get_fname_from_file(file), file->pio_ncid, (long long int) (vdesc->nreqs + PIO_REQUEST_ALLOC_CHUNK));
+                break;
+            }
+
+            /* Write, in non-blocking fashion, the data and fill values
+             * of the variable. */
+            LOG((3, "about to call ncmpi_iput_varn() varids[%d] = %d rrcnt = %d, llen = %d",
+                 nv, varids[nv], rrcnt, llen));
+            ierr = ncmpi_iput_varn(file->fh, varids[nv], rrcnt, startlist, countlist,
+                                   buf + voffset[nv], llen, vtype[nv],
+                                   vdesc->request + vdesc->nreqs);
+            if (ierr != PIO_NOERR)
+            {
+                ierr = pio_err(ios, file, ierr, __FILE__, __LINE__,
+                               "Writing variables (number of variables = %d) to file (%s, ncid=%d) using PIO_IOTYPE_PNETCDF iotype failed. Non blocking write for variable (%s, varid=%d) failed (Number of subarray requests/regions=%d, Size of data and fill values local to this process = %lld)", nvars, pio_get_fname_from_file(file), file->pio_ncid, pio_get_vname_from_file(file, varids[nv]), varids[nv], rrcnt, (long long int)llen);
+                break;
+            }
+
+            /* PIO_REQ_NULL == NC_REQ_NULL */
+            if (vdesc->request[vdesc->nreqs] != PIO_REQ_NULL)
+                vdesc->request_sz[vdesc->nreqs] = llen * vsize[nv];
+
+            /* Increment the number of requests even for PIO_REQ_NULL
+             * to keep the wait calls in sync across processes (see
+             * write_darray_multi_par()). */
+            vdesc->nreqs++;
+        }
+
+        free(startcount);
+    } /* endif (ios->ioproc) */
+
+    /* Check the return code from the pnetcdf call. */
+    ierr = check_netcdf(NULL, file, ierr, __FILE__,__LINE__);
+
+    /* The data is written even if some values were out of range,
+     * report them after the write. */
+    int ret = report_erange(file, nvars, varids, iodesc, nerange);
+    if (ierr == PIO_NOERR)
+        ierr = ret;
+
+    /* Stop timing this function. */
+    GPTLstop("PIO:write_darray_multi_par_fill");
+
+    return ierr;
+}
+#endif /* _PNETCDF */
+
 /**
  * Fill the tmp_start and tmp_count arrays, which contain the start
  * and count arrays for all regions.
@@ -1010,7 +1583,7 @@ int pio_read_darray_nc(file_desc_t *file, int fndims, io_desc_t *iodesc, int vid
                 else
                     bufptr=(void *)((char *)iobuf + iodesc->mpitype_size * region->loffset);
 
-                LOG((2, "%d %d %d", iodesc->llen - region->loffset, iodesc->llen, region->loffset));
+                LOG((2, "%lld %lld %lld", iodesc->llen - region->loffset, iodesc->llen, region->loffset));
 
                 /* Allow extra outermost dimensions in the decomposition */
                 int num_extra_dims = (vdesc->record >= 0 && fndims > 1)? (ndims - (fndims - 1)) : (ndims - fndims);
@@ -1818,29 +2391,303 @@ int get_file_req_blocks(file_desc_t *file,
 }
 
 /**
- * Flush the output buffer. This is only relevant for files opened
- * with pnetcdf.
- *
- * @param file a pointer to the open file descriptor for the file
- * that will be written to
- * @param force true to force the flushing of the buffer
- * @param addsize additional size to add to buffer (in bytes)
- * @return 0 for success, error code otherwise.
- * @ingroup PIO_write_darray
- * @author Jim Edwards, Jayesh Krishna, Ed Hartnett
+ * The state of a flush to disk of a file running in the background
+ * (see PIOc_set_bg_flush()). A thread waits on the PnetCDF requests
+ * that were pending when the flush started, while the application
+ * caches (and rearranges) more data. The buffers the requests write
+ * from belong to the flush until it completes.
  */
-int flush_output_buffer(file_desc_t *file, bool force, PIO_Offset addsize)
+struct bg_flush
 {
-    int mpierr = MPI_SUCCESS;  /* Return code from MPI functions. */
-    int ierr = PIO_NOERR;
+    /** True if the flush has not been waited on yet. */
+    bool active;
+
+    /** True if the requests are waited on by a thread. */
+    bool threaded;
+
+#if PIO_BG_FLUSH
+    /** The thread waiting on the requests. */
+    pthread_t thread;
+#endif
+
+    /** The PnetCDF id of the file. */
+    int fh;
+
+    /** The pending requests (see get_file_req_blocks()). */
+    int *reqs;
+
+    /** Number of pending requests. */
+    int nreqs;
+
+    /** The ranges (first and last index in reqs) of the blocks of
+     * requests waited on together (see get_file_req_blocks()). */
+    int *req_block_ranges;
+
+    /** Number of blocks of requests. */
+    int nreq_blocks;
+
+    /** The buffers the requests write from (file->iobuf and the
+     * vdesc->fillbuf of the variables). */
+    void **bufs;
+
+    /** Number of buffers. */
+    int nbufs;
+
+    /** Result of the flush. */
+    int ierr;
+};
 
-    GPTLstart("PIO:flush_output_buffer");
 #ifdef _PNETCDF
+/**
+ * Release the pending requests of a file, after they were waited on
+ * (or handed to a background flush), and the buffers they write
+ * from.
+ *
+ * @param file pointer to the file.
+ * @param bgf pointer to the background flush the buffers are handed
+ * to, with room for all of them. NULL to release the buffers.
+ */
+static void release_file_reqs(file_desc_t *file, struct bg_flush *bgf)
+{
     var_desc_t *vdesc;
+
+    for (int i = 0; i < PIO_IODESC_MAX_IDS; i++)
+    {
+        if (file->iobuf[i])
+        {
+            LOG((3,"freeing variable buffer in flush_output_buffer"));
+            if (bgf)
+                bgf->bufs[bgf->nbufs++] = file->iobuf[i];
+            else
+                brel(file->iobuf[i]);
+            file->iobuf[i] = NULL;
+        }
+    }
+    for (int i = 0; i < PIO_MAX_VARS; i++)
+    {
+        vdesc = file->varlist + i;
+        vdesc->wb_pend = 0;
+        if (vdesc->nreqs > 0)
+        {
+            assert(vdesc->request && vdesc->request_sz);
+            free(vdesc->request);
+            free(vdesc->request_sz);
+
+            vdesc->request = NULL;
+            vdesc->request_sz = NULL;
+            vdesc->nreqs = 0;
+        }
+
+        if (vdesc->fillbuf)
+        {
+            if (bgf)
+                bgf->bufs[bgf->nbufs++] = vdesc->fillbuf;
+            else
+                brel(vdesc->fillbuf);
+            vdesc->fillbuf = NULL;
+        }
+    }
+    file->wb_pend = 0;
+    file->iobuf_usage = 0;
+}
+#endif /* _PNETCDF */
+
+#if PIO_BG_FLUSH
+/**
+ * Wait on the requests of a background flush. This is the function
+ * run by the thread of the flush, it only calls PnetCDF (no PIO,
+ * MPI or timer functions).
+ *
+ * @param arg pointer to the background flush.
+ * @returns NULL.
+ */
+static void *bg_flush_run(void *arg)
+{
+    struct bg_flush *bgf = arg;
+    int *req_block_starts = bgf->req_block_ranges;
+    int *req_block_ends = bgf->req_block_ranges + bgf->nreq_blocks;
+    int *request = bgf->reqs;
+
+    for (int k = 0; k < bgf->nreq_blocks && bgf->ierr == PIO_NOERR; k++)
+    {
+        int rcnt = req_block_ends[k] - req_block_starts[k] + 1;
+
+        bgf->ierr = ncmpi_wait_all(bgf->fh, rcnt, request, NULL);
+        request += rcnt;
+    }
+
+    return NULL;
+}
+
+/**
+ * Start a background flush of the pending requests of a file. The
+ * flush takes over the requests and the buffers they write from.
+ *
+ * @param file pointer to the file, with no background flush active.
+ * @param reqs the pending requests (see get_file_req_blocks()), the
+ * flush frees the array.
+ * @param nreqs number of pending requests.
+ * @param req_block_ranges the ranges of the blocks of requests, the
+ * flush frees the array.
+ * @param nreq_blocks number of blocks of requests.
+ * @returns 0 for success, error code otherwise. If the flush could
+ * not be started the requests and buffers are left to the caller.
+ */
+static int bg_flush_start(file_desc_t *file, int *reqs, int nreqs, int *req_block_ranges,
+                          int nreq_blocks)
+{
+    struct bg_flush *bgf;
+    int nbufs = 0;
+
+    assert(file && !(file->bg_flush && file->bg_flush->active));
+
+    if (!file->bg_flush && !(file->bg_flush = calloc(1, sizeof(struct bg_flush))))
+        return PIO_ENOMEM;
+    bgf = file->bg_flush;
+
+    for (int i = 0; i < PIO_IODESC_MAX_IDS; i++)
+        if (file->iobuf[i])
+            nbufs++;
+    for (int i = 0; i < PIO_MAX_VARS; i++)
+        if (file->varlist[i].fillbuf)
+            nbufs++;
+    if (nbufs > 0 && !(bgf->bufs = malloc(nbufs * sizeof(void *))))
+        return PIO_ENOMEM;
+
+    bgf->nbufs = 0;
+    release_file_reqs(file, bgf);
+    assert(bgf->nbufs == nbufs);
+
+    bgf->fh = file->fh;
+    bgf->reqs = reqs;
+    bgf->nreqs = nreqs;
+    bgf->req_block_ranges = req_block_ranges;
+    bgf->nreq_blocks = nreq_blocks;
+    bgf->ierr = PIO_NOERR;
+    bgf->active = true;
+
+    /* If no thread can be created, the requests are waited on here. */
+    bgf->threaded = !pthread_create(&bgf->thread, NULL, bg_flush_run, bgf);
+    if (!bgf->threaded)
+    {
+        LOG((1, "Creating a thread to flush file %s in the background failed, flushing in the foreground", pio_get_fname_from_file(file)));
+        bg_flush_run(bgf);
+    }
+    LOG((2, "bg_flush_start ncid = %d nreqs = %d nreq_blocks = %d nbufs = %d threaded = %d",
+         file->pio_ncid, nreqs, nreq_blocks, nbufs, bgf->threaded));
+
+    return PIO_NOERR;
+}
+#endif /* PIO_BG_FLUSH */
+
+/**
+ * Wait for the background flush of a file, if any, to complete and
+ * release its requests and buffers. The result of the flush is kept
+ * (see bg_flush_wait()).
+ *
+ * @param file pointer to the file.
+ */
+void bg_flush_join(file_desc_t *file)
+{
+    struct bg_flush *bgf;
+
+    assert(file);
+
+    if (!(bgf = file->bg_flush) || !bgf->active)
+        return;
+
+    GPTLstart("PIO:bg_flush_wait");
+#if PIO_BG_FLUSH
+    if (bgf->threaded)
+        pthread_join(bgf->thread, NULL);
+#endif
+    LOG((2, "bg_flush_join ncid = %d ierr = %d", file->pio_ncid, bgf->ierr));
+
+    for (int i = 0; i < bgf->nbufs; i++)
+        brel(bgf->bufs[i]);
+    free(bgf->bufs);
+    free(bgf->reqs);
+    free(bgf->req_block_ranges);
+    bgf->bufs = NULL;
+    bgf->nbufs = 0;
+    bgf->reqs = NULL;
+    bgf->nreqs = 0;
+    bgf->req_block_ranges = NULL;
+    bgf->nreq_blocks = 0;
+    bgf->active = false;
+    GPTLstop("PIO:bg_flush_wait");
+}
+
+/**
+ * Wait for the background flush of a file, if any, to complete.
+ *
+ * @param file pointer to the file.
+ * @returns the result of the last background flush of the file that
+ * was not reported yet, 0 if there is none.
+ */
+int bg_flush_wait(file_desc_t *file)
+{
+    int ierr;
+
+    bg_flush_join(file);
+    if (!file->bg_flush)
+        return PIO_NOERR;
+
+    ierr = file->bg_flush->ierr;
+    file->bg_flush->ierr = PIO_NOERR;
+
+    return ierr;
+}
+
+/**
+ * Wait for the background flush of a file, if any, to complete and
+ * free the state of the background flushes of the file.
+ *
+ * @param file pointer to the file.
+ */
+void bg_flush_free(file_desc_t *file)
+{
+    bg_flush_join(file);
+    free(file->bg_flush);
+    file->bg_flush = NULL;
+}
+
+/**
+ * Flush the output buffer. This is only relevant for files opened
+ * with pnetcdf.
+ *
+ * @param file a pointer to the open file descriptor for the file
+ * that will be written to
+ * @param force true to force the flushing of the buffer
+ * @param addsize additional size to add to buffer (in bytes)
+ * @return 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ * @author Jim Edwards, Jayesh Krishna, Ed Hartnett
+ */
+int flush_output_buffer(file_desc_t *file, bool force, PIO_Offset addsize)
+{
+    int mpierr = MPI_SUCCESS;  /* Return code from MPI functions. */
+    int ierr = PIO_NOERR;
+
+    GPTLstart("PIO:flush_output_buffer");
+#ifdef _PNETCDF
+#if defined(PIO_MICRO_TIMING) || defined(MPIO_ONESIDED)
+    var_desc_t *vdesc;
+#endif
     PIO_Offset usage = 0;
+    PIO_Offset limit;
 
     /* Check inputs. */
     pioassert(file, "invalid input", __FILE__, __LINE__);
+    limit = file->buffer_size_limit;
+
+    /* Wait for the previous flush, if it runs in the background. */
+    if ((ierr = bg_flush_wait(file)))
+    {
+        GPTLstop("PIO:flush_output_buffer");
+        return pio_err(file->iosystem, file, ierr, __FILE__, __LINE__,
+                        "Flushing data to file (%s, ncid=%d) in the background failed. Waiting on the pending requests failed", pio_get_fname_from_file(file), file->pio_ncid);
+    }
 
     /* Find out the buffer usage. */
     if ((ierr = ncmpi_inq_buffer_usage(file->fh, &usage)))
@@ -1853,16 +2700,22 @@ int flush_output_buffer(file_desc_t *file, bool force, PIO_Offset addsize)
         }
 
     /* If we are not forcing a flush, spread the usage to all IO
-     * tasks. */
+     * tasks. The limit of the file may differ between tasks (see
+     * PIOc_set_file_buffer_size()), so the smallest limit is spread
+     * too (as a maximum of its negation, in the same reduction), and
+     * all IO tasks decide to flush together. */
     if (!force && file->iosystem->io_comm != MPI_COMM_NULL)
     {
-        usage += addsize;
-        if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &usage, 1,  MPI_OFFSET,  MPI_MAX,
+        PIO_Offset usage_limit[2] = {usage + addsize, -file->buffer_size_limit};
+
+        if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, usage_limit, 2,  MPI_OFFSET,  MPI_MAX,
                                     file->iosystem->io_comm)))
         {
             GPTLstop("PIO:flush_output_buffer");
             return check_mpi(NULL, file, mpierr, __FILE__, __LINE__);
         }
+        usage = usage_limit[0];
+        limit = -usage_limit[1];
     }
 
     /* Keep track of the maximum usage. */
@@ -1871,7 +2724,7 @@ int flush_output_buffer(file_desc_t *file, bool force, PIO_Offset addsize)
 
     /* If the user forces it, or the buffer has exceeded the size
      * limit, then flush to disk. */
-    if (force || usage >= pio_buffer_size_limit)
+    if (force || usage >= limit)
     {
         int rcnt;
         int  maxreq; /* Index of the last vdesc with pending requests */
@@ -1894,6 +2747,27 @@ int flush_output_buffer(file_desc_t *file, bool force, PIO_Offset addsize)
                             "Unable to consolidate pending requests on file (%s, ncid=%d) to blocks (The function returned : Number of pending requests on file = %d, Number of variables with pending requests = %d, Number of request blocks = %d).", pio_get_fname_from_file(file), file->pio_ncid, nreqs, nvars_with_reqs, nreq_blocks); 
         }
 
+#if PIO_BG_FLUSH
+        /* Wait on the requests in the background. The callers that
+         * need the data on disk when this function returns wait for
+         * the flush (see sync_file()). */
+        if (file->iosystem->bg_flush)
+        {
+            if ((ierr = bg_flush_start(file, reqs, nreqs, req_block_ranges,
+                                       nreq_blocks)) == PIO_NOERR)
+            {
+                GPTLstop("PIO:flush_output_buffer");
+                return PIO_NOERR;
+            }
+            LOG((1, "Starting a background flush failed, ierr = %d, flushing in the foreground", ierr));
+            ierr = PIO_NOERR;
+        }
+#endif /* PIO_BG_FLUSH */
+
+        /* The wait is measured for the flush policy model. */
+        PIO_Offset disk_bytes = file->iobuf_usage;
+        double disk_start = MPI_Wtime();
+
 #ifdef PIO_MICRO_TIMING
         bool var_has_pend_reqs[maxreq + 1];
         bool var_timer_was_running[maxreq + 1];
@@ -2081,38 +2955,13 @@ int flush_output_buffer(file_desc_t *file, bool force, PIO_Offset addsize)
         }
 #endif
 
-        /* Release resources. */
-        for (int i = 0; i < PIO_IODESC_MAX_IDS; i++)
-        {
-            if (file->iobuf[i])
-            {
-                LOG((3,"freeing variable buffer in flush_output_buffer"));
-                brel(file->iobuf[i]);
-                file->iobuf[i] = NULL;
-            }
-        }
-        for (int i = 0; i < PIO_MAX_VARS; i++)
-        {
-            vdesc = file->varlist + i;
-            vdesc->wb_pend = 0;
-            if (vdesc->nreqs > 0)
-            {
-                assert(vdesc->request && vdesc->request_sz);
-                free(vdesc->request);
-                free(vdesc->request_sz);
+        double disk_secs = MPI_Wtime() - disk_start;
+        file->disk_wait += disk_secs;
+        if (disk_bytes > 0)
+            pio_cost_fit_add(&file->disk_cost, disk_bytes, disk_secs);
 
-                vdesc->request = NULL;
-                vdesc->request_sz = NULL;
-                vdesc->nreqs = 0;
-            }
-  
-            if (vdesc->fillbuf)
-            {
-                brel(vdesc->fillbuf);
-                vdesc->fillbuf = NULL;
-            }
-        }
-        file->wb_pend = 0;
+        /* Release resources. */
+        release_file_reqs(file, NULL);
     }
 
 #endif /* _PNETCDF */
@@ -2132,39 +2981,274 @@ int flush_output_buffer(file_desc_t *file, bool force, PIO_Offset addsize)
 void cn_buffer_report(iosystem_desc_t *ios, bool collective)
 {
     int mpierr = MPI_SUCCESS;  /* Return code from MPI functions. */
+    pio_arena_stats_t stats;
 
     LOG((2, "cn_buffer_report ios->iossysid = %d collective = %d",
          ios->iosysid, collective));
-    long bget_stats[5];
-    long bget_mins[5];
-    long bget_maxs[5];
-
-    bstats(bget_stats, bget_stats+1,bget_stats+2,bget_stats+3,bget_stats+4);
+    long bget_stats[6];
+    long bget_mins[6];
+    long bget_maxs[6];
+
+    pio_arena_stats(&stats);
+    bget_stats[0] = stats.curalloc;
+    bget_stats[1] = stats.peakalloc;
+    bget_stats[2] = stats.sysalloc;
+    bget_stats[3] = stats.maxfree;
+    bget_stats[4] = stats.nget;
+    bget_stats[5] = stats.nrel;
     if (collective)
     {
         LOG((3, "cn_buffer_report calling MPI_Reduce ios->comp_comm = %d", ios->comp_comm));
-        if ((mpierr = MPI_Reduce(bget_stats, bget_maxs, 5, MPI_LONG, MPI_MAX, 0, ios->comp_comm)))
+        if ((mpierr = MPI_Reduce(bget_stats, bget_maxs, 6, MPI_LONG, MPI_MAX, 0, ios->comp_comm)))
             check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
         LOG((3, "cn_buffer_report calling MPI_Reduce"));
-        if ((mpierr = MPI_Reduce(bget_stats, bget_mins, 5, MPI_LONG, MPI_MIN, 0, ios->comp_comm)))
+        if ((mpierr = MPI_Reduce(bget_stats, bget_mins, 6, MPI_LONG, MPI_MIN, 0, ios->comp_comm)))
             check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
         if (ios->compmaster == MPI_ROOT)
         {
             LOG((1, "Currently allocated buffer space %ld %ld", bget_mins[0], bget_maxs[0]));
-            LOG((1, "Currently available buffer space %ld %ld", bget_mins[1], bget_maxs[1]));
-            LOG((1, "Current largest free block %ld %ld", bget_mins[2], bget_maxs[2]));
-            LOG((1, "Number of successful bget calls %ld %ld", bget_mins[3], bget_maxs[3]));
-            LOG((1, "Number of successful brel calls  %ld %ld", bget_mins[4], bget_maxs[4]));
+            LOG((1, "Peak allocated buffer space %ld %ld", bget_mins[1], bget_maxs[1]));
+            LOG((1, "Buffer space held from the system %ld %ld", bget_mins[2], bget_maxs[2]));
+            LOG((1, "Currently available buffer space %ld %ld", bget_mins[3], bget_maxs[3]));
+            LOG((1, "Number of successful bget calls %ld %ld", bget_mins[4], bget_maxs[4]));
+            LOG((1, "Number of successful brel calls  %ld %ld", bget_mins[5], bget_maxs[5]));
         }
     }
     else
     {
         LOG((1, "Currently allocated buffer space %ld", bget_stats[0]));
-        LOG((1, "Currently available buffer space %ld", bget_stats[1]));
-        LOG((1, "Current largest free block %ld", bget_stats[2]));
-        LOG((1, "Number of successful bget calls %ld", bget_stats[3]));
-        LOG((1, "Number of successful brel calls  %ld", bget_stats[4]));
+        LOG((1, "Peak allocated buffer space %ld", bget_stats[1]));
+        LOG((1, "Buffer space held from the system %ld (%.1f%% not allocated)", bget_stats[2],
+             100 * stats.frag));
+        LOG((1, "Currently available buffer space %ld", bget_stats[3]));
+        LOG((1, "Number of successful bget calls %ld", bget_stats[4]));
+        LOG((1, "Number of successful brel calls  %ld", bget_stats[5]));
+    }
+}
+
+/**
+ * Add a measured flush to the fit of the cost of a kind of flush
+ * (see PIO_FLUSH_POLICY_MODEL). The older flushes are weighted down
+ * by PIO_FLUSH_MODEL_DECAY.
+ *
+ * @param fit pointer to the fit.
+ * @param bytes the number of bytes flushed.
+ * @param secs the time taken by the flush, in seconds.
+ */
+void pio_cost_fit_add(pio_cost_fit *fit, PIO_Offset bytes, double secs)
+{
+    double b = (double)bytes;
+
+    assert(fit);
+
+    fit->sn = PIO_FLUSH_MODEL_DECAY * fit->sn + 1;
+    fit->sb = PIO_FLUSH_MODEL_DECAY * fit->sb + b;
+    fit->st = PIO_FLUSH_MODEL_DECAY * fit->st + secs;
+    fit->sbb = PIO_FLUSH_MODEL_DECAY * fit->sbb + b * b;
+    fit->sbt = PIO_FLUSH_MODEL_DECAY * fit->sbt + b * secs;
+    fit->nsamples++;
+}
+
+/**
+ * Check if the model of the cost of a kind of flush (a latency plus
+ * a time per byte, fitted to the flushes measured) predicts that
+ * flushing bytes now costs, per byte, at most PIO_FLUSH_MODEL_SLACK
+ * more than waiting until limit bytes are cached. Until
+ * PIO_FLUSH_MODEL_MIN_SAMPLES flushes are measured there is no
+ * prediction.
+ *
+ * @param fit pointer to the fit.
+ * @param bytes the number of bytes that would be flushed now.
+ * @param limit the number of bytes that would be flushed at the
+ * limit.
+ * @returns true if the data should be flushed now.
+ */
+bool pio_cost_fit_flush_now(const pio_cost_fit *fit, PIO_Offset bytes, PIO_Offset limit)
+{
+    double den, lat, tpb;
+
+    assert(fit);
+
+    if (fit->nsamples < PIO_FLUSH_MODEL_MIN_SAMPLES || bytes <= 0 || bytes >= limit)
+        return false;
+
+    /* Fit t = lat + b * tpb. If the flushes measured were all of the
+     * same size (the steady state of fixed size writes), the latency
+     * can not be told apart from the time per byte. Without a
+     * positive latency (also from a noisy fit) there is nothing to
+     * amortize, and flushing early is never cheaper, so there is no
+     * prediction. */
+    den = fit->sn * fit->sbb - fit->sb * fit->sb;
+    if (den <= 1e-9 * fit->sn * fit->sbb)
+        return false;
+    tpb = (fit->sn * fit->sbt - fit->sb * fit->st) / den;
+    lat = (fit->st - tpb * fit->sb) / fit->sn;
+    if (lat <= 0 || tpb < 0)
+        return false;
+
+    LOG((3, "pio_cost_fit_flush_now lat = %g tpb = %g bytes = %lld limit = %lld", lat, tpb,
+         (long long int)bytes, (long long int)limit));
+
+    /* Compare the costs per byte of flushing now and at the limit. */
+    return lat / bytes + tpb <= (1 + PIO_FLUSH_MODEL_SLACK) * (lat / limit + tpb);
+}
+
+/**
+ * Release the data cached in a write multi buffer, after it has been
+ * written.
+ *
+ * @param file pointer to the file the data was written to.
+ * @param wmb pointer to the wmulti_buffer structure.
+ * @param iodesc pointer to the decomposition of the data.
+ */
+static void release_wmb_data(file_desc_t *file, wmulti_buffer *wmb, io_desc_t *iodesc)
+{
+    assert(file && wmb && iodesc);
+
+    wmb->num_arrays = 0;
+
+    /* Release the list of variable IDs. */
+    free(wmb->vid);
+    wmb->vid = NULL;
+
+    /* Release the data memory, the registered arrays belong to the
+     * caller. */
+    for (int k = 0; k < wmb->nsegs; k++)
+    {
+        if (wmb->seg_user[k])
+            continue;
+        file->wmb_usage -= (PIO_Offset)wmb->seg_arrays * wmb->arraylen * iodesc->mpitype_size;
+        brel(wmb->segs[k]);
     }
+    free(wmb->segs);
+    free(wmb->seg_nvars);
+    free(wmb->seg_user);
+    wmb->segs = NULL;
+    wmb->seg_nvars = NULL;
+    wmb->seg_user = NULL;
+    wmb->nsegs = 0;
+    wmb->seg_arrays = 0;
+    wmb->nuser = 0;
+
+    /* If there is a fill value, release it. */
+    if (wmb->fillvalue)
+        brel(wmb->fillvalue);
+    wmb->fillvalue = NULL;
+
+    /* Release the record number. */
+    if (wmb->frame)
+        free(wmb->frame);
+    wmb->frame = NULL;
+}
+
+/**
+ * Get the entries for rearrange_comp2io_fused() that move the data
+ * cached in a write multi buffer to the IO tasks: one entry per
+ * segment of the data, with the variables of the segment received in
+ * their place in iobuf. Without data on this task (no segments) a
+ * single entry receives all the variables.
+ *
+ * @param wmb pointer to the wmulti_buffer structure.
+ * @param iodesc pointer to the decomposition of the buffer.
+ * @param iobuf the buffer for the rearranged data (NULL if not
+ * needed on this task).
+ * @param iodescs array (length max(1, wmb->nsegs)) that gets the
+ * decomposition of each entry.
+ * @param sbufs array (length max(1, wmb->nsegs)) that gets the send
+ * buffer of each entry.
+ * @param rbufs array (length max(1, wmb->nsegs)) that gets the
+ * receive buffer of each entry.
+ * @param nvars array (length max(1, wmb->nsegs)) that gets the
+ * number of variables of each entry.
+ * @returns the number of entries.
+ */
+static int get_wmb_rearr_entries(wmulti_buffer *wmb, io_desc_t *iodesc, void *iobuf,
+                                 io_desc_t **iodescs, void **sbufs, void **rbufs, int *nvars)
+{
+    assert(wmb && iodesc && iodescs && sbufs && rbufs && nvars);
+
+    if (wmb->nsegs == 0)
+    {
+        iodescs[0] = iodesc;
+        sbufs[0] = NULL;
+        rbufs[0] = iobuf;
+        nvars[0] = wmb->num_arrays;
+        return 1;
+    }
+
+    for (int k = 0, v0 = 0; k < wmb->nsegs; v0 += wmb->seg_nvars[k++])
+    {
+        iodescs[k] = iodesc;
+        sbufs[k] = wmb->segs[k];
+        rbufs[k] = iobuf ? (char *)iobuf + (PIO_Offset)v0 * iodesc->llen * iodesc->mpitype_size : NULL;
+        nvars[k] = wmb->seg_nvars[k];
+    }
+
+    return wmb->nsegs;
+}
+
+/**
+ * Write the data cached in the segments of a write multi buffer,
+ * moving the segments to the IO tasks with one exchange (see
+ * rearrange_comp2io_fused()) instead of copying them to a contiguous
+ * buffer first. The decomposition must be
+ * rearr_comp2io_segmentable(), without async. All the tasks of the
+ * rearranger communicator must call this function, whatever the
+ * number of segments they hold (none on tasks without data).
+ *
+ * @param file pointer to the file.
+ * @param wmb pointer to the wmulti_buffer structure.
+ * @param iodesc pointer to the decomposition of the buffer.
+ * @param flushtodisk if true, then flush data to disk.
+ * @returns 0 for success, error code otherwise.
+ */
+static int write_wmb_segs(file_desc_t *file, wmulti_buffer *wmb, io_desc_t *iodesc,
+                          bool flushtodisk)
+{
+    iosystem_desc_t *ios = file->iosystem;
+    int n = max(1, wmb->nsegs);
+    io_desc_t *iodescs[n];
+    void *sbufs[n];
+    void *rbufs[n];
+    int nvars[n];
+    void *iobuf = NULL;
+    int ret = PIO_NOERR;
+
+    spio_ltimer_start(ios->io_fstats->wr_timer_name);
+    spio_ltimer_start(ios->io_fstats->tot_timer_name);
+    spio_ltimer_start(file->io_fstats->wr_timer_name);
+    spio_ltimer_start(file->io_fstats->tot_timer_name);
+
+    /* If the buffer for the rearranged data is in use in pnetcdf we
+     * need to flush first. */
+    if (file->iotype == PIO_IOTYPE_PNETCDF && file->iobuf[wmb->ioid - PIO_IODESC_START_ID])
+        ret = flush_output_buffer(file, true, 0);
+
+    if (ret == PIO_NOERR)
+        ret = alloc_write_iobuf(file, iodesc, wmb->num_arrays, wmb->fillvalue, &iobuf);
+
+    /* Move the data of all the segments from compute to IO tasks. */
+    if (ret == PIO_NOERR)
+    {
+        n = get_wmb_rearr_entries(wmb, iodesc, iobuf, iodescs, sbufs, rbufs, nvars);
+        ret = rearrange_comp2io_fused(ios, n, iodescs, sbufs, rbufs, nvars);
+    }
+
+    spio_ltimer_stop(ios->io_fstats->wr_timer_name);
+    spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+    spio_ltimer_stop(file->io_fstats->wr_timer_name);
+    spio_ltimer_stop(file->io_fstats->tot_timer_name);
+
+    /* Write the rearranged data, the file owns the rearranged data
+     * after the write. */
+    if (ret == PIO_NOERR)
+        ret = write_darray_multi(file->pio_ncid, wmb->vid, wmb->ioid, wmb->num_arrays,
+                                 wmb->arraylen, wmb->nsegs ? wmb->segs[0] : NULL, wmb->frame,
+                                 wmb->fillvalue, flushtodisk, true, iobuf);
+    else if (iobuf)
+        brel(iobuf);
+
+    return ret;
 }
 
 /**
@@ -2188,7 +3272,7 @@ int flush_buffer(int ncid, wmulti_buffer *wmb, bool flushtodisk)
     pioassert(wmb, "invalid input", __FILE__, __LINE__);
 
     /* Get the file info (to get error handler). */
-    if ((ret = pio_get_file(ncid, &file)))
+    if ((ret = pio_get_file_nowait(ncid, &file)))
     {
         GPTLstop("PIO:flush_buffer");
         return pio_err(NULL, NULL, ret, __FILE__, __LINE__,
@@ -2209,39 +3293,67 @@ int flush_buffer(int ncid, wmulti_buffer *wmb, bool flushtodisk)
     /* If there are any variables in this buffer... */
     if (wmb->num_arrays > 0)
     {
+        io_desc_t *iodesc = pio_get_iodesc_from_id(wmb->ioid);
+        double flush_start = MPI_Wtime();
+
+        /* The time waited for the data to be written to disk is left
+         * out of the cost of moving the data to the IO tasks. */
+        file->disk_wait = 0;
+
         /* Write any data in the buffer. */
         spio_ltimer_stop(ios->io_fstats->wr_timer_name);
         spio_ltimer_stop(ios->io_fstats->tot_timer_name);
         spio_ltimer_stop(file->io_fstats->wr_timer_name);
         spio_ltimer_stop(file->io_fstats->tot_timer_name);
-        ret = PIOc_write_darray_multi(ncid, wmb->vid,  wmb->ioid, wmb->num_arrays,
-                                      wmb->arraylen, wmb->data, wmb->frame,
-                                      wmb->fillvalue, flushtodisk);
+        /* The number of segments differs from task to task (it
+         * depends on the local array length), so the way the data
+         * is rearranged is picked from options that are the same on
+         * all tasks. */
+        if (!iodesc)
+            ret = PIO_EBADID;
+        else if (!ios->async && rearr_comp2io_segmentable(ios, iodesc))
+            ret = write_wmb_segs(file, wmb, iodesc, flushtodisk);
+        else if (wmb->nsegs <= 1)
+            ret = PIOc_write_darray_multi(ncid, wmb->vid,  wmb->ioid, wmb->num_arrays,
+                                          wmb->arraylen, wmb->nsegs ? wmb->segs[0] : NULL,
+                                          wmb->frame, wmb->fillvalue, flushtodisk);
+        else
+        {
+            /* The data must be contiguous, copy the segments to a
+             * single buffer. */
+            PIO_Offset data_sz_bytes = (PIO_Offset)wmb->num_arrays * wmb->arraylen * iodesc->mpitype_size;
+            PIO_Offset array_sz_bytes = (PIO_Offset)wmb->arraylen * iodesc->mpitype_size;
+            char *data;
+
+            if (!(data = bget(data_sz_bytes)))
+                ret = PIO_ENOMEM;
+            else
+            {
+                char *bufptr = data;
+
+                for (int k = 0; k < wmb->nsegs; k++)
+                {
+                    memcpy(bufptr, wmb->segs[k], wmb->seg_nvars[k] * array_sz_bytes);
+                    bufptr += wmb->seg_nvars[k] * array_sz_bytes;
+                }
+                ret = PIOc_write_darray_multi(ncid, wmb->vid,  wmb->ioid, wmb->num_arrays,
+                                              wmb->arraylen, data, wmb->frame,
+                                              wmb->fillvalue, flushtodisk);
+                brel(data);
+            }
+        }
         spio_ltimer_start(ios->io_fstats->wr_timer_name);
         spio_ltimer_start(ios->io_fstats->tot_timer_name);
         spio_ltimer_start(file->io_fstats->wr_timer_name);
         spio_ltimer_start(file->io_fstats->tot_timer_name);
         LOG((2, "return from PIOc_write_darray_multi ret = %d", ret));
 
-        wmb->num_arrays = 0;
-
-        /* Release the list of variable IDs. */
-        free(wmb->vid);
-        wmb->vid = NULL;
-
-        /* Release the data memory. */
-        brel(wmb->data);
-        wmb->data = NULL;
+        if ((ret == PIO_NOERR || ret == PIO_ERANGE) && wmb->arraylen > 0)
+            pio_cost_fit_add(&file->rearr_cost,
+                             (PIO_Offset)wmb->num_arrays * wmb->arraylen * iodesc->mpitype_size,
+                             MPI_Wtime() - flush_start - file->disk_wait);
 
-        /* If there is a fill value, release it. */
-        if (wmb->fillvalue)
-            brel(wmb->fillvalue);
-        wmb->fillvalue = NULL;
-
-        /* Release the record number. */
-        if (wmb->frame)
-            free(wmb->frame);
-        wmb->frame = NULL;
+        release_wmb_data(file, wmb, iodesc);
 
         if (ret)
         {
@@ -2263,6 +3375,290 @@ int flush_buffer(int ncid, wmulti_buffer *wmb, bool flushtodisk)
     return PIO_NOERR;
 }
 
+/**
+ * Flush all the write multi buffers of a file.
+ *
+ * The data of the buffers with different decompositions that use the
+ * box rearranger (see rearr_comp2io_fusable()) is moved to the IO
+ * tasks in a single exchange (see rearrange_comp2io_fused()), instead
+ * of one exchange per buffer, and then written. The other buffers are
+ * flushed one at a time with flush_buffer(). Without async all tasks
+ * have the same list of buffers, so all tasks pick the same buffers
+ * to rearrange together.
+ *
+ * The buffers are left in the list of buffers of the file, empty.
+ *
+ * @param ncid identifies the netCDF file.
+ * @param flushtodisk if true, then flush data to disk.
+ * @returns 0 for success, PIO_ERANGE if some values were out of the
+ * range of the types of the variables (all the buffers are still
+ * written), error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+int flush_buffers(int ncid, bool flushtodisk)
+{
+    iosystem_desc_t *ios = NULL;
+    file_desc_t *file = NULL;
+    wmulti_buffer *wmb;
+    int nbufs = 0;    /* Number of buffers with data. */
+    int nentries = 0; /* Number of segments of the data of the buffers. */
+    int nfused = 0;   /* Number of buffers rearranged together. */
+    int erange = PIO_NOERR; /* PIO_ERANGE if values were out of range. */
+    int ret = PIO_NOERR;
+
+    /* Get the file info (to get error handler). */
+    if ((ret = pio_get_file_nowait(ncid, &file)))
+        return pio_err(NULL, NULL, ret, __FILE__, __LINE__,
+                        "Internal error flushing data cached in write multi buffers to %s. Invalid file id (ncid=%d) provided", (flushtodisk) ? "disk" : "I/O processes", ncid);
+    assert(file);
+    ios = file->iosystem;
+    assert(ios);
+
+    LOG((1, "flush_buffers ncid = %d flushtodisk = %d", ncid, flushtodisk));
+
+    for (int i = 0; i < file->nwmbs; i++)
+        if (file->wmbs[i]->num_arrays > 0)
+        {
+            nbufs++;
+            nentries += max(1, file->wmbs[i]->nsegs);
+        }
+    if (nbufs == 0)
+        return PIO_NOERR;
+
+    wmulti_buffer *fused[nbufs];
+    io_desc_t *fused_iodescs[nbufs];
+    void *iobufs[nbufs];
+
+    /* The entries of the exchange, one per segment of the data of the
+     * fused buffers (see get_wmb_rearr_entries()). */
+    io_desc_t *iodescs[nentries];
+    void *sbufs[nentries];
+    void *rbufs[nentries];
+    int nvars[nentries];
+
+    /* Pick the buffers that can be rearranged together, at most one
+     * buffer per decomposition since the rearranged data of a
+     * decomposition is held in file->iobuf[ioid]. When both the
+     * buffers of the non-record and the record variables of a
+     * decomposition have data, the non-record one is picked. */
+    if (!ios->async)
+    {
+        for (int i = 0; i < file->nwmbs; i++)
+        {
+            wmulti_buffer *other;
+            io_desc_t *iodesc;
+
+            wmb = file->wmbs[i];
+            if (wmb->num_arrays <= 0 || !(iodesc = pio_get_iodesc_from_id(wmb->ioid)) ||
+                !rearr_comp2io_fusable(ios, iodesc))
+                continue;
+            other = pio_get_wmb(file, wmb->ioid, !wmb->recordvar);
+            if (wmb->recordvar && other && other->num_arrays > 0)
+                continue;
+
+            fused[nfused] = wmb;
+            fused_iodescs[nfused] = iodesc;
+            iobufs[nfused] = NULL;
+            nfused++;
+        }
+    }
+
+    /* There is nothing to gain with a single buffer. */
+    if (nfused < 2)
+        nfused = 0;
+
+    if (nfused > 0)
+    {
+        GPTLstart("PIO:flush_buffers");
+        spio_ltimer_start(ios->io_fstats->wr_timer_name);
+        spio_ltimer_start(ios->io_fstats->tot_timer_name);
+        spio_ltimer_start(file->io_fstats->wr_timer_name);
+        spio_ltimer_start(file->io_fstats->tot_timer_name);
+
+        /* If any of the buffers for the rearranged data is in use in
+         * pnetcdf we need to flush first. The buffers are only handed
+         * to the file (file->iobuf) after that, since flushing
+         * releases all of them. */
+        if (file->iotype == PIO_IOTYPE_PNETCDF)
+        {
+            bool inuse = false;
+
+            for (int k = 0; k < nfused; k++)
+                if (file->iobuf[fused[k]->ioid - PIO_IODESC_START_ID])
+                    inuse = true;
+            if (inuse)
+                ret = flush_output_buffer(file, true, 0);
+        }
+
+        for (int k = 0; ret == PIO_NOERR && k < nfused; k++)
+            ret = alloc_write_iobuf(file, fused_iodescs[k], fused[k]->num_arrays,
+                                    fused[k]->fillvalue, &iobufs[k]);
+
+        /* Move the data of all the buffers from compute to IO tasks. */
+        if (ret == PIO_NOERR)
+        {
+            nentries = 0;
+            for (int k = 0; k < nfused; k++)
+                nentries += get_wmb_rearr_entries(fused[k], fused_iodescs[k], iobufs[k],
+                                                  &iodescs[nentries], &sbufs[nentries],
+                                                  &rbufs[nentries], &nvars[nentries]);
+            ret = rearrange_comp2io_fused(ios, nentries, iodescs, sbufs, rbufs, nvars);
+        }
+
+        spio_ltimer_stop(ios->io_fstats->wr_timer_name);
+        spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+        spio_ltimer_stop(file->io_fstats->wr_timer_name);
+        spio_ltimer_stop(file->io_fstats->tot_timer_name);
+        GPTLstop("PIO:flush_buffers");
+
+        /* Write the rearranged data, the file owns the rearranged
+         * data after the write. */
+        for (int k = 0; k < nfused; k++)
+        {
+            wmb = fused[k];
+            if (ret == PIO_NOERR)
+            {
+                ret = write_darray_multi(ncid, wmb->vid, wmb->ioid, wmb->num_arrays,
+                                         wmb->arraylen, wmb->nsegs ? wmb->segs[0] : NULL,
+                                         wmb->frame, wmb->fillvalue, flushtodisk, true,
+                                         iobufs[k]);
+                LOG((2, "return from write_darray_multi ret = %d", ret));
+                /* The values out of range were written as fill
+                 * values, write the other buffers too. */
+                if (ret == PIO_ERANGE)
+                {
+                    erange = ret;
+                    ret = PIO_NOERR;
+                }
+            }
+            else if (iobufs[k])
+            {
+                brel(iobufs[k]);
+            }
+            release_wmb_data(file, wmb, fused_iodescs[k]);
+        }
+
+        if (ret != PIO_NOERR)
+            return pio_err(NULL, file, ret, __FILE__, __LINE__,
+                            "Internal error flushing data cached in write multi buffers to file (%s, ncid=%d). Error while flushing data of %d decompositions to %s", pio_get_fname_from_file(file), file->pio_ncid, nfused, (flushtodisk) ? "disk" : "I/O processes");
+    }
+
+    /* Flush the rest of the buffers one at a time. */
+    for (int i = 0; i < file->nwmbs; i++)
+    {
+        if (file->wmbs[i]->num_arrays == 0)
+            continue;
+        if ((ret = flush_buffer(ncid, file->wmbs[i], flushtodisk)) == PIO_ERANGE)
+            erange = ret;
+        else if (ret)
+            return ret;
+    }
+
+    return erange;
+}
+
+/**
+ * Progress the rearrangements of the nonblocking writes of a file,
+ * without blocking.
+ *
+ * @param file pointer to the file.
+ * @returns 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+int darray_nb_progress(file_desc_t *file)
+{
+    int flag;
+    int ret;
+
+    assert(file);
+
+    for (darray_nb_req_t *req = file->nb_reqs; req; req = req->next)
+        if ((ret = pio_swapm_test(req->xreq, &flag)))
+            return ret;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Complete a nonblocking write of a file (see
+ * PIOc_write_darray_nb()): wait for the rearrangement of the data,
+ * write the data and free the request.
+ *
+ * @param file pointer to the file.
+ * @param req pointer to the request, in the list of the file.
+ * @returns 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+int darray_nb_wait(file_desc_t *file, darray_nb_req_t *req)
+{
+    iosystem_desc_t *ios;
+    int ret;
+
+    assert(file && req);
+    ios = file->iosystem;
+    assert(ios);
+
+    GPTLstart("PIO:darray_nb_wait");
+    LOG((1, "darray_nb_wait ncid = %d request = %d", file->pio_ncid, req->id));
+
+    for (darray_nb_req_t **prev = &file->nb_reqs; *prev; prev = &(*prev)->next)
+        if (*prev == req)
+        {
+            *prev = req->next;
+            break;
+        }
+
+    ret = pio_swapm_wait(req->xreq);
+    ios->nb_rearr_slots &= ~(1ULL << req->slot);
+    req->plan->nusers--;
+
+    /* If the buffer is already in use in pnetcdf we need to flush
+     * first. */
+    if (ret == PIO_NOERR && file->iotype == PIO_IOTYPE_PNETCDF &&
+        file->iobuf[req->ioid - PIO_IODESC_START_ID])
+        ret = flush_output_buffer(file, true, 0);
+
+    /* Write the rearranged data, the file owns the rearranged data
+     * after the write. */
+    if (ret == PIO_NOERR)
+        ret = write_darray_multi(file->pio_ncid, &req->varid, req->ioid, 1, req->arraylen,
+                                 req->array, (req->frame >= 0) ? &req->frame : NULL,
+                                 req->fillvalue, false, true, req->iobuf);
+    else if (req->iobuf)
+        brel(req->iobuf);
+
+    if (req->fillvalue)
+        brel(req->fillvalue);
+    free(req);
+
+    GPTLstop("PIO:darray_nb_wait");
+    return ret;
+}
+
+/**
+ * Complete all the nonblocking writes of a file, oldest first. This
+ * is called from sync_file().
+ *
+ * @param file pointer to the file.
+ * @returns 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+int darray_nb_wait_all(file_desc_t *file)
+{
+    int ret = PIO_NOERR;
+
+    assert(file);
+
+    while (file->nb_reqs)
+    {
+        int ierr = darray_nb_wait(file, file->nb_reqs);
+        if (ret == PIO_NOERR)
+            ret = ierr;
+    }
+
+    return ret;
+}
+
 /**
  * Compute the maximum aggregate number of bytes. This is called by
  * subset_rearrange_create() and box_rearrange_create().
@@ -260,12 +260,15 @@ int PIOc_create(int iosysid, const char *filename, int cmode, int *ncidp)
 
 /* Internal helper function to perform sync operations
  * ncid : the ncid of the file to sync
- * Returns PIO_NOERR for success, error code otherwise
+ * Returns PIO_NOERR for success, PIO_ERANGE if the data flushed had
+ * values out of the range of the types of the variables, error code
+ * otherwise
  */
 static int sync_file(int ncid)
 {
     iosystem_desc_t *ios;  /* Pointer to io system information. */
     file_desc_t *file = NULL;     /* Pointer to file information. */
+    int erange = PIO_NOERR; /* PIO_ERANGE if flushed values were out of range. */
     int ierr = PIO_NOERR;  /* Return code from function calls. */
 
     LOG((1, "sync_file ncid = %d", ncid));
@@ -299,38 +302,25 @@ static int sync_file(int ncid)
     {
         if (file->mode & PIO_WRITE)
         {
-            wmulti_buffer *wmb, *twmb;
-
             LOG((3, "sync_file checking buffers"));
-            wmb = &file->buffer;
-            while (wmb)
-            {
-                /* If there are any data arrays waiting in the
-                 * multibuffer, flush it to IO tasks. */
-                if (wmb->num_arrays > 0)
-                {
-                    spio_ltimer_stop(ios->io_fstats->wr_timer_name);
-                    spio_ltimer_stop(ios->io_fstats->tot_timer_name);
-                    spio_ltimer_stop(file->io_fstats->wr_timer_name);
-                    spio_ltimer_stop(file->io_fstats->tot_timer_name);
-                    flush_buffer(ncid, wmb, false);
-                    spio_ltimer_start(ios->io_fstats->wr_timer_name);
-                    spio_ltimer_start(ios->io_fstats->tot_timer_name);
-                    spio_ltimer_start(file->io_fstats->wr_timer_name);
-                    spio_ltimer_start(file->io_fstats->tot_timer_name);
-                }
-                twmb = wmb;
-                wmb = wmb->next;
-                if (twmb == &file->buffer)
-                {
-                    twmb->ioid = -1;
-                    twmb->next = NULL;
-                }
-                else
-                {
-                    free(twmb);
-                }
-            }
+            /* If there are any data arrays waiting in the
+             * multibuffers, flush them to IO tasks. */
+            spio_ltimer_stop(ios->io_fstats->wr_timer_name);
+            spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+            spio_ltimer_stop(file->io_fstats->wr_timer_name);
+            spio_ltimer_stop(file->io_fstats->tot_timer_name);
+            darray_nb_wait_all(file);
+            /* The values out of the range of the types of the
+             * variables are written as fill values, this is reported
+             * once the file is synced. */
+            if (flush_buffers(ncid, false) == PIO_ERANGE)
+                erange = PIO_ERANGE;
+            spio_ltimer_start(ios->io_fstats->wr_timer_name);
+            spio_ltimer_start(ios->io_fstats->tot_timer_name);
+            spio_ltimer_start(file->io_fstats->wr_timer_name);
+            spio_ltimer_start(file->io_fstats->tot_timer_name);
+
+            pio_free_wmbs(file);
         }
     }
 
@@ -383,6 +373,9 @@ static int sync_file(int ncid)
 #ifdef _PNETCDF
             case PIO_IOTYPE_PNETCDF:
                 ierr = flush_output_buffer(file, true, 0);
+                /* Wait for the data flushed in the background. */
+                if (ierr == PIO_NOERR)
+                    ierr = bg_flush_wait(file);
                 break;
 #endif
             default:
@@ -412,20 +405,23 @@ static int sync_file(int ncid)
     spio_ltimer_stop(ios->io_fstats->tot_timer_name);
     spio_ltimer_stop(file->io_fstats->wr_timer_name);
     spio_ltimer_stop(file->io_fstats->tot_timer_name);
-    return PIO_NOERR;
+    return erange;
 }
 
 /**
  * Close a file previously opened with PIO.
  *
  * @param ncid: the file pointer
- * @returns PIO_NOERR for success, error code otherwise.
+ * @returns PIO_NOERR for success, PIO_ERANGE if the data written
+ * when the file was synced had values out of the range of the types
+ * of the variables (the file is still closed), error code otherwise.
  * @author Jim Edwards, Ed Hartnett
  */
 int PIOc_closefile(int ncid)
 {
     iosystem_desc_t *ios;  /* Pointer to io system information. */
     file_desc_t *file = NULL;     /* Pointer to file information. */
+    int erange = PIO_NOERR; /* PIO_ERANGE if synced values were out of range. */
     int ierr = PIO_NOERR;  /* Return code from function calls. */
 #ifdef _ADIOS2
     char outfilename[PIO_MAX_NAME + 1];
@@ -468,7 +464,8 @@ int PIOc_closefile(int ncid)
     if (!ios->async || !ios->ioproc)
         if (file->mode & PIO_WRITE)
         {
-            sync_file(ncid);
+            if (sync_file(ncid) == PIO_ERANGE)
+                erange = PIO_ERANGE;
         }
 
     if (file->iotype == PIO_IOTYPE_ADIOS)
@@ -805,7 +802,7 @@ int PIOc_closefile(int ncid)
     pio_delete_file_from_list(ncid);
 
     GPTLstop("PIO:PIOc_closefile");
-    return ierr;
+    return (ierr == PIO_NOERR) ? erange : ierr;
 }
 
 /**
@@ -890,12 +887,18 @@ int PIOc_deletefile(int iosysid, const char *filename)
  * PIO interface to nc_sync This routine is called collectively by all
  * tasks in the communicator ios.union_comm.
  *
+ * The data cached for the file is written to disk before this
+ * function returns, including the data being flushed in the
+ * background (see PIOc_set_bg_flush()).
+ *
  * Refer to the <A
  * HREF="http://www.unidata.ucar.edu/software/netcdf/docs/modules.html"
  * target="_blank"> netcdf </A> documentation.
  *
  * @param ncid the ncid of the file to sync.
- * @returns PIO_NOERR for success, error code otherwise.
+ * @returns PIO_NOERR for success, PIO_ERANGE if the data written had
+ * values out of the range of the types of the variables (see
+ * PIOc_write_darray_multi()), error code otherwise.
  * @author Jim Edwards, Ed Hartnett
  */
 int PIOc_sync(int ncid)
@@ -40,7 +40,7 @@
 #define PIO_DATATYPE_NULL MPI_DATATYPE_NULL
 #endif
 
-#include <bget.h>
+#include <pio_arena.h>
 #include <limits.h>
 #include <math.h>
 #ifdef TIMING
@@ -71,6 +71,42 @@ void pio_log(int severity, const char *fmt, ...);
 #define MAX_GATHER_BLOCK_SIZE 0
 #define PIO_REQUEST_ALLOC_CHUNK 16
 
+/** Number of candidate rearranger settings timed by the rearranger
+ * autotuner. */
+#define PIO_REARR_AUTOTUNE_NCANDIDATES 8
+
+/** Minimum average length of the runs of consecutive elements for
+ * the rearranger to pack data run by run (with memcpy) instead of
+ * element by element. */
+#define PIO_REARR_PACK_MIN_RUN 4
+
+/** Size, in bytes, of the segments of the data cached in a write
+ * multi buffer. A segment holds at least one array. */
+#define PIO_WMB_SEG_SIZE (1 << 20)
+
+/** With PIO_FLUSH_POLICY_MODEL, data is flushed before the limit
+ * when the predicted cost per byte of the flush is within this
+ * fraction of the cost per byte of a flush at the limit. */
+#define PIO_FLUSH_MODEL_SLACK 0.1
+
+/** Number of flushes measured before PIO_FLUSH_POLICY_MODEL uses the
+ * fit of their cost. */
+#define PIO_FLUSH_MODEL_MIN_SAMPLES 4
+
+/** Weight of the older flushes in the fit of the cost of the flushes
+ * each time a new flush is measured. */
+#define PIO_FLUSH_MODEL_DECAY 0.9
+
+/** Set to 1 if data can be flushed to disk in the background (see
+ * PIOc_set_bg_flush()). The background flushes wait on the pending
+ * PnetCDF requests in a thread, and are not supported with one-sided
+ * MPI-IO or the micro timers. */
+#if PIO_USE_PTHREADS && defined(_PNETCDF) && !defined(MPIO_ONESIDED) && !defined(PIO_MICRO_TIMING)
+#define PIO_BG_FLUSH 1
+#else
+#define PIO_BG_FLUSH 0
+#endif
+
 /** This is needed to handle _long() functions. It may not be used as
  * a data type when creating attributes or varaibles, it is only used
  * internally. */
@@ -81,6 +117,7 @@ extern "C" {
 #endif
 
     extern PIO_Offset pio_buffer_size_limit;
+    extern PIO_Offset pio_rearr_setup_buffer_limit;
 
     /** Used to sort map points in the subset rearranger. */
     typedef struct mapsort
@@ -90,6 +127,19 @@ extern "C" {
         PIO_Offset iomap;
     } mapsort;
 
+    /** State of the rearranger autotuner for an I/O decomposition. */
+    typedef struct rearr_autotune
+    {
+        /** Index of the candidate setting used for the next
+         * rearrangement. -1 for the first (untimed, warm up)
+         * rearrangement. */
+        int next;
+
+        /** Max time, across all tasks in the rearranger communicator,
+         * spent rearranging data with each candidate setting. */
+        double wtime[PIO_REARR_AUTOTUNE_NCANDIDATES];
+    } rearr_autotune_t;
+
     /** swapm defaults. */
     typedef struct pio_swapm_defaults
     {
@@ -132,12 +182,17 @@ extern "C" {
     void pio_get_env(void);
     int  pio_add_to_iodesc_list(io_desc_t *iodesc, MPI_Comm comm);
     io_desc_t *pio_get_iodesc_from_id(int ioid);
+    io_desc_t *pio_get_iodesc_from_hash(int iosysid, unsigned long long hash);
     int pio_delete_iodesc_from_list(int ioid);
     int pio_num_iosystem(int *niosysid);
 
     int pio_get_file(int ncid, file_desc_t **filep);
+    int pio_get_file_nowait(int ncid, file_desc_t **filep);
     int pio_delete_file_from_list(int ncid);
     int pio_add_to_file_list(file_desc_t *file, MPI_Comm comm);
+    wmulti_buffer *pio_get_wmb(file_desc_t *file, int ioid, int recordvar);
+    int pio_add_wmb(file_desc_t *file, int ioid, int recordvar, wmulti_buffer **wmbp);
+    void pio_free_wmbs(file_desc_t *file);
 
     /* Get a description of the variable represented by varid */
     const char *get_var_desc_str(int ncid, int varid, const char *desc_prefix);
@@ -202,6 +257,7 @@ extern "C" {
 
     /* Create the MPI communicators needed by the subset rearranger. */
     int default_subset_partition(iosystem_desc_t *ios, io_desc_t *iodesc);
+    int volume_subset_partition(iosystem_desc_t *ios, io_desc_t *iodesc);
 
     /* Check return from MPI function and print error message. */
     void CheckMPIReturn(int ierr, const char *file, int line);
@@ -211,11 +267,52 @@ extern "C" {
                   void *recvbuf, int *recvcounts, int *rdispls, MPI_Datatype *recvtypes,
                   MPI_Comm comm, rearr_comm_fc_opt_t *fc);
 
+    /* Start a nonblocking pio_swapm(). */
+    int pio_swapm_start(void *sendbuf, int *sendcounts, int *sdispls, MPI_Datatype *sendtypes,
+                        void *recvbuf, int *recvcounts, int *rdispls, MPI_Datatype *recvtypes,
+                        MPI_Comm comm, rearr_comm_fc_opt_t *fc, int slot,
+                        pio_swapm_req_t **reqp);
+
+    /* Progress a nonblocking pio_swapm(). */
+    int pio_swapm_test(pio_swapm_req_t *req, int *flag);
+
+    /* Complete a nonblocking pio_swapm(). */
+    int pio_swapm_wait(pio_swapm_req_t *req);
+
+    /* Like pio_swapm(), but only iterating over the peers of this task. */
+    int pio_sparse_swapm(void *sendbuf, int *sendcounts, int *sdispls, MPI_Datatype *sendtypes,
+                         void *recvbuf, int *recvcounts, int *rdispls, MPI_Datatype *recvtypes,
+                         MPI_Comm comm, int npeers, const int *peers, rearr_comm_fc_opt_t *fc);
+
+    /* Send values to a sparse set of tasks that do not know the senders (NBX). */
+    int pio_sparse_exchange(int nsend, const int *sendranks, const int *sendvals, MPI_Comm comm,
+                            int *nrecvp, int **recvranksp, int **recvvalsp);
+
+    /* Like pio_swapm(), but using a neighborhood collective on a graph communicator. */
+    int pio_neighbor_swapm(void *sendbuf, int *sendcounts, int *sdispls, MPI_Datatype *sendtypes,
+                           void *recvbuf, int *recvcounts, int *rdispls, MPI_Datatype *recvtypes,
+                           MPI_Comm graph_comm, int nneighbors, const int *neighbors);
+
+    /* Like MPI_Gatherv(), but with displacements that may exceed INT_MAX. */
+    int pio_gatherv_large(const void *sendbuf, int sendcnt, MPI_Datatype type, void *recvbuf,
+                          const int *recvcnts, const PIO_Offset *displs, int root,
+                          MPI_Comm comm);
+
+    /* Like MPI_Scatterv(), but with displacements that may exceed INT_MAX. */
+    int pio_scatterv_large(const void *sendbuf, const int *sendcnts, const PIO_Offset *displs,
+                           MPI_Datatype type, void *recvbuf, int recvcnt, int root,
+                           MPI_Comm comm);
+
     long long lgcd_array(int nain, long long* ain);
 
     void PIO_Offset_size(MPI_Datatype *dtype, int *tsize);
     PIO_Offset GCDblocksize(int arrlen, const PIO_Offset *arr_in);
 
+    /* Pick the IO task ranks and find their layout across the nodes. */
+    int place_iotasks(MPI_Comm comm, int placement, int num_iotasks, int max_per_node,
+                      int *ioranks, int *num_nodes, int *num_io_nodes,
+                      int *max_iotasks_per_node);
+
     /* Initialize the rearranger options. */
     void init_rearr_opts(iosystem_desc_t *iosys);
 
@@ -234,7 +331,7 @@ extern "C" {
                            PIO_Offset *start, PIO_Offset *count);
 
     /* Calculate start and count regions for the subset rearranger. */
-    int get_regions(int ndims, const int *gdimlen, int maplen, const PIO_Offset *map,
+    int get_regions(int ndims, const int *gdimlen, PIO_Offset maplen, const PIO_Offset *map,
                     int *maxregions, io_region *firstregion);
 
     /* Expand a region along dimension dim, by incrementing count[i] as
@@ -263,6 +360,10 @@ extern "C" {
                              int ndim, io_desc_t *iodesc);
 
 
+    /* Create the hierarchical (node-aware) box rearranger. */
+    int box_hier_rearrange_create(iosystem_desc_t *ios, int maplen, const PIO_Offset *compmap,
+                                  const int *gdimlen, int ndims, io_desc_t *iodesc);
+
     /* Move data from IO tasks to compute tasks. */
     int rearrange_io2comp(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf, void *rbuf);
 
@@ -270,13 +371,57 @@ extern "C" {
     int rearrange_comp2io(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf, void *rbuf,
                           int nvars);
 
+    /* Check if a decomposition can be rearranged with others in one exchange. */
+    bool rearr_comp2io_fusable(const iosystem_desc_t *ios, const io_desc_t *iodesc);
+
+    /* Check if the data of a decomposition held in several buffers can be rearranged in one exchange. */
+    bool rearr_comp2io_segmentable(const iosystem_desc_t *ios, const io_desc_t *iodesc);
+
+    /* Move data of several decompositions from compute tasks to IO tasks. */
+    int rearrange_comp2io_fused(iosystem_desc_t *ios, int ndecomps, io_desc_t **iodescs,
+                                void **sbufs, void **rbufs, const int *nvars);
+
+    /* Start moving data from compute tasks to IO tasks, without blocking. */
+    int rearrange_comp2io_start(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf, void *rbuf,
+                                int nvars, int slot, pio_swapm_req_t **reqp,
+                                rearr_comm_plan_t **planp);
+
+    /* Create the neighborhood communicator used by the rearranger. */
+    int create_neighbor_comm(iosystem_desc_t *ios, io_desc_t *iodesc);
+
+    /* Free a list of cached rearranger communication plans. */
+    int free_rearr_comm_plans(rearr_comm_plan_t *plans);
+
+    /* Free a rearranger pack list. */
+    void free_rearr_pack_list(rearr_pack_list_t *list);
+
     /* Allocate and initialize storage for decomposition information. */
     int malloc_iodesc(iosystem_desc_t *ios, int piotype, int ndims, io_desc_t **iodesc);
-    void performance_tune_rearranger(iosystem_desc_t *ios, io_desc_t *iodesc);
+
+    /* Start tuning the rearranger options of a decomposition. */
+    int rearr_autotune_init(io_desc_t *iodesc);
+
+    /* Set the rearranger options to try in the next rearrangement. */
+    int rearr_autotune_begin(iosystem_desc_t *ios, io_desc_t *iodesc, MPI_Comm comm);
+
+    /* Record the time of the last rearrangement, pick the best options when done. */
+    int rearr_autotune_end(iosystem_desc_t *ios, io_desc_t *iodesc, MPI_Comm comm,
+                           double wtime);
 
     /* Flush contents of multi-buffer to disk. */
     int flush_output_buffer(file_desc_t *file, bool force, PIO_Offset addsize);
 
+    /* Is a background flush of a file in flight? */
+
+    /* Wait for the background flush of a file, and get its result. */
+    int bg_flush_wait(file_desc_t *file);
+
+    /* Wait for the background flush of a file, keep its result. */
+    void bg_flush_join(file_desc_t *file);
+
+    /* Wait for the background flush of a file and free its state. */
+    void bg_flush_free(file_desc_t *file);
+
     /* Compute the size that the IO tasks will need to hold the data. */
     int compute_maxIObuffersize(MPI_Comm io_comm, io_desc_t *iodesc);
 
@@ -312,6 +457,9 @@ extern "C" {
                              const int *mcount, int *mfrom, MPI_Datatype *mtype);
     int compare_offsets(const void *a, const void *b) ;
 
+    /* Sort the map points of the subset rearranger on iomap. */
+    int sort_mapsort(mapsort *map, PIO_Offset nmap, const int *runlen, int nruns);
+
     /* Print a trace statement, for debugging. */
     void print_trace (FILE *fp);
 
@@ -323,6 +471,33 @@ extern "C" {
     /* Flush PIO's data buffer. */
     int flush_buffer(int ncid, wmulti_buffer *wmb, bool flushtodisk);
 
+    /* Add a measured flush to the fit of the cost of the flushes. */
+    void pio_cost_fit_add(pio_cost_fit *fit, PIO_Offset bytes, double secs);
+
+    /* Check if flushing now is about as cheap (per byte) as flushing at the limit. */
+    bool pio_cost_fit_flush_now(const pio_cost_fit *fit, PIO_Offset bytes, PIO_Offset limit);
+
+    /* Flush all of PIO's data buffers of a file. */
+    int flush_buffers(int ncid, bool flushtodisk);
+
+    /* Progress the nonblocking writes of a file. */
+    int darray_nb_progress(file_desc_t *file);
+
+    /* Complete a nonblocking write. */
+    int darray_nb_wait(file_desc_t *file, darray_nb_req_t *req);
+
+    /* Complete all the nonblocking writes of a file. */
+    int darray_nb_wait_all(file_desc_t *file);
+
+    /* Allocate the buffer for data rearranged for writing. */
+    int alloc_write_iobuf(file_desc_t *file, io_desc_t *iodesc, int nvars, void *fillvalue,
+                          void **iobufp);
+
+    /* Write multiple arrays, optionally already rearranged. */
+    int write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
+                           PIO_Offset arraylen, void *array, const int *frame,
+                           void **fillvalue, bool flushtodisk, bool rearranged, void *iobuf);
+
     int compute_maxaggregate_bytes(iosystem_desc_t *ios, io_desc_t *iodesc);
 
     /* Compute an element of start/count arrays. */
@@ -337,12 +512,24 @@ extern "C" {
 
     /* Write aggregated arrays to file using parallel I/O (netCDF-4 parallel/pnetcdf) */
     int write_darray_multi_par(file_desc_t *file, int nvars, int fndims, const int *vid,
-                               io_desc_t *iodesc, int fill, const int *frame);
+                               io_desc_t *iodesc, int fill, const void *fillvalue,
+                               const int *frame);
+
+    /* Write aggregated arrays and their fill values to file in one pnetcdf request per var */
+    int write_darray_multi_par_fill(file_desc_t *file, int nvars, int fndims, const int *vid,
+                                    io_desc_t *iodesc, const void *fillvalue, const int *frame);
 
     /* Write aggregated arrays to file using serial I/O (netCDF-3/netCDF-4 serial) */
     int write_darray_multi_serial(file_desc_t *file, int nvars, int fndims, const int *vid,
                                   io_desc_t *iodesc, int fill, const int *frame);
 
+    /* Check if data can be converted between two types with pio_convert(). */
+    bool pio_convert_supported(int from_type, int to_type);
+
+    /* Convert data from one numeric type to another. */
+    int pio_convert(int from_type, int to_type, const void *src, void *dst, PIO_Offset n,
+                    const void *src_fill, const void *dst_fill, PIO_Offset *nerange);
+
     int pio_read_darray_nc(file_desc_t *file, int fndims, io_desc_t *iodesc, int vid, void *iobuf);
     int pio_read_darray_nc_serial(file_desc_t *file, int fndims, io_desc_t *iodesc, int vid, void *iobuf);
 
@@ -77,6 +77,11 @@ int pio_add_to_file_list(file_desc_t *file, MPI_Comm comm)
  * Given ncid, find the file_desc_t data for an open file. The ncid
  * used is the interally generated pio_ncid.
  *
+ * If the file is being flushed to disk in the background (see
+ * PIOc_set_bg_flush()) this function waits for the flush to
+ * complete, so that the caller can access the file. Any error from
+ * the flush is reported by the next flush (or sync) of the file.
+ *
  * @param ncid the PIO assigned ncid of the open file.
  * @param cfile1 pointer to a pointer to a file_desc_t. The pointer
  * will get a copy of the pointer to the file info.
@@ -85,6 +90,31 @@ int pio_add_to_file_list(file_desc_t *file, MPI_Comm comm)
  * @author Ed Hartnett
  */
 int pio_get_file(int ncid, file_desc_t **cfile1)
+{
+    int ret;
+
+    if ((ret = pio_get_file_nowait(ncid, cfile1)))
+        return ret;
+
+    bg_flush_join(*cfile1);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Given ncid, find the file_desc_t data for an open file, without
+ * waiting for a flush of the file running in the background. Only
+ * for the functions that cache or rearrange data, they must wait for
+ * the flush with bg_flush_join() before they access the file in the
+ * underlying library.
+ *
+ * @param ncid the PIO assigned ncid of the open file.
+ * @param cfile1 pointer to a pointer to a file_desc_t. The pointer
+ * will get a copy of the pointer to the file info.
+ *
+ * @returns 0 for success, error code otherwise.
+ */
+int pio_get_file_nowait(int ncid, file_desc_t **cfile1)
 {
     file_desc_t *cfile = NULL;
 
@@ -159,6 +189,8 @@ int pio_delete_file_from_list(int ncid)
 #endif
             }
 
+            bg_flush_free(cfile);
+            pio_free_wmbs(cfile);
             free(cfile->unlim_dimids);
             free(cfile->io_fstats);
             /* Free the memory used for this file. */
@@ -173,6 +205,108 @@ int pio_delete_file_from_list(int ncid)
     return PIO_EBADID;
 }
 
+/**
+ * Find the write multi buffer of a file for a decomposition.
+ *
+ * @param file pointer to the file.
+ * @param ioid the ID of the decomposition.
+ * @param recordvar non-zero for the buffer of the record variables.
+ * @returns pointer to the buffer, NULL if the file has no buffer for
+ * the decomposition.
+ */
+wmulti_buffer *pio_get_wmb(file_desc_t *file, int ioid, int recordvar)
+{
+    int idx = 2 * (ioid - PIO_IODESC_START_ID) + (recordvar ? 1 : 0);
+
+    assert(file);
+
+    if (idx < 0 || idx >= file->wmb_table_len)
+        return NULL;
+
+    return file->wmb_table[idx];
+}
+
+/**
+ * Add a write multi buffer for a decomposition to a file. The new
+ * buffer is empty and is flushed after the buffers created before it.
+ *
+ * @param file pointer to the file.
+ * @param ioid the ID of the decomposition.
+ * @param recordvar non-zero for the buffer of the record variables.
+ * @param wmbp pointer that gets the new buffer.
+ * @returns 0 for success, error code otherwise.
+ */
+int pio_add_wmb(file_desc_t *file, int ioid, int recordvar, wmulti_buffer **wmbp)
+{
+    int idx = 2 * (ioid - PIO_IODESC_START_ID) + (recordvar ? 1 : 0);
+    wmulti_buffer *wmb;
+
+    assert(file && wmbp && !pio_get_wmb(file, ioid, recordvar));
+
+    if (idx < 0 || idx >= 2 * PIO_IODESC_MAX_IDS)
+        return PIO_EINVAL;
+
+    /* Grow the lookup table to cover this decomposition. The ids of
+     * the decompositions are handed out in increasing order, so the
+     * table is doubled to keep the number of reallocations low. */
+    if (idx >= file->wmb_table_len)
+    {
+        int len = max(idx + 1, 2 * file->wmb_table_len);
+        wmulti_buffer **table;
+
+        if (!(table = realloc(file->wmb_table, len * sizeof(wmulti_buffer *))))
+            return PIO_ENOMEM;
+        for (int i = file->wmb_table_len; i < len; i++)
+            table[i] = NULL;
+        file->wmb_table = table;
+        file->wmb_table_len = len;
+    }
+
+    if (file->nwmbs == file->wmbs_size)
+    {
+        int size = max(8, 2 * file->wmbs_size);
+        wmulti_buffer **wmbs;
+
+        if (!(wmbs = realloc(file->wmbs, size * sizeof(wmulti_buffer *))))
+            return PIO_ENOMEM;
+        file->wmbs = wmbs;
+        file->wmbs_size = size;
+    }
+
+    if (!(wmb = calloc(1, sizeof(wmulti_buffer))))
+        return PIO_ENOMEM;
+    wmb->ioid = ioid;
+    wmb->recordvar = recordvar;
+
+    file->wmbs[file->nwmbs++] = wmb;
+    file->wmb_table[idx] = wmb;
+    *wmbp = wmb;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Free the write multi buffers of a file. The data cached in the
+ * buffers must have been flushed (or released) before.
+ *
+ * @param file pointer to the file.
+ */
+void pio_free_wmbs(file_desc_t *file)
+{
+    assert(file);
+
+    for (int i = 0; i < file->nwmbs; i++)
+        free(file->wmbs[i]);
+    free(file->wmbs);
+    file->wmbs = NULL;
+    file->nwmbs = 0;
+    file->wmbs_size = 0;
+
+    free(file->wmb_table);
+    file->wmb_table = NULL;
+    file->wmb_table_len = 0;
+}
+
 /** 
  * Delete iosystem info from list.
  *
@@ -364,6 +498,23 @@ io_desc_t *pio_get_iodesc_from_id(int ioid)
     return ciodesc;
 }
 
+/**
+ * Find an iodesc created on an iosystem with a given hash of its
+ * creation arguments (see PIOc_InitDecomp()).
+ *
+ * @param iosysid the ID of the iosystem.
+ * @param hash the hash of the arguments used to create the iodesc.
+ * @returns pointer to the iodesc struct, NULL if not found.
+ */
+io_desc_t *pio_get_iodesc_from_hash(int iosysid, unsigned long long hash)
+{
+    for (io_desc_t *ciodesc = pio_iodesc_list; ciodesc; ciodesc = ciodesc->next)
+        if (ciodesc->iosysid == iosysid && ciodesc->dedup_hash == hash)
+            return ciodesc;
+
+    return NULL;
+}
+
 /** 
  * Delete an iodesc.
  *
@@ -43,6 +43,10 @@ const char *pio_rearr_comm_type_to_string(int comm_type)
                               return "PIO_REARR_COMM_P2P";
     case PIO_REARR_COMM_COLL:
                               return "PIO_REARR_COMM_COLL";
+    case PIO_REARR_COMM_NEIGHBOR:
+                              return "PIO_REARR_COMM_NEIGHBOR";
+    case PIO_REARR_COMM_SPARSE:
+                              return "PIO_REARR_COMM_SPARSE";
     default:
                               return "UNKNOWN";
   }
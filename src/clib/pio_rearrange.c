@@ -7,6 +7,33 @@
 #include <pio.h>
 #include <pio_internal.h>
 
+/** The limit (in bytes) on the scratch memory used to find the
+ * destination of each data element while creating the box
+ * rearranger. */
+PIO_Offset pio_rearr_setup_buffer_limit = 8388608;
+
+/**
+ * Set the limit on the scratch memory used to find the destination IO
+ * task of each data element while creating the box rearranger. The
+ * decomposition map is processed in chunks that fit in this limit.
+ *
+ * The limit only applies to decompositions created after the setting
+ * is changed.
+ *
+ * @param limit the size (in bytes) of the scratch memory.
+ * @return The previous limit setting.
+ */
+PIO_Offset PIOc_set_rearr_setup_buffer_limit(PIO_Offset limit)
+{
+    PIO_Offset oldsize = pio_rearr_setup_buffer_limit;
+
+    /* If the user passed a valid size, use it. */
+    if (limit > 0)
+        pio_rearr_setup_buffer_limit = limit;
+
+    return oldsize;
+}
+
 /**
  * Internal library util function to initialize rearranger
  * options. This is used in PIOc_Init_Intracomm().
@@ -298,12 +325,26 @@ int create_mpi_datatypes(MPI_Datatype mpitype, int msgcnt,
                          MPI_Datatype *mtype)
 {
     int blocksize;
-    int numinds = 0;
+    PIO_Offset numinds = 0;
     int mpierr; /* Return code from MPI functions. */
+#if PIO_USE_MPISERIAL
+    /* Displacements in elements of mpitype. */
+    typedef int displ_t;
+    MPI_Aint extent = 1;
+#else
+    /* Displacements in bytes, so the indices can exceed INT_MAX. */
+    typedef MPI_Aint displ_t;
+    MPI_Aint lb, extent;
+#endif /* PIO_USE_MPISERIAL */
 
     /* Check inputs. */
     pioassert(msgcnt > 0 && mcount, "invalid input", __FILE__, __LINE__);
 
+#if !PIO_USE_MPISERIAL
+    if ((mpierr = MPI_Type_get_extent(mpitype, &lb, &extent)))
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+#endif /* !PIO_USE_MPISERIAL */
+
     PIO_Offset bsizeT[msgcnt];
 
     LOG((1, "create_mpi_datatypes mpitype = %d msgcnt = %d", mpitype, msgcnt));
@@ -313,11 +354,11 @@ int create_mpi_datatypes(MPI_Datatype mpitype, int msgcnt,
     /* How many indicies in the array? */
     for (int j = 0; j < msgcnt; j++)
         numinds += mcount[j];
-    LOG((2, "numinds = %d", numinds));
+    LOG((2, "numinds = %lld", (long long)numinds));
 
     bsizeT[0] = 0;
     mtype[0] = PIO_DATATYPE_NULL;
-    int pos = 0;
+    PIO_Offset pos = 0;
     int ii = 0;
 
     /* Determine the blocksize. This is done differently for the
@@ -352,16 +393,16 @@ int create_mpi_datatypes(MPI_Datatype mpitype, int msgcnt,
         if (mcount[i] > 0)
         {
             int len = mcount[i] / blocksize;
-            int *displace = NULL;
+            displ_t *displace = NULL;
             LOG((3, "blocksize = %d i = %d mcount[%d] = %d len = %d", blocksize, i, i,
                  mcount[i], len));
 
             if (len > 0)
             {
-                if (!(displace = calloc(len, sizeof(int))))
+                if (!(displace = calloc(len, sizeof(displ_t))))
                 {
                     return pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__,
-                                    "Creating MPI datatypes to rearrange data from/to compute processes to/from io processes failed. Out of memory allocating %lld bytes to store displacements", (unsigned long long) (len * sizeof(int)));
+                                    "Creating MPI datatypes to rearrange data from/to compute processes to/from io processes failed. Out of memory allocating %lld bytes to store displacements", (unsigned long long) (len * sizeof(displ_t)));
                 }
             }
 
@@ -371,34 +412,38 @@ int create_mpi_datatypes(MPI_Datatype mpitype, int msgcnt,
                 {
                     /* Box rearranger. */
                     for (int j = 0; j < len; j++)
-                        displace[j] = (int)(mindex[pos + j]);
+                        displace[j] = (displ_t)(mindex[pos + j] * extent);
                 }
                 else
                 {
                     /* Subset rearranger. */
                     int k = 0;
-                    for (int j = 0; j < numinds; j++)
+                    for (PIO_Offset j = 0; j < numinds; j++)
                         if (mfrom[j] == i)
-                            displace[k++] = (int)(mindex[j]);
+                            displace[k++] = (displ_t)(mindex[j] * extent);
                 }
 
             }
             else
             {
                 for (int j = 0; j < len; j++)
-                    displace[j] = (int)(mindex[pos + j * blocksize]);
+                    displace[j] = (displ_t)(mindex[pos + j * blocksize] * extent);
             }
 
 #if PIO_ENABLE_LOGGING
             for (int j = 0; j < len; j++)
-                LOG((3, "displace[%d] = %d", j, displace[j]));
+                LOG((3, "displace[%d] = %lld", j, (long long)displace[j]));
 #endif /* PIO_ENABLE_LOGGING */
 
-            LOG((3, "calling MPI_Type_create_indexed_block len = %d blocksize = %d "
+            LOG((3, "creating indexed block type len = %d blocksize = %d "
                  "mpitype = %d", len, blocksize, mpitype));
             /* Create an indexed datatype with constant-sized blocks. */
-            if ((mpierr = MPI_Type_create_indexed_block(len, blocksize, displace,
-                                                        mpitype, &mtype[i])))
+#if PIO_USE_MPISERIAL
+            mpierr = MPI_Type_create_indexed_block(len, blocksize, displace, mpitype, &mtype[i]);
+#else
+            mpierr = MPI_Type_create_hindexed_block(len, blocksize, displace, mpitype, &mtype[i]);
+#endif /* PIO_USE_MPISERIAL */
+            if (mpierr)
                 return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
 
             free(displace);
@@ -530,6 +575,124 @@ int define_iodesc_datatypes(iosystem_desc_t *ios, io_desc_t *iodesc)
     return PIO_NOERR;
 }
 
+/**
+ * Send the nonzero iodesc->scount entries of each compute task to the
+ * IO tasks, for the PIO_REARR_COMM_SPARSE comm type. Unlike the
+ * pio_swapm() call in compute_counts(), which involves every pair of
+ * compute and IO tasks, the IO tasks discover the compute tasks that
+ * send them data with pio_sparse_exchange(), so the cost depends on
+ * the number of IO tasks each compute task sends data to.
+ *
+ * This function is collective across ios->union_comm.
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param recv_buf array (length ios->num_comptasks, initialized to 0)
+ * that gets, on IO tasks, the scount from each compute task. Ignored
+ * on other tasks.
+ * @returns 0 on success, error code otherwise.
+ */
+static int exchange_scount_sparse(iosystem_desc_t *ios, io_desc_t *iodesc, int *recv_buf)
+{
+    int nsend = 0;
+    int nrecv;
+    int *recvranks = NULL;
+    int *recvvals = NULL;
+    int ierr;
+
+    pioassert(ios && iodesc && iodesc->scount && (!ios->ioproc || recv_buf),
+              "invalid input", __FILE__, __LINE__);
+
+    int sendranks[ios->num_iotasks];
+    int sendvals[ios->num_iotasks];
+
+    if (ios->compproc)
+    {
+        for (int i = 0; i < ios->num_iotasks; i++)
+        {
+            if (iodesc->scount[i] > 0)
+            {
+                sendranks[nsend] = ios->ioranks[i];
+                sendvals[nsend] = iodesc->scount[i];
+                nsend++;
+            }
+        }
+    }
+
+    if ((ierr = pio_sparse_exchange(nsend, sendranks, sendvals, ios->union_comm,
+                                    &nrecv, &recvranks, &recvvals)))
+        return ierr;
+
+    if (ios->ioproc && nrecv > 0)
+    {
+        /* Index of each compute task, by its rank in union_comm. */
+        int comp_index[ios->num_uniontasks];
+
+        for (int i = 0; i < ios->num_uniontasks; i++)
+            comp_index[i] = -1;
+        for (int i = 0; i < ios->num_comptasks; i++)
+            comp_index[ios->compranks[i]] = i;
+
+        for (int i = 0; i < nrecv; i++)
+        {
+            int c = comp_index[recvranks[i]];
+
+            pioassert(c >= 0, "data received from a task that is not a compute task",
+                      __FILE__, __LINE__);
+            recv_buf[c] = recvvals[i];
+        }
+    }
+
+    free(recvranks);
+    free(recvvals);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Set up a message of count MPI_OFFSET elements, starting at element
+ * pos of the buffer, for pio_swapm(). pio_swapm() takes the
+ * displacements in bytes as int. If the byte displacement is larger
+ * than INT_MAX, the displacement is moved into a derived datatype
+ * (one block of count elements) that is sent/received once from the
+ * start of the buffer. The message is the same sequence of elements
+ * either way, so the other side does not need to know.
+ *
+ * @param pos the offset of the message in the buffer, in elements.
+ * @param count pointer to the number of elements, set to 1 if a
+ * derived datatype is created.
+ * @param displ pointer that gets the displacement in bytes.
+ * @param type pointer that gets the datatype (MPI_OFFSET, or a
+ * derived datatype that must be freed by the caller).
+ * @returns 0 on success, error code otherwise.
+ */
+static int offset_msg(PIO_Offset pos, int *count, int *displ, MPI_Datatype *type)
+{
+    MPI_Aint bdispl = (MPI_Aint)pos * SIZEOF_MPI_OFFSET;
+    int mpierr;
+
+    *displ = 0;
+    *type = MPI_OFFSET;
+    if (bdispl <= INT_MAX)
+    {
+        *displ = (int)bdispl;
+        return PIO_NOERR;
+    }
+
+#if PIO_USE_MPISERIAL
+    return pio_err(NULL, NULL, PIO_EINVAL, __FILE__, __LINE__,
+                    "Setting up the exchange of offsets/indices failed. The displacement (%lld bytes) is too large", (long long)bdispl);
+#else
+    if ((mpierr = MPI_Type_create_hindexed(1, count, &bdispl, MPI_OFFSET, type)))
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Type_commit(type)))
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    *count = 1;
+
+    return PIO_NOERR;
+#endif /* PIO_USE_MPISERIAL */
+}
+
 /**
  * Completes the mapping for the box rearranger. This function is
  * called from box_rearrange_create(). It is not used for the subset
@@ -662,9 +825,13 @@ int compute_counts(iosystem_desc_t *ios, io_desc_t *iodesc,
     LOG((2, "about to share scount from each compute task to all IO tasks."));
     /* Share the iodesc->scount from each compute task to all IO
      * tasks. The scounts will end up in array recv_buf. */
-    if ((ierr = pio_swapm(iodesc->scount, send_counts, send_displs, sr_types,
-                          recv_buf, recv_counts, recv_displs, sr_types, ios->union_comm,
-                          &iodesc->rearr_opts.comp2io)))
+    if (iodesc->rearr_opts.comm_type == PIO_REARR_COMM_SPARSE)
+        ierr = exchange_scount_sparse(ios, iodesc, recv_buf);
+    else
+        ierr = pio_swapm(iodesc->scount, send_counts, send_displs, sr_types,
+                         recv_buf, recv_counts, recv_displs, sr_types, ios->union_comm,
+                         &iodesc->rearr_opts.comp2io);
+    if (ierr)
     {
         return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
                         "Calculating the amount/offset of data transferred between compute and I/O processes failed. pio_swapm() call failed to transfer the amount of data transferred between compute and I/O processes");
@@ -725,7 +892,7 @@ int compute_counts(iosystem_desc_t *ios, io_desc_t *iodesc,
     LOG((2, "iodesc->ndof = %d ios->num_iotasks = %d", iodesc->ndof, ios->num_iotasks));
 
     int tempcount[ios->num_iotasks];
-    int spos[ios->num_iotasks];
+    PIO_Offset spos[ios->num_iotasks];
 
     /* ??? */
     spos[0] = 0;
@@ -734,16 +901,16 @@ int compute_counts(iosystem_desc_t *ios, io_desc_t *iodesc,
     {
         spos[i] = spos[i - 1] + iodesc->scount[i - 1];
         tempcount[i] = 0;
-        LOG((3, "spos[%d] = %d tempcount[%d] = %d", i, spos[i], i, tempcount[i]));
+        LOG((3, "spos[%d] = %lld tempcount[%d] = %d", i, spos[i], i, tempcount[i]));
     }
 
     /* ??? */
     for (int i = 0; i < iodesc->ndof; i++)
     {
         int iorank;
-        int ioindex;
+        PIO_Offset ioindex;
 
-        LOG((3, "dest_ioproc[%d] = %d dest_ioindex[%d] = %d", i, dest_ioproc[i], i,
+        LOG((3, "dest_ioproc[%d] = %d dest_ioindex[%d] = %lld", i, dest_ioproc[i], i,
              dest_ioindex[i]));
         iorank = dest_ioproc[i];
         ioindex = dest_ioindex[i];
@@ -754,18 +921,23 @@ int compute_counts(iosystem_desc_t *ios, io_desc_t *iodesc,
 
             s2rindex[spos[iorank] + tempcount[iorank]] = ioindex;
             (tempcount[iorank])++;
-            LOG((3, "iorank = %d ioindex = %d tempcount[iorank] = %d", iorank, ioindex,
+            LOG((3, "iorank = %d ioindex = %lld tempcount[iorank] = %d", iorank, ioindex,
                  tempcount[iorank]));
         }
     }
 
-    /* Initialize arrays to zeros. */
+    /* Initialize arrays to zeros. The offsets/indices are exchanged
+     * as MPI_OFFSET. */
+    MPI_Datatype send_types[ios->num_uniontasks];
+    MPI_Datatype recv_types[ios->num_uniontasks];
     for (int i = 0; i < ios->num_uniontasks; i++)
     {
         send_counts[i] = 0;
         send_displs[i] = 0;
         recv_counts[i] = 0;
         recv_displs[i] = 0;
+        send_types[i] = MPI_OFFSET;
+        recv_types[i] = MPI_OFFSET;
     }
 
     /* ??? */
@@ -775,33 +947,33 @@ int compute_counts(iosystem_desc_t *ios, io_desc_t *iodesc,
          * each IO task. */
         send_counts[ios->ioranks[i]] = iodesc->scount[i];
         if (send_counts[ios->ioranks[i]] > 0)
-            send_displs[ios->ioranks[i]] = spos[i] * SIZEOF_MPI_OFFSET;
-        LOG((3, "ios->ioranks[i] = %d iodesc->scount[%d] = %d spos[%d] = %d",
+            if ((ierr = offset_msg(spos[i], &send_counts[ios->ioranks[i]],
+                                   &send_displs[ios->ioranks[i]], &send_types[ios->ioranks[i]])))
+                return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                                "Calculating the amount/offset of data transferred between compute and I/O processes failed. Setting up the exchange of offset/index of data failed");
+        LOG((3, "ios->ioranks[i] = %d iodesc->scount[%d] = %d spos[%d] = %lld",
              ios->ioranks[i], i, iodesc->scount[i], i, spos[i]));
     }
 
     /* Only do this on IO tasks. */
     if (ios->ioproc)
     {
-        int totalrecv = 0;
+        PIO_Offset totalrecv = 0;
         for (int i = 0; i < nrecvs; i++)
         {
             recv_counts[iodesc->rfrom[i]] = iodesc->rcount[i];
-            totalrecv += iodesc->rcount[i];
-        }
-
-        recv_displs[0] = 0;
-        for (int i = 1; i < nrecvs; i++)
-        {
-            recv_displs[iodesc->rfrom[i]] = recv_displs[iodesc->rfrom[i - 1]] +
-                iodesc->rcount[i - 1] * SIZEOF_MPI_OFFSET;
+            if ((ierr = offset_msg(totalrecv, &recv_counts[iodesc->rfrom[i]],
+                                   &recv_displs[iodesc->rfrom[i]], &recv_types[iodesc->rfrom[i]])))
+                return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                                "Calculating the amount/offset of data transferred between compute and I/O processes failed. Setting up the exchange of offset/index of data failed");
             LOG((3, "iodesc->rfrom[%d] = %d recv_displs[iodesc->rfrom[i]] = %d", i,
                  iodesc->rfrom[i], recv_displs[iodesc->rfrom[i]]));
+            totalrecv += iodesc->rcount[i];
         }
 
         /* rindex is an array of the indices of the data to be sent from
            this io task to each compute task. */
-        LOG((3, "totalrecv = %d", totalrecv));
+        LOG((3, "totalrecv = %lld", totalrecv));
         if (totalrecv > 0)
         {
             if (!(iodesc->rindex = calloc(totalrecv, sizeof(PIO_Offset))))
@@ -813,17 +985,24 @@ int compute_counts(iosystem_desc_t *ios, io_desc_t *iodesc,
         }
     }
 
-    /* For the swapm call below, init the types to MPI_OFFSET. */
-    for (int i = 0; i < ios->num_uniontasks; i++)
-        sr_types[i] = MPI_OFFSET;
-
     /* Here we are sending the mapping from the index on the compute
      * task to the index on the io task. */
     /* s2rindex is the list of indeces on each compute task */
     LOG((3, "sending mapping"));
-    if ((ierr = pio_swapm(s2rindex, send_counts, send_displs, sr_types, iodesc->rindex,
-                          recv_counts, recv_displs, sr_types, ios->union_comm,
-                          &iodesc->rearr_opts.comp2io)))
+    ierr = pio_swapm(s2rindex, send_counts, send_displs, send_types, iodesc->rindex,
+                     recv_counts, recv_displs, recv_types, ios->union_comm,
+                     &iodesc->rearr_opts.comp2io);
+
+    /* Free the datatypes created for large displacements. */
+    for (int i = 0; i < ios->num_uniontasks; i++)
+    {
+        if (send_types[i] != MPI_OFFSET)
+            MPI_Type_free(&send_types[i]);
+        if (recv_types[i] != MPI_OFFSET)
+            MPI_Type_free(&recv_types[i]);
+    }
+
+    if (ierr)
     {
         return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
                         "Calculating the amount/offset of data transferred between compute and I/O processes failed. pio_swapm() call failed to exchange offset/index of data transferred.");
@@ -836,273 +1015,116 @@ int compute_counts(iosystem_desc_t *ios, io_desc_t *iodesc,
 }
 
 /**
- * Moves data from compute tasks to IO tasks. This is called from
- * PIOc_write_darray_multi().
+ * Find the neighbors of this task for the rearranger, the IO tasks
+ * that it sends data to (iodesc->scount) and the compute tasks it
+ * receives data from (iodesc->rfrom/rcount). The ranks of the
+ * neighbors, in the communicator used by the rearranger, are stored
+ * in iodesc->neighbors (sorted) and their number in
+ * iodesc->nneighbors.
  *
  * @param ios pointer to the iosystem_desc_t struct.
  * @param iodesc a pointer to the io_desc_t struct.
- * @param sbuf send buffer. May be NULL.
- * @param rbuf receive buffer. May be NULL.
- * @param nvars number of variables.
+ * @param mycomm the communicator used by the rearranger.
+ * @param niotasks number of IO tasks in mycomm.
  * @returns 0 on success, error code otherwise.
- * @author Jim Edwards
  */
-int rearrange_comp2io(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf,
-                      void *rbuf, int nvars)
+static int find_rearr_neighbors(iosystem_desc_t *ios, io_desc_t *iodesc, MPI_Comm mycomm,
+                                int niotasks)
 {
-    int ntasks;       /* Number of tasks in communicator. */
-    int niotasks;     /* Number of IO tasks. */
-    MPI_Comm mycomm;  /* Communicator that data is transferred over. */
+    int ntasks;       /* Number of tasks in mycomm. */
+    bool *is_neighbor;
     int mpierr;       /* Return code from MPI calls. */
-    int ret;
-
-    GPTLstart("PIO:rearrange_comp2io");
-
-    /* Caller must provide these. */
-    pioassert(ios && iodesc && nvars > 0, "invalid input", __FILE__, __LINE__);
-
-    LOG((1, "rearrange_comp2io nvars = %d iodesc->rearranger = %d", nvars,
-         iodesc->rearranger));
-
-    /* Different rearraangers use different communicators. */
-    if (iodesc->rearranger == PIO_REARR_BOX)
-    {
-        mycomm = ios->union_comm;
-        niotasks = ios->num_iotasks;
-    }
-    else
-    {
-        mycomm = iodesc->subset_comm;
-        niotasks = 1;
-    }
 
-    /* Get the number of tasks. */
     if ((mpierr = MPI_Comm_size(mycomm, &ntasks)))
-    {
-        GPTLstop("PIO:rearrange_comp2io");
         return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-    }
-
-    /* These are parameters to pio_swapm to send data from compute to
-     * IO tasks. */
-    int sendcounts[ntasks];
-    int recvcounts[ntasks];
-    int sdispls[ntasks];
-    int rdispls[ntasks];
-    MPI_Datatype sendtypes[ntasks];
-    MPI_Datatype recvtypes[ntasks];
-
-    /* Initialize pio_swapm parameter arrays. */
-    for (int i = 0; i < ntasks; i++)
-    {
-        sendcounts[i] = 0;
-        recvcounts[i] = 0;
-        sdispls[i] = 0;
-        rdispls[i] = 0;
-        recvtypes[i] = PIO_DATATYPE_NULL;
-        sendtypes[i] =  PIO_DATATYPE_NULL;
-    }
-    LOG((3, "ntasks = %d iodesc->mpitype_size = %d niotasks = %d", ntasks,
-         iodesc->mpitype_size, niotasks));
 
-    /* If it has not already been done, define the MPI data types that
-     * will be used for this io_desc_t. */
-    if ((ret = define_iodesc_datatypes(ios, iodesc)))
+    if (!(is_neighbor = calloc(ntasks, sizeof(bool))))
     {
-        GPTLstop("PIO:rearrange_comp2io");
-        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
-                        "Rearranging data from compute to I/O processes failed. Defining MPI datatypes for rearranging data failed");
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                        "Creating neighborhood communicator for the rearranger failed. Out of memory allocating %lld bytes for neighbor flags", (long long int) (ntasks * sizeof(bool)));
     }
 
-    /* If this io proc, we need to exchange data with compute
-     * tasks. Create a MPI DataType for that exchange. */
-    LOG((2, "ios->ioproc %d iodesc->nrecvs = %d", ios->ioproc, iodesc->nrecvs));
-    if (ios->ioproc && iodesc->nrecvs > 0)
+    /* IO tasks that this compute task sends data to. */
+    if ((!ios->async || ios->compproc) && iodesc->scount)
     {
-        for (int i = 0; i < iodesc->nrecvs; i++)
+        for (int i = 0; i < niotasks; i++)
         {
-            if (iodesc->rtype[i] != PIO_DATATYPE_NULL)
+            if (iodesc->scount[i] > 0)
             {
-                LOG((3, "iodesc->rtype[%d] = %d iodesc->rearranger = %d", i, iodesc->rtype[i],
-                        iodesc->rearranger));
-                if (iodesc->rearranger == PIO_REARR_SUBSET)
-                {
-                    LOG((3, "exchanging data for subset rearranger"));
-                    recvcounts[i] = 1;
-
-                    /*  Create an MPI derived data type from equally
-                     *  spaced blocks of the same size. The block size
-                     *  is 1, the stride here is the length of the
-                     *  collected array (llen). */
-#if PIO_USE_MPISERIAL
-                    if ((mpierr = MPI_Type_hvector(nvars, 1, (MPI_Aint)iodesc->llen * iodesc->mpitype_size,
-                                                   iodesc->rtype[i], &recvtypes[i])))
-                    {
-                        GPTLstop("PIO:rearrange_comp2io");
-                        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-                    }
-#else
-                    if ((mpierr = MPI_Type_create_hvector(nvars, 1, (MPI_Aint)iodesc->llen * iodesc->mpitype_size,
-                                                          iodesc->rtype[i], &recvtypes[i])))
-                    {
-                        GPTLstop("PIO:rearrange_comp2io");
-                        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-                    }
-#endif /* PIO_USE_MPISERIAL */
-                    pioassert(recvtypes[i] != PIO_DATATYPE_NULL, "bad mpi type", __FILE__, __LINE__);
-
-                    if ((mpierr = MPI_Type_commit(&recvtypes[i])))
-                    {
-                        GPTLstop("PIO:rearrange_comp2io");
-                        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-                    }
-                }
-                else
-                {
-                    recvcounts[iodesc->rfrom[i]] = 1;
-                    LOG((3, "exchanging data for box rearranger i = %d iodesc->rfrom[i] = %d "
-                         "recvcounts[iodesc->rfrom[i]] = %d", i, iodesc->rfrom[i],
-                         recvcounts[iodesc->rfrom[i]]));
-
-#if PIO_USE_MPISERIAL
-                    if ((mpierr = MPI_Type_hvector(nvars, 1, (MPI_Aint)iodesc->llen * iodesc->mpitype_size,
-                                                   iodesc->rtype[i], &recvtypes[iodesc->rfrom[i]])))
-                    {
-                        GPTLstop("PIO:rearrange_comp2io");
-                        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-                    }
-#else
-                    if ((mpierr = MPI_Type_create_hvector(nvars, 1, (MPI_Aint)iodesc->llen * iodesc->mpitype_size,
-                                                          iodesc->rtype[i], &recvtypes[iodesc->rfrom[i]])))
-                    {
-                        GPTLstop("PIO:rearrange_comp2io");
-                        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-                    }
-#endif /* PIO_USE_MPISERIAL */
-                    pioassert(recvtypes[iodesc->rfrom[i]] != PIO_DATATYPE_NULL,  "bad mpi type",
-                              __FILE__, __LINE__);
-
-                    if ((mpierr = MPI_Type_commit(&recvtypes[iodesc->rfrom[i]])))
-                    {
-                        GPTLstop("PIO:rearrange_comp2io");
-                        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-                    }
-
-                    rdispls[iodesc->rfrom[i]] = 0;
-                }
+                int io_comprank = (iodesc->rearranger == PIO_REARR_SUBSET) ? 0 : ios->ioranks[i];
+                is_neighbor[io_comprank] = true;
             }
         }
     }
 
-    /* On compute tasks loop over iotasks and create a data type for
-     * each exchange.  */
-    if(!ios->async || ios->compproc)
+    /* Compute tasks that this IO task receives data from. */
+    if (ios->ioproc && iodesc->rcount)
     {
-        for (int i = 0; i < niotasks; i++)
+        for (int i = 0; i < iodesc->nrecvs; i++)
         {
-            int io_comprank = ios->ioranks[i];
-            LOG((3, "ios->ioranks[%d] = %d", i, ios->ioranks[i]));
-            if (iodesc->rearranger == PIO_REARR_SUBSET)
-                io_comprank = 0;
-
-            LOG((3, "i = %d iodesc->scount[i] = %d", i, iodesc->scount[i]));
-            if (iodesc->scount[i] > 0 && sbuf)
-            {
-                LOG((3, "io task %d creating sendtypes[%d]", i, io_comprank));
-                sendcounts[io_comprank] = 1;
-    #if PIO_USE_MPISERIAL
-                if ((mpierr = MPI_Type_hvector(nvars, 1, (MPI_Aint)iodesc->ndof * iodesc->mpitype_size,
-                                               iodesc->stype[i], &sendtypes[io_comprank])))
-                {
-                    GPTLstop("PIO:rearrange_comp2io");
-                    return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-                }
-    #else
-                if ((mpierr = MPI_Type_create_hvector(nvars, 1, (MPI_Aint)iodesc->ndof * iodesc->mpitype_size,
-                                                      iodesc->stype[i], &sendtypes[io_comprank])))
-                {
-                    GPTLstop("PIO:rearrange_comp2io");
-                    return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-                }
-    #endif /* PIO_USE_MPISERIAL */
-                pioassert(sendtypes[io_comprank] != PIO_DATATYPE_NULL,  "bad mpi type", __FILE__, __LINE__);
-
-                if ((mpierr = MPI_Type_commit(&sendtypes[io_comprank])))
-                {
-                    GPTLstop("PIO:rearrange_comp2io");
-                    return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-                }
-            }
-            else
+            if (iodesc->rcount[i] > 0)
             {
-                sendcounts[io_comprank] = 0;
+                int rtask = (iodesc->rearranger == PIO_REARR_SUBSET) ? i : iodesc->rfrom[i];
+                is_neighbor[rtask] = true;
             }
         }
     }
-    
-    /* Data in sbuf on the compute nodes is sent to rbuf on the ionodes */
-    LOG((2, "about to call pio_swapm for sbuf"));
-    if ((ret = pio_swapm(sbuf, sendcounts, sdispls, sendtypes,
-                         rbuf, recvcounts, rdispls, recvtypes, mycomm,
-                         &iodesc->rearr_opts.comp2io)))
-    {
-        GPTLstop("PIO:rearrange_comp2io");
-        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
-                        "Rearranging data from compute to I/O processes failed. pio_swapm() call failed to exchange data");
-    }
 
-    /* Free the MPI types. */
+    iodesc->nneighbors = 0;
     for (int i = 0; i < ntasks; i++)
-    {
-        LOG((3, "freeing MPI types for task %d", i));
-        if (sendtypes[i] != PIO_DATATYPE_NULL)
-            if ((mpierr = MPI_Type_free(&sendtypes[i])))
-            {
-                GPTLstop("PIO:rearrange_comp2io");
-                return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-            }
+        if (is_neighbor[i])
+            iodesc->nneighbors++;
 
-        if (recvtypes[i] != PIO_DATATYPE_NULL)
-            if ((mpierr = MPI_Type_free(&recvtypes[i])))
-            {
-                GPTLstop("PIO:rearrange_comp2io");
-                return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-            }
+    if (!(iodesc->neighbors = malloc(((iodesc->nneighbors > 0) ? iodesc->nneighbors : 1) * sizeof(int))))
+    {
+        free(is_neighbor);
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                        "Creating neighborhood communicator for the rearranger failed. Out of memory allocating %lld bytes for neighbor ranks", (long long int) (iodesc->nneighbors * sizeof(int)));
     }
 
-    GPTLstop("PIO:rearrange_comp2io");
+    for (int i = 0, n = 0; i < ntasks; i++)
+        if (is_neighbor[i])
+            iodesc->neighbors[n++] = i;
+    free(is_neighbor);
+
+    LOG((2, "find_rearr_neighbors nneighbors = %d", iodesc->nneighbors));
 
     return PIO_NOERR;
 }
 
 /**
- * Moves data from IO tasks to compute tasks. This function is used in
- * PIOc_read_darray().
+ * Create the distributed graph communicator used to rearrange data
+ * with the PIO_REARR_COMM_NEIGHBOR comm type. The neighbors of a task
+ * are the IO tasks that it sends data to (iodesc->scount) and the
+ * compute tasks it receives data from (iodesc->rfrom/rcount). Since a
+ * compute task sends data to an IO task only if the IO task receives
+ * data from it, the graph is symmetric and the same neighbors are
+ * used as sources and destinations (in both the compute to IO and
+ * the IO to compute directions).
+ *
+ * With the PIO_REARR_COMM_SPARSE comm type only the list of neighbors
+ * (iodesc->neighbors) is needed, the graph communicator is not
+ * created.
+ *
+ * This function must be called, after the rearranger is created, by
+ * all tasks in the communicator used by the rearranger.
  *
  * @param ios pointer to the iosystem_desc_t struct.
  * @param iodesc a pointer to the io_desc_t struct.
- * @param sbuf send buffer.
- * @param rbuf receive buffer.
  * @returns 0 on success, error code otherwise.
- * @author Jim Edwards
  */
-int rearrange_io2comp(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf,
-                      void *rbuf)
+int create_neighbor_comm(iosystem_desc_t *ios, io_desc_t *iodesc)
 {
-    MPI_Comm mycomm;
-    int ntasks;
-    int niotasks;
-    int mpierr; /* Return code from MPI calls. */
+    MPI_Comm mycomm;  /* Communicator that data is transferred over. */
+    int niotasks;     /* Number of IO tasks. */
+    int mpierr;       /* Return code from MPI calls. */
     int ret;
 
-    /* Check inputs. */
     pioassert(ios && iodesc, "invalid input", __FILE__, __LINE__);
 
-    GPTLstart("PIO:rearrange_io2comp");
+    GPTLstart("PIO:create_neighbor_comm");
 
-    /* Different rearrangers use different communicators and number of
-     * IO tasks. */
-    if (iodesc->rearranger == PIO_REARR_BOX)
+    if (iodesc->rearranger == PIO_REARR_BOX || iodesc->rearranger == PIO_REARR_BOX_HIER)
     {
         mycomm = ios->union_comm;
         niotasks = ios->num_iotasks;
@@ -1112,45 +1134,1609 @@ int rearrange_io2comp(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf,
         mycomm = iodesc->subset_comm;
         niotasks = 1;
     }
-    LOG((3, "niotasks = %d", niotasks));
 
-    /* Get the size of this communicator. */
-    if ((mpierr = MPI_Comm_size(mycomm, &ntasks)))
+    /* The neighbors may already be known, if the comm type was
+     * changed by the rearranger autotuner. */
+    if (!iodesc->neighbors)
     {
-        GPTLstop("PIO:rearrange_io2comp");
-        return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        if ((ret = find_rearr_neighbors(ios, iodesc, mycomm, niotasks)))
+        {
+            GPTLstop("PIO:create_neighbor_comm");
+            return ret;
+        }
     }
 
-    /* Define the MPI data types that will be used for this
-     * io_desc_t. */
-    if ((ret = define_iodesc_datatypes(ios, iodesc)))
+#if PIO_USE_MPISERIAL
+    /* No neighborhood collectives, pio_swapm() is used instead. */
+    GPTLstop("PIO:create_neighbor_comm");
+    return PIO_NOERR;
+#endif /* PIO_USE_MPISERIAL */
+
+    if (iodesc->rearr_opts.comm_type != PIO_REARR_COMM_NEIGHBOR ||
+        iodesc->neigh_comm != MPI_COMM_NULL)
     {
-        GPTLstop("PIO:rearrange_io2comp");
+        GPTLstop("PIO:create_neighbor_comm");
+        return PIO_NOERR;
+    }
+
+    /* All the edges have the same weight. MPI_UNWEIGHTED is not used,
+     * it is a sentinel pointer that compilers flag as reading an
+     * empty region. The array has at least one element so that it is
+     * valid when there are no neighbors. */
+    int *weights;
+    if (!(weights = malloc(max(iodesc->nneighbors, 1) * sizeof(int))))
+    {
+        GPTLstop("PIO:create_neighbor_comm");
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                       "Creating the neighborhood communicator for the rearranger failed. Out of memory allocating the weights of %d neighbors", iodesc->nneighbors);
+    }
+    for (int i = 0; i < max(iodesc->nneighbors, 1); i++)
+        weights[i] = 1;
+
+    /* Do not reorder the ranks, the rearranger uses ranks in mycomm. */
+    mpierr = MPI_Dist_graph_create_adjacent(mycomm, iodesc->nneighbors, iodesc->neighbors,
+                                            weights, iodesc->nneighbors, iodesc->neighbors,
+                                            weights, MPI_INFO_NULL, 0, &iodesc->neigh_comm);
+    free(weights);
+    if (mpierr)
+    {
+        GPTLstop("PIO:create_neighbor_comm");
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    }
+
+    GPTLstop("PIO:create_neighbor_comm");
+
+    return PIO_NOERR;
+}
+
+/**
+ * Allocate a communication plan for exchanging data over a
+ * communicator with ntasks tasks. All counts and displacements are
+ * initialized to 0 and all datatypes to PIO_DATATYPE_NULL.
+ *
+ * @param ntasks number of tasks in the communicator.
+ * @param nvars number of variables exchanged using the plan.
+ * @param has_sbuf true if a send buffer is available.
+ * @param owns_types true if the datatypes are created (and freed) by
+ * the plan.
+ * @param plan pointer that gets the newly allocated plan.
+ * @returns 0 on success, error code otherwise.
+ */
+static int alloc_rearr_comm_plan(int ntasks, int nvars, bool has_sbuf,
+                                 bool owns_types, rearr_comm_plan_t **plan)
+{
+    rearr_comm_plan_t *p;
+
+    pioassert(ntasks > 0 && plan, "invalid input", __FILE__, __LINE__);
+
+    if (!(p = calloc(1, sizeof(rearr_comm_plan_t))))
+        return PIO_ENOMEM;
+
+    p->nvars = nvars;
+    p->has_sbuf = has_sbuf;
+    p->ntasks = ntasks;
+    p->owns_types = owns_types;
+    p->sendcounts = calloc(ntasks, sizeof(int));
+    p->recvcounts = calloc(ntasks, sizeof(int));
+    p->sdispls = calloc(ntasks, sizeof(int));
+    p->rdispls = calloc(ntasks, sizeof(int));
+    p->sendtypes = malloc(ntasks * sizeof(MPI_Datatype));
+    p->recvtypes = malloc(ntasks * sizeof(MPI_Datatype));
+    if (!p->sendcounts || !p->recvcounts || !p->sdispls || !p->rdispls ||
+        !p->sendtypes || !p->recvtypes)
+    {
+        p->owns_types = false;
+        free_rearr_comm_plans(p);
+        return PIO_ENOMEM;
+    }
+
+    for (int i = 0; i < ntasks; i++)
+    {
+        p->sendtypes[i] = PIO_DATATYPE_NULL;
+        p->recvtypes[i] = PIO_DATATYPE_NULL;
+    }
+
+    *plan = p;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Free a list of communication plans, including any MPI datatypes
+ * owned by the plans.
+ *
+ * @param plans pointer to the first plan in the list. May be NULL.
+ * @returns 0 on success, error code otherwise.
+ */
+int free_rearr_comm_plans(rearr_comm_plan_t *plans)
+{
+    int mpierr = MPI_SUCCESS;
+
+    while (plans)
+    {
+        rearr_comm_plan_t *next = plans->next;
+
+        if (plans->owns_types)
+        {
+            for (int i = 0; i < plans->ntasks; i++)
+            {
+                if (plans->sendtypes[i] != PIO_DATATYPE_NULL && mpierr == MPI_SUCCESS)
+                    mpierr = MPI_Type_free(&plans->sendtypes[i]);
+                if (plans->recvtypes[i] != PIO_DATATYPE_NULL && mpierr == MPI_SUCCESS)
+                    mpierr = MPI_Type_free(&plans->recvtypes[i]);
+            }
+        }
+
+        free(plans->sendcounts);
+        free(plans->recvcounts);
+        free(plans->sdispls);
+        free(plans->rdispls);
+        free(plans->sendtypes);
+        free(plans->recvtypes);
+        free(plans);
+        plans = next;
+    }
+
+    if (mpierr != MPI_SUCCESS)
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Find a cached communication plan. The plan found is moved to the
+ * front of the list, so the list is ordered from the most to the
+ * least recently used plan.
+ *
+ * @param plans pointer to the pointer to the first plan in the
+ * list. The list may be empty.
+ * @param nvars number of variables exchanged.
+ * @param has_sbuf true if a send buffer is available.
+ * @param packed true for a plan exchanging packed data.
+ * @returns pointer to the plan, or NULL if no matching plan is cached.
+ */
+static rearr_comm_plan_t *find_rearr_comm_plan(rearr_comm_plan_t **plans, int nvars,
+                                               bool has_sbuf, bool packed)
+{
+    for (rearr_comm_plan_t **prev = plans; *prev; prev = &(*prev)->next)
+    {
+        rearr_comm_plan_t *p = *prev;
+
+        if (p->nvars == nvars && p->has_sbuf == has_sbuf && p->packed == packed)
+        {
+            *prev = p->next;
+            p->next = *plans;
+            *plans = p;
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Add a new communication plan to the front of a list of cached
+ * plans. If the list then has more than PIO_MAX_REARR_PLANS plans,
+ * the least recently used plans not in use by an exchange in progress
+ * are freed, with the MPI datatypes they own.
+ *
+ * @param plans pointer to the pointer to the first plan in the
+ * list. The list may be empty.
+ * @param plan pointer to the new plan.
+ * @returns 0 on success, error code otherwise.
+ */
+static int add_rearr_comm_plan(rearr_comm_plan_t **plans, rearr_comm_plan_t *plan)
+{
+    int nplans = 0;
+    int ret;
+
+    pioassert(plans && plan, "invalid input", __FILE__, __LINE__);
+
+    plan->next = *plans;
+    *plans = plan;
+
+    for (rearr_comm_plan_t *p = *plans; p; p = p->next)
+        nplans++;
+
+    while (nplans > PIO_MAX_REARR_PLANS)
+    {
+        rearr_comm_plan_t **victim = NULL;
+
+        /* Find the least recently used plan not in use. */
+        for (rearr_comm_plan_t **prev = &(*plans)->next; *prev; prev = &(*prev)->next)
+            if ((*prev)->nusers == 0)
+                victim = prev;
+        if (!victim)
+            break;
+
+        rearr_comm_plan_t *p = *victim;
+        *victim = p->next;
+        p->next = NULL;
+        LOG((3, "evicting the communication plan for %d variables", p->nvars));
+        if ((ret = free_rearr_comm_plans(p)))
+            return ret;
+        nplans--;
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Create the MPI datatype, a vector of nvars blocks of type basetype
+ * with a stride of stride bytes, used to exchange data for nvars
+ * variables in a single message.
+ *
+ * @param nvars number of variables.
+ * @param stride stride in bytes between the data of two variables.
+ * @param basetype the MPI type describing the data of one variable.
+ * @param newtype pointer that gets the committed MPI type.
+ * @returns 0 on success, error code otherwise.
+ */
+static int create_nvars_type(int nvars, MPI_Aint stride, MPI_Datatype basetype,
+                             MPI_Datatype *newtype)
+{
+    int mpierr;
+
+#if PIO_USE_MPISERIAL
+    if ((mpierr = MPI_Type_hvector(nvars, 1, stride, basetype, newtype)))
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+#else
+    if ((mpierr = MPI_Type_create_hvector(nvars, 1, stride, basetype, newtype)))
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+#endif /* PIO_USE_MPISERIAL */
+    pioassert(*newtype != PIO_DATATYPE_NULL, "bad mpi type", __FILE__, __LINE__);
+
+    if ((mpierr = MPI_Type_commit(newtype)))
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Free a pack list.
+ *
+ * @param list pointer to the pack list. May be NULL.
+ */
+void free_rearr_pack_list(rearr_pack_list_t *list)
+{
+    if (!list)
+        return;
+
+    free(list->task);
+    free(list->start);
+    free(list->index);
+    free(list->run_first);
+    free(list->run_index);
+    free(list->run_len);
+    free(list);
+}
+
+/**
+ * Create the pack list of the messages described by msgcnt, mindex,
+ * mcount and mfrom (as in create_mpi_datatypes()).
+ *
+ * The elements of each message are split in runs of consecutive
+ * indices. If the runs are long enough on average
+ * (PIO_REARR_PACK_MIN_RUN elements) the elements are copied run by
+ * run, otherwise element by element.
+ *
+ * @param msgcnt the number of messages.
+ * @param mtask array (length msgcnt) of the ranks of the tasks the
+ * messages are exchanged with.
+ * @param mindex the indices of the elements of all messages.
+ * @param mcount array (length msgcnt) of the number of elements of
+ * each message.
+ * @param mfrom NULL if the elements of each message are contiguous
+ * in mindex, otherwise the message of each element (subset
+ * rearranger).
+ * @param listp pointer that gets the pack list.
+ * @returns 0 on success, error code otherwise.
+ */
+static int create_rearr_pack_list(int msgcnt, const int *mtask, const PIO_Offset *mindex,
+                                  const int *mcount, const int *mfrom,
+                                  rearr_pack_list_t **listp)
+{
+    rearr_pack_list_t *list;
+    int msgid[max(1, msgcnt)]; /* Index of each message in the list. */
+    int fill[max(1, msgcnt)];  /* Number of elements of each message listed so far. */
+    PIO_Offset numinds = 0;
+    PIO_Offset nruns = 0;
+    int nmsgs = 0;
+
+    pioassert(msgcnt >= 0 && listp, "invalid input", __FILE__, __LINE__);
+
+    for (int i = 0; i < msgcnt; i++)
+    {
+        numinds += mcount[i];
+        msgid[i] = (mcount[i] > 0) ? nmsgs++ : -1;
+        fill[i] = 0;
+    }
+
+    if (!(list = calloc(1, sizeof(rearr_pack_list_t))))
+        return PIO_ENOMEM;
+    list->nmsgs = nmsgs;
+    list->task = malloc(max(1, nmsgs) * sizeof(int));
+    list->start = malloc((nmsgs + 1) * sizeof(PIO_Offset));
+    list->index = malloc(max(1, numinds) * sizeof(PIO_Offset));
+    if (!list->task || !list->start || !list->index)
+    {
+        free_rearr_pack_list(list);
+        return PIO_ENOMEM;
+    }
+
+    list->start[0] = 0;
+    for (int i = 0; i < msgcnt; i++)
+    {
+        if (msgid[i] >= 0)
+        {
+            list->task[msgid[i]] = mtask[i];
+            list->start[msgid[i] + 1] = list->start[msgid[i]] + mcount[i];
+        }
+    }
+
+    /* List the indices message after message, in the order of the
+     * elements of the messages in mindex. */
+    if (!mfrom)
+    {
+        /* The messages are contiguous in mindex. */
+        if (numinds > 0)
+            memcpy(list->index, mindex, numinds * sizeof(PIO_Offset));
+    }
+    else
+    {
+        for (PIO_Offset j = 0; j < numinds; j++)
+        {
+            int i = mfrom[j];
+
+            pioassert(i >= 0 && i < msgcnt && msgid[i] >= 0, "invalid message", __FILE__, __LINE__);
+            list->index[list->start[msgid[i]] + fill[i]++] = mindex[j];
+        }
+    }
+
+    /* Count the runs of consecutive indices, a run does not cross
+     * messages. */
+    for (int m = 0; m < nmsgs; m++)
+        for (PIO_Offset k = list->start[m]; k < list->start[m + 1]; k++)
+            if (k == list->start[m] || list->index[k] != list->index[k - 1] + 1)
+                nruns++;
+
+    LOG((2, "create_rearr_pack_list nmsgs = %d numinds = %lld nruns = %lld", nmsgs,
+         (long long)numinds, (long long)nruns));
+
+    /* With long enough runs, replace the indices by the runs. */
+    if (numinds > 0 && nruns * PIO_REARR_PACK_MIN_RUN <= numinds)
+    {
+        PIO_Offset r = 0;
+
+        list->run_first = malloc((nmsgs + 1) * sizeof(PIO_Offset));
+        list->run_index = malloc(nruns * sizeof(PIO_Offset));
+        list->run_len = malloc(nruns * sizeof(int));
+        if (!list->run_first || !list->run_index || !list->run_len)
+        {
+            free_rearr_pack_list(list);
+            return PIO_ENOMEM;
+        }
+
+        for (int m = 0; m < nmsgs; m++)
+        {
+            list->run_first[m] = r;
+            for (PIO_Offset k = list->start[m]; k < list->start[m + 1]; k++)
+            {
+                if (k == list->start[m] || list->index[k] != list->index[k - 1] + 1)
+                {
+                    list->run_index[r] = list->index[k];
+                    list->run_len[r++] = 0;
+                }
+                list->run_len[r - 1]++;
+            }
+        }
+        list->run_first[nmsgs] = r;
+
+        free(list->index);
+        list->index = NULL;
+        list->use_runs = true;
+    }
+
+    *listp = list;
+
+    return PIO_NOERR;
+}
+
+/**
+ * If needed, create the pack lists of a decomposition, used when the
+ * rearranger packs the data exchanged (see PIOc_set_rearr_pack()).
+ *
+ * The compute tasks get the list of the elements sent to (received
+ * from, when reading) each IO task, the IO tasks the list of the
+ * elements received from (sent to) each compute task. The messages
+ * and the order of their elements are the ones of the MPI datatypes
+ * created by define_iodesc_datatypes().
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @returns 0 on success, error code otherwise.
+ */
+static int define_iodesc_pack_lists(iosystem_desc_t *ios, io_desc_t *iodesc)
+{
+    int ret;
+
+    if (ios->ioproc && !iodesc->rpack)
+    {
+        int nrecvs = iodesc->nrecvs;
+        int rtask[max(1, nrecvs)];
+        int *mfrom = NULL;
+
+        /* The subset rearranger exchanges message i with task i of
+         * the subset communicator. */
+        for (int i = 0; i < nrecvs; i++)
+            rtask[i] = (iodesc->rearranger == PIO_REARR_SUBSET) ? i : iodesc->rfrom[i];
+        if (iodesc->rearranger == PIO_REARR_SUBSET)
+            mfrom = iodesc->rfrom;
+
+        if ((ret = create_rearr_pack_list(nrecvs, rtask, iodesc->rindex, iodesc->rcount,
+                                          mfrom, &iodesc->rpack)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                            "Defining the pack lists for I/O decomposition failed. Creating the list of the data received from compute processes failed");
+    }
+
+    if (ios->compproc && !iodesc->spack)
+    {
+        int ntypes = iodesc->rearranger == PIO_REARR_SUBSET ? 1 : ios->num_iotasks;
+        int stask[ntypes];
+
+        for (int i = 0; i < ntypes; i++)
+            stask[i] = (iodesc->rearranger == PIO_REARR_SUBSET) ? 0 : ios->ioranks[i];
+
+        if ((ret = create_rearr_pack_list(ntypes, stask, iodesc->sindex, iodesc->scount,
+                                          NULL, &iodesc->spack)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                            "Defining the pack lists for I/O decomposition failed. Creating the list of the data sent from the compute process failed");
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Gather elements of size bytes, src[index[k]], into dst[k]. The
+ * copies of 4 and 8 byte elements have a constant size, so the
+ * compiler inlines (and can vectorize) them.
+ *
+ * @param src the source buffer.
+ * @param index array (length n) of the indices of the elements.
+ * @param n number of elements.
+ * @param size size of an element in bytes.
+ * @param dst the destination buffer.
+ */
+static void pack_elems(const char *src, const PIO_Offset *index, int n, int size,
+                       char *dst)
+{
+    switch (size)
+    {
+    case 4:
+        for (int k = 0; k < n; k++)
+            memcpy(dst + 4 * (size_t)k, src + 4 * index[k], 4);
+        break;
+    case 8:
+        for (int k = 0; k < n; k++)
+            memcpy(dst + 8 * (size_t)k, src + 8 * index[k], 8);
+        break;
+    default:
+        for (int k = 0; k < n; k++)
+            memcpy(dst + (size_t)size * k, src + size * index[k], size);
+    }
+}
+
+/**
+ * Scatter elements of size bytes, src[k], into dst[index[k]]. See
+ * pack_elems().
+ *
+ * @param src the source buffer.
+ * @param index array (length n) of the indices of the elements.
+ * @param n number of elements.
+ * @param size size of an element in bytes.
+ * @param dst the destination buffer.
+ */
+static void unpack_elems(const char *src, const PIO_Offset *index, int n, int size,
+                         char *dst)
+{
+    switch (size)
+    {
+    case 4:
+        for (int k = 0; k < n; k++)
+            memcpy(dst + 4 * index[k], src + 4 * (size_t)k, 4);
+        break;
+    case 8:
+        for (int k = 0; k < n; k++)
+            memcpy(dst + 8 * index[k], src + 8 * (size_t)k, 8);
+        break;
+    default:
+        for (int k = 0; k < n; k++)
+            memcpy(dst + size * index[k], src + (size_t)size * k, size);
+    }
+}
+
+/**
+ * Pack the data of nvars variables into a contiguous buffer. The
+ * data of message m is packed at offset nvars * list->start[m]
+ * (elements), variable after variable.
+ *
+ * @param list the pack list.
+ * @param buf the (unpacked) data of the variables.
+ * @param stride the number of elements between the data of two
+ * variables in buf.
+ * @param nvars number of variables.
+ * @param size size of an element in bytes.
+ * @param pbuf the packed buffer.
+ */
+static void rearr_pack(const rearr_pack_list_t *list, const void *buf, PIO_Offset stride,
+                       int nvars, int size, void *pbuf)
+{
+    char *dst = pbuf;
+
+    for (int m = 0; m < list->nmsgs; m++)
+    {
+        int count = list->start[m + 1] - list->start[m];
+
+        for (int v = 0; v < nvars; v++)
+        {
+            const char *src = (const char *)buf + (size_t)v * stride * size;
+
+            if (list->use_runs)
+            {
+                char *d = dst;
+                for (PIO_Offset r = list->run_first[m]; r < list->run_first[m + 1]; r++)
+                {
+                    memcpy(d, src + list->run_index[r] * size, (size_t)list->run_len[r] * size);
+                    d += (size_t)list->run_len[r] * size;
+                }
+            }
+            else
+            {
+                pack_elems(src, list->index + list->start[m], count, size, dst);
+            }
+            dst += (size_t)count * size;
+        }
+    }
+}
+
+/**
+ * Unpack the data of nvars variables from a contiguous buffer packed
+ * as in rearr_pack(). Only the elements in the list are written.
+ *
+ * @param list the pack list.
+ * @param pbuf the packed buffer.
+ * @param stride the number of elements between the data of two
+ * variables in buf.
+ * @param nvars number of variables.
+ * @param size size of an element in bytes.
+ * @param buf the (unpacked) data of the variables.
+ */
+static void rearr_unpack(const rearr_pack_list_t *list, const void *pbuf, PIO_Offset stride,
+                         int nvars, int size, void *buf)
+{
+    const char *src = pbuf;
+
+    for (int m = 0; m < list->nmsgs; m++)
+    {
+        int count = list->start[m + 1] - list->start[m];
+
+        for (int v = 0; v < nvars; v++)
+        {
+            char *dst = (char *)buf + (size_t)v * stride * size;
+
+            if (list->use_runs)
+            {
+                const char *s = src;
+                for (PIO_Offset r = list->run_first[m]; r < list->run_first[m + 1]; r++)
+                {
+                    memcpy(dst + list->run_index[r] * size, s, (size_t)list->run_len[r] * size);
+                    s += (size_t)list->run_len[r] * size;
+                }
+            }
+            else
+            {
+                unpack_elems(src, list->index + list->start[m], count, size, dst);
+            }
+            src += (size_t)count * size;
+        }
+    }
+}
+
+/**
+ * Check if the packed data of nvars variables fits in the int counts
+ * and displacements of pio_swapm(). Larger exchanges are done with
+ * the MPI datatypes. Each task can decide on its own: either way a
+ * message is the same sequence of elements of the MPI type of the
+ * data.
+ *
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param nvars number of variables.
+ * @returns true if the packed data fits.
+ */
+static bool rearr_pack_fits(const io_desc_t *iodesc, int nvars)
+{
+    PIO_Offset esize = (PIO_Offset)nvars * iodesc->mpitype_size;
+
+    return (!iodesc->spack || iodesc->spack->start[iodesc->spack->nmsgs] * esize <= INT_MAX) &&
+        (!iodesc->rpack || iodesc->rpack->start[iodesc->rpack->nmsgs] * esize <= INT_MAX);
+}
+
+/**
+ * Create the communication plan used to exchange packed data for
+ * nvars variables. The messages are contiguous elements of the MPI
+ * type of the data, the displacements are in bytes into the packed
+ * buffers (see rearr_pack_fits()).
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param ntasks number of tasks in the communicator used for the
+ * exchange.
+ * @param slist pack list of the data sent. May be NULL.
+ * @param rlist pack list of the data received. May be NULL.
+ * @param has_sbuf true if a send buffer is available.
+ * @param nvars number of variables.
+ * @param plan pointer that gets the newly created plan.
+ * @returns 0 on success, error code otherwise.
+ */
+static int create_packed_plan(iosystem_desc_t *ios, io_desc_t *iodesc, int ntasks,
+                              const rearr_pack_list_t *slist, const rearr_pack_list_t *rlist,
+                              bool has_sbuf, int nvars, rearr_comm_plan_t **plan)
+{
+    rearr_comm_plan_t *p;
+    PIO_Offset esize = (PIO_Offset)nvars * iodesc->mpitype_size;
+    int ret;
+
+    if ((ret = alloc_rearr_comm_plan(ntasks, nvars, has_sbuf, false, &p)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Creating communication plan for rearranging packed data (nvars=%d) failed. Out of memory allocating %lld bytes for the plan", nvars, (long long int) (ntasks * (4 * sizeof(int) + 2 * sizeof(MPI_Datatype))));
+    p->packed = true;
+
+    if (slist && has_sbuf)
+    {
+        for (int m = 0; m < slist->nmsgs; m++)
+        {
+            int t = slist->task[m];
+            p->sendcounts[t] = (slist->start[m + 1] - slist->start[m]) * nvars;
+            p->sdispls[t] = slist->start[m] * esize;
+            p->sendtypes[t] = iodesc->mpitype;
+        }
+    }
+
+    if (rlist)
+    {
+        for (int m = 0; m < rlist->nmsgs; m++)
+        {
+            int t = rlist->task[m];
+            p->recvcounts[t] = (rlist->start[m + 1] - rlist->start[m]) * nvars;
+            p->rdispls[t] = rlist->start[m] * esize;
+            p->recvtypes[t] = iodesc->mpitype;
+        }
+    }
+
+    *plan = p;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Allocate the contiguous buffers of an exchange of packed data, and
+ * pack the data to send.
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param slist pack list of the data sent. May be NULL.
+ * @param sbuf the data sent. May be NULL.
+ * @param sstride number of elements between two variables in sbuf.
+ * @param rlist pack list of the data received. May be NULL.
+ * @param nvars number of variables.
+ * @param psbuf pointer that gets the packed send buffer (NULL if
+ * nothing is sent).
+ * @param prbuf pointer that gets the packed receive buffer (NULL if
+ * nothing is received).
+ * @returns 0 on success, error code otherwise.
+ */
+static int rearr_pack_start(iosystem_desc_t *ios, io_desc_t *iodesc,
+                            const rearr_pack_list_t *slist, const void *sbuf, PIO_Offset sstride,
+                            const rearr_pack_list_t *rlist, int nvars,
+                            void **psbuf, void **prbuf)
+{
+    size_t esize = (size_t)nvars * iodesc->mpitype_size;
+    size_t ssize = (slist && sbuf) ? slist->start[slist->nmsgs] * esize : 0;
+    size_t rsize = rlist ? rlist->start[rlist->nmsgs] * esize : 0;
+
+    *psbuf = NULL;
+    *prbuf = NULL;
+
+    if (ssize > 0 && !(*psbuf = malloc(ssize)))
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                        "Packing data for the rearranger failed. Out of memory allocating %lld bytes for the packed send buffer", (long long int) ssize);
+    if (rsize > 0 && !(*prbuf = malloc(rsize)))
+    {
+        free(*psbuf);
+        *psbuf = NULL;
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                        "Packing data for the rearranger failed. Out of memory allocating %lld bytes for the packed receive buffer", (long long int) rsize);
+    }
+
+    if (*psbuf)
+    {
+        GPTLstart("PIO:rearr_pack");
+        rearr_pack(slist, sbuf, sstride, nvars, iodesc->mpitype_size, *psbuf);
+        GPTLstop("PIO:rearr_pack");
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Unpack the data received in an exchange of packed data, and free
+ * the buffers allocated by rearr_pack_start().
+ *
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param rlist pack list of the data received. May be NULL.
+ * @param rbuf buffer that gets the data received. May be NULL.
+ * @param rstride number of elements between two variables in rbuf.
+ * @param nvars number of variables.
+ * @param psbuf the packed send buffer. May be NULL.
+ * @param prbuf the packed receive buffer. May be NULL.
+ */
+static void rearr_pack_end(io_desc_t *iodesc, const rearr_pack_list_t *rlist, void *rbuf,
+                           PIO_Offset rstride, int nvars, void *psbuf, void *prbuf)
+{
+    if (prbuf && rbuf)
+    {
+        GPTLstart("PIO:rearr_unpack");
+        rearr_unpack(rlist, prbuf, rstride, nvars, iodesc->mpitype_size, rbuf);
+        GPTLstop("PIO:rearr_unpack");
+    }
+
+    free(psbuf);
+    free(prbuf);
+}
+
+/**
+ * Create the communication plan used to move data for nvars
+ * variables from compute tasks to IO tasks.
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param ntasks number of tasks in the communicator used for the
+ * exchange.
+ * @param niotasks number of IO tasks.
+ * @param has_sbuf true if a send buffer is available.
+ * @param nvars number of variables.
+ * @param plan pointer that gets the newly created plan.
+ * @returns 0 on success, error code otherwise.
+ */
+static int create_comp2io_plan(iosystem_desc_t *ios, io_desc_t *iodesc, int ntasks,
+                               int niotasks, bool has_sbuf, int nvars,
+                               rearr_comm_plan_t **plan)
+{
+    rearr_comm_plan_t *p;
+    int ret;
+
+    /* The hierarchical box rearranger sends the data aggregated on
+     * the node leader. */
+    int ndof = (iodesc->rearranger == PIO_REARR_BOX_HIER) ? iodesc->node_ndof : iodesc->ndof;
+
+    if ((ret = alloc_rearr_comm_plan(ntasks, nvars, has_sbuf, true, &p)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Creating communication plan for rearranging data (nvars=%d) from compute to I/O processes failed. Out of memory allocating %lld bytes for the plan", nvars, (long long int) (ntasks * (4 * sizeof(int) + 2 * sizeof(MPI_Datatype))));
+
+    /* If this io proc, we need to exchange data with compute
+     * tasks. Create a MPI DataType for that exchange. */
+    LOG((2, "ios->ioproc %d iodesc->nrecvs = %d", ios->ioproc, iodesc->nrecvs));
+    if (ios->ioproc && iodesc->nrecvs > 0)
+    {
+        for (int i = 0; i < iodesc->nrecvs; i++)
+        {
+            if (iodesc->rtype[i] != PIO_DATATYPE_NULL)
+            {
+                LOG((3, "iodesc->rtype[%d] = %d iodesc->rearranger = %d", i, iodesc->rtype[i],
+                        iodesc->rearranger));
+                /* The subset rearranger receives from task i in the
+                 * subset communicator, the box rearranger from task
+                 * rfrom[i] in the union communicator. */
+                int rtask = (iodesc->rearranger == PIO_REARR_SUBSET) ? i : iodesc->rfrom[i];
+                LOG((3, "exchanging data i = %d rtask = %d", i, rtask));
+                p->recvcounts[rtask] = 1;
+                p->rdispls[rtask] = 0;
+
+                /*  Create an MPI derived data type from equally
+                 *  spaced blocks of the same size. The block size
+                 *  is 1, the stride here is the length of the
+                 *  collected array (llen). */
+                if ((ret = create_nvars_type(nvars, (MPI_Aint)iodesc->llen * iodesc->mpitype_size,
+                                             iodesc->rtype[i], &p->recvtypes[rtask])))
+                {
+                    free_rearr_comm_plans(p);
+                    return ret;
+                }
+            }
+        }
+    }
+
+    /* On compute tasks loop over iotasks and create a data type for
+     * each exchange.  */
+    if (!ios->async || ios->compproc)
+    {
+        for (int i = 0; i < niotasks; i++)
+        {
+            int io_comprank = ios->ioranks[i];
+            LOG((3, "ios->ioranks[%d] = %d", i, ios->ioranks[i]));
+            if (iodesc->rearranger == PIO_REARR_SUBSET)
+                io_comprank = 0;
+
+            LOG((3, "i = %d iodesc->scount[i] = %d", i, iodesc->scount[i]));
+            if (iodesc->scount[i] > 0 && has_sbuf)
+            {
+                LOG((3, "io task %d creating sendtypes[%d]", i, io_comprank));
+                p->sendcounts[io_comprank] = 1;
+                if ((ret = create_nvars_type(nvars, (MPI_Aint)ndof * iodesc->mpitype_size,
+                                             iodesc->stype[i], &p->sendtypes[io_comprank])))
+                {
+                    free_rearr_comm_plans(p);
+                    return ret;
+                }
+            }
+            else
+            {
+                p->sendcounts[io_comprank] = 0;
+            }
+        }
+    }
+
+    *plan = p;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Make sure the shared memory buffer, used by the hierarchical box
+ * rearranger to aggregate the data of a node on the node leader, can
+ * hold the data of nvars variables. This function is collective
+ * across all tasks in iodesc->node_comm.
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param nvars number of variables.
+ * @returns 0 on success, error code otherwise.
+ */
+static int reserve_node_buf(iosystem_desc_t *ios, io_desc_t *iodesc, int nvars)
+{
+#if !PIO_USE_MPISERIAL
+    MPI_Aint wsize = 0;
+    MPI_Aint qsize;
+    int qdisp_unit;
+    void *base;
+    int node_rank;
+    int mpierr;
+
+    if (iodesc->node_buf_nvars >= nvars)
+        return PIO_NOERR;
+
+    if (iodesc->node_win != MPI_WIN_NULL)
+    {
+        if ((mpierr = MPI_Win_unlock_all(iodesc->node_win)))
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        if ((mpierr = MPI_Win_free(&iodesc->node_win)))
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        iodesc->node_buf = NULL;
+        iodesc->node_buf_nvars = 0;
+    }
+
+    if ((mpierr = MPI_Comm_rank(iodesc->node_comm, &node_rank)))
+        return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+
+    /* Only the node leader contributes memory to the window. */
+    if (node_rank == 0)
+        wsize = (MPI_Aint)iodesc->node_ndof * iodesc->mpitype_size * nvars;
+
+    if ((mpierr = MPI_Win_allocate_shared(wsize, iodesc->mpitype_size, MPI_INFO_NULL,
+                                          iodesc->node_comm, &base, &iodesc->node_win)))
+        return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+
+    if ((mpierr = MPI_Win_shared_query(iodesc->node_win, 0, &qsize, &qdisp_unit,
+                                       &iodesc->node_buf)))
+        return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+
+    /* The window is accessed with loads/stores, synchronized with
+     * node_buf_sync(). */
+    if ((mpierr = MPI_Win_lock_all(MPI_MODE_NOCHECK, iodesc->node_win)))
+        return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+
+    iodesc->node_buf_nvars = nvars;
+    LOG((2, "reserve_node_buf nvars = %d size = %lld", nvars, (long long)qsize));
+#endif /* !PIO_USE_MPISERIAL */
+
+    return PIO_NOERR;
+}
+
+/**
+ * Synchronize the accesses to the shared memory buffer, used by the
+ * hierarchical box rearranger, across all tasks in the node. All
+ * loads/stores by the tasks in the node before this call complete
+ * before any loads/stores after this call. This function is
+ * collective across all tasks in iodesc->node_comm.
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @returns 0 on success, error code otherwise.
+ */
+static int node_buf_sync(iosystem_desc_t *ios, io_desc_t *iodesc)
+{
+#if !PIO_USE_MPISERIAL
+    int mpierr;
+
+    if ((mpierr = MPI_Win_sync(iodesc->node_win)))
+        return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Barrier(iodesc->node_comm)))
+        return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Win_sync(iodesc->node_win)))
+        return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+#endif /* !PIO_USE_MPISERIAL */
+
+    return PIO_NOERR;
+}
+
+/**
+ * Aggregate the data, of nvars variables, of all the compute tasks
+ * in a node on the node leader. The data is aggregated in the shared
+ * memory buffer iodesc->node_buf as nvars arrays of length
+ * iodesc->node_ndof. This function is collective across all tasks in
+ * iodesc->node_comm.
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param sbuf the data (nvars arrays of length iodesc->ndof) on this
+ * task. May be NULL if iodesc->ndof is 0.
+ * @param nvars number of variables.
+ * @returns 0 on success, error code otherwise.
+ */
+static int node_aggregate(iosystem_desc_t *ios, io_desc_t *iodesc, const void *sbuf, int nvars)
+{
+    int ret;
+
+    GPTLstart("PIO:node_aggregate");
+    if ((ret = reserve_node_buf(ios, iodesc, nvars)))
+    {
+        GPTLstop("PIO:node_aggregate");
+        return ret;
+    }
+
+    /* Wait for the node leader to finish with the previous data. */
+    if ((ret = node_buf_sync(ios, iodesc)))
+    {
+        GPTLstop("PIO:node_aggregate");
+        return ret;
+    }
+
+    if (sbuf && iodesc->ndof > 0)
+    {
+        size_t vlen = (size_t)iodesc->ndof * iodesc->mpitype_size;
+        for (int v = 0; v < nvars; v++)
+            memcpy((char *)iodesc->node_buf +
+                   ((size_t)v * iodesc->node_ndof + iodesc->node_offset) * iodesc->mpitype_size,
+                   (const char *)sbuf + v * vlen, vlen);
+    }
+
+    if ((ret = node_buf_sync(ios, iodesc)))
+    {
+        GPTLstop("PIO:node_aggregate");
+        return ret;
+    }
+
+    GPTLstop("PIO:node_aggregate");
+    return PIO_NOERR;
+}
+
+/**
+ * Find the cached communication plan used to move the data of nvars
+ * variables from compute tasks to IO tasks, or create (and cache) a
+ * new one.
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param mycomm the communicator used by the rearranger.
+ * @param niotasks number of IO tasks.
+ * @param has_sbuf true if a send buffer is available.
+ * @param nvars number of variables.
+ * @param packed true to exchange packed data, false to use MPI
+ * datatypes.
+ * @param plan pointer that gets the plan.
+ * @returns 0 on success, error code otherwise.
+ */
+static int get_comp2io_plan(iosystem_desc_t *ios, io_desc_t *iodesc, MPI_Comm mycomm,
+                            int niotasks, bool has_sbuf, int nvars, bool packed,
+                            rearr_comm_plan_t **plan)
+{
+    int ntasks;       /* Number of tasks in communicator. */
+    int mpierr;       /* Return code from MPI calls. */
+    int ret;
+
+    if ((*plan = find_rearr_comm_plan(&iodesc->comp2io_plans, nvars, has_sbuf, packed)))
+        return PIO_NOERR;
+
+    /* Get the number of tasks. */
+    if ((mpierr = MPI_Comm_size(mycomm, &ntasks)))
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    LOG((3, "ntasks = %d iodesc->mpitype_size = %d niotasks = %d", ntasks,
+         iodesc->mpitype_size, niotasks));
+
+    if (packed)
+        ret = create_packed_plan(ios, iodesc, ntasks, iodesc->spack, iodesc->rpack,
+                                 has_sbuf, nvars, plan);
+    else
+        ret = create_comp2io_plan(ios, iodesc, ntasks, niotasks, has_sbuf, nvars, plan);
+    if (ret)
         return pio_err(ios, NULL, ret, __FILE__, __LINE__,
-                        "Rearranging data from I/O to compute processes failed. Defining MPI datatypes for transferring data failed");
+                        "Rearranging data from compute to I/O processes failed. Creating the communication plan for %d variables failed", nvars);
+    if ((ret = add_rearr_comm_plan(&iodesc->comp2io_plans, *plan)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Rearranging data from compute to I/O processes failed. Freeing the least recently used communication plans failed");
+
+    return PIO_NOERR;
+}
+
+/**
+ * Moves data from compute tasks to IO tasks. This is called from
+ * PIOc_write_darray_multi().
+ *
+ * The MPI datatypes used for the exchange are cached in the io_desc_t
+ * (one communication plan per number of variables), so repeated
+ * writes of the same number of variables with a decomposition do not
+ * need to create and commit new MPI datatypes.
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param sbuf send buffer. May be NULL.
+ * @param rbuf receive buffer. May be NULL.
+ * @param nvars number of variables.
+ * @returns 0 on success, error code otherwise.
+ * @author Jim Edwards
+ */
+int rearrange_comp2io(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf,
+                      void *rbuf, int nvars)
+{
+    int niotasks;     /* Number of IO tasks. */
+    int ndof;         /* Number of elements of a variable in sbuf. */
+    MPI_Comm mycomm;  /* Communicator that data is transferred over. */
+    rearr_comm_plan_t *plan; /* Communication plan for this exchange. */
+    bool packed;      /* True if the data is packed. */
+    void *xsbuf;      /* Send buffer exchanged (packed or sbuf). */
+    void *xrbuf;      /* Receive buffer exchanged (packed or rbuf). */
+    double tune_start = 0; /* Start time, when tuning the rearranger. */
+    int mpierr;       /* Return code from MPI calls. */
+    int ret;
+
+    GPTLstart("PIO:rearrange_comp2io");
+
+    /* Caller must provide these. */
+    pioassert(ios && iodesc && nvars > 0, "invalid input", __FILE__, __LINE__);
+
+    LOG((1, "rearrange_comp2io nvars = %d iodesc->rearranger = %d", nvars,
+         iodesc->rearranger));
+
+    /* Different rearraangers use different communicators. */
+    if (iodesc->rearranger == PIO_REARR_BOX || iodesc->rearranger == PIO_REARR_BOX_HIER)
+    {
+        mycomm = ios->union_comm;
+        niotasks = ios->num_iotasks;
+    }
+    else
+    {
+        mycomm = iodesc->subset_comm;
+        niotasks = 1;
+    }
+
+    /* With the hierarchical box rearranger the data of all the
+     * compute tasks on a node is aggregated on the node leader, and
+     * only the node leader sends data to the IO tasks. */
+    if (iodesc->rearranger == PIO_REARR_BOX_HIER && iodesc->node_comm != MPI_COMM_NULL)
+    {
+        int node_rank;
+
+        if ((ret = node_aggregate(ios, iodesc, sbuf, nvars)))
+        {
+            GPTLstop("PIO:rearrange_comp2io");
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                            "Rearranging data from compute to I/O processes failed. Aggregating data on the node leader failed");
+        }
+        if ((mpierr = MPI_Comm_rank(iodesc->node_comm, &node_rank)))
+        {
+            GPTLstop("PIO:rearrange_comp2io");
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        }
+        sbuf = (node_rank == 0) ? iodesc->node_buf : NULL;
+    }
+
+    /* The hierarchical box rearranger sends the data aggregated on
+     * the node leader. */
+    ndof = (iodesc->rearranger == PIO_REARR_BOX_HIER) ? iodesc->node_ndof : iodesc->ndof;
+
+    /* If it has not already been done, define the MPI data types (or,
+     * when the data is packed, the pack lists) that will be used for
+     * this io_desc_t. Data too large to be packed is exchanged with
+     * the MPI data types. */
+    packed = ios->rearr_pack;
+    if (packed)
+    {
+        if ((ret = define_iodesc_pack_lists(ios, iodesc)))
+        {
+            GPTLstop("PIO:rearrange_comp2io");
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                            "Rearranging data from compute to I/O processes failed. Defining the pack lists for rearranging data failed");
+        }
+        packed = rearr_pack_fits(iodesc, nvars);
+    }
+    if (!packed && (ret = define_iodesc_datatypes(ios, iodesc)))
+    {
+        GPTLstop("PIO:rearrange_comp2io");
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Rearranging data from compute to I/O processes failed. Defining MPI datatypes for rearranging data failed");
+    }
+
+    /* Reuse the cached communication plan for nvars variables, if
+     * one is available. Otherwise create and cache a new one. */
+    if ((ret = get_comp2io_plan(ios, iodesc, mycomm, niotasks, sbuf != NULL, nvars,
+                                packed, &plan)))
+    {
+        GPTLstop("PIO:rearrange_comp2io");
+        return ret;
+    }
+
+    /* If the rearranger is being tuned, time this rearrangement with
+     * the next candidate options. */
+    if (iodesc->autotune)
+    {
+        if ((ret = rearr_autotune_begin(ios, iodesc, mycomm)))
+        {
+            GPTLstop("PIO:rearrange_comp2io");
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                            "Rearranging data from compute to I/O processes failed. Setting the rearranger options for tuning failed");
+        }
+        tune_start = MPI_Wtime();
+    }
+
+    /* Pack the data to send, the packed buffers are exchanged
+     * instead of sbuf and rbuf. */
+    xsbuf = sbuf;
+    xrbuf = rbuf;
+    if (plan->packed)
+    {
+        if ((ret = rearr_pack_start(ios, iodesc, iodesc->spack, sbuf, ndof, iodesc->rpack,
+                                    nvars, &xsbuf, &xrbuf)))
+        {
+            GPTLstop("PIO:rearrange_comp2io");
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                            "Rearranging data from compute to I/O processes failed. Packing the data to send failed");
+        }
+    }
+
+    /* Data in sbuf on the compute nodes is sent to rbuf on the ionodes */
+    if (iodesc->rearr_opts.comm_type == PIO_REARR_COMM_NEIGHBOR &&
+        iodesc->neigh_comm != MPI_COMM_NULL)
+    {
+        LOG((2, "about to call pio_neighbor_swapm for sbuf"));
+        ret = pio_neighbor_swapm(xsbuf, plan->sendcounts, plan->sdispls, plan->sendtypes,
+                                 xrbuf, plan->recvcounts, plan->rdispls, plan->recvtypes,
+                                 iodesc->neigh_comm, iodesc->nneighbors, iodesc->neighbors);
+    }
+    else if (iodesc->rearr_opts.comm_type == PIO_REARR_COMM_SPARSE && iodesc->neighbors)
+    {
+        LOG((2, "about to call pio_sparse_swapm for sbuf"));
+        ret = pio_sparse_swapm(xsbuf, plan->sendcounts, plan->sdispls, plan->sendtypes,
+                               xrbuf, plan->recvcounts, plan->rdispls, plan->recvtypes,
+                               mycomm, iodesc->nneighbors, iodesc->neighbors,
+                               &iodesc->rearr_opts.comp2io);
+    }
+    else
+    {
+        LOG((2, "about to call pio_swapm for sbuf"));
+        ret = pio_swapm(xsbuf, plan->sendcounts, plan->sdispls, plan->sendtypes,
+                        xrbuf, plan->recvcounts, plan->rdispls, plan->recvtypes, mycomm,
+                        &iodesc->rearr_opts.comp2io);
+    }
+
+    /* Unpack the data received into rbuf. */
+    if (plan->packed)
+        rearr_pack_end(iodesc, iodesc->rpack, rbuf, iodesc->llen, nvars, xsbuf, xrbuf);
+
+    if (ret != PIO_NOERR)
+    {
+        GPTLstop("PIO:rearrange_comp2io");
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Rearranging data from compute to I/O processes failed. pio_swapm() call failed to exchange data");
+    }
+
+    if (iodesc->autotune)
+    {
+        if ((ret = rearr_autotune_end(ios, iodesc, mycomm, MPI_Wtime() - tune_start)))
+        {
+            GPTLstop("PIO:rearrange_comp2io");
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                            "Rearranging data from compute to I/O processes failed. Recording the rearranger timing for tuning failed");
+        }
+    }
+
+    GPTLstop("PIO:rearrange_comp2io");
+
+    return PIO_NOERR;
+}
+
+/**
+ * Start moving data from compute tasks to IO tasks, without
+ * blocking. This is called from PIOc_write_darray_nb(). The exchange
+ * is progressed with pio_swapm_test() and completed with
+ * pio_swapm_wait(), sbuf and rbuf must not be used until then.
+ *
+ * The exchange uses the cached communication plan of the
+ * decomposition (as rearrange_comp2io()) and its comp2io flow
+ * control options, always with point to point messages (whatever the
+ * comm type of the rearranger). The hierarchical box rearranger is
+ * not supported, its data is aggregated on the node leaders first.
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param sbuf send buffer. May be NULL.
+ * @param rbuf receive buffer. May be NULL.
+ * @param nvars number of variables.
+ * @param slot the slot of the exchange, see pio_swapm_start().
+ * @param reqp pointer that gets the state of the exchange.
+ * @param planp pointer that gets the communication plan used by the
+ * exchange. The plan is in use (not evicted from the cache) until
+ * the caller decrements its nusers, after pio_swapm_wait().
+ * @returns 0 on success, error code otherwise.
+ */
+int rearrange_comp2io_start(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf, void *rbuf,
+                            int nvars, int slot, pio_swapm_req_t **reqp,
+                            rearr_comm_plan_t **planp)
+{
+    int niotasks;     /* Number of IO tasks. */
+    MPI_Comm mycomm;  /* Communicator that data is transferred over. */
+    rearr_comm_plan_t *plan; /* Communication plan for this exchange. */
+    int ret;
+
+    /* Caller must provide these. */
+    pioassert(ios && iodesc && nvars > 0 && reqp && planp &&
+              iodesc->rearranger != PIO_REARR_BOX_HIER, "invalid input", __FILE__, __LINE__);
+
+    GPTLstart("PIO:rearrange_comp2io_start");
+    LOG((1, "rearrange_comp2io_start nvars = %d iodesc->rearranger = %d slot = %d", nvars,
+         iodesc->rearranger, slot));
+
+    /* Different rearraangers use different communicators. */
+    if (iodesc->rearranger == PIO_REARR_BOX)
+    {
+        mycomm = ios->union_comm;
+        niotasks = ios->num_iotasks;
+    }
+    else
+    {
+        mycomm = iodesc->subset_comm;
+        niotasks = 1;
+    }
+
+    /* If it has not already been done, define the MPI data types that
+     * will be used for this io_desc_t. */
+    if ((ret = define_iodesc_datatypes(ios, iodesc)))
+    {
+        GPTLstop("PIO:rearrange_comp2io_start");
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Rearranging data from compute to I/O processes failed. Defining MPI datatypes for rearranging data failed");
+    }
+
+    if ((ret = get_comp2io_plan(ios, iodesc, mycomm, niotasks, sbuf != NULL, nvars, false, &plan)))
+    {
+        GPTLstop("PIO:rearrange_comp2io_start");
+        return ret;
+    }
+
+    LOG((2, "about to call pio_swapm_start for sbuf"));
+    if ((ret = pio_swapm_start(sbuf, plan->sendcounts, plan->sdispls, plan->sendtypes,
+                               rbuf, plan->recvcounts, plan->rdispls, plan->recvtypes, mycomm,
+                               &iodesc->rearr_opts.comp2io, slot, reqp)))
+    {
+        GPTLstop("PIO:rearrange_comp2io_start");
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Rearranging data from compute to I/O processes failed. pio_swapm_start() call failed to start exchanging data");
+    }
+    plan->nusers++;
+    *planp = plan;
+
+    GPTLstop("PIO:rearrange_comp2io_start");
+
+    return PIO_NOERR;
+}
+
+/**
+ * Check if the rearranger options of a decomposition let its data be
+ * moved from compute tasks to IO tasks with
+ * rearrange_comp2io_fused(). The fused exchange is a pio_swapm() of
+ * the MPI datatypes of the decompositions, so the rearranger must not
+ * be tuned, the data must not be packed (see PIOc_set_rearr_pack())
+ * and the communication type must be PIO_REARR_COMM_P2P or
+ * PIO_REARR_COMM_COLL. These options are the same on all tasks.
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @returns true if the options allow the fused exchange.
+ */
+static bool rearr_comp2io_fused_opts(const iosystem_desc_t *ios, const io_desc_t *iodesc)
+{
+    return !iodesc->autotune && !ios->rearr_pack &&
+        (iodesc->rearr_opts.comm_type == PIO_REARR_COMM_P2P ||
+         iodesc->rearr_opts.comm_type == PIO_REARR_COMM_COLL);
+}
+
+/**
+ * Check if the data of a decomposition can be moved from compute
+ * tasks to IO tasks together with the data of other decompositions,
+ * with rearrange_comp2io_fused(). This is possible with the box
+ * rearranger (all decompositions use the union communicator), if the
+ * rearranger options allow it (see rearr_comp2io_fused_opts()).
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @returns true if the decomposition can be rearranged with others.
+ */
+bool rearr_comp2io_fusable(const iosystem_desc_t *ios, const io_desc_t *iodesc)
+{
+    pioassert(ios && iodesc, "invalid input", __FILE__, __LINE__);
+
+    return iodesc->rearranger == PIO_REARR_BOX && rearr_comp2io_fused_opts(ios, iodesc);
+}
+
+/**
+ * Check if the data of a decomposition, held in several separate
+ * buffers (segments of variables), can be moved from compute tasks to
+ * IO tasks in one exchange with rearrange_comp2io_fused(). This is
+ * possible with the box and subset rearrangers (the hierarchical box
+ * rearranger aggregates a contiguous buffer on the node leader), if
+ * the rearranger options allow it (see rearr_comp2io_fused_opts()).
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @returns true if the segments of the data can be rearranged
+ * together.
+ */
+bool rearr_comp2io_segmentable(const iosystem_desc_t *ios, const io_desc_t *iodesc)
+{
+    pioassert(ios && iodesc, "invalid input", __FILE__, __LINE__);
+
+    return (iodesc->rearranger == PIO_REARR_BOX || iodesc->rearranger == PIO_REARR_SUBSET) &&
+        rearr_comp2io_fused_opts(ios, iodesc);
+}
+
+/**
+ * Moves the data of several decompositions from compute tasks to IO
+ * tasks in one exchange. This is called from flush_buffers() and
+ * flush_buffer().
+ *
+ * For each task exchanged with, the messages of all the
+ * decompositions (from the cached communication plans of the
+ * decompositions) are concatenated into one message, described by an
+ * MPI struct datatype of the absolute addresses of the buffers. So
+ * the handshakes and synchronizations of the exchange are paid once
+ * instead of once per decomposition. The flow control options of the
+ * first decomposition are used. The exchange always uses pio_swapm(),
+ * so the decompositions must be rearranged without packing and with
+ * the P2P or COLL communication types (checked by
+ * rearr_comp2io_fusable() and rearr_comp2io_segmentable()).
+ *
+ * All the decompositions must be rearr_comp2io_fusable(). This
+ * function is collective across ios->union_comm. A decomposition may
+ * appear several times, to move the variables held in several
+ * buffers (the segments of a write multi buffer) with one exchange.
+ * The variables of each entry must then follow the variables of the
+ * previous entry of the decomposition, on all tasks. If all the
+ * entries are of the same decomposition, it only needs to be
+ * rearr_comp2io_segmentable(), and the function is collective across
+ * the communicator of its rearranger.
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param ndecomps number of decompositions.
+ * @param iodescs array (length ndecomps) of pointers to the
+ * decompositions.
+ * @param sbufs array (length ndecomps) of send buffers. The entries
+ * may be NULL.
+ * @param rbufs array (length ndecomps) of receive buffers. The
+ * entries may be NULL.
+ * @param nvars array (length ndecomps) of the number of variables
+ * of each decomposition.
+ * @returns 0 on success, error code otherwise.
+ */
+int rearrange_comp2io_fused(iosystem_desc_t *ios, int ndecomps, io_desc_t **iodescs,
+                            void **sbufs, void **rbufs, const int *nvars)
+{
+    MPI_Comm mycomm = ios->union_comm; /* Communicator of the exchange. */
+    int niotasks = ios->num_iotasks;  /* Number of IO tasks in mycomm. */
+    int ntasks;       /* Number of tasks in mycomm. */
+    int mpierr;       /* Return code from MPI calls. */
+    int ret = PIO_NOERR;
+
+    pioassert(ios && ndecomps > 0 && iodescs && sbufs && rbufs && nvars, "invalid input",
+              __FILE__, __LINE__);
+
+    GPTLstart("PIO:rearrange_comp2io_fused");
+    LOG((1, "rearrange_comp2io_fused ndecomps = %d", ndecomps));
+
+    /* The segments of a decomposition using the subset rearranger are
+     * exchanged on its subset communicator. */
+    if (iodescs[0]->rearranger == PIO_REARR_SUBSET)
+    {
+        mycomm = iodescs[0]->subset_comm;
+        niotasks = 1;
+    }
+
+    if ((mpierr = MPI_Comm_size(mycomm, &ntasks)))
+    {
+        GPTLstop("PIO:rearrange_comp2io_fused");
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    }
+
+    rearr_comm_plan_t *plans[ndecomps];
+    int sendcounts[ntasks];
+    int recvcounts[ntasks];
+    int sdispls[ntasks];
+    int rdispls[ntasks];
+    MPI_Datatype sendtypes[ntasks];
+    MPI_Datatype recvtypes[ntasks];
+    int blocklens[ndecomps];
+    MPI_Aint displs[ndecomps];
+    MPI_Datatype types[ndecomps];
+
+    for (int k = 0; k < ndecomps; k++)
+    {
+        pioassert((rearr_comp2io_fusable(ios, iodescs[k]) ||
+                   (iodescs[k] == iodescs[0] && rearr_comp2io_segmentable(ios, iodescs[k]))) &&
+                  nvars[k] > 0, "invalid input", __FILE__, __LINE__);
+
+        /* If it has not already been done, define the MPI data types
+         * that will be used for this io_desc_t. */
+        if ((ret = define_iodesc_datatypes(ios, iodescs[k])))
+            ret = pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                            "Rearranging data from compute to I/O processes failed. Defining MPI datatypes for rearranging data failed");
+        else
+            ret = get_comp2io_plan(ios, iodescs[k], mycomm, niotasks,
+                                   sbufs[k] != NULL, nvars[k], false, &plans[k]);
+        if (ret)
+        {
+            for (int j = 0; j < k; j++)
+                plans[j]->nusers--;
+            GPTLstop("PIO:rearrange_comp2io_fused");
+            return ret;
+        }
+
+        /* The plan is in use until the exchange is complete, it must
+         * not be evicted by the plans of the next entries (of the
+         * same decomposition). */
+        plans[k]->nusers++;
     }
 
-    /* Allocate arrays needed by the pio_swapm() function. */
-    int sendcounts[ntasks];
-    int recvcounts[ntasks];
-    int sdispls[ntasks];
-    int rdispls[ntasks];
-    MPI_Datatype sendtypes[ntasks];
-    MPI_Datatype recvtypes[ntasks];
+    /* Concatenate the messages of the decompositions to/from each
+     * task. */
+    for (int p = 0; p < ntasks; p++)
+    {
+        int nsend = 0, nrecv = 0;
 
-    /* Initialize arrays. */
-    for (int i = 0; i < ntasks; i++)
+        sendcounts[p] = recvcounts[p] = 0;
+        sdispls[p] = rdispls[p] = 0;
+        sendtypes[p] = recvtypes[p] = MPI_BYTE;
+
+        for (int k = 0; k < ndecomps; k++)
+        {
+            if (plans[k]->sendcounts[p] > 0)
+            {
+                blocklens[nsend] = plans[k]->sendcounts[p];
+                types[nsend] = plans[k]->sendtypes[p];
+                if ((mpierr = MPI_Get_address((char *)sbufs[k] + plans[k]->sdispls[p],
+                                              &displs[nsend])))
+                    ret = check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+                nsend++;
+            }
+        }
+        if (ret == PIO_NOERR && nsend > 0)
+        {
+            /* The count is only set once the type is committed, so
+             * that only committed types are freed. */
+            if ((mpierr = MPI_Type_create_struct(nsend, blocklens, displs, types, &sendtypes[p])))
+                ret = check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+            else if ((mpierr = MPI_Type_commit(&sendtypes[p])))
+            {
+                MPI_Type_free(&sendtypes[p]);
+                ret = check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+            }
+            else
+                sendcounts[p] = 1;
+        }
+
+        for (int k = 0; ret == PIO_NOERR && k < ndecomps; k++)
+        {
+            if (plans[k]->recvcounts[p] > 0)
+            {
+                blocklens[nrecv] = plans[k]->recvcounts[p];
+                types[nrecv] = plans[k]->recvtypes[p];
+                if ((mpierr = MPI_Get_address((char *)rbufs[k] + plans[k]->rdispls[p],
+                                              &displs[nrecv])))
+                    ret = check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+                nrecv++;
+            }
+        }
+        if (ret == PIO_NOERR && nrecv > 0)
+        {
+            /* The count is only set once the type is committed, so
+             * that only committed types are freed. */
+            if ((mpierr = MPI_Type_create_struct(nrecv, blocklens, displs, types, &recvtypes[p])))
+                ret = check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+            else if ((mpierr = MPI_Type_commit(&recvtypes[p])))
+            {
+                MPI_Type_free(&recvtypes[p]);
+                ret = check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+            }
+            else
+                recvcounts[p] = 1;
+        }
+
+        if (ret != PIO_NOERR)
+        {
+            /* Only free the types created so far. */
+            ntasks = p + 1;
+            break;
+        }
+    }
+
+    /* Data in the send buffers on the compute nodes is sent to the
+     * receive buffers on the ionodes. */
+    if (ret == PIO_NOERR)
     {
-        sendcounts[i] = 0;
-        recvcounts[i] = 0;
-        sdispls[i] = 0;
-        rdispls[i] = 0;
-        sendtypes[i] = PIO_DATATYPE_NULL;
-        recvtypes[i] = PIO_DATATYPE_NULL;
+        LOG((2, "about to call pio_swapm for %d decompositions", ndecomps));
+        if ((ret = pio_swapm(MPI_BOTTOM, sendcounts, sdispls, sendtypes,
+                             MPI_BOTTOM, recvcounts, rdispls, recvtypes, mycomm,
+                             &iodescs[0]->rearr_opts.comp2io)))
+            ret = pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                            "Rearranging data from compute to I/O processes failed. pio_swapm() call failed to exchange data of %d decompositions", ndecomps);
+    }
+
+    for (int p = 0; p < ntasks; p++)
+    {
+        if (sendcounts[p] > 0)
+            MPI_Type_free(&sendtypes[p]);
+        if (recvcounts[p] > 0)
+            MPI_Type_free(&recvtypes[p]);
     }
+    for (int k = 0; k < ndecomps; k++)
+        plans[k]->nusers--;
+
+    GPTLstop("PIO:rearrange_comp2io_fused");
+
+    return ret;
+}
+
+/**
+ * Create the communication plan used to move data from IO tasks to
+ * compute tasks. The plan borrows the MPI datatypes of the io_desc_t.
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param ntasks number of tasks in the communicator used for the
+ * exchange.
+ * @param niotasks number of IO tasks.
+ * @param has_sbuf true if a send buffer is available.
+ * @param plan pointer that gets the newly created plan.
+ * @returns 0 on success, error code otherwise.
+ */
+static int create_io2comp_plan(iosystem_desc_t *ios, io_desc_t *iodesc, int ntasks,
+                               int niotasks, bool has_sbuf, rearr_comm_plan_t **plan)
+{
+    rearr_comm_plan_t *p;
+    int ret;
+
+    if ((ret = alloc_rearr_comm_plan(ntasks, 1, has_sbuf, false, &p)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Creating communication plan for rearranging data from I/O to compute processes failed. Out of memory allocating %lld bytes for the plan", (long long int) (ntasks * (4 * sizeof(int) + 2 * sizeof(MPI_Datatype))));
 
-    /* In IO tasks set up sendcounts/sendtypes for pio_swapm() call
-     * below. */
+    /* In IO tasks set up sendcounts/sendtypes for pio_swapm() call. */
     if (ios->ioproc)
     {
         for (int i = 0; i < iodesc->nrecvs; i++)
@@ -1159,16 +2745,16 @@ int rearrange_io2comp(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf,
             {
                 if (iodesc->rearranger == PIO_REARR_SUBSET)
                 {
-                    if (sbuf)
+                    if (has_sbuf)
                     {
-                        sendcounts[i] = 1;
-                        sendtypes[i] = iodesc->rtype[i];
+                        p->sendcounts[i] = 1;
+                        p->sendtypes[i] = iodesc->rtype[i];
                     }
                 }
                 else
                 {
-                    sendcounts[iodesc->rfrom[i]] = 1;
-                    sendtypes[iodesc->rfrom[i]] = iodesc->rtype[i];
+                    p->sendcounts[iodesc->rfrom[i]] = 1;
+                    p->sendtypes[iodesc->rfrom[i]] = iodesc->rtype[i];
                 }
             }
         }
@@ -1187,20 +2773,191 @@ int rearrange_io2comp(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf,
 
         if (iodesc->scount[i] > 0 && iodesc->stype[i] != PIO_DATATYPE_NULL)
         {
-            recvcounts[io_comprank] = 1;
-            recvtypes[io_comprank] = iodesc->stype[i];
+            p->recvcounts[io_comprank] = 1;
+            p->recvtypes[io_comprank] = iodesc->stype[i];
+        }
+    }
+
+    *plan = p;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Moves data from IO tasks to compute tasks. This function is used in
+ * PIOc_read_darray().
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param sbuf send buffer.
+ * @param rbuf receive buffer.
+ * @returns 0 on success, error code otherwise.
+ * @author Jim Edwards
+ */
+int rearrange_io2comp(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf,
+                      void *rbuf)
+{
+    MPI_Comm mycomm;
+    int ntasks;
+    int niotasks;
+    rearr_comm_plan_t *plan; /* Communication plan for this exchange. */
+    bool packed;             /* True if the data is packed. */
+    void *xsbuf;  /* Send buffer exchanged (packed or sbuf). */
+    void *xrbuf;  /* Receive buffer exchanged (packed or rbuf). */
+    void *node_rbuf = NULL; /* Receive buffer, for the hierarchical box rearranger. */
+    int mpierr; /* Return code from MPI calls. */
+    int ret;
+
+    /* Check inputs. */
+    pioassert(ios && iodesc, "invalid input", __FILE__, __LINE__);
+
+    GPTLstart("PIO:rearrange_io2comp");
+
+    /* Different rearrangers use different communicators and number of
+     * IO tasks. */
+    if (iodesc->rearranger == PIO_REARR_BOX || iodesc->rearranger == PIO_REARR_BOX_HIER)
+    {
+        mycomm = ios->union_comm;
+        niotasks = ios->num_iotasks;
+    }
+    else
+    {
+        mycomm = iodesc->subset_comm;
+        niotasks = 1;
+    }
+    LOG((3, "niotasks = %d", niotasks));
+
+    /* Define the MPI data types (or, when the data is packed, the
+     * pack lists) that will be used for this io_desc_t. Data too
+     * large to be packed is exchanged with the MPI data types. */
+    packed = ios->rearr_pack;
+    if (packed)
+    {
+        if ((ret = define_iodesc_pack_lists(ios, iodesc)))
+        {
+            GPTLstop("PIO:rearrange_io2comp");
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                            "Rearranging data from I/O to compute processes failed. Defining the pack lists for transferring data failed");
+        }
+        packed = rearr_pack_fits(iodesc, 1);
+    }
+    if (!packed && (ret = define_iodesc_datatypes(ios, iodesc)))
+    {
+        GPTLstop("PIO:rearrange_io2comp");
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Rearranging data from I/O to compute processes failed. Defining MPI datatypes for transferring data failed");
+    }
+
+    /* With the hierarchical box rearranger the node leader receives
+     * the data of all the compute tasks on the node. */
+    if (iodesc->rearranger == PIO_REARR_BOX_HIER && iodesc->node_comm != MPI_COMM_NULL)
+    {
+        int node_rank;
+
+        /* Wait for all tasks in the node to finish with the
+         * previous data. */
+        if ((ret = reserve_node_buf(ios, iodesc, 1)) ||
+            (ret = node_buf_sync(ios, iodesc)))
+        {
+            GPTLstop("PIO:rearrange_io2comp");
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                            "Rearranging data from I/O to compute processes failed. Preparing the node buffer to receive data failed");
+        }
+        if ((mpierr = MPI_Comm_rank(iodesc->node_comm, &node_rank)))
+        {
+            GPTLstop("PIO:rearrange_io2comp");
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        }
+        node_rbuf = rbuf;
+        rbuf = (node_rank == 0) ? iodesc->node_buf : NULL;
+    }
+
+    /* Reuse the cached communication plan, if available. */
+    if (!(plan = find_rearr_comm_plan(&iodesc->io2comp_plans, 1, sbuf != NULL, packed)))
+    {
+        /* Get the size of this communicator. */
+        if ((mpierr = MPI_Comm_size(mycomm, &ntasks)))
+        {
+            GPTLstop("PIO:rearrange_io2comp");
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        }
+
+        if (packed)
+            ret = create_packed_plan(ios, iodesc, ntasks, iodesc->rpack, iodesc->spack,
+                                     sbuf != NULL, 1, &plan);
+        else
+            ret = create_io2comp_plan(ios, iodesc, ntasks, niotasks, sbuf != NULL, &plan);
+        if (ret)
+        {
+            GPTLstop("PIO:rearrange_io2comp");
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                            "Rearranging data from I/O to compute processes failed. Creating the communication plan failed");
+        }
+        if ((ret = add_rearr_comm_plan(&iodesc->io2comp_plans, plan)))
+        {
+            GPTLstop("PIO:rearrange_io2comp");
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                            "Rearranging data from I/O to compute processes failed. Freeing the least recently used communication plans failed");
+        }
+    }
+
+    /* Pack the data to send, the packed buffers are exchanged
+     * instead of sbuf and rbuf. */
+    xsbuf = sbuf;
+    xrbuf = rbuf;
+    if (plan->packed)
+    {
+        if ((ret = rearr_pack_start(ios, iodesc, iodesc->rpack, sbuf, iodesc->llen,
+                                    iodesc->spack, 1, &xsbuf, &xrbuf)))
+        {
+            GPTLstop("PIO:rearrange_io2comp");
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                            "Rearranging data from I/O to compute processes failed. Packing the data to send failed");
         }
     }
 
     /* Data in sbuf on the ionodes is sent to rbuf on the compute nodes */
-    if ((ret = pio_swapm(sbuf, sendcounts, sdispls, sendtypes, rbuf, recvcounts,
-                         rdispls, recvtypes, mycomm, &iodesc->rearr_opts.io2comp)))
+    if (iodesc->rearr_opts.comm_type == PIO_REARR_COMM_NEIGHBOR &&
+        iodesc->neigh_comm != MPI_COMM_NULL)
+        ret = pio_neighbor_swapm(xsbuf, plan->sendcounts, plan->sdispls, plan->sendtypes,
+                                 xrbuf, plan->recvcounts, plan->rdispls, plan->recvtypes,
+                                 iodesc->neigh_comm, iodesc->nneighbors, iodesc->neighbors);
+    else if (iodesc->rearr_opts.comm_type == PIO_REARR_COMM_SPARSE && iodesc->neighbors)
+        ret = pio_sparse_swapm(xsbuf, plan->sendcounts, plan->sdispls, plan->sendtypes,
+                               xrbuf, plan->recvcounts, plan->rdispls, plan->recvtypes,
+                               mycomm, iodesc->nneighbors, iodesc->neighbors,
+                               &iodesc->rearr_opts.io2comp);
+    else
+        ret = pio_swapm(xsbuf, plan->sendcounts, plan->sdispls, plan->sendtypes,
+                        xrbuf, plan->recvcounts, plan->rdispls, plan->recvtypes,
+                        mycomm, &iodesc->rearr_opts.io2comp);
+
+    /* Unpack the data received into rbuf. */
+    if (plan->packed)
+        rearr_pack_end(iodesc, iodesc->spack, ret ? NULL : rbuf, 0, 1, xsbuf, xrbuf);
+
+    if (ret != PIO_NOERR)
     {
         GPTLstop("PIO:rearrange_io2comp");
         return pio_err(ios, NULL, ret, __FILE__, __LINE__,
                         "Rearranging data from I/O to compute processes failed. pio_swapm() call failed to transfer data between the processes");
     }
 
+    /* Copy the data of this task from the node leader. */
+    if (iodesc->rearranger == PIO_REARR_BOX_HIER && iodesc->node_comm != MPI_COMM_NULL)
+    {
+        if ((ret = node_buf_sync(ios, iodesc)))
+        {
+            GPTLstop("PIO:rearrange_io2comp");
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                            "Rearranging data from I/O to compute processes failed. Synchronizing the node buffer failed");
+        }
+        if (node_rbuf && iodesc->ndof > 0)
+            memcpy(node_rbuf, (char *)iodesc->node_buf +
+                   (size_t)iodesc->node_offset * iodesc->mpitype_size,
+                   (size_t)iodesc->ndof * iodesc->mpitype_size);
+    }
+
     GPTLstop("PIO:rearrange_io2comp");
 
     return PIO_NOERR;
@@ -1318,7 +3075,8 @@ int box_rearrange_create(iosystem_desc_t *ios, int maplen, const PIO_Offset *com
     /* Allocate arrays needed for this function. */
     int *dest_ioproc = NULL; /* Destination IO task for each data element on compute task. */
     PIO_Offset *dest_ioindex = NULL;    /* Offset into IO task array for each data element. */
-    PIO_Offset **gcoord_map = NULL; /* Global coordinate value for each data element. */
+    PIO_Offset *gcoord_chunk = NULL; /* Global coordinates of a chunk of data elements. */
+    int chunk_len = 1; /* The number of data elements in a chunk. */
     int sendcounts[ios->num_uniontasks]; /* Send counts for swapm call. */
     int sdispls[ios->num_uniontasks];    /* Send displacements for swapm. */
     int recvcounts[ios->num_uniontasks]; /* Receive counts for swapm. */
@@ -1355,21 +3113,17 @@ int box_rearrange_create(iosystem_desc_t *ios, int maplen, const PIO_Offset *com
                             "Creating BOX rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Out of memory allocating %lld bytes to store destination I/O indices while setting up the rearranger", iodesc->ioid, ios->iosysid, (unsigned long long) (maplen * sizeof(PIO_Offset)));
         }
 
-        if (!(gcoord_map = malloc(maplen * sizeof(PIO_Offset*))))
+        /* The global coordinates of the data elements are computed
+         * in chunks, in a reusable scratch array bounded by
+         * pio_rearr_setup_buffer_limit. */
+        chunk_len = (int)min((PIO_Offset)maplen,
+                             max((PIO_Offset)1, pio_rearr_setup_buffer_limit /
+                                 (PIO_Offset)(ndims * sizeof(PIO_Offset))));
+        if (!(gcoord_chunk = malloc(chunk_len * ndims * sizeof(PIO_Offset))))
         {
             GPTLstop("PIO:box_rearrange_create");
             return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
-                            "Creating BOX rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Out of memory allocating %lld bytes to store global coordinate map while setting up the rearranger", iodesc->ioid, ios->iosysid, (unsigned long long) (maplen * sizeof(PIO_Offset)));
-        }
-
-        for (int i = 0; i < maplen; i++)
-        {
-            if (!(gcoord_map[i] = calloc(ndims, sizeof(PIO_Offset))))
-            {
-                GPTLstop("PIO:box_rearrange_create");
-                return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
-                                "Creating BOX rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Out of memory allocating %lld bytes to store dim array global coordinate map (gcoord_map[%d]) while setting up the rearranger", iodesc->ioid, ios->iosysid, (unsigned long long) (ndims * sizeof(PIO_Offset)), i);
-            }
+                            "Creating BOX rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Out of memory allocating %lld bytes to store global coordinates while setting up the rearranger", iodesc->ioid, ios->iosysid, (unsigned long long) (chunk_len * ndims * sizeof(PIO_Offset)));
         }
     }
 
@@ -1501,39 +3255,36 @@ int box_rearrange_create(iosystem_desc_t *ios, int maplen, const PIO_Offset *com
         LOG((3, "iomaplen[%d] = %d", i, sc_info_msg_recv[i * sc_info_msg_sz]));
 #endif /* PIO_ENABLE_LOGGING */
 
-    /* Convert a 1-D index into a global coordinate value for each data element */
-    for (int k = 0; k < maplen; k++)
-    {
-        /* The compmap array is 1 based but calculations are 0 based */
-        LOG((3, "about to call idx_to_dim_list ndims = %d ", ndims));
-        idx_to_dim_list(ndims, gdimlen, compmap[k] - 1, gcoord_map[k]);
-#if PIO_ENABLE_LOGGING
-        for (int d = 0; d < ndims; d++)
-            LOG((3, "gcoord_map[%d][%d] = %lld", k, d, gcoord_map[k][d]));
-#endif /* PIO_ENABLE_LOGGING */
-    }
-
+    /* First entry in the sc_info msg is the iomaplen */
     for (int i = 0; i < ios->num_iotasks; i++)
-    {
-        /* First entry in the sc_info msg is the iomaplen */
         iomaplen[i] = sc_info_msg_recv[i * sc_info_msg_sz];
-        if(iomaplen[i] > 0)
+
+    for (int kstart = 0; kstart < maplen; kstart += chunk_len)
+    {
+        int kend = min(maplen, kstart + chunk_len);
+
+        /* Convert a 1-D index into a global coordinate value for each
+         * data element in this chunk. The compmap array is 1 based but
+         * calculations are 0 based. */
+        for (int k = kstart; k < kend; k++)
+            if (compmap[k] > 0)
+                idx_to_dim_list(ndims, gdimlen, compmap[k] - 1,
+                                &gcoord_chunk[(k - kstart) * ndims]);
+
+        for (int i = 0; i < ios->num_iotasks; i++)
         {
-            /* The rest of the entries in the sc_info msg are the start and
-             * count arrays
-             */
+            if (iomaplen[i] <= 0)
+                continue;
+
+            /* The rest of the entries in the sc_info msg are the start
+             * and count arrays */
             PIO_Offset *start = &(sc_info_msg_recv[i * sc_info_msg_sz + 1]);
             PIO_Offset *count = &(sc_info_msg_recv[i * sc_info_msg_sz + 1 + ndims]);
 
-  #if PIO_ENABLE_LOGGING
-            for (int d = 0; d < ndims; d++)
-                LOG((3, "start[%d] = %lld count[%d] = %lld", d, start[d], d, count[d]));
-  #endif /* PIO_ENABLE_LOGGING */
-
             /* For each element of the data array on the compute task,
              * find the IO task to send the data element to, and its
              * offset into the global data array. */
-            for (int k = 0; k < maplen; k++)
+            for (int k = kstart; k < kend; k++)
             {
                 /* An IO task has already been found for this element */
                 if (dest_ioproc[k] >= 0)
@@ -1544,15 +3295,16 @@ int box_rearrange_create(iosystem_desc_t *ios, int maplen, const PIO_Offset *com
                 if (compmap[k] < 1)
                     continue;
 
+                const PIO_Offset *gcoord = &gcoord_chunk[(k - kstart) * ndims];
                 PIO_Offset lcoord[ndims];
                 bool found = true;
 
                 /* Find a destination for each entry in the compmap. */
                 for (int j = 0; j < ndims; j++)
                 {
-                    if (gcoord_map[k][j] >= start[j] && gcoord_map[k][j] < start[j] + count[j])
+                    if (gcoord[j] >= start[j] && gcoord[j] < start[j] + count[j])
                     {
-                        lcoord[j] = gcoord_map[k][j] - start[j];
+                        lcoord[j] = gcoord[j] - start[j];
                     }
                     else
                     {
@@ -1576,10 +3328,8 @@ int box_rearrange_create(iosystem_desc_t *ios, int maplen, const PIO_Offset *com
         }
     }
 
-    for (int i = 0; i < maplen; i++)
-        free(gcoord_map[i]);
-    free(gcoord_map);
-    gcoord_map = NULL;
+    free(gcoord_chunk);
+    gcoord_chunk = NULL;
 
     /* Check that a destination is found for each compmap entry. */
     for (int k = 0; k < maplen; k++)
@@ -1610,24 +3360,174 @@ int box_rearrange_create(iosystem_desc_t *ios, int maplen, const PIO_Offset *com
     {
         if ((ret = compute_maxIObuffersize(ios->io_comm, iodesc)))
         {
-            GPTLstop("PIO:box_rearrange_create");
-            return pio_err(ios, NULL, ret, __FILE__, __LINE__,
-                            "Creating BOX rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Unable to compute hte maximum I/O buffer size required for caching data", iodesc->ioid, ios->iosysid);
+            GPTLstop("PIO:box_rearrange_create");
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                            "Creating BOX rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Unable to compute hte maximum I/O buffer size required for caching data", iodesc->ioid, ios->iosysid);
+        }
+        LOG((3, "iodesc->maxiobuflen = %d", iodesc->maxiobuflen));
+    }
+
+    /* Using maxiobuflen compute the maximum number of bytes that the
+     * io task buffer can handle. */
+    if ((ret = compute_maxaggregate_bytes(ios, iodesc)))
+    {
+        GPTLstop("PIO:box_rearrange_create");
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Creating BOX rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Unable to calculate the max aggregate bytes across all processes", iodesc->ioid, ios->iosysid);
+    }
+    LOG((3, "iodesc->maxbytes = %d", iodesc->maxbytes));
+
+    GPTLstop("PIO:box_rearrange_create");
+    return PIO_NOERR;
+}
+
+/**
+ * Create the hierarchical (node-aware) box rearranger. The compute
+ * tasks on each (shared memory) node aggregate their data on a node
+ * leader (rank 0 of the node communicator), and only the node leaders
+ * exchange data with the IO tasks, using the box rearranger created
+ * with the aggregated decomposition map of the node. This reduces
+ * the number of messages between the compute and IO tasks by the
+ * number of compute tasks per node.
+ *
+ * This function is collective across all tasks in the union
+ * communicator.
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param maplen the length of the map.
+ * @param compmap a 1 based array of offsets into the array record on
+ * file. A 0 in this array indicates a value which should not be
+ * transfered.
+ * @param gdimlen an array length ndims with the sizes of the global
+ * dimensions.
+ * @param ndims the number of dimensions.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @returns 0 on success, error code otherwise.
+ */
+int box_hier_rearrange_create(iosystem_desc_t *ios, int maplen, const PIO_Offset *compmap,
+                              const int *gdimlen, int ndims, io_desc_t *iodesc)
+{
+    PIO_Offset *node_map = NULL; /* Decomposition map aggregated on the node leader. */
+    PIO_Offset dummy_map = 0;    /* Map used by tasks that have no data. */
+    int node_rank = 0;
+    int node_size = 1;
+    int mpierr;
+    int ret;
+
+    pioassert(ios && maplen >= 0 && gdimlen && ndims > 0 && iodesc,
+              "invalid input", __FILE__, __LINE__);
+    LOG((1, "box_hier_rearrange_create maplen = %d ndims = %d", maplen, ndims));
+
+    GPTLstart("PIO:box_hier_rearrange_create");
+
+    iodesc->node_comm = MPI_COMM_NULL;
+    iodesc->node_win = MPI_WIN_NULL;
+    iodesc->node_ndof = maplen;
+    iodesc->node_offset = 0;
+
+#if !PIO_USE_MPISERIAL
+    /* Only compute tasks aggregate data. */
+    if (!ios->async || ios->compproc)
+    {
+        if ((mpierr = MPI_Comm_split_type(ios->comp_comm, MPI_COMM_TYPE_SHARED, ios->comp_rank,
+                                          MPI_INFO_NULL, &iodesc->node_comm)))
+        {
+            GPTLstop("PIO:box_hier_rearrange_create");
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        }
+        if ((mpierr = MPI_Comm_rank(iodesc->node_comm, &node_rank)))
+        {
+            GPTLstop("PIO:box_hier_rearrange_create");
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        }
+        if ((mpierr = MPI_Comm_size(iodesc->node_comm, &node_size)))
+        {
+            GPTLstop("PIO:box_hier_rearrange_create");
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        }
+
+        int node_maplens[node_size];
+        int node_displs[node_size];
+
+        /* Gather the maps of all the tasks in the node on the leader. */
+        if ((mpierr = MPI_Gather(&maplen, 1, MPI_INT, node_maplens, 1, MPI_INT, 0,
+                                 iodesc->node_comm)))
+        {
+            GPTLstop("PIO:box_hier_rearrange_create");
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        }
+
+        iodesc->node_ndof = 0;
+        if (node_rank == 0)
+        {
+            for (int i = 0; i < node_size; i++)
+            {
+                node_displs[i] = iodesc->node_ndof;
+                iodesc->node_ndof += node_maplens[i];
+            }
+
+            if (iodesc->node_ndof > 0)
+            {
+                if (!(node_map = malloc(iodesc->node_ndof * sizeof(PIO_Offset))))
+                {
+                    GPTLstop("PIO:box_hier_rearrange_create");
+                    return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                                    "Creating hierarchical BOX rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Out of memory allocating %lld bytes for the decomposition map aggregated on the node", iodesc->ioid, ios->iosysid, (unsigned long long) (iodesc->node_ndof * sizeof(PIO_Offset)));
+                }
+            }
+        }
+
+        if ((mpierr = MPI_Gatherv(compmap, maplen, MPI_OFFSET, node_map, node_maplens,
+                                  node_displs, MPI_OFFSET, 0, iodesc->node_comm)))
+        {
+            GPTLstop("PIO:box_hier_rearrange_create");
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        }
+
+        /* All tasks need the size of the aggregated data and the
+         * offset of their data in it. */
+        if ((mpierr = MPI_Scatter(node_displs, 1, MPI_INT, &iodesc->node_offset, 1, MPI_INT, 0,
+                                  iodesc->node_comm)))
+        {
+            GPTLstop("PIO:box_hier_rearrange_create");
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        }
+        if ((mpierr = MPI_Bcast(&iodesc->node_ndof, 1, MPI_INT, 0, iodesc->node_comm)))
+        {
+            GPTLstop("PIO:box_hier_rearrange_create");
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
         }
-        LOG((3, "iodesc->maxiobuflen = %d", iodesc->maxiobuflen));
     }
-
-    /* Using maxiobuflen compute the maximum number of bytes that the
-     * io task buffer can handle. */
-    if ((ret = compute_maxaggregate_bytes(ios, iodesc)))
+#endif /* !PIO_USE_MPISERIAL */
+
+    /* Create the box rearranger between the node leaders (that own
+     * the data aggregated on the node) and the IO tasks. */
+    if (iodesc->node_comm == MPI_COMM_NULL)
+        ret = box_rearrange_create(ios, maplen, compmap ? compmap : &dummy_map, gdimlen,
+                                   ndims, iodesc);
+    else if (node_rank == 0)
+        ret = box_rearrange_create(ios, iodesc->node_ndof, node_map ? node_map : &dummy_map,
+                                   gdimlen, ndims, iodesc);
+    else
+        ret = box_rearrange_create(ios, 0, &dummy_map, gdimlen, ndims, iodesc);
+    free(node_map);
+    if (ret != PIO_NOERR)
     {
-        GPTLstop("PIO:box_rearrange_create");
+        GPTLstop("PIO:box_hier_rearrange_create");
         return pio_err(ios, NULL, ret, __FILE__, __LINE__,
-                        "Creating BOX rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Unable to calculate the max aggregate bytes across all processes", iodesc->ioid, ios->iosysid);
+                        "Creating hierarchical BOX rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Creating the BOX rearranger between node leaders and I/O processes failed", iodesc->ioid, ios->iosysid);
     }
-    LOG((3, "iodesc->maxbytes = %d", iodesc->maxbytes));
 
-    GPTLstop("PIO:box_rearrange_create");
+    /* The number of elements of data on the compute task is still
+     * the length of the local map (the rearranger uses node_ndof). */
+    iodesc->rearranger = PIO_REARR_BOX_HIER;
+    iodesc->ndof = maplen;
+    if (iodesc->node_comm == MPI_COMM_NULL)
+        iodesc->node_ndof = maplen;
+    LOG((2, "box_hier_rearrange_create node_rank = %d node_size = %d node_ndof = %d "
+         "node_offset = %d", node_rank, node_size, iodesc->node_ndof, iodesc->node_offset));
+
+    GPTLstop("PIO:box_hier_rearrange_create");
     return PIO_NOERR;
 }
 
@@ -1966,6 +3866,281 @@ int compare_offsets(const void *a, const void *b)
     return (int)(x->iomap - y->iomap);
 }
 
+/**
+ * Merge two adjacent sorted runs of map points, in[0, nleft) and
+ * in[nleft, nleft + nright), into out. Points with the same iomap
+ * keep their relative order.
+ *
+ * @param in the runs to merge.
+ * @param nleft the length of the first run.
+ * @param nright the length of the second run.
+ * @param out gets the merged run.
+ */
+static void merge_mapsort_runs(const mapsort *in, PIO_Offset nleft, PIO_Offset nright,
+                               mapsort *out)
+{
+    const mapsort *left = in;
+    const mapsort *right = in + nleft;
+    PIO_Offset i = 0, j = 0, k = 0;
+
+    while (i < nleft && j < nright)
+    {
+        if (right[j].iomap < left[i].iomap)
+            out[k++] = right[j++];
+        else
+            out[k++] = left[i++];
+    }
+    while (i < nleft)
+        out[k++] = left[i++];
+    while (j < nright)
+        out[k++] = right[j++];
+}
+
+/**
+ * Sort the map points on iomap using a LSD radix sort on the bytes
+ * of the offsets. Bytes that are the same for all keys are skipped.
+ *
+ * @param map the map points to sort.
+ * @param nmap the number of map points.
+ * @param tmp scratch array of nmap map points.
+ * @returns pointer to the sorted map points, map or tmp.
+ */
+static mapsort *radix_sort_mapsort(mapsort *map, PIO_Offset nmap, mapsort *tmp)
+{
+#define MAPSORT_RADIX_BITS 8
+#define MAPSORT_RADIX (1 << MAPSORT_RADIX_BITS)
+#define MAPSORT_NDIGITS ((int)(sizeof(PIO_Offset) * 8 / MAPSORT_RADIX_BITS))
+    PIO_Offset hist[MAPSORT_NDIGITS][MAPSORT_RADIX];
+    mapsort *in = map;
+    mapsort *out = tmp;
+
+    /* Compute the histograms of all digits in a single pass. Flip
+     * the sign bit so that negative offsets sort first. */
+    memset(hist, 0, sizeof(hist));
+    for (PIO_Offset i = 0; i < nmap; i++)
+    {
+        unsigned long long key = (unsigned long long)map[i].iomap ^ (1ULL << 63);
+        for (int d = 0; d < MAPSORT_NDIGITS; d++)
+            hist[d][(key >> (d * MAPSORT_RADIX_BITS)) & (MAPSORT_RADIX - 1)]++;
+    }
+
+    for (int d = 0; d < MAPSORT_NDIGITS; d++)
+    {
+        PIO_Offset pos = 0;
+        bool skip = false;
+
+        /* All keys have the same digit, nothing to do. */
+        for (int b = 0; b < MAPSORT_RADIX && !skip; b++)
+            if (hist[d][b] == nmap)
+                skip = true;
+        if (skip)
+            continue;
+
+        for (int b = 0; b < MAPSORT_RADIX; b++)
+        {
+            PIO_Offset cnt = hist[d][b];
+            hist[d][b] = pos;
+            pos += cnt;
+        }
+        for (PIO_Offset i = 0; i < nmap; i++)
+        {
+            unsigned long long key = (unsigned long long)in[i].iomap ^ (1ULL << 63);
+            out[hist[d][(key >> (d * MAPSORT_RADIX_BITS)) & (MAPSORT_RADIX - 1)]++] = in[i];
+        }
+
+        mapsort *swap = in;
+        in = out;
+        out = swap;
+    }
+
+    return in;
+}
+
+/**
+ * Sort the map points of the subset rearranger on iomap. This
+ * replaces a qsort() with compare_offsets().
+ *
+ * The map points are the concatenation of nruns runs, one per
+ * compute task, and the contribution of each compute task is usually
+ * sorted already. If all runs are sorted they are merged pairwise,
+ * otherwise the points are sorted with a LSD radix sort on
+ * iomap. Both sorts are stable.
+ *
+ * @param map the map points to sort, in place.
+ * @param nmap the number of map points.
+ * @param runlen array of length nruns with the length of each run,
+ * may be NULL if nruns is 0.
+ * @param nruns the number of runs. If 0, the map is treated as a
+ * single unsorted run.
+ * @returns 0 on success, error code otherwise.
+ */
+int sort_mapsort(mapsort *map, PIO_Offset nmap, const int *runlen, int nruns)
+{
+    PIO_Offset *runstart;
+    mapsort *tmp;
+    mapsort *sorted;
+    bool runs_sorted = (nruns > 0);
+    int nsorted_runs = 0;
+
+    pioassert(nmap >= 0 && (nmap == 0 || map) && nruns >= 0 && (!nruns || runlen),
+              "invalid input", __FILE__, __LINE__);
+
+    if (nmap < 2)
+        return PIO_NOERR;
+
+    /* Find the runs (skipping empty ones), and check if they are
+     * sorted. */
+    if (!(runstart = malloc((nruns + 1) * sizeof(PIO_Offset))))
+        return pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                        "Sorting the subset rearranger map failed. Out of memory allocating %lld bytes for the runs in the map", (unsigned long long) ((nruns + 1) * sizeof(PIO_Offset)));
+    {
+        PIO_Offset pos = 0;
+        for (int r = 0; r < nruns; r++)
+        {
+            if (runlen[r] <= 0)
+                continue;
+            runstart[nsorted_runs++] = pos;
+            for (PIO_Offset i = pos + 1; runs_sorted && i < pos + runlen[r]; i++)
+                if (map[i].iomap < map[i - 1].iomap)
+                    runs_sorted = false;
+            pos += runlen[r];
+        }
+        runstart[nsorted_runs] = pos;
+        pioassert(!nruns || pos == nmap, "run lengths do not add up to map length",
+                  __FILE__, __LINE__);
+    }
+
+    /* A single sorted run, nothing to do. */
+    if (runs_sorted && nsorted_runs <= 1)
+    {
+        free(runstart);
+        return PIO_NOERR;
+    }
+
+    if (!(tmp = malloc(nmap * sizeof(mapsort))))
+    {
+        free(runstart);
+        return pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                        "Sorting the subset rearranger map failed. Out of memory allocating %lld bytes for sorting the map", (unsigned long long) (nmap * sizeof(mapsort)));
+    }
+
+    if (runs_sorted)
+    {
+        mapsort *in = map;
+        mapsort *out = tmp;
+
+        /* Merge adjacent runs until one run is left. */
+        while (nsorted_runs > 1)
+        {
+            int nmerged = 0;
+            for (int r = 0; r < nsorted_runs; r += 2)
+            {
+                PIO_Offset start = runstart[r];
+                if (r + 1 < nsorted_runs)
+                    merge_mapsort_runs(in + start, runstart[r + 1] - start,
+                                       runstart[r + 2] - runstart[r + 1], out + start);
+                else
+                    memcpy(out + start, in + start, (runstart[r + 1] - start) * sizeof(mapsort));
+                runstart[nmerged++] = start;
+            }
+            runstart[nmerged] = nmap;
+            nsorted_runs = nmerged;
+
+            mapsort *swap = in;
+            in = out;
+            out = swap;
+        }
+        sorted = in;
+    }
+    else
+        sorted = radix_sort_mapsort(map, nmap, tmp);
+
+    if (sorted != map)
+        memcpy(map, sorted, nmap * sizeof(mapsort));
+
+    free(tmp);
+    free(runstart);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Set start and count so that they describe the first region in
+ * map. This finds the same region as find_region(), in time linear in
+ * the length of the region.
+ *
+ * find_region() checks the next copy of the region along a dimension
+ * point by point, so a copy that only fails to match near its end
+ * (e.g. a land point at the end of the next level of an ocean grid)
+ * costs a scan of the whole region. Here the first and last points of
+ * each row of the copy are checked first, and the copy is only
+ * scanned point by point if all its rows match at both ends, in which
+ * case it almost always becomes part of the region.
+ *
+ * @param ndims the number of dimensions.
+ * @param gdimlen an array length ndims with the sizes of the global
+ * dimensions.
+ * @param maplen the length of the map.
+ * @param map the (sorted, 1 based) map.
+ * @param start array (length ndims) that will get start indicies of
+ * found region.
+ * @param count array (length ndims) that will get counts of found
+ * region.
+ * @returns length of the region found.
+ */
+static PIO_Offset find_region_fast(int ndims, const int *gdimlen, PIO_Offset maplen,
+                                   const PIO_Offset *map, PIO_Offset *start, PIO_Offset *count)
+{
+    PIO_Offset rowlen;      /* Length of the innermost rows of the region. */
+    PIO_Offset max_size;
+    PIO_Offset region_size; /* Number of points in the region so far. */
+    PIO_Offset region_stride;
+
+    pioassert(ndims > 0 && gdimlen && maplen > 0 && map && start && count,
+              "invalid input", __FILE__, __LINE__);
+
+    idx_to_dim_list(ndims, gdimlen, map[0] - 1, start);
+
+    /* Expand along the innermost dimension, up to the array edge. */
+    max_size = gdimlen[ndims - 1] - start[ndims - 1];
+    for (rowlen = 1; rowlen < max_size && rowlen < maplen; rowlen++)
+        if (map[rowlen] != map[0] + rowlen)
+            break;
+    count[ndims - 1] = rowlen;
+    region_size = rowlen;
+    region_stride = gdimlen[ndims - 1];
+
+    /* Expand along the outer dimensions while the next copy of the
+     * region, shifted by region_stride, follows in the map. */
+    for (int dim = ndims - 2; dim >= 0; dim--)
+    {
+        PIO_Offset i;
+
+        max_size = gdimlen[dim] - start[dim];
+        for (i = 1; i < max_size; i++)
+        {
+            const PIO_Offset *copy = map + i * region_size;
+            PIO_Offset shift = i * region_stride;
+            bool match = (i * region_size + region_size <= maplen);
+
+            for (PIO_Offset r = 0; match && r < region_size; r += rowlen)
+                if (copy[r] != map[r] + shift ||
+                    copy[r + rowlen - 1] != map[r + rowlen - 1] + shift)
+                    match = false;
+            for (PIO_Offset j = 0; match && j < region_size; j++)
+                if (copy[j] != map[j] + shift)
+                    match = false;
+            if (!match)
+                break;
+        }
+        count[dim] = i;
+        region_size *= i;
+        region_stride *= gdimlen[dim];
+    }
+
+    return region_size;
+}
+
 /**
  * Calculate start and count regions for the subset rearranger. This
  * function is not used in the box rearranger.
@@ -1985,31 +4160,31 @@ int compare_offsets(const void *a, const void *b)
  * @returns 0 on success, error code otherwise.
  * @author Jim Edwards
  */
-int get_regions(int ndims, const int *gdimlen, int maplen, const PIO_Offset *map,
+int get_regions(int ndims, const int *gdimlen, PIO_Offset maplen, const PIO_Offset *map,
                 int *maxregions, io_region *firstregion)
 {
-    int nmaplen = 0;
-    int regionlen;
+    PIO_Offset nmaplen = 0;
+    PIO_Offset regionlen;
     io_region *region;
     int ret;
 
     /* Check inputs. */
     pioassert(ndims >= 0 && gdimlen && maplen >= 0 && maxregions && firstregion,
               "invalid input", __FILE__, __LINE__);
-    LOG((1, "get_regions ndims = %d maplen = %d", ndims, maplen));
+    LOG((1, "get_regions ndims = %d maplen = %lld", ndims, maplen));
 
     region = firstregion;
     if (map)
     {
         while (map[nmaplen++] <= 0)
         {
-            LOG((3, "map[%d] = %d", nmaplen, map[nmaplen]));
+            LOG((3, "map[%lld] = %lld", nmaplen, map[nmaplen]));
             ;
         }
         nmaplen--;
     }
     region->loffset = nmaplen;
-    LOG((2, "region->loffset = %d", region->loffset));
+    LOG((2, "region->loffset = %lld", region->loffset));
 
     *maxregions = 1;
 
@@ -2023,12 +4198,12 @@ int get_regions(int ndims, const int *gdimlen, int maplen, const PIO_Offset *map
             region->count[i] = 1;
 
         /* Set start/count to describe first region in map. */
-        regionlen = find_region(ndims, gdimlen, maplen-nmaplen,
-                                &map[nmaplen], region->start, region->count);
+        regionlen = find_region_fast(ndims, gdimlen, maplen - nmaplen, &map[nmaplen],
+                                     region->start, region->count);
         pioassert(region->start[0] >= 0, "failed to find region", __FILE__, __LINE__);
 
         nmaplen = nmaplen + regionlen;
-        LOG((2, "regionlen = %d nmaplen = %d", regionlen, nmaplen));
+        LOG((2, "regionlen = %lld nmaplen = %lld", regionlen, nmaplen));
 
         /* If we need to, allocate the next region. */
         if (region->next == NULL && nmaplen < maplen)
@@ -2147,6 +4322,173 @@ int default_subset_partition(iosystem_desc_t *ios, io_desc_t *iodesc)
     return PIO_NOERR;
 }
 
+/* A computation task ordered by the volume subset partition */
+typedef struct subset_task
+{
+    /* The lowest global offset in the decomposition map of the task */
+    PIO_Offset minoffset;
+    /* The rank of the task */
+    int rank;
+} subset_task_t;
+
+/* Compare two computation tasks by their lowest global offsets, for
+ * qsort(). Ties are broken by rank, so the order is deterministic. */
+static int compare_subset_tasks(const void *a, const void *b)
+{
+    const subset_task_t *x = (const subset_task_t *)a;
+    const subset_task_t *y = (const subset_task_t *)b;
+
+    if (x->minoffset != y->minoffset)
+        return (x->minoffset > y->minoffset) - (x->minoffset < y->minoffset);
+    return (x->rank > y->rank) - (x->rank < y->rank);
+}
+
+/**
+ * Create the MPI communicators needed by the subset rearranger,
+ * balancing the data volume of the groups of computation tasks
+ * assigned to each IO task.
+ *
+ * Each IO task is in its own group, along with a contiguous range of
+ * the computation tasks. The computation tasks are ordered by rank
+ * (PIO_SUBSET_PARTITION_VOLUME) or by the lowest global offset in
+ * their decomposition maps (PIO_SUBSET_PARTITION_VOLUME_LOCALITY),
+ * and the order is split in ranges so that the (cumulative) volume of
+ * each group is close to its share of the total volume. The volume
+ * of a task is the number of non-hole entries in its map.
+ *
+ * This function is collective across the tasks used to create the
+ * subset communicators (see default_subset_partition()), and all
+ * tasks compute the same partition from the allgathered volumes.
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @returns 0 on success, error code otherwise.
+ */
+int volume_subset_partition(iosystem_desc_t *ios, io_desc_t *iodesc)
+{
+    MPI_Comm union_comm;
+    int ntasks, rank;
+    PIO_Offset myinfo[3]; /* {io rank (-1 if not an IO task), volume, lowest offset} */
+    PIO_Offset *info = NULL;
+    PIO_Offset *gvolume = NULL; /* The volume of each group */
+    subset_task_t *order = NULL;
+    PIO_Offset totvolume = 0, cumvolume, maxvolume = 0;
+    int norder = 0;
+    int color = -1, key = 0;
+    int mpierr; /* Return value from MPI functions. */
+
+    pioassert(ios && iodesc && ios->num_iotasks > 0, "invalid input", __FILE__, __LINE__);
+    LOG((1, "volume_subset_partition ios->ioproc = %d ios->io_rank = %d "
+         "ios->subset_partition = %d", ios->ioproc, ios->io_rank, ios->subset_partition));
+
+    /* See default_subset_partition() */
+    union_comm = (ios->async) ? ios->union_comm : ios->comp_comm;
+    if ((mpierr = MPI_Comm_size(union_comm, &ntasks)))
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Comm_rank(union_comm, &rank)))
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+
+    myinfo[0] = (ios->ioproc) ? ios->io_rank : -1;
+    myinfo[1] = 0;
+    myinfo[2] = LLONG_MAX;
+    for (int i = 0; i < iodesc->maplen; i++)
+    {
+        if (iodesc->map[i] > 0)
+        {
+            myinfo[1]++;
+            if (iodesc->map[i] < myinfo[2])
+                myinfo[2] = iodesc->map[i];
+        }
+    }
+
+    if (!(info = malloc(3 * ntasks * sizeof(PIO_Offset))) ||
+        !(gvolume = calloc(ios->num_iotasks, sizeof(PIO_Offset))) ||
+        !(order = malloc(ntasks * sizeof(subset_task_t))))
+    {
+        free(info);
+        free(gvolume);
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                        "Creating the volume balanced subset partition failed. Out of memory allocating %lld bytes for the data volumes of the tasks", (unsigned long long) (ntasks * (3 * sizeof(PIO_Offset) + sizeof(subset_task_t))));
+    }
+
+    if ((mpierr = MPI_Allgather(myinfo, 3, MPI_OFFSET, info, 3, MPI_OFFSET, union_comm)))
+    {
+        free(info);
+        free(gvolume);
+        free(order);
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    }
+
+    /* The IO tasks are in the group of their IO rank, the other tasks
+     * are ordered. */
+    for (int t = 0; t < ntasks; t++)
+    {
+        totvolume += info[3 * t + 1];
+        if (info[3 * t] >= 0)
+        {
+            gvolume[info[3 * t]] += info[3 * t + 1];
+        }
+        else
+        {
+            order[norder].minoffset = (ios->subset_partition == PIO_SUBSET_PARTITION_VOLUME_LOCALITY) ?
+                info[3 * t + 2] : 0;
+            order[norder].rank = t;
+            norder++;
+        }
+    }
+    if (ios->subset_partition == PIO_SUBSET_PARTITION_VOLUME_LOCALITY)
+        qsort(order, norder, sizeof(subset_task_t), compare_subset_tasks);
+
+    /* Assign the ordered tasks to the groups, moving to the next group
+     * once the cumulative volume (including the volume of the IO
+     * tasks of the groups) reaches the share of the groups so far. A
+     * task is kept in the current group if at least half of its
+     * volume fits in the share. */
+    cumvolume = gvolume[0];
+    for (int i = 0, g = 0; i < norder; i++)
+    {
+        PIO_Offset volume = info[3 * order[i].rank + 1];
+
+        while (g < ios->num_iotasks - 1 &&
+               2 * (cumvolume * ios->num_iotasks) + volume * ios->num_iotasks >
+               2 * (g + 1) * totvolume)
+        {
+            g++;
+            cumvolume += gvolume[g];
+        }
+        gvolume[g] += volume;
+        cumvolume += volume;
+
+        if (order[i].rank == rank)
+        {
+            color = g;
+            key = i + 1;
+        }
+    }
+
+    if (ios->ioproc)
+    {
+        color = ios->io_rank;
+        key = 0;
+    }
+    assert(color >= 0 && color <= ios->num_iotasks - 1);
+
+    for (int g = 0; g < ios->num_iotasks; g++)
+        maxvolume = max(maxvolume, gvolume[g]);
+    LOG((2, "volume_subset_partition key = %d color = %d max group volume = %lld "
+         "average group volume = %f", key, color, (long long)maxvolume,
+         (double)totvolume / ios->num_iotasks));
+
+    free(info);
+    free(gvolume);
+    free(order);
+
+    if ((mpierr = MPI_Comm_split(union_comm, color, key, &(iodesc->subset_comm))))
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+
+    return PIO_NOERR;
+}
+
 /**
  * Create the subset rearranger.
  *
@@ -2158,7 +4500,8 @@ int default_subset_partition(iosystem_desc_t *ios, io_desc_t *iodesc)
  *
  * This function:
  * <ul>
- * <li>Calls default_subset_partition() to create subset_comm.
+ * <li>Calls default_subset_partition() or volume_subset_partition()
+ * (see PIOc_set_subset_partition()) to create subset_comm.
  * <li>For IO tasks, allocates iodesc->rcount array (length ntasks).
  * <li>Allocates iodesc->scount array (length 1)
  * <li>Determins value of iodesc->scount[0], the number of data
@@ -2221,12 +4564,15 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
 
     /* subset partitions each have exactly 1 io task which is task 0
      * of that subset_comm */
-    /* TODO: introduce a mechanism for users to define partitions */
-    if ((ret = default_subset_partition(ios, iodesc)))
+    if (ios->subset_partition == PIO_SUBSET_PARTITION_RANK)
+        ret = default_subset_partition(ios, iodesc);
+    else
+        ret = volume_subset_partition(ios, iodesc);
+    if (ret)
     {
         GPTLstop("PIO:subset_rearrange_create");
         return pio_err(ios, NULL, ret, __FILE__, __LINE__,
-                        "Creating SUBSET rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Unable to create the default subset partition for the I/O decomposition", iodesc->ioid, ios->iosysid);
+                        "Creating SUBSET rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Unable to create the subset partition for the I/O decomposition", iodesc->ioid, ios->iosysid);
     }
     iodesc->rearranger = PIO_REARR_SUBSET;
 
@@ -2319,7 +4665,7 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
 
     iodesc->llen = 0;
 
-    int rdispls[ntasks];
+    PIO_Offset rdispls[ntasks];
     int recvcounts[ntasks];
 
     /* On IO tasks determine llen. */
@@ -2343,8 +4689,8 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
                                 "Creating SUBSET rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Out of memory allocating %lld bytes for storing source indices while setting up the rearranger", iodesc->ioid, ios->iosysid, (unsigned long long) (iodesc->llen * sizeof(PIO_Offset)));
             }
 
-            for (i = 0; i < iodesc->llen; i++)
-                srcindex[i] = 0;
+            for (PIO_Offset k = 0; k < iodesc->llen; k++)
+                srcindex[k] = 0;
         }
     }
     else
@@ -2364,13 +4710,14 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
                         "Creating SUBSET rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Unable to determine the fillvalue to be used", iodesc->ioid, ios->iosysid);
     }
 
-    /* Pass the sindex from each compute task to its associated IO task. */
-    if ((mpierr = MPI_Gatherv(iodesc->sindex, iodesc->scount[0], PIO_OFFSET,
-                              srcindex, recvcounts, rdispls, PIO_OFFSET, 0,
-                              iodesc->subset_comm)))
+    /* Pass the sindex from each compute task to its associated IO
+     * task. The IO task may get more than INT_MAX elements. */
+    if ((ret = pio_gatherv_large(iodesc->sindex, iodesc->scount[0], PIO_OFFSET, srcindex,
+                                 recvcounts, rdispls, 0, iodesc->subset_comm)))
     {
         GPTLstop("PIO:subset_rearrange_create");
-        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Creating SUBSET rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Gathering the send indices on the I/O process failed", iodesc->ioid, ios->iosysid);
     }
 
     /* On IO tasks which need it, allocate memory for the map and the
@@ -2415,11 +4762,12 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
 
     /* Gather shrtmap from each task in the subset communicator, and
      * put gathered results into iomap. */
-    if ((mpierr = MPI_Gatherv(shrtmap, iodesc->scount[0], PIO_OFFSET, iomap, recvcounts,
-                              rdispls, PIO_OFFSET, 0, iodesc->subset_comm)))
+    if ((ret = pio_gatherv_large(shrtmap, iodesc->scount[0], PIO_OFFSET, iomap, recvcounts,
+                                 rdispls, 0, iodesc->subset_comm)))
     {
         GPTLstop("PIO:subset_rearrange_create");
-        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Creating SUBSET rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Gathering the map on the I/O process failed", iodesc->ioid, ios->iosysid);
     }
 
     if (shrtmap != compmap)
@@ -2428,8 +4776,8 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
     /* On IO tasks that have data in the local array ??? */
     if (ios->ioproc && iodesc->llen > 0)
     {
-        int pos = 0;
-        int k = 0;
+        PIO_Offset pos = 0;
+        PIO_Offset k = 0;
         mapsort *mptr;
         for (i = 0; i < ntasks; i++)
         {
@@ -2445,7 +4793,12 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
         }
 
         /* sort the mapping, this will transpose the data into IO order */
-        qsort(map, iodesc->llen, sizeof(mapsort), compare_offsets);
+        if ((ret = sort_mapsort(map, iodesc->llen, iodesc->rcount, ntasks)))
+        {
+            GPTLstop("PIO:subset_rearrange_create");
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                            "Creating SUBSET rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Sorting the internal map failed", iodesc->ioid, ios->iosysid);
+        }
 
         if (!(iodesc->rindex = calloc(1, iodesc->llen * sizeof(PIO_Offset))))
         {
@@ -2462,7 +4815,7 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
         }
     }
 
-    int cnt[ntasks];
+    PIO_Offset cnt[ntasks];
     for (i = 0; i < ntasks; i++)
     {
         cnt[i] = rdispls[i];
@@ -2470,7 +4823,7 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
 
     /* For IO tasks init rfrom and rindex arrays (compute tasks have
      * llen of 0). */
-    for (i = 0; i < iodesc->llen; i++)
+    for (PIO_Offset i = 0; i < iodesc->llen; i++)
     {
         mapsort *mptr = &map[i];
         iodesc->rfrom[i] = mptr->rfrom;
@@ -2658,12 +5011,12 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
     }
 
     /* Scatter values of srcindex to subset communicator. ??? */
-    if ((mpierr = MPI_Scatterv((void *)srcindex, recvcounts, rdispls, PIO_OFFSET,
-                               (void *)iodesc->sindex, iodesc->scount[0],  PIO_OFFSET,
-                               0, iodesc->subset_comm)))
+    if ((ret = pio_scatterv_large(srcindex, recvcounts, rdispls, PIO_OFFSET, iodesc->sindex,
+                                  iodesc->scount[0], 0, iodesc->subset_comm)))
     {
         GPTLstop("PIO:subset_rearrange_create");
-        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Creating SUBSET rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Scattering the send indices to the compute processes failed", iodesc->ioid, ios->iosysid);
     }
 
     if (ios->ioproc)
@@ -2706,6 +5059,22 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
         }
 
         iodesc->nrecvs = ntasks;
+
+        /* Record the imbalance of the data volume received by the IO
+         * tasks, for the I/O performance summary. */
+        PIO_Offset maxllen = iodesc->llen, totllen = iodesc->llen;
+        if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &maxllen, 1, MPI_OFFSET, MPI_MAX, ios->io_comm)) ||
+            (mpierr = MPI_Allreduce(MPI_IN_PLACE, &totllen, 1, MPI_OFFSET, MPI_SUM, ios->io_comm)))
+        {
+            GPTLstop("PIO:subset_rearrange_create");
+            return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+        }
+        if (totllen > 0)
+        {
+            double imbalance = (double)maxllen * ios->num_iotasks / totllen;
+            LOG((2, "subset rearranger data volume imbalance = %f", imbalance));
+            ios->subset_imbalance = max(ios->subset_imbalance, imbalance);
+        }
     }
 
     /* Using maxiobuflen compute the maximum number of vars of this type that the io
@@ -2722,132 +5091,150 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
 }
 
 /**
- * Performance tuning rearranger.
+ * Candidate rearranger options timed by the rearranger autotuner.
+ * Only the compute to IO rearrangement (writes) is timed, the flow
+ * control options of a candidate are used in both directions.
+ */
+static const rearr_opt_t rearr_autotune_candidates[PIO_REARR_AUTOTUNE_NCANDIDATES] = {
+    {PIO_REARR_COMM_COLL, PIO_REARR_COMM_FC_2D_DISABLE,
+        {false, false, 0}, {false, false, 0}},
+    {PIO_REARR_COMM_NEIGHBOR, PIO_REARR_COMM_FC_2D_DISABLE,
+        {false, false, 0}, {false, false, 0}},
+    {PIO_REARR_COMM_P2P, PIO_REARR_COMM_FC_2D_DISABLE,
+        {false, false, PIO_REARR_COMM_UNLIMITED_PEND_REQ},
+        {false, false, PIO_REARR_COMM_UNLIMITED_PEND_REQ}},
+    {PIO_REARR_COMM_P2P, PIO_REARR_COMM_FC_2D_ENABLE,
+        {true, true, 64}, {true, true, 64}},
+    {PIO_REARR_COMM_P2P, PIO_REARR_COMM_FC_2D_ENABLE,
+        {false, true, 64}, {false, true, 64}},
+    {PIO_REARR_COMM_P2P, PIO_REARR_COMM_FC_2D_ENABLE,
+        {true, false, 64}, {true, false, 64}},
+    {PIO_REARR_COMM_P2P, PIO_REARR_COMM_FC_2D_ENABLE,
+        {true, true, 16}, {true, true, 16}},
+    {PIO_REARR_COMM_SPARSE, PIO_REARR_COMM_FC_2D_ENABLE,
+        {true, true, 64}, {true, true, 64}}
+};
+
+/**
+ * Start tuning the rearranger options of an I/O decomposition. The
+ * next PIO_REARR_AUTOTUNE_NCANDIDATES + 1 rearrangements of data
+ * from compute to IO tasks are used to time the candidate options.
  *
- * @param ios pointer to the iosystem description struct.
  * @param iodesc pointer to the IO description struct.
  * @returns 0 on success, error code otherwise.
- * @author Jim Edwards
  */
-void performance_tune_rearranger(iosystem_desc_t *ios, io_desc_t *iodesc)
+int rearr_autotune_init(io_desc_t *iodesc)
 {
-#ifdef TIMING
-#ifdef PERFTUNE
-    double *wall, usr[2], sys[2];
-    void *cbuf, *ibuf;
-    int tsize;
-    int myrank;
-    int mpierr; /* Return code for MPI calls. */
+    pioassert(iodesc, "invalid input", __FILE__, __LINE__);
 
-    assert(iodesc);
+    if (!(iodesc->autotune = calloc(1, sizeof(rearr_autotune_t))))
+        return PIO_ENOMEM;
 
-    if ((mpierr = MPI_Type_size(iodesc->mpitype, &tsize)))
-        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-    cbuf = NULL;
-    ibuf = NULL;
-    if (iodesc->ndof > 0)
-        if (!(cbuf = bget(iodesc->ndof * tsize)))
-        {
-            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
-                            "Performance tuning of the rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Out of memory allocating %lld bytes for buffer on compute processes", iodesc->ioid, ios->iosysid, (unsigned long long) (iodesc->ndof * tsize));
-        }
+    /* The first rearrangement is a warm up (it includes the creation
+     * of the MPI datatypes), it is not timed. */
+    iodesc->autotune->next = -1;
 
-    if (iodesc->llen > 0)
-        if (!(ibuf = bget(iodesc->llen * tsize)))
-        {
-            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
-                            "Performance tuning of the rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Out of memory allocating %lld bytes for buffer on I/O processes", iodesc->ioid, ios->iosysid, (unsigned long long) (iodesc->llen * tsize));
-        }
+    return PIO_NOERR;
+}
 
-    if (iodesc->rearranger == PIO_REARR_BOX)
-        mycomm = ios->union_comm;
-    else
-        mycomm = iodesc->subset_comm;
+/**
+ * Set the rearranger options, of an I/O decomposition being tuned,
+ * to the candidate options to be timed in the next rearrangement.
+ * This function is collective across all tasks in comm.
+ *
+ * @param ios pointer to the iosystem description struct.
+ * @param iodesc pointer to the IO description struct.
+ * @param comm the communicator used by the rearranger.
+ * @returns 0 on success, error code otherwise.
+ */
+int rearr_autotune_begin(iosystem_desc_t *ios, io_desc_t *iodesc, MPI_Comm comm)
+{
+    int mpierr;
+    int ret;
 
-    if ((mpierr = MPI_Comm_size(mycomm, &nprocs)))
-        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Comm_rank(mycomm, &myrank)))
-        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    pioassert(ios && iodesc && iodesc->autotune, "invalid input", __FILE__, __LINE__);
+
+    if (iodesc->autotune->next < 0)
+        return PIO_NOERR;
+
+    iodesc->rearr_opts = rearr_autotune_candidates[iodesc->autotune->next];
+    LOG((2, "rearr_autotune_begin ioid = %d candidate = %d comm_type = %s",
+         iodesc->ioid, iodesc->autotune->next,
+         pio_rearr_comm_type_to_string(iodesc->rearr_opts.comm_type)));
 
-    int log2 = log(nprocs) / log(2) + 1;
-    if (!(wall = bget(2 * 4 * log2 * sizeof(double))))
+    if ((iodesc->rearr_opts.comm_type == PIO_REARR_COMM_NEIGHBOR &&
+         iodesc->neigh_comm == MPI_COMM_NULL) ||
+        (iodesc->rearr_opts.comm_type == PIO_REARR_COMM_SPARSE && !iodesc->neighbors))
     {
-        return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
-                        "Performance tuning of the rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Out of memory allocating %lld bytes for timers", iodesc->ioid, ios->iosysid, (unsigned long long) (i2 * 4 * log2 * sizeof(double)));
+        if ((ret = create_neighbor_comm(ios, iodesc)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                            "Tuning the rearranger for I/O decomposition (ioid=%d) failed. Creating the neighborhood communicator failed", iodesc->ioid);
     }
-    double mintime;
-    int k = 0;
 
-    if ((mpierr = MPI_Barrier(mycomm)))
-        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-    GPTLstamp(&wall[0], &usr[0], &sys[0]);
-    rearrange_comp2io(ios, iodesc, cbuf, ibuf, 1);
-    rearrange_io2comp(ios, iodesc, ibuf, cbuf);
-    GPTLstamp(&wall[1], &usr[1], &sys[1]);
-    mintime = wall[1]-wall[0];
-    if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &mintime, 1, MPI_DOUBLE, MPI_MAX, mycomm)))
+    /* Do not include the load imbalance from before the rearrangement
+     * in the timing. */
+    if ((mpierr = MPI_Barrier(comm)))
         return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
 
-    handshake = iodesc->rearr_opts.comp2io.hs;
-    isend = iodesc->isend;
-    maxreqs = iodesc->max_requests;
+    return PIO_NOERR;
+}
+
+/**
+ * Record the time spent in a rearrangement with the current
+ * candidate options, of an I/O decomposition being tuned. Once all
+ * the candidates are timed, the fastest options are set for the
+ * decomposition and the tuning ends. This function is collective
+ * across all tasks in comm.
+ *
+ * The max time across all tasks in comm is recorded for each
+ * candidate, so all tasks pick the same (fastest) options.
+ *
+ * @param ios pointer to the iosystem description struct.
+ * @param iodesc pointer to the IO description struct.
+ * @param comm the communicator used by the rearranger.
+ * @param wtime the time, in seconds, spent by this task in the
+ * rearrangement.
+ * @returns 0 on success, error code otherwise.
+ */
+int rearr_autotune_end(iosystem_desc_t *ios, io_desc_t *iodesc, MPI_Comm comm,
+                       double wtime)
+{
+    rearr_autotune_t *tune;
+    int best = 0;
+    int mpierr;
+
+    pioassert(ios && iodesc && iodesc->autotune, "invalid input", __FILE__, __LINE__);
+    tune = iodesc->autotune;
 
-    for (int i = 0; i < 2; i++)
+    if (tune->next < 0)
     {
-        if (i == 0)
-            iodesc->rearr_opts.comp2io.hs = false;
-        else
-            iodesc->rearr_opts.comp2io.hs = true;
+        tune->next = 0;
+        return PIO_NOERR;
+    }
 
-        for (int j = 0; j < 2; j++)
-        {
-            if (j == 0)
-                iodesc->isend = false;
-            else
-                iodesc->isend = true;
+    if ((mpierr = MPI_Allreduce(&wtime, &(tune->wtime[tune->next]), 1, MPI_DOUBLE, MPI_MAX,
+                                comm)))
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    LOG((2, "rearr_autotune_end ioid = %d candidate = %d wtime = %f", iodesc->ioid,
+         tune->next, tune->wtime[tune->next]));
 
-            iodesc->max_requests = 0;
+    if (++(tune->next) < PIO_REARR_AUTOTUNE_NCANDIDATES)
+        return PIO_NOERR;
 
-            for (nreqs = nprocs; nreqs >= 2; nreqs /= 2)
-            {
-                iodesc->max_requests = nreqs;
-                if ((mpierr = MPI_Barrier(mycomm)))
-                    return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-                GPTLstamp(wall, usr, sys);
-                rearrange_comp2io(ios, iodesc, cbuf, ibuf, 1);
-                rearrange_io2comp(ios, iodesc, ibuf, cbuf);
-                GPTLstamp(wall+1, usr, sys);
-                wall[1] -= wall[0];
-                if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, wall + 1, 1, MPI_DOUBLE, MPI_MAX,
-                                            mycomm)))
-                    return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-
-                if (wall[1] < mintime * 0.95)
-                {
-                    handshake = iodesc->rearr_opts.comp2io.hs;
-                    isend = iodesc->isend;
-                    maxreqs = nreqs;
-                    mintime = wall[1];
-                }
-                else if (wall[1] > mintime * 1.05)
-                {
-                    exit;
-                }
-            }
-        }
-    }
+    /* All candidates are timed, lock in the fastest options. */
+    for (int i = 1; i < PIO_REARR_AUTOTUNE_NCANDIDATES; i++)
+        if (tune->wtime[i] < tune->wtime[best])
+            best = i;
 
-    iodesc->rearr_opts.comp2io.hs = handshake;
-    iodesc->isend = isend;
-    iodesc->max_requests = maxreqs;
+    iodesc->rearr_opts = rearr_autotune_candidates[best];
+    LOG((1, "Rearranger tuned for ioid = %d : comm_type = %s fcd = %d hs = %d isend = %d "
+         "max_pend_req = %d (wtime = %f s)", iodesc->ioid,
+         pio_rearr_comm_type_to_string(iodesc->rearr_opts.comm_type), iodesc->rearr_opts.fcd,
+         iodesc->rearr_opts.comp2io.hs, iodesc->rearr_opts.comp2io.isend,
+         iodesc->rearr_opts.comp2io.max_pend_req, tune->wtime[best]));
 
-    LOG((1, "spmd optimization: maxreqs: %d handshake:%d isend:%d mintime=%f\n",
-         maxreqs,handshake,isend,mintime));
+    free(iodesc->autotune);
+    iodesc->autotune = NULL;
 
-    /* Free memory. */
-    brel(wall);
-    brel(cbuf);
-    brel(ibuf);
-#endif
-#endif
+    return PIO_NOERR;
 }
@@ -47,41 +47,97 @@ int pair(int np, int p, int k)
 }
 
 /**
- * Provides the functionality of MPI_Alltoallw with flow control
- * options. Generalized all-to-all communication allowing different
- * datatypes, counts, and displacements for each partner
+ * Send data from this task to itself, for pio_swapm() and
+ * pio_sparse_swapm().
  *
- * @param sendbuf starting address of send buffer
- * @param sendcounts integer array equal to the number of tasks in
- * communicator comm (ntasks). It specifies the number of elements to
- * send to each processor
- * @param sdispls integer array (of length ntasks). Entry j
- * specifies the displacement in bytes (relative to sendbuf) from
- * which to take the outgoing data destined for process j.
- * @param sendtypes array of datatypes (of length ntasks). Entry j
- * specifies the type of data to send to process j.
+ * @param sendbuf starting address of send buffer.
+ * @param sendcounts array (of length ntasks) of the number of
+ * elements to send to each task.
+ * @param sdispls array (of length ntasks) of the send displacements
+ * (in bytes).
+ * @param sendtypes array (of length ntasks) of send datatypes.
  * @param recvbuf address of receive buffer.
- * @param recvcounts integer array (of length ntasks) specifying the
- * number of elements that can be received from each processor.
- * @param rdispls integer array (of length ntasks). Entry i
- * specifies the displacement in bytes (relative to recvbuf) at which
- * to place the incoming data from process i.
- * @param recvtypes array of datatypes (of length ntasks). Entry i
- * specifies the type of data received from process i.
- * @param comm MPI communicator for the MPI_Alltoallw call.
+ * @param recvcounts array (of length ntasks) of the number of
+ * elements to receive from each task.
+ * @param rdispls array (of length ntasks) of the receive
+ * displacements (in bytes).
+ * @param recvtypes array (of length ntasks) of receive datatypes.
+ * @param comm MPI communicator.
+ * @param my_rank rank of this task in comm.
+ * @param offset_t offset added to the ranks to get the message tags.
+ * @returns 0 for success, error code otherwise.
+ */
+static int swapm_self(void *sendbuf, int *sendcounts, int *sdispls, MPI_Datatype *sendtypes,
+                      void *recvbuf, int *recvcounts, int *rdispls, MPI_Datatype *recvtypes,
+                      MPI_Comm comm, int my_rank, int offset_t)
+{
+    void *sptr, *rptr;
+    int tag = my_rank + offset_t;
+    MPI_Status status;
+    int mpierr;  /* Return code from MPI functions. */
+
+    sptr = (char *)sendbuf + sdispls[my_rank];
+    rptr = (char *)recvbuf + rdispls[my_rank];
+
+#ifdef ONEWAY
+    /* If ONEWAY is true we will post mpi_sendrecv comms instead
+     * of irecv/send. */
+    if ((mpierr = MPI_Sendrecv(sptr, sendcounts[my_rank],sendtypes[my_rank],
+                               my_rank, tag, rptr, recvcounts[my_rank], recvtypes[my_rank],
+                               my_rank, tag, comm, &status)))
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+#else
+    MPI_Request rcvid;
+
+    if ((mpierr = MPI_Irecv(rptr, recvcounts[my_rank], recvtypes[my_rank],
+                            my_rank, tag, comm, &rcvid)))
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Send(sptr, sendcounts[my_rank], sendtypes[my_rank],
+                           my_rank, tag, comm)))
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Wait(&rcvid, &status)))
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+#endif
+
+    return PIO_NOERR;
+}
+
+/**
+ * Exchange data with the tasks in swapids, with flow control. This
+ * is the point to point part of pio_swapm() and pio_sparse_swapm().
+ *
+ * The tasks in swapids must be in pair() order (the order of
+ * (swapids[i] ^ my_rank)), so that each pair of tasks post their
+ * messages to each other at the same step. The request arrays are
+ * indexed by the step, so only steps requests are needed.
+ *
+ * @param sendbuf starting address of send buffer.
+ * @param sendcounts array (of length ntasks) of the number of
+ * elements to send to each task.
+ * @param sdispls array (of length ntasks) of the send displacements
+ * (in bytes).
+ * @param sendtypes array (of length ntasks) of send datatypes.
+ * @param recvbuf address of receive buffer.
+ * @param recvcounts array (of length ntasks) of the number of
+ * elements to receive from each task.
+ * @param rdispls array (of length ntasks) of the receive
+ * displacements (in bytes).
+ * @param recvtypes array (of length ntasks) of receive datatypes.
+ * @param comm MPI communicator.
  * @param fc pointer to the struct that provided flow control options.
+ * @param my_rank rank of this task in comm.
+ * @param offset_t offset added to the ranks to get the message tags.
+ * @param swapids array (of length steps) of the ranks of the tasks
+ * this task exchanges data with.
+ * @param steps number of tasks in swapids (> 0).
  * @returns 0 for success, error code otherwise.
- * @author Jim Edwards
  */
-int pio_swapm(void *sendbuf, int *sendcounts, int *sdispls, MPI_Datatype *sendtypes,
-              void *recvbuf, int *recvcounts, int *rdispls, MPI_Datatype *recvtypes,
-              MPI_Comm comm, rearr_comm_fc_opt_t *fc)
+static int swapm_steps(void *sendbuf, int *sendcounts, int *sdispls, MPI_Datatype *sendtypes,
+                       void *recvbuf, int *recvcounts, int *rdispls, MPI_Datatype *recvtypes,
+                       MPI_Comm comm, rearr_comm_fc_opt_t *fc, int my_rank, int offset_t,
+                       const int *swapids, int steps)
 {
-    int ntasks;  /* Number of tasks in communicator comm. */
-    int my_rank; /* Rank of this task in comm. */
     int tag;
-    int offset_t;
-    int steps;
     int istep;
     int rstep;
     int p;
@@ -92,144 +148,17 @@ int pio_swapm(void *sendbuf, int *sendcounts, int *sdispls, MPI_Datatype *sendty
     MPI_Status status; /* Not actually used - replace with MPI_STATUSES_IGNORE. */
     int mpierr;  /* Return code from MPI functions. */
 
-    GPTLstart("PIO:pio_swapm");
-    LOG((2, "pio_swapm fc->hs = %d fc->isend = %d fc->max_pend_req = %d", fc->hs,
-         fc->isend, fc->max_pend_req));
-
-    /* Get my rank and size of communicator. */
-    if ((mpierr = MPI_Comm_size(comm, &ntasks)))
-    {
-        GPTLstop("PIO:pio_swapm");
-        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-    }
-    if ((mpierr = MPI_Comm_rank(comm, &my_rank)))
-    {
-        GPTLstop("PIO:pio_swapm");
-        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-    }
-
-    LOG((2, "ntasks = %d my_rank = %d", ntasks, my_rank));
-
-    /* Now we know the size of these arrays. */
-    int swapids[ntasks];
-    MPI_Request rcvids[ntasks];
-    MPI_Request sndids[ntasks];
-    MPI_Request hs_rcvids[ntasks];
-
-    /* Print some debugging info, if logging is enabled. */
-#if PIO_ENABLE_LOGGING
-    {
-        for (int p = 0; p < ntasks; p++)
-            LOG((3, "sendcounts[%d] = %d sdispls[%d] = %d sendtypes[%d] = %d recvcounts[%d] = %d "
-                 "rdispls[%d] = %d recvtypes[%d] = %d", p, sendcounts[p], p, sdispls[p], p,
-                 sendtypes[p], p, recvcounts[p], p, rdispls[p], p, recvtypes[p]));
-    }
-#endif /* PIO_ENABLE_LOGGING */
-
-    /* If fc->max_pend_req == 0 no throttling is requested and the default
-     * mpi_alltoallw function is used. */
-    if (fc->max_pend_req == 0)
-    {
-        /* Call the MPI alltoall without flow control. */
-        LOG((3, "Calling MPI_Alltoallw without flow control."));
-        if ((mpierr = MPI_Alltoallw(sendbuf, sendcounts, sdispls, sendtypes, recvbuf,
-                                    recvcounts, rdispls, recvtypes, comm)))
-        {
-            GPTLstop("PIO:pio_swapm");
-            return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-        }
-        GPTLstop("PIO:pio_swapm");
-        return PIO_NOERR;
-    }
-
-    /* an index for communications tags */
-    offset_t = ntasks;
-
-    /* Send to self. */
-    if (sendcounts[my_rank] > 0)
-    {
-        void *sptr, *rptr;
-        tag = my_rank + offset_t;
-        sptr = (char *)sendbuf + sdispls[my_rank];
-        rptr = (char *)recvbuf + rdispls[my_rank];
-
-        /*
-          MPI_Type_get_extent(sendtypes[my_rank], &lb, &extent);
-          printf("%s %d %d %d\n",__FILE__,__LINE__,extent, lb);
-          MPI_Type_get_extent(recvtypes[my_rank], &lb, &extent);
-          printf("%s %d %d %d\n",__FILE__,__LINE__,extent, lb);
-        */
-
-#ifdef ONEWAY
-        /* If ONEWAY is true we will post mpi_sendrecv comms instead
-         * of irecv/send. */
-        if ((mpierr = MPI_Sendrecv(sptr, sendcounts[my_rank],sendtypes[my_rank],
-                                   my_rank, tag, rptr, recvcounts[my_rank], recvtypes[my_rank],
-                                   my_rank, tag, comm, &status)))
-        {
-            GPTLstop("PIO:pio_swapm");
-            return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-        }
-#else
-        if ((mpierr = MPI_Irecv(rptr, recvcounts[my_rank], recvtypes[my_rank],
-                                my_rank, tag, comm, rcvids)))
-        {
-            GPTLstop("PIO:pio_swapm");
-            return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-        }
-        if ((mpierr = MPI_Send(sptr, sendcounts[my_rank], sendtypes[my_rank],
-                               my_rank, tag, comm)))
-        {
-            GPTLstop("PIO:pio_swapm");
-            return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-        }
-
-        if ((mpierr = MPI_Wait(rcvids, &status)))
-        {
-            GPTLstop("PIO:pio_swapm");
-            return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-        }
-#endif
-    }
-
-    LOG((2, "Done sending to self... sending to other procs"));
+    pioassert(swapids && steps > 0, "invalid input", __FILE__, __LINE__);
 
-    /* When send to self is complete there is nothing left to do if
-     * ntasks==1. */
-    if (ntasks == 1)
-    {
-        GPTLstop("PIO:pio_swapm");
-        return PIO_NOERR;
-    }
+    MPI_Request rcvids[steps];
+    MPI_Request sndids[steps];
+    MPI_Request hs_rcvids[steps];
 
-    for (int i = 0; i < ntasks; i++)
+    for (int i = 0; i < steps; i++)
     {
         rcvids[i] = MPI_REQUEST_NULL;
-        swapids[i] = 0;
-    }
-
-    if (fc->isend)
-        for (int i = 0; i < ntasks; i++)
-            sndids[i] = MPI_REQUEST_NULL;
-
-    if (fc->hs)
-        for (int i = 0; i < ntasks; i++)
-            hs_rcvids[i] = MPI_REQUEST_NULL;
-
-    steps = 0;
-    for (istep = 0; istep < ceil2(ntasks) - 1; istep++)
-    {
-        p = pair(ntasks, istep, my_rank);
-        if (p >= 0 && (sendcounts[p] > 0 || recvcounts[p] > 0))
-            swapids[steps++] = p;
-    }
-
-    LOG((3, "steps=%d", steps));
-
-    if (steps == 0)
-    {
-        GPTLstop("PIO:pio_swapm");
-        return PIO_NOERR;
+        sndids[i] = MPI_REQUEST_NULL;
+        hs_rcvids[i] = MPI_REQUEST_NULL;
     }
 
     if (steps == 1)
@@ -275,10 +204,7 @@ int pio_swapm(void *sendbuf, int *sendcounts, int *sdispls, MPI_Datatype *sendty
             {
                 tag = my_rank + offset_t;
                 if ((mpierr = MPI_Irecv(&hs, 1, MPI_INT, p, tag, comm, hs_rcvids + istep)))
-                {
-                    GPTLstop("PIO:pio_swapm");
                     return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-                }
             }
         }
     }
@@ -294,17 +220,11 @@ int pio_swapm(void *sendbuf, int *sendcounts, int *sdispls, MPI_Datatype *sendty
 
             if ((mpierr = MPI_Irecv(ptr, recvcounts[p], recvtypes[p], p, tag, comm,
                                     rcvids + istep)))
-            {
-                GPTLstop("PIO:pio_swapm");
                 return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-            }
 
             if (fc->hs)
                 if ((mpierr = MPI_Send(&hs, 1, MPI_INT, p, tag, comm)))
-                {
-                    GPTLstop("PIO:pio_swapm");
                     return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-                }
         }
     }
 
@@ -321,10 +241,7 @@ int pio_swapm(void *sendbuf, int *sendcounts, int *sdispls, MPI_Datatype *sendty
             if (fc->hs)
             {
                 if ((mpierr = MPI_Wait(hs_rcvids + istep, &status)))
-                {
-                    GPTLstop("PIO:pio_swapm");
                     return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-                }
                 hs_rcvids[istep] = MPI_REQUEST_NULL;
             }
             ptr = (char *)sendbuf + sdispls[p];
@@ -341,35 +258,23 @@ int pio_swapm(void *sendbuf, int *sendcounts, int *sdispls, MPI_Datatype *sendty
 #ifndef _USE_MPI_RSEND
                 if ((mpierr = MPI_Isend(ptr, sendcounts[p], sendtypes[p], p, tag, comm,
                                         sndids + istep)))
-                {
-                    GPTLstop("PIO:pio_swapm");
                     return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-                }
 #else
                 if ((mpierr = MPI_Irsend(ptr, sendcounts[p], sendtypes[p], p, tag, comm,
                                          sndids + istep)))
-                {
-                    GPTLstop("PIO:pio_swapm");
                     return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-                }
 #endif
             }
             else if (fc->isend)
             {
                 if ((mpierr = MPI_Isend(ptr, sendcounts[p], sendtypes[p], p, tag, comm,
                                          sndids + istep)))
-                {
-                    GPTLstop("PIO:pio_swapm");
                     return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-                }
             }
             else
             {
                 if ((mpierr = MPI_Send(ptr, sendcounts[p], sendtypes[p], p, tag, comm)))
-                {
-                    GPTLstop("PIO:pio_swapm");
                     return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-                }
             }
         }
 
@@ -381,10 +286,7 @@ int pio_swapm(void *sendbuf, int *sendcounts, int *sdispls, MPI_Datatype *sendty
             if (rcvids[p] != MPI_REQUEST_NULL)
             {
                 if ((mpierr = MPI_Wait(rcvids + p, &status)))
-                {
-                    GPTLstop("PIO:pio_swapm");
                     return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-                }
                 rcvids[p] = MPI_REQUEST_NULL;
             }
             if (rstep < steps)
@@ -394,10 +296,7 @@ int pio_swapm(void *sendbuf, int *sendcounts, int *sdispls, MPI_Datatype *sendty
                 {
                     tag = my_rank + offset_t;
                     if ((mpierr = MPI_Irecv(&hs, 1, MPI_INT, p, tag, comm, hs_rcvids+rstep)))
-                    {
-                        GPTLstop("PIO:pio_swapm");
                         return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-                    }
                 }
                 if (recvcounts[p] > 0)
                 {
@@ -405,84 +304,1016 @@ int pio_swapm(void *sendbuf, int *sendcounts, int *sdispls, MPI_Datatype *sendty
 
                     ptr = (char *)recvbuf + rdispls[p];
                     if ((mpierr = MPI_Irecv(ptr, recvcounts[p], recvtypes[p], p, tag, comm, rcvids + rstep)))
-                    {
-                        GPTLstop("PIO:pio_swapm");
                         return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-                    }
                     if (fc->hs)
                         if ((mpierr = MPI_Send(&hs, 1, MPI_INT, p, tag, comm)))
-                        {
-                            GPTLstop("PIO:pio_swapm");
                             return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-                        }
                 }
                 rstep++;
             }
         }
     }
 
-    /* If steps > 0 there could still be outstanding messages, wait for
-     * them here. */
-    if (steps > 0)
-    {
-        LOG((2, "Waiting for outstanding msgs"));
-        if ((mpierr = MPI_Waitall(steps, rcvids, MPI_STATUSES_IGNORE)))
-        {
-            GPTLstop("PIO:pio_swapm");
+    /* There could still be outstanding messages, wait for them
+     * here. */
+    LOG((2, "Waiting for outstanding msgs"));
+    if ((mpierr = MPI_Waitall(steps, rcvids, MPI_STATUSES_IGNORE)))
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    if (fc->isend)
+        if ((mpierr = MPI_Waitall(steps, sndids, MPI_STATUSES_IGNORE)))
             return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-        }
-        if (fc->isend)
-            if ((mpierr = MPI_Waitall(steps, sndids, MPI_STATUSES_IGNORE)))
-            {
-                GPTLstop("PIO:pio_swapm");
-                return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-            }
-    }
 
-    GPTLstop("PIO:pio_swapm");
     return PIO_NOERR;
 }
 
 /**
- * Provides the functionality of MPI_Gatherv with flow control
- * options. This function is not currently used, but we hope it will
- * be useful in future optimizations.
+ * Provides the functionality of MPI_Alltoallw with flow control
+ * options. Generalized all-to-all communication allowing different
+ * datatypes, counts, and displacements for each partner
  *
- * @param sendbuf starting address of send buffer.
- * @param sendcnt number of elements in send buffer.
- * @param sendtype data type of send buffer elements.
+ * @param sendbuf starting address of send buffer
+ * @param sendcounts integer array equal to the number of tasks in
+ * communicator comm (ntasks). It specifies the number of elements to
+ * send to each processor
+ * @param sdispls integer array (of length ntasks). Entry j
+ * specifies the displacement in bytes (relative to sendbuf) from
+ * which to take the outgoing data destined for process j.
+ * @param sendtypes array of datatypes (of length ntasks). Entry j
+ * specifies the type of data to send to process j.
  * @param recvbuf address of receive buffer.
- * @param recvcnts integer array (of length group size) containing the
- * number of elements that are received from each process (significant
- * only at root).
- * @param displs integer array (of length group size). Entry i
- * specifies the displacement relative to recvbuf at which to place
- * the incoming data from process i (significant only at root).
- * @param recvtype data type of recv buffer elements (significant only
- * at root).
- * @param root rank of receiving process.
- * @param comm communicator.
- * @param flow_cntl if non-zero, flow control will be used.
+ * @param recvcounts integer array (of length ntasks) specifying the
+ * number of elements that can be received from each processor.
+ * @param rdispls integer array (of length ntasks). Entry i
+ * specifies the displacement in bytes (relative to recvbuf) at which
+ * to place the incoming data from process i.
+ * @param recvtypes array of datatypes (of length ntasks). Entry i
+ * specifies the type of data received from process i.
+ * @param comm MPI communicator for the MPI_Alltoallw call.
+ * @param fc pointer to the struct that provided flow control options.
  * @returns 0 for success, error code otherwise.
  * @author Jim Edwards
  */
-int pio_fc_gatherv(const void *sendbuf, int sendcnt, MPI_Datatype sendtype,
-                   void *recvbuf, const int *recvcnts, const int *displs,
-                   MPI_Datatype recvtype, int root, MPI_Comm comm, int flow_cntl)
+int pio_swapm(void *sendbuf, int *sendcounts, int *sdispls, MPI_Datatype *sendtypes,
+              void *recvbuf, int *recvcounts, int *rdispls, MPI_Datatype *recvtypes,
+              MPI_Comm comm, rearr_comm_fc_opt_t *fc)
 {
-    bool fc_gather;
-    int gather_block_size;
-    int mytask, nprocs;
-    int mtag;
-    MPI_Status status;
-    int hs;
-    int dsize;
+    int ntasks;  /* Number of tasks in communicator comm. */
+    int my_rank; /* Rank of this task in comm. */
+    int offset_t;
+    int steps;
+    int p;
     int mpierr;  /* Return code from MPI functions. */
+    int ret;
 
-    if (flow_cntl > 0)
+    GPTLstart("PIO:pio_swapm");
+    LOG((2, "pio_swapm fc->hs = %d fc->isend = %d fc->max_pend_req = %d", fc->hs,
+         fc->isend, fc->max_pend_req));
+
+    /* Get my rank and size of communicator. */
+    if ((mpierr = MPI_Comm_size(comm, &ntasks)))
     {
-        fc_gather = true;
-        gather_block_size = min(flow_cntl, MAX_GATHER_BLOCK_SIZE);
+        GPTLstop("PIO:pio_swapm");
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    }
+    if ((mpierr = MPI_Comm_rank(comm, &my_rank)))
+    {
+        GPTLstop("PIO:pio_swapm");
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    }
+
+    LOG((2, "ntasks = %d my_rank = %d", ntasks, my_rank));
+
+    /* Now we know the size of this array. */
+    int swapids[ntasks];
+
+    /* Print some debugging info, if logging is enabled. */
+#if PIO_ENABLE_LOGGING
+    {
+        for (int p = 0; p < ntasks; p++)
+            LOG((3, "sendcounts[%d] = %d sdispls[%d] = %d sendtypes[%d] = %d recvcounts[%d] = %d "
+                 "rdispls[%d] = %d recvtypes[%d] = %d", p, sendcounts[p], p, sdispls[p], p,
+                 sendtypes[p], p, recvcounts[p], p, rdispls[p], p, recvtypes[p]));
+    }
+#endif /* PIO_ENABLE_LOGGING */
+
+    /* If fc->max_pend_req == 0 no throttling is requested and the default
+     * mpi_alltoallw function is used. */
+    if (fc->max_pend_req == 0)
+    {
+        /* Call the MPI alltoall without flow control. */
+        LOG((3, "Calling MPI_Alltoallw without flow control."));
+        if ((mpierr = MPI_Alltoallw(sendbuf, sendcounts, sdispls, sendtypes, recvbuf,
+                                    recvcounts, rdispls, recvtypes, comm)))
+        {
+            GPTLstop("PIO:pio_swapm");
+            return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+        }
+        GPTLstop("PIO:pio_swapm");
+        return PIO_NOERR;
+    }
+
+    /* an index for communications tags */
+    offset_t = ntasks;
+
+    /* Send to self. */
+    if (sendcounts[my_rank] > 0)
+    {
+        if ((ret = swapm_self(sendbuf, sendcounts, sdispls, sendtypes, recvbuf, recvcounts,
+                              rdispls, recvtypes, comm, my_rank, offset_t)))
+        {
+            GPTLstop("PIO:pio_swapm");
+            return ret;
+        }
+    }
+
+    LOG((2, "Done sending to self... sending to other procs"));
+
+    /* When send to self is complete there is nothing left to do if
+     * ntasks==1. */
+    if (ntasks == 1)
+    {
+        GPTLstop("PIO:pio_swapm");
+        return PIO_NOERR;
+    }
+
+    steps = 0;
+    for (int istep = 0; istep < ceil2(ntasks) - 1; istep++)
+    {
+        p = pair(ntasks, istep, my_rank);
+        if (p >= 0 && (sendcounts[p] > 0 || recvcounts[p] > 0))
+            swapids[steps++] = p;
+    }
+
+    LOG((3, "steps=%d", steps));
+
+    if (steps > 0)
+        ret = swapm_steps(sendbuf, sendcounts, sdispls, sendtypes, recvbuf, recvcounts,
+                          rdispls, recvtypes, comm, fc, my_rank, offset_t, swapids, steps);
+    else
+        ret = PIO_NOERR;
+
+    GPTLstop("PIO:pio_swapm");
+    return ret;
+}
+
+/**
+ * Post the receive of the next step of a nonblocking exchange, and
+ * the handshake message that tells the sending task that the
+ * receive is posted.
+ *
+ * @param req pointer to the state of the exchange.
+ * @returns 0 for success, error code otherwise.
+ */
+static int swapm_post_recv(pio_swapm_req_t *req)
+{
+    int istep = req->rstep++;
+    int p = req->swapids[istep];
+    int mpierr;  /* Return code from MPI functions. */
+
+    if (req->recvcounts[p] > 0)
+    {
+        if ((mpierr = MPI_Irecv((char *)req->recvbuf + req->rdispls[p], req->recvcounts[p],
+                                req->recvtypes[p], p, req->tag, req->comm,
+                                req->rcvids + istep)))
+            return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+        req->npend++;
+
+        if (req->fc.hs)
+            if ((mpierr = MPI_Isend(req->hs + req->steps + istep, 1, MPI_INT, p, req->tag + 1, req->comm,
+                                    req->hs_sndids + istep)))
+                return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Post the send of a step of a nonblocking exchange.
+ *
+ * @param req pointer to the state of the exchange.
+ * @param istep the step.
+ * @returns 0 for success, error code otherwise.
+ */
+static int swapm_post_send(pio_swapm_req_t *req, int istep)
+{
+    int p = req->swapids[istep];
+    int mpierr;  /* Return code from MPI functions. */
+
+    if ((mpierr = MPI_Isend((char *)req->sendbuf + req->sdispls[p], req->sendcounts[p],
+                            req->sendtypes[p], p, req->tag, req->comm, req->sndids + istep)))
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Progress a nonblocking exchange started with pio_swapm_start(),
+ * without blocking. Sends are posted for the handshakes received, and
+ * receives are posted as earlier receives complete.
+ *
+ * @param req pointer to the state of the exchange.
+ * @returns 0 for success, error code otherwise.
+ */
+static int swapm_progress(pio_swapm_req_t *req)
+{
+    int outcount;
+    int flag;
+    int mpierr;  /* Return code from MPI functions. */
+    int ret;
+
+    if (req->complete)
+        return PIO_NOERR;
+
+    /* Without flow control the exchange is a nonblocking
+     * collective. */
+    if (req->fc.max_pend_req == 0)
+    {
+        if ((mpierr = MPI_Test(&req->coll_req, &flag, MPI_STATUS_IGNORE)))
+            return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+        req->complete = flag;
+        return PIO_NOERR;
+    }
+
+    if (req->steps == 0)
+    {
+        req->complete = true;
+        return PIO_NOERR;
+    }
+
+    int indices[req->steps];
+
+    /* Post the sends to the tasks that posted their receives. */
+    if (req->nsendwait > 0)
+    {
+        if ((mpierr = MPI_Testsome(req->steps, req->hs_rcvids, &outcount, indices,
+                                   MPI_STATUSES_IGNORE)))
+            return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+        for (int i = 0; outcount != MPI_UNDEFINED && i < outcount; i++)
+        {
+            if ((ret = swapm_post_send(req, indices[i])))
+                return ret;
+            req->nsendwait--;
+        }
+    }
+
+    /* Post more receives as the pending receives complete. */
+    if (req->npend > 0)
+    {
+        if ((mpierr = MPI_Testsome(req->steps, req->rcvids, &outcount, indices,
+                                   MPI_STATUSES_IGNORE)))
+            return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+        if (outcount != MPI_UNDEFINED)
+            req->npend -= outcount;
+    }
+    while (req->rstep < req->steps && req->npend < req->maxreq)
+        if ((ret = swapm_post_recv(req)))
+            return ret;
+
+    if (req->rstep == req->steps && req->npend == 0 && req->nsendwait == 0)
+    {
+        if ((mpierr = MPI_Testall(req->steps, req->sndids, &flag, MPI_STATUSES_IGNORE)))
+            return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+        if (flag && (mpierr = MPI_Testall(req->steps, req->hs_sndids, &flag,
+                                          MPI_STATUSES_IGNORE)))
+            return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+        req->complete = flag;
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Post the messages of a nonblocking exchange started with
+ * pio_swapm_start().
+ *
+ * @param req pointer to the state of the exchange.
+ * @param ntasks the number of tasks in the communicator.
+ * @param my_rank the rank of this task in the communicator.
+ * @returns 0 for success, error code otherwise. On error some of the
+ * messages may be posted, see swapm_cancel().
+ */
+static int swapm_start(pio_swapm_req_t *req, int ntasks, int my_rank)
+{
+    int p;
+    int mpierr;  /* Return code from MPI functions. */
+    int ret;
+
+    /* If max_pend_req == 0 no throttling is requested. */
+    if (req->fc.max_pend_req == 0)
+    {
+        if ((mpierr = MPI_Ialltoallw(req->sendbuf, req->sendcounts, req->sdispls,
+                                     req->sendtypes, req->recvbuf, req->recvcounts,
+                                     req->rdispls, req->recvtypes, req->comm, &req->coll_req)))
+            return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+        return PIO_NOERR;
+    }
+
+    /* Send to self. */
+    if (req->sendcounts[my_rank] > 0)
+        if ((ret = swapm_self(req->sendbuf, req->sendcounts, req->sdispls, req->sendtypes,
+                              req->recvbuf, req->recvcounts, req->rdispls, req->recvtypes,
+                              req->comm, my_rank, req->tag)))
+            return ret;
+
+    if (!(req->swapids = malloc(ntasks * sizeof(int))))
+        return pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                        "Starting a nonblocking exchange failed. Out of memory allocating %lld bytes for the ranks exchanged with", (unsigned long long)(ntasks * sizeof(int)));
+    for (int istep = 0; istep < ceil2(ntasks) - 1; istep++)
+    {
+        p = pair(ntasks, istep, my_rank);
+        if (p >= 0 && (req->sendcounts[p] > 0 || req->recvcounts[p] > 0))
+            req->swapids[req->steps++] = p;
+    }
+    LOG((3, "steps=%d", req->steps));
+
+    if (req->steps > 0)
+    {
+        if (!(req->rcvids = malloc(4 * req->steps * sizeof(MPI_Request))))
+            return pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                            "Starting a nonblocking exchange failed. Out of memory allocating requests for %d tasks", req->steps);
+        req->sndids = req->rcvids + req->steps;
+        req->hs_rcvids = req->sndids + req->steps;
+        req->hs_sndids = req->hs_rcvids + req->steps;
+        for (int i = 0; i < 4 * req->steps; i++)
+            req->rcvids[i] = MPI_REQUEST_NULL;
+        if (!(req->hs = calloc(2 * req->steps, sizeof(int))))
+            return pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                            "Starting a nonblocking exchange failed. Out of memory allocating handshakes for %d tasks", req->steps);
+
+        if (req->fc.max_pend_req == PIO_REARR_COMM_UNLIMITED_PEND_REQ ||
+            req->fc.max_pend_req >= req->steps)
+            req->maxreq = req->steps;
+        else
+            req->maxreq = req->fc.max_pend_req;
+
+        /* With handshaking, listen for the handshakes of the tasks
+         * this task sends to. Otherwise post all the sends. */
+        for (int istep = 0; istep < req->steps; istep++)
+        {
+            p = req->swapids[istep];
+            if (req->sendcounts[p] > 0)
+            {
+                if (req->fc.hs)
+                {
+                    if ((mpierr = MPI_Irecv(req->hs + istep, 1, MPI_INT, p, req->tag + 1,
+                                            req->comm, req->hs_rcvids + istep)))
+                        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+                    req->nsendwait++;
+                }
+                else if ((ret = swapm_post_send(req, istep)))
+                    return ret;
+            }
+        }
+    }
+
+    return swapm_progress(req);
+}
+
+/**
+ * Cancel the messages posted by a nonblocking exchange that failed.
+ * The receives are cancelled and completed, so that no data is
+ * received in the buffers after this call. The sends are cancelled
+ * and freed. The collective of an exchange without flow control can
+ * not be cancelled, it is only posted when it is the last call that
+ * can fail.
+ *
+ * @param req pointer to the state of the exchange.
+ */
+static void swapm_cancel(pio_swapm_req_t *req)
+{
+    if (!req->rcvids)
+        return;
+
+    for (int i = 0; i < 4 * req->steps; i++)
+    {
+        MPI_Request *r = req->rcvids + i;
+        bool recv = (r < req->sndids) || (r >= req->hs_rcvids && r < req->hs_sndids);
+
+        if (*r == MPI_REQUEST_NULL)
+            continue;
+        MPI_Cancel(r);
+        if (recv)
+            MPI_Wait(r, MPI_STATUS_IGNORE);
+        else
+            MPI_Request_free(r);
+    }
+}
+
+/**
+ * Free the state of a nonblocking exchange.
+ *
+ * @param req pointer to the state of the exchange.
+ */
+static void swapm_free_req(pio_swapm_req_t *req)
+{
+    free(req->swapids);
+    free(req->rcvids);
+    free(req->hs);
+    free(req);
+}
+
+/**
+ * Start a nonblocking pio_swapm(). The exchange is progressed with
+ * pio_swapm_test() and completed with pio_swapm_wait(). The buffers
+ * and arrays passed in must not be modified (or freed) until the
+ * exchange is complete.
+ *
+ * The flow control options are applied as in pio_swapm(): with
+ * handshaking a task only sends to a task after the receive is
+ * posted there, and at most fc->max_pend_req receives are pending at
+ * one time. Sends are always nonblocking. Without flow control
+ * (fc->max_pend_req == 0) MPI_Ialltoallw() is used.
+ *
+ * Several nonblocking exchanges (and blocking exchanges) can be in
+ * progress on the same communicator, as long as each nonblocking
+ * exchange in progress uses a different slot. The exchanges must be
+ * started in the same order on all tasks of the communicator.
+ *
+ * @param sendbuf starting address of send buffer.
+ * @param sendcounts array (of length ntasks) of the number of
+ * elements to send to each task.
+ * @param sdispls array (of length ntasks) of the send displacements
+ * (in bytes).
+ * @param sendtypes array (of length ntasks) of send datatypes.
+ * @param recvbuf address of receive buffer.
+ * @param recvcounts array (of length ntasks) of the number of
+ * elements to receive from each task.
+ * @param rdispls array (of length ntasks) of the receive
+ * displacements (in bytes).
+ * @param recvtypes array (of length ntasks) of receive datatypes.
+ * @param comm MPI communicator.
+ * @param fc pointer to the struct that provided flow control options.
+ * @param slot the slot (0 to PIO_MAX_NB_REARR - 1) of the exchange,
+ * used for the message tags.
+ * @param reqp pointer that gets the state of the exchange, freed
+ * with pio_swapm_wait(). On error it gets NULL, the messages posted
+ * are cancelled and the buffers can be freed.
+ * @returns 0 for success, error code otherwise.
+ */
+int pio_swapm_start(void *sendbuf, int *sendcounts, int *sdispls, MPI_Datatype *sendtypes,
+                    void *recvbuf, int *recvcounts, int *rdispls, MPI_Datatype *recvtypes,
+                    MPI_Comm comm, rearr_comm_fc_opt_t *fc, int slot, pio_swapm_req_t **reqp)
+{
+    pio_swapm_req_t *req;
+    int ntasks;  /* Number of tasks in communicator comm. */
+    int my_rank; /* Rank of this task in comm. */
+    int mpierr;  /* Return code from MPI functions. */
+    int ret;
+
+    pioassert(fc && slot >= 0 && slot < PIO_MAX_NB_REARR && reqp, "invalid input",
+              __FILE__, __LINE__);
+
+    GPTLstart("PIO:pio_swapm_start");
+    LOG((2, "pio_swapm_start fc->hs = %d fc->max_pend_req = %d slot = %d", fc->hs,
+         fc->max_pend_req, slot));
+
+    if ((mpierr = MPI_Comm_size(comm, &ntasks)) ||
+        (mpierr = MPI_Comm_rank(comm, &my_rank)))
+    {
+        GPTLstop("PIO:pio_swapm_start");
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    }
+
+    if (!(req = calloc(1, sizeof(pio_swapm_req_t))))
+    {
+        GPTLstop("PIO:pio_swapm_start");
+        return pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                        "Starting a nonblocking exchange failed. Out of memory allocating %lld bytes for the state of the exchange", (unsigned long long)sizeof(pio_swapm_req_t));
+    }
+    req->sendbuf = sendbuf;
+    req->sendcounts = sendcounts;
+    req->sdispls = sdispls;
+    req->sendtypes = sendtypes;
+    req->recvbuf = recvbuf;
+    req->recvcounts = recvcounts;
+    req->rdispls = rdispls;
+    req->recvtypes = recvtypes;
+    req->comm = comm;
+    req->fc = *fc;
+    req->coll_req = MPI_REQUEST_NULL;
+    *reqp = NULL;
+
+    /* The tags used by pio_swapm() and pio_sparse_exchange() are
+     * below 3 * ntasks. */
+    req->tag = 3 * ntasks + 2 * slot;
+
+    if ((ret = swapm_start(req, ntasks, my_rank)))
+    {
+        /* Nothing may be left posted on the buffers, the caller
+         * frees them. */
+        swapm_cancel(req);
+        swapm_free_req(req);
+        GPTLstop("PIO:pio_swapm_start");
+        return ret;
+    }
+    *reqp = req;
+
+    GPTLstop("PIO:pio_swapm_start");
+    return PIO_NOERR;
+}
+
+/**
+ * Progress a nonblocking exchange started with pio_swapm_start(),
+ * without blocking.
+ *
+ * @param req pointer to the state of the exchange.
+ * @param flag pointer that gets 1 if the exchange is complete, 0
+ * otherwise.
+ * @returns 0 for success, error code otherwise.
+ */
+int pio_swapm_test(pio_swapm_req_t *req, int *flag)
+{
+    int ret;
+
+    pioassert(req && flag, "invalid input", __FILE__, __LINE__);
+
+    if ((ret = swapm_progress(req)))
+        return ret;
+    *flag = req->complete;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Complete a nonblocking exchange started with pio_swapm_start(),
+ * and free its state.
+ *
+ * @param req pointer to the state of the exchange.
+ * @returns 0 for success, error code otherwise.
+ */
+int pio_swapm_wait(pio_swapm_req_t *req)
+{
+    int mpierr;  /* Return code from MPI functions. */
+    int ret = PIO_NOERR;
+
+    pioassert(req, "invalid input", __FILE__, __LINE__);
+
+    GPTLstart("PIO:pio_swapm_wait");
+    if (req->fc.max_pend_req == 0 && !req->complete)
+    {
+        if ((mpierr = MPI_Wait(&req->coll_req, MPI_STATUS_IGNORE)))
+            ret = check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+        req->complete = true;
+    }
+
+    /* The sends of a task wait for the handshakes of other tasks, so
+     * the exchange is progressed until complete instead of blocking
+     * on a subset of the requests. */
+    while (ret == PIO_NOERR && !req->complete)
+        ret = swapm_progress(req);
+
+    swapm_free_req(req);
+    GPTLstop("PIO:pio_swapm_wait");
+
+    return ret;
+}
+
+/**
+ * Compare two integer keys, for qsort(). In pio_sparse_swapm() the
+ * keys are the pair() steps of the ranks (rank ^ my_rank), in
+ * pio_sparse_exchange() the ranks of the senders (followed by the
+ * value received from the sender).
+ *
+ * @param a pointer to the first key.
+ * @param b pointer to the second key.
+ * @returns -1, 0 or 1 if a is less than, equal to or greater than b.
+ */
+static int compare_swap_keys(const void *a, const void *b)
+{
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Provides the functionality of pio_swapm(), with the same flow
+ * control options (handshake, isend and max_pend_req), but only
+ * iterates over the peers of this task instead of all the tasks in
+ * comm. The peers are the tasks this task sends data to or receives
+ * data from, so the cost of the exchange is proportional to the
+ * number of peers rather than to the size of comm.
+ *
+ * The peers are exchanged with in the same order as in pio_swapm()
+ * (the pair() order), so the messages match those of the peers and
+ * the max_pend_req throttling behaves the same way. Unlike
+ * pio_swapm(), max_pend_req == 0 does not switch to MPI_Alltoallw(),
+ * it is treated as unlimited.
+ *
+ * The counts, displacements and datatypes are indexed by the rank in
+ * comm (same as in pio_swapm()), but only the entries of the peers
+ * (and this task) are read.
+ *
+ * @param sendbuf starting address of send buffer
+ * @param sendcounts integer array (of length ntasks) specifying the
+ * number of elements to send to each processor.
+ * @param sdispls integer array (of length ntasks). Entry j
+ * specifies the displacement in bytes (relative to sendbuf) from
+ * which to take the outgoing data destined for process j.
+ * @param sendtypes array of datatypes (of length ntasks). Entry j
+ * specifies the type of data to send to process j.
+ * @param recvbuf address of receive buffer.
+ * @param recvcounts integer array (of length ntasks) specifying the
+ * number of elements that can be received from each processor.
+ * @param rdispls integer array (of length ntasks). Entry i
+ * specifies the displacement in bytes (relative to recvbuf) at which
+ * to place the incoming data from process i.
+ * @param recvtypes array of datatypes (of length ntasks). Entry i
+ * specifies the type of data received from process i.
+ * @param comm MPI communicator.
+ * @param npeers number of peers of this task.
+ * @param peers array (of length npeers) of the ranks, in comm, of
+ * the peers. It may include this task.
+ * @param fc pointer to the struct that provided flow control options.
+ * @returns 0 for success, error code otherwise.
+ */
+int pio_sparse_swapm(void *sendbuf, int *sendcounts, int *sdispls, MPI_Datatype *sendtypes,
+                     void *recvbuf, int *recvcounts, int *rdispls, MPI_Datatype *recvtypes,
+                     MPI_Comm comm, int npeers, const int *peers, rearr_comm_fc_opt_t *fc)
+{
+    int ntasks;  /* Number of tasks in communicator comm. */
+    int my_rank; /* Rank of this task in comm. */
+    int offset_t;
+    int steps;
+    int nsteps;
+    int mpierr;  /* Return code from MPI functions. */
+    int ret = PIO_NOERR;
+
+    pioassert(npeers >= 0 && (npeers == 0 || peers) && fc, "invalid input",
+              __FILE__, __LINE__);
+
+    GPTLstart("PIO:pio_sparse_swapm");
+    LOG((2, "pio_sparse_swapm npeers = %d fc->hs = %d fc->isend = %d fc->max_pend_req = %d",
+         npeers, fc->hs, fc->isend, fc->max_pend_req));
+
+    if ((mpierr = MPI_Comm_size(comm, &ntasks)))
+    {
+        GPTLstop("PIO:pio_sparse_swapm");
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    }
+    if ((mpierr = MPI_Comm_rank(comm, &my_rank)))
+    {
+        GPTLstop("PIO:pio_sparse_swapm");
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    }
+
+    /* Same tags as pio_swapm(). */
+    offset_t = ntasks;
+
+    /* Avoid zero length arrays when this task has no peers. */
+    int swapids[(npeers > 0) ? npeers : 1];
+
+    /* Order the peers (other than this task) that data is exchanged
+     * with by their pair() step, i.e. by (peer ^ my_rank). */
+    steps = 0;
+    for (int i = 0; i < npeers; i++)
+    {
+        int p = peers[i];
+
+        if (p != my_rank && (sendcounts[p] > 0 || recvcounts[p] > 0))
+            swapids[steps++] = p ^ my_rank;
+    }
+    qsort(swapids, steps, sizeof(int), compare_swap_keys);
+    nsteps = 0;
+    for (int i = 0; i < steps; i++)
+    {
+        /* Skip duplicate peers. */
+        if (nsteps > 0 && swapids[i] == (swapids[nsteps - 1] ^ my_rank))
+            continue;
+        swapids[nsteps++] = swapids[i] ^ my_rank;
+    }
+    steps = nsteps;
+
+    LOG((3, "steps=%d", steps));
+
+    /* Send to self. */
+    if (sendcounts[my_rank] > 0)
+        ret = swapm_self(sendbuf, sendcounts, sdispls, sendtypes, recvbuf, recvcounts,
+                         rdispls, recvtypes, comm, my_rank, offset_t);
+
+    if (ret == PIO_NOERR && steps > 0)
+        ret = swapm_steps(sendbuf, sendcounts, sdispls, sendtypes, recvbuf, recvcounts,
+                          rdispls, recvtypes, comm, fc, my_rank, offset_t, swapids, steps);
+
+    GPTLstop("PIO:pio_sparse_swapm");
+    return ret;
+}
+
+/**
+ * Send an integer value to each of a (sparse) set of tasks, where the
+ * receiving tasks do not know who sends them values. This uses the
+ * nonblocking consensus (NBX) algorithm: the values are sent with
+ * synchronous sends (MPI_Issend), and received with MPI_Iprobe from
+ * any source until every task has entered a nonblocking barrier
+ * (MPI_Ibarrier), which a task only enters once all its sends have
+ * been received. The cost is proportional to the number of messages
+ * sent and received by a task rather than to the size of comm.
+ *
+ * This function is collective across all tasks in comm. The messages
+ * are tagged with 2 * ntasks, above the range of the tags used by
+ * pio_swapm() and pio_sparse_swapm() over comm.
+ *
+ * @param nsend number of tasks this task sends values to.
+ * @param sendranks array (of length nsend) of the ranks, in comm, of
+ * the tasks values are sent to.
+ * @param sendvals array (of length nsend) of the values sent.
+ * @param comm MPI communicator.
+ * @param nrecvp pointer that gets the number of values received.
+ * @param recvranksp pointer that gets an array (of length *nrecvp,
+ * sorted) of the ranks the values were received from. The array is
+ * allocated here and must be freed by the caller.
+ * @param recvvalsp pointer that gets an array (of length *nrecvp) of
+ * the values received. The array is allocated here and must be freed
+ * by the caller.
+ * @returns 0 for success, error code otherwise.
+ */
+int pio_sparse_exchange(int nsend, const int *sendranks, const int *sendvals, MPI_Comm comm,
+                        int *nrecvp, int **recvranksp, int **recvvalsp)
+{
+    int ntasks;
+    int tag;
+    int nrecv = 0;
+    int recv_sz = PIO_REQUEST_ALLOC_CHUNK;
+    int *recvranks = NULL;
+    int *recvvals = NULL;
+    MPI_Request barrier_req = MPI_REQUEST_NULL;
+    bool in_barrier = false;
+    int mpierr;  /* Return code from MPI functions. */
+    int ret = PIO_NOERR;
+
+    pioassert(nsend >= 0 && (nsend == 0 || (sendranks && sendvals)) && nrecvp &&
+              recvranksp && recvvalsp, "invalid input", __FILE__, __LINE__);
+
+    GPTLstart("PIO:pio_sparse_exchange");
+    LOG((2, "pio_sparse_exchange nsend = %d", nsend));
+
+    if ((mpierr = MPI_Comm_size(comm, &ntasks)))
+    {
+        GPTLstop("PIO:pio_sparse_exchange");
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    }
+    tag = 2 * ntasks;
+
+    MPI_Request sndids[(nsend > 0) ? nsend : 1];
+
+    if (!(recvranks = malloc(recv_sz * sizeof(int))) ||
+        !(recvvals = malloc(recv_sz * sizeof(int))))
+    {
+        free(recvranks);
+        GPTLstop("PIO:pio_sparse_exchange");
+        return pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                        "Sparse exchange of values failed. Out of memory allocating %lld bytes for the received values", (long long int) (2 * recv_sz * sizeof(int)));
+    }
+
+    for (int i = 0; i < nsend; i++)
+    {
+        if ((mpierr = MPI_Issend(&sendvals[i], 1, MPI_INT, sendranks[i], tag, comm,
+                                 sndids + i)))
+        {
+            ret = check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+            break;
+        }
+    }
+
+    while (ret == PIO_NOERR)
+    {
+        MPI_Status status;
+        int flag;
+
+        /* Receive any value sent to this task. */
+        if ((mpierr = MPI_Iprobe(MPI_ANY_SOURCE, tag, comm, &flag, &status)))
+        {
+            ret = check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+            break;
+        }
+        if (flag)
+        {
+            if (nrecv == recv_sz)
+            {
+                int *tmp;
+
+                recv_sz *= 2;
+                if (!(tmp = realloc(recvranks, recv_sz * sizeof(int))))
+                {
+                    ret = pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                                    "Sparse exchange of values failed. Out of memory allocating %lld bytes for the received ranks", (long long int) (recv_sz * sizeof(int)));
+                    break;
+                }
+                recvranks = tmp;
+                if (!(tmp = realloc(recvvals, recv_sz * sizeof(int))))
+                {
+                    ret = pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                                    "Sparse exchange of values failed. Out of memory allocating %lld bytes for the received values", (long long int) (recv_sz * sizeof(int)));
+                    break;
+                }
+                recvvals = tmp;
+            }
+            if ((mpierr = MPI_Recv(&recvvals[nrecv], 1, MPI_INT, status.MPI_SOURCE, tag, comm,
+                                   MPI_STATUS_IGNORE)))
+            {
+                ret = check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+                break;
+            }
+            recvranks[nrecv++] = status.MPI_SOURCE;
+        }
+
+        if (in_barrier)
+        {
+            /* All tasks have had all their values received. */
+            if ((mpierr = MPI_Test(&barrier_req, &flag, MPI_STATUS_IGNORE)))
+            {
+                ret = check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+                break;
+            }
+            if (flag)
+                break;
+        }
+        else
+        {
+            /* Enter the barrier once all values sent by this task
+             * have been received. */
+            if ((mpierr = MPI_Testall(nsend, sndids, &flag, MPI_STATUSES_IGNORE)))
+            {
+                ret = check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+                break;
+            }
+            if (flag)
+            {
+                if ((mpierr = MPI_Ibarrier(comm, &barrier_req)))
+                {
+                    ret = check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+                    break;
+                }
+                in_barrier = true;
+            }
+        }
+    }
+
+    if (ret != PIO_NOERR)
+    {
+        free(recvranks);
+        free(recvvals);
+        GPTLstop("PIO:pio_sparse_exchange");
+        return ret;
+    }
+
+    /* Sort the values by the rank of the sender. */
+    if (nrecv > 1)
+    {
+        int (*recvpairs)[2];
+
+        if (!(recvpairs = malloc(nrecv * sizeof(*recvpairs))))
+        {
+            free(recvranks);
+            free(recvvals);
+            GPTLstop("PIO:pio_sparse_exchange");
+            return pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                            "Sparse exchange of values failed. Out of memory allocating %lld bytes for sorting the received values", (long long int) (nrecv * sizeof(*recvpairs)));
+        }
+        for (int i = 0; i < nrecv; i++)
+        {
+            recvpairs[i][0] = recvranks[i];
+            recvpairs[i][1] = recvvals[i];
+        }
+        qsort(recvpairs, nrecv, sizeof(*recvpairs), compare_swap_keys);
+        for (int i = 0; i < nrecv; i++)
+        {
+            recvranks[i] = recvpairs[i][0];
+            recvvals[i] = recvpairs[i][1];
+        }
+        free(recvpairs);
+    }
+
+    LOG((2, "pio_sparse_exchange nrecv = %d", nrecv));
+
+    *nrecvp = nrecv;
+    *recvranksp = recvranks;
+    *recvvalsp = recvvals;
+
+    GPTLstop("PIO:pio_sparse_exchange");
+    return PIO_NOERR;
+}
+
+/**
+ * Provides the functionality of pio_swapm() using a neighborhood
+ * collective (MPI_Neighbor_alltoallw) on a distributed graph
+ * communicator. Only the tasks that are neighbors of this task in
+ * the graph communicator are involved in the exchange.
+ *
+ * The counts, displacements and datatypes are indexed by the rank in
+ * the communicator that was used to create the graph communicator
+ * (same as in pio_swapm()). They are compacted here into arrays
+ * indexed by the neighbors of this task.
+ *
+ * @param sendbuf starting address of send buffer
+ * @param sendcounts integer array (of length ntasks) specifying the
+ * number of elements to send to each processor.
+ * @param sdispls integer array (of length ntasks). Entry j
+ * specifies the displacement in bytes (relative to sendbuf) from
+ * which to take the outgoing data destined for process j.
+ * @param sendtypes array of datatypes (of length ntasks). Entry j
+ * specifies the type of data to send to process j.
+ * @param recvbuf address of receive buffer.
+ * @param recvcounts integer array (of length ntasks) specifying the
+ * number of elements that can be received from each processor.
+ * @param rdispls integer array (of length ntasks). Entry i
+ * specifies the displacement in bytes (relative to recvbuf) at which
+ * to place the incoming data from process i.
+ * @param recvtypes array of datatypes (of length ntasks). Entry i
+ * specifies the type of data received from process i.
+ * @param graph_comm the distributed graph communicator, where the
+ * sources and destinations of each task are the same.
+ * @param nneighbors number of neighbors of this task in graph_comm.
+ * @param neighbors array (of length nneighbors) of the ranks of the
+ * neighbors (in the order used to create graph_comm).
+ * @returns 0 for success, error code otherwise.
+ */
+int pio_neighbor_swapm(void *sendbuf, int *sendcounts, int *sdispls, MPI_Datatype *sendtypes,
+                       void *recvbuf, int *recvcounts, int *rdispls, MPI_Datatype *recvtypes,
+                       MPI_Comm graph_comm, int nneighbors, const int *neighbors)
+{
+#if PIO_USE_MPISERIAL
+    return pio_err(NULL, NULL, PIO_EINTERNAL, __FILE__, __LINE__,
+                    "Neighborhood collectives are not supported with MPI serial");
+#else
+    /* Avoid zero length arrays when this task has no neighbors. */
+    int nn = (nneighbors > 0) ? nneighbors : 1;
+    int nsendcounts[nn];
+    int nrecvcounts[nn];
+    MPI_Aint nsdispls[nn];
+    MPI_Aint nrdispls[nn];
+    MPI_Datatype nsendtypes[nn];
+    MPI_Datatype nrecvtypes[nn];
+    int mpierr;  /* Return code from MPI functions. */
+
+    GPTLstart("PIO:pio_neighbor_swapm");
+    LOG((2, "pio_neighbor_swapm nneighbors = %d", nneighbors));
+
+    for (int i = 0; i < nneighbors; i++)
+    {
+        int p = neighbors[i];
+
+        nsendcounts[i] = sendcounts[p];
+        nsdispls[i] = sdispls[p];
+        nsendtypes[i] = (sendcounts[p] > 0) ? sendtypes[p] : MPI_BYTE;
+        nrecvcounts[i] = recvcounts[p];
+        nrdispls[i] = rdispls[p];
+        nrecvtypes[i] = (recvcounts[p] > 0) ? recvtypes[p] : MPI_BYTE;
+    }
+
+    if ((mpierr = MPI_Neighbor_alltoallw(sendbuf, nsendcounts, nsdispls, nsendtypes,
+                                         recvbuf, nrecvcounts, nrdispls, nrecvtypes,
+                                         graph_comm)))
+    {
+        GPTLstop("PIO:pio_neighbor_swapm");
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    }
+
+    GPTLstop("PIO:pio_neighbor_swapm");
+    return PIO_NOERR;
+#endif /* PIO_USE_MPISERIAL */
+}
+
+/**
+ * Provides the functionality of MPI_Gatherv with flow control
+ * options. This function is not currently used, but we hope it will
+ * be useful in future optimizations.
+ *
+ * @param sendbuf starting address of send buffer.
+ * @param sendcnt number of elements in send buffer.
+ * @param sendtype data type of send buffer elements.
+ * @param recvbuf address of receive buffer.
+ * @param recvcnts integer array (of length group size) containing the
+ * number of elements that are received from each process (significant
+ * only at root).
+ * @param displs integer array (of length group size). Entry i
+ * specifies the displacement relative to recvbuf at which to place
+ * the incoming data from process i (significant only at root).
+ * @param recvtype data type of recv buffer elements (significant only
+ * at root).
+ * @param root rank of receiving process.
+ * @param comm communicator.
+ * @param flow_cntl if non-zero, flow control will be used.
+ * @returns 0 for success, error code otherwise.
+ * @author Jim Edwards
+ */
+int pio_fc_gatherv(const void *sendbuf, int sendcnt, MPI_Datatype sendtype,
+                   void *recvbuf, const int *recvcnts, const int *displs,
+                   MPI_Datatype recvtype, int root, MPI_Comm comm, int flow_cntl)
+{
+    bool fc_gather;
+    int gather_block_size;
+    int mytask, nprocs;
+    int mtag;
+    MPI_Status status;
+    int hs;
+    int dsize;
+    int mpierr;  /* Return code from MPI functions. */
+
+    if (flow_cntl > 0)
+    {
+        fc_gather = true;
+        gather_block_size = min(flow_cntl, MAX_GATHER_BLOCK_SIZE);
     }
     else
     {
@@ -567,3 +1398,185 @@ int pio_fc_gatherv(const void *sendbuf, int sendcnt, MPI_Datatype sendtype,
 
     return PIO_NOERR;
 }
+
+/**
+ * Gather (or scatter) data between the tasks of comm and a root
+ * buffer larger than INT_MAX elements, for pio_gatherv_large() and
+ * pio_scatterv_large(). With MPI-4 MPI_Gatherv_c()/MPI_Scatterv_c()
+ * are used. Otherwise MPI_Gatherv()/MPI_Scatterv() are used when all
+ * the displacements fit in an int, and point-to-point messages (one
+ * per task, each no larger than INT_MAX elements) when they do not.
+ *
+ * @param gather true to gather buf into rootbuf, false to scatter
+ * rootbuf into buf.
+ * @param buf the buffer of this task.
+ * @param cnt number of elements in buf.
+ * @param type data type of the elements.
+ * @param rootbuf the buffer of the root (significant only at root).
+ * @param cnts integer array (of length group size) with the number
+ * of elements of each task (significant only at root).
+ * @param displs array (of length group size). Entry i specifies the
+ * displacement (in elements) relative to rootbuf of the data of task
+ * i (significant only at root).
+ * @param root rank of the root.
+ * @param comm communicator.
+ * @returns 0 for success, error code otherwise.
+ */
+static int pio_xv_large(bool gather, void *buf, int cnt, MPI_Datatype type, void *rootbuf,
+                        const int *cnts, const PIO_Offset *displs, int root, MPI_Comm comm)
+{
+    int mytask, nprocs;
+    int mpierr;  /* Return code from MPI functions. */
+
+    if ((mpierr = MPI_Comm_rank(comm, &mytask)))
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Comm_size(comm, &nprocs)))
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+
+#if MPI_VERSION >= 4
+    {
+        MPI_Count ccnts[mytask == root ? nprocs : 1];
+        MPI_Aint cdispls[mytask == root ? nprocs : 1];
+
+        if (mytask == root)
+        {
+            for (int p = 0; p < nprocs; p++)
+            {
+                ccnts[p] = cnts[p];
+                cdispls[p] = displs[p];
+            }
+        }
+        if (gather)
+            mpierr = MPI_Gatherv_c(buf, cnt, type, rootbuf, ccnts, cdispls, type, root, comm);
+        else
+            mpierr = MPI_Scatterv_c(rootbuf, ccnts, cdispls, type, buf, cnt, type, root, comm);
+        if (mpierr)
+            return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    }
+#else
+    {
+        int large = 0;
+        int idispls[mytask == root ? nprocs : 1];
+
+        /* The root decides if the displacements fit in an int. */
+        if (mytask == root)
+        {
+            for (int p = 0; p < nprocs; p++)
+            {
+                if (displs[p] > INT_MAX)
+                    large = 1;
+                idispls[p] = (int)displs[p];
+            }
+        }
+        if ((mpierr = MPI_Bcast(&large, 1, MPI_INT, root, comm)))
+            return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+
+        if (!large)
+        {
+            if (gather)
+                mpierr = MPI_Gatherv(buf, cnt, type, rootbuf, (int *)cnts, idispls, type,
+                                     root, comm);
+            else
+                mpierr = MPI_Scatterv(rootbuf, (int *)cnts, idispls, type, buf, cnt, type,
+                                      root, comm);
+            if (mpierr)
+                return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+        }
+        else if (mytask == root)
+        {
+            MPI_Request reqs[nprocs];
+            MPI_Aint lb, extent;
+            int nreqs = 0;
+
+            if ((mpierr = MPI_Type_get_extent(type, &lb, &extent)))
+                return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+
+            for (int p = 0; p < nprocs; p++)
+            {
+                char *ptr = (char *)rootbuf + extent * displs[p];
+
+                if (cnts[p] <= 0)
+                    continue;
+                if (p == root)
+                {
+                    if (gather)
+                        memcpy(ptr, buf, (size_t)extent * cnts[p]);
+                    else
+                        memcpy(buf, ptr, (size_t)extent * cnts[p]);
+                    continue;
+                }
+                if (gather)
+                    mpierr = MPI_Irecv(ptr, cnts[p], type, p, 0, comm, &reqs[nreqs++]);
+                else
+                    mpierr = MPI_Isend(ptr, cnts[p], type, p, 0, comm, &reqs[nreqs++]);
+                if (mpierr)
+                    return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+            }
+            if (nreqs > 0)
+                if ((mpierr = MPI_Waitall(nreqs, reqs, MPI_STATUSES_IGNORE)))
+                    return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+        }
+        else if (cnt > 0)
+        {
+            if (gather)
+                mpierr = MPI_Send(buf, cnt, type, root, 0, comm);
+            else
+                mpierr = MPI_Recv(buf, cnt, type, root, 0, comm, MPI_STATUS_IGNORE);
+            if (mpierr)
+                return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+        }
+    }
+#endif /* MPI_VERSION >= 4 */
+
+    return PIO_NOERR;
+}
+
+/**
+ * Provides the functionality of MPI_Gatherv for receive buffers
+ * larger than INT_MAX elements (the displacements are PIO_Offset).
+ *
+ * @param sendbuf starting address of send buffer.
+ * @param sendcnt number of elements in send buffer.
+ * @param type data type of the send and recv buffer elements.
+ * @param recvbuf address of receive buffer.
+ * @param recvcnts integer array (of length group size) containing the
+ * number of elements that are received from each process (significant
+ * only at root).
+ * @param displs array (of length group size). Entry i specifies the
+ * displacement (in elements) relative to recvbuf at which to place
+ * the incoming data from process i (significant only at root).
+ * @param root rank of receiving process.
+ * @param comm communicator.
+ * @returns 0 for success, error code otherwise.
+ */
+int pio_gatherv_large(const void *sendbuf, int sendcnt, MPI_Datatype type, void *recvbuf,
+                      const int *recvcnts, const PIO_Offset *displs, int root, MPI_Comm comm)
+{
+    return pio_xv_large(true, (void *)sendbuf, sendcnt, type, recvbuf, recvcnts, displs,
+                        root, comm);
+}
+
+/**
+ * Provides the functionality of MPI_Scatterv for send buffers larger
+ * than INT_MAX elements (the displacements are PIO_Offset).
+ *
+ * @param sendbuf address of send buffer (significant only at root).
+ * @param sendcnts integer array (of length group size) containing the
+ * number of elements that are sent to each process (significant only
+ * at root).
+ * @param displs array (of length group size). Entry i specifies the
+ * displacement (in elements) relative to sendbuf from which to take
+ * the outgoing data to process i (significant only at root).
+ * @param type data type of the send and recv buffer elements.
+ * @param recvbuf address of receive buffer.
+ * @param recvcnt number of elements in receive buffer.
+ * @param root rank of sending process.
+ * @param comm communicator.
+ * @returns 0 for success, error code otherwise.
+ */
+int pio_scatterv_large(const void *sendbuf, const int *sendcnts, const PIO_Offset *displs,
+                       MPI_Datatype type, void *recvbuf, int recvcnt, int root, MPI_Comm comm)
+{
+    return pio_xv_large(false, recvbuf, recvcnt, type, (void *)sendbuf, sendcnts, displs,
+                        root, comm);
+}
@@ -25,6 +25,14 @@ int default_error_handler = PIO_INTERNAL_ERROR;
  * used (see pio_sc.c). */
 extern int blocksize;
 
+/** The method used to place the IO tasks in PIOc_Init_Intracomm()
+ * (see PIOc_set_iotask_placement()). */
+static int iotask_placement = PIO_IOTASK_PLACEMENT_STRIDE;
+
+/** The maximum number of IO tasks on a node with
+ * PIO_IOTASK_PLACEMENT_NODE, 0 for no limit. */
+static int iotask_max_per_node = 0;
+
 /**
  * Check to see if PIO has been initialized.
  *
@@ -479,6 +487,283 @@ int pio_create_uniq_str(iosystem_desc_t *ios, io_desc_t *iodesc, char *str, int
     return PIO_NOERR;
 }
 
+/* Offset basis and prime of the 64-bit FNV-1a hash */
+#define DECOMP_HASH_BASIS 14695981039346656037ULL
+#define DECOMP_HASH_PRIME 1099511628211ULL
+
+/* Add len bytes in buf to the (64-bit FNV-1a) hash h */
+static unsigned long long decomp_hash_bytes(unsigned long long h, const void *buf, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)buf;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= p[i];
+        h *= DECOMP_HASH_PRIME;
+    }
+    return h;
+}
+
+/* Add the rearranger flow control options in opt to the hash h */
+static unsigned long long decomp_hash_fc_opts(unsigned long long h, const rearr_comm_fc_opt_t *opt)
+{
+    int vals[] = {opt->hs, opt->isend, opt->max_pend_req};
+
+    return decomp_hash_bytes(h, vals, sizeof(vals));
+}
+
+/**
+ * Compute the hash of the arguments to PIOc_InitDecomp(), used to find
+ * an existing decomposition identical to the one requested. The
+ * rearranger options and the subset partition method of the iosystem,
+ * and the box rearranger blocksize, are included since they are used
+ * when the decomposition is created.
+ *
+ * @param ios pointer to the iosystem info.
+ * @param pio_type the basic PIO data type used.
+ * @param ndims the number of dimensions in the variable.
+ * @param gdimlen an array length ndims with the sizes of the global
+ * dimensions.
+ * @param maplen the local length of the compmap array.
+ * @param compmap the 1 based array of offsets into the array record on file.
+ * @param rearranger the rearranger used for this decomposition.
+ * @param iostart the array of start values for the decomposition, or NULL.
+ * @param iocount the array of count values for the decomposition, or NULL.
+ * @returns the hash of the arguments.
+ */
+static unsigned long long decomp_hash(iosystem_desc_t *ios, int pio_type, int ndims,
+                                      const int *gdimlen, int maplen,
+                                      const PIO_Offset *compmap, int rearranger,
+                                      const PIO_Offset *iostart, const PIO_Offset *iocount)
+{
+    int hdr[] = {pio_type, ndims, maplen, rearranger, iostart ? 1 : 0, iocount ? 1 : 0,
+                 ios->rearr_opts.comm_type, ios->rearr_opts.fcd, blocksize,
+                 ios->subset_partition};
+    unsigned long long h = DECOMP_HASH_BASIS;
+
+    h = decomp_hash_bytes(h, hdr, sizeof(hdr));
+    h = decomp_hash_fc_opts(h, &ios->rearr_opts.comp2io);
+    h = decomp_hash_fc_opts(h, &ios->rearr_opts.io2comp);
+    h = decomp_hash_bytes(h, gdimlen, ndims * sizeof(int));
+    h = decomp_hash_bytes(h, compmap, maplen * sizeof(PIO_Offset));
+    if (iostart)
+        h = decomp_hash_bytes(h, iostart, ndims * sizeof(PIO_Offset));
+    if (iocount)
+        h = decomp_hash_bytes(h, iocount, ndims * sizeof(PIO_Offset));
+
+    return h;
+}
+
+/* Return true if the rearranger flow control options a and b are equal */
+static bool fc_opts_equal(const rearr_comm_fc_opt_t *a, const rearr_comm_fc_opt_t *b)
+{
+    return a->hs == b->hs && a->isend == b->isend && a->max_pend_req == b->max_pend_req;
+}
+
+/* Return true if the start/count arrays a and b (length ndims, or NULL)
+ * are equal */
+static bool decomp_offsets_equal(const PIO_Offset *a, const PIO_Offset *b, int ndims)
+{
+    if (!a || !b)
+        return a == b;
+    return !memcmp(a, b, ndims * sizeof(PIO_Offset));
+}
+
+/**
+ * Check whether the decomposition iodesc was created with the same
+ * arguments to PIOc_InitDecomp() and the same iosystem settings
+ * (rearranger options, subset partition method and box rearranger
+ * blocksize) as the one requested, comparing everything hashed by
+ * decomp_hash().
+ *
+ * @param ios pointer to the iosystem info.
+ * @param iodesc pointer to the existing decomposition.
+ * @param pio_type the basic PIO data type used.
+ * @param ndims the number of dimensions in the variable.
+ * @param gdimlen an array length ndims with the sizes of the global
+ * dimensions.
+ * @param maplen the local length of the compmap array.
+ * @param compmap the 1 based array of offsets into the array record on file.
+ * @param rearranger the rearranger used for this decomposition.
+ * @param iostart the array of start values for the decomposition, or NULL.
+ * @param iocount the array of count values for the decomposition, or NULL.
+ * @returns true if the decomposition is identical, false otherwise.
+ */
+static bool decomp_inputs_equal(iosystem_desc_t *ios, io_desc_t *iodesc, int pio_type,
+                                int ndims, const int *gdimlen, int maplen,
+                                const PIO_Offset *compmap, int rearranger,
+                                const PIO_Offset *iostart, const PIO_Offset *iocount)
+{
+    const rearr_opt_t *opts = &iodesc->dedup_rearr_opts;
+
+    return iodesc->piotype == pio_type && iodesc->ndims == ndims &&
+        iodesc->maplen == maplen && iodesc->rearranger == rearranger &&
+        opts->comm_type == ios->rearr_opts.comm_type && opts->fcd == ios->rearr_opts.fcd &&
+        fc_opts_equal(&opts->comp2io, &ios->rearr_opts.comp2io) &&
+        fc_opts_equal(&opts->io2comp, &ios->rearr_opts.io2comp) &&
+        iodesc->dedup_subset_partition == ios->subset_partition &&
+        iodesc->dedup_blocksize == blocksize &&
+        decomp_offsets_equal(iodesc->dedup_iostart, iostart, ndims) &&
+        decomp_offsets_equal(iodesc->dedup_iocount, iocount, ndims) &&
+        !memcmp(iodesc->dimlen, gdimlen, ndims * sizeof(int)) &&
+        !memcmp(iodesc->map, compmap, maplen * sizeof(PIO_Offset));
+}
+
+/**
+ * Remember the inputs, other than the map and dimension lengths, used
+ * to create the decomposition iodesc, see decomp_inputs_equal().
+ *
+ * @param ios pointer to the iosystem info.
+ * @param iodesc pointer to the new decomposition.
+ * @param iostart the array of start values for the decomposition, or NULL.
+ * @param iocount the array of count values for the decomposition, or NULL.
+ * @returns 0 on success, error code otherwise.
+ */
+static int set_decomp_inputs(iosystem_desc_t *ios, io_desc_t *iodesc,
+                             const PIO_Offset *iostart, const PIO_Offset *iocount)
+{
+    size_t sz = max(1, iodesc->ndims) * sizeof(PIO_Offset);
+
+    assert(ios && iodesc);
+
+    iodesc->dedup_rearr_opts = ios->rearr_opts;
+    iodesc->dedup_subset_partition = ios->subset_partition;
+    iodesc->dedup_blocksize = blocksize;
+    if (iostart)
+    {
+        if (!(iodesc->dedup_iostart = malloc(sz)))
+            return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                            "Out of memory allocating %lld bytes to store the start array of the I/O decomposition", (unsigned long long) sz);
+        memcpy(iodesc->dedup_iostart, iostart, iodesc->ndims * sizeof(PIO_Offset));
+    }
+    if (iocount)
+    {
+        if (!(iodesc->dedup_iocount = malloc(sz)))
+            return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                            "Out of memory allocating %lld bytes to store the count array of the I/O decomposition", (unsigned long long) sz);
+        memcpy(iodesc->dedup_iocount, iocount, iodesc->ndims * sizeof(PIO_Offset));
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Find an existing decomposition identical to the one requested in
+ * PIOc_InitDecomp(). A candidate is found locally using the hash of
+ * the arguments (and verified against all the stored inputs of the
+ * decomposition, see decomp_inputs_equal()) and all tasks then agree
+ * on it, since the decomposition can only be shared if it is
+ * identical on every task. This function is collective across the
+ * tasks in the iosystem.
+ *
+ * @param ios pointer to the iosystem info.
+ * @param hash the hash of the arguments to PIOc_InitDecomp(), see
+ * decomp_hash().
+ * @param pio_type the basic PIO data type used.
+ * @param ndims the number of dimensions in the variable.
+ * @param gdimlen an array length ndims with the sizes of the global
+ * dimensions.
+ * @param maplen the local length of the compmap array.
+ * @param compmap the 1 based array of offsets into the array record on file.
+ * @param rearranger the rearranger used for this decomposition.
+ * @param iostart the array of start values for the decomposition, or NULL.
+ * @param iocount the array of count values for the decomposition, or NULL.
+ * @param ioidp pointer that gets the id of the identical decomposition,
+ * or -1 if there is no identical decomposition.
+ * @returns 0 on success, error code otherwise.
+ */
+static int find_identical_decomp(iosystem_desc_t *ios, unsigned long long hash,
+                                 int pio_type, int ndims, const int *gdimlen,
+                                 int maplen, const PIO_Offset *compmap,
+                                 int rearranger, const PIO_Offset *iostart,
+                                 const PIO_Offset *iocount, int *ioidp)
+{
+    io_desc_t *iodesc;
+    int ioid[2] = {-1, -1}; /* {-min ioid, max ioid} on all tasks */
+    int mpierr = MPI_SUCCESS;
+
+    assert(ios && ioidp);
+
+    iodesc = pio_get_iodesc_from_hash(ios->iosysid, hash);
+    if (iodesc && decomp_inputs_equal(ios, iodesc, pio_type, ndims, gdimlen, maplen,
+                                      compmap, rearranger, iostart, iocount))
+    {
+        ioid[0] = -iodesc->ioid;
+        ioid[1] = iodesc->ioid;
+    }
+    else
+    {
+        /* No candidate : -min ioid > max ioid on all tasks */
+        ioid[0] = 0;
+        ioid[1] = -1;
+    }
+
+    if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, ioid, 2, MPI_INT, MPI_MAX, ios->my_comm)))
+        return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+
+    /* Identical on all tasks iff min ioid == max ioid (a valid id) */
+    *ioidp = (ioid[1] >= 0 && -ioid[0] == ioid[1]) ? ioid[1] : -1;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Complete the setup of a new decomposition, once its rearranger is
+ * created, and add it to the list of decompositions. This creates the
+ * neighborhood communicator for the rearranger, if needed, and is
+ * collective across the tasks in the iosystem.
+ *
+ * @param ios pointer to the iosystem info.
+ * @param iodesc pointer to the new decomposition.
+ * @param ioidp pointer that gets the id of the decomposition.
+ * @returns 0 on success, error code otherwise.
+ */
+static int add_decomp(iosystem_desc_t *ios, io_desc_t *iodesc, int *ioidp)
+{
+    int ierr;
+
+    assert(ios && iodesc && ioidp);
+
+    /* Create the neighborhood communicator (or, with the sparse comm
+     * type, find the neighbors) for the rearranger, if needed. */
+    if (iodesc->rearr_opts.comm_type == PIO_REARR_COMM_NEIGHBOR ||
+        iodesc->rearr_opts.comm_type == PIO_REARR_COMM_SPARSE)
+    {
+        if ((ierr = create_neighbor_comm(ios, iodesc)))
+        {
+            return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                            "Initializing the PIO decomposition failed. Error creating the neighborhood communicator for the rearranger");
+        }
+    }
+
+    /* Add this IO description to the list. */
+    MPI_Comm comm = MPI_COMM_NULL;
+#ifdef _ADIOS2
+    comm = ios->union_comm;
+#endif
+    if(ios->async)
+    {
+        /* For asynchronous I/O service, the iodescs (iodesc ids) need to
+         * be unique across the union_comm (union of I/O and compute comms)
+         */
+        comm = ios->union_comm;
+    }
+    *ioidp = pio_add_to_iodesc_list(iodesc, comm);
+
+    /* Check whether we have exceeded the maximum number of ioids (PIO_IODESC_MAX_IDS).
+     * This limit is necessary since each file uses a sparse pointer array (with a fixed
+     * size of PIO_IODESC_MAX_IDS) to look up a data buffer per ioid.
+     * FIXME: Replace the sparse array with a map or hash map to get rid of this limit
+     */
+    if (*ioidp - PIO_IODESC_START_ID + 1 > PIO_IODESC_MAX_IDS)
+    {
+        return pio_err(ios, NULL, PIO_EINTERNAL, __FILE__, __LINE__,
+                       "Initializing the PIO decomposition failed. Maximum number of ioids (limit = %d) has been reached", PIO_IODESC_MAX_IDS);
+    }
+
+    return PIO_NOERR;
+}
+
 /**
  * Initialize the decomposition used with distributed arrays. The
  * decomposition describes how the data will be distributed between
@@ -528,6 +813,7 @@ int PIOc_InitDecomp(int iosysid, int pio_type, int ndims, const int *gdimlen, in
 {
     iosystem_desc_t *ios;  /* Pointer to io system information. */
     io_desc_t *iodesc;     /* The IO description. */
+    unsigned long long dedup_hash = 0; /* Hash of the decomposition arguments. */
     int mpierr = MPI_SUCCESS;  /* Return code from MPI function calls. */
     int ierr;              /* Return code. */
 
@@ -607,6 +893,41 @@ int PIOc_InitDecomp(int iosysid, int pio_type, int ndims, const int *gdimlen, in
         }
     }
 
+    /* Reuse an existing identical decomposition, if any. The existing
+     * decomposition is returned with an additional reference, that is
+     * dropped by PIOc_freedecomp(). Not supported with async I/O since
+     * the I/O tasks do not have the compute task maps. */
+    if (!ios->async)
+    {
+        int rearr = (rearranger) ? (*rearranger) : ios->default_rearranger;
+        int existing_ioid = -1;
+
+        dedup_hash = decomp_hash(ios, pio_type, ndims, gdimlen, maplen, compmap, rearr,
+                                 iostart, iocount);
+        if ((ierr = find_identical_decomp(ios, dedup_hash, pio_type, ndims, gdimlen,
+                                          maplen, compmap, rearr, iostart, iocount,
+                                          &existing_ioid)))
+        {
+            GPTLstop("PIO:PIOc_initdecomp");
+            spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+            return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                            "Initializing the PIO decomposition failed. Error searching for an identical I/O decomposition");
+        }
+
+        if (existing_ioid >= 0)
+        {
+            iodesc = pio_get_iodesc_from_id(existing_ioid);
+            assert(iodesc);
+            iodesc->refcnt++;
+            *ioidp = existing_ioid;
+            LOG((2, "PIOc_InitDecomp reusing identical decomposition ioid = %d (refcnt = %d)",
+                 existing_ioid, iodesc->refcnt));
+            GPTLstop("PIO:PIOc_initdecomp");
+            spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+            return PIO_NOERR;
+        }
+    }
+
     /* Allocate space for the iodesc info. This also allocates the
      * first region and copies the rearranger opts into this
      * iodesc. */
@@ -618,6 +939,17 @@ int PIOc_InitDecomp(int iosysid, int pio_type, int ndims, const int *gdimlen, in
                         "Initializing the PIO decomposition failed. Out of memory allocating memory for I/O descriptor");
     }
 
+    /* Remember the hash of the arguments, to find this decomposition
+     * if it is requested again. */
+    iodesc->dedup_hash = dedup_hash;
+    if ((ierr = set_decomp_inputs(ios, iodesc, iostart, iocount)))
+    {
+        GPTLstop("PIO:PIOc_initdecomp");
+        spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+        return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                        "Initializing the PIO decomposition failed. Error saving the inputs of the I/O decomposition");
+    }
+
     /* Remember the maplen. */
     iodesc->maplen = maplen;
 
@@ -721,6 +1053,7 @@ int PIOc_InitDecomp(int iosysid, int pio_type, int ndims, const int *gdimlen, in
 
         /* Compute the communications pattern for this decomposition. */
         if (iodesc->rearranger == PIO_REARR_BOX)
+        {
             if ((ierr = box_rearrange_create(ios, maplen, compmap, gdimlen, ndims, iodesc)))
             {
                 GPTLstop("PIO:PIOc_initdecomp");
@@ -728,33 +1061,27 @@ int PIOc_InitDecomp(int iosysid, int pio_type, int ndims, const int *gdimlen, in
                 return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
                                 "Error initializing the PIO decomposition. Error creating the BOX rearranger");
             }
+        }
+        else if (iodesc->rearranger == PIO_REARR_BOX_HIER)
+        {
+            if ((ierr = box_hier_rearrange_create(ios, maplen, compmap, gdimlen, ndims, iodesc)))
+            {
+                GPTLstop("PIO:PIOc_initdecomp");
+                spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+                return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                                "Error initializing the PIO decomposition. Error creating the hierarchical BOX rearranger");
+            }
+        }
     }
 
-    /* Add this IO description to the list. */
-    MPI_Comm comm = MPI_COMM_NULL;
-#ifdef _ADIOS2
-    comm = ios->union_comm;
-#endif
-    if(ios->async)
-    {
-        /* For asynchronous I/O service, the iodescs (iodesc ids) need to
-         * be unique across the union_comm (union of I/O and compute comms)
-         */
-        comm = ios->union_comm;
-    }
-    *ioidp = pio_add_to_iodesc_list(iodesc, comm);
-
-    /* Check whether we have exceeded the maximum number of ioids (PIO_IODESC_MAX_IDS).
-     * This limit is necessary since each file uses a sparse pointer array (with a fixed
-     * size of PIO_IODESC_MAX_IDS) to look up a data buffer per ioid.
-     * FIXME: Replace the sparse array with a map or hash map to get rid of this limit
-     */
-    if (*ioidp - PIO_IODESC_START_ID + 1 > PIO_IODESC_MAX_IDS)
+    /* Create the neighborhood communicator, if needed, and add this
+     * IO description to the list. */
+    if ((ierr = add_decomp(ios, iodesc, ioidp)))
     {
         GPTLstop("PIO:PIOc_initdecomp");
         spio_ltimer_stop(ios->io_fstats->tot_timer_name);
-        return pio_err(ios, NULL, PIO_EINTERNAL, __FILE__, __LINE__,
-                       "Initializing the PIO decomposition failed. Maximum number of ioids (limit = %d) has been reached", PIO_IODESC_MAX_IDS);
+        return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                        "Initializing the PIO decomposition failed. Adding the I/O decomposition to the list of decompositions failed");
     }
 
 #if PIO_SAVE_DECOMPS
@@ -801,10 +1128,6 @@ int PIOc_InitDecomp(int iosysid, int pio_type, int ndims, const int *gdimlen, in
     }
 #endif /* PIO_ENABLE_LOGGING */            
 
-    /* This function only does something if pre-processor macro
-     * PERFTUNE is set. */
-    performance_tune_rearranger(ios, iodesc);
-
     GPTLstop("PIO:PIOc_initdecomp");
     spio_ltimer_stop(ios->io_fstats->tot_timer_name);
     return PIO_NOERR;
@@ -827,8 +1150,8 @@ int PIOc_InitDecomp(int iosysid, int pio_type, int ndims, const int *gdimlen, in
  * transfered.
  * @param ioidp pointer that will get the io description ID.
  * @param rearranger the rearranger to be used for this decomp or 0 to
- * use the default. Valid rearrangers are PIO_REARR_BOX and
- * PIO_REARR_SUBSET.
+ * use the default. Valid rearrangers are PIO_REARR_BOX,
+ * PIO_REARR_SUBSET and PIO_REARR_BOX_HIER.
  * @param iostart An array of start values for block cyclic
  * decompositions. If NULL ???
  * @param iocount An array of count values for block cyclic
@@ -863,6 +1186,664 @@ int PIOc_init_decomp(int iosysid, int pio_type, int ndims, const int *gdimlen, i
                            ioidp, rearrangerp, iostart, iocount);
 }
 
+/* Magic number ("SPIOPLAN") and version of the decomposition plan
+ * files written by PIOc_save_decomp_plan() */
+#define DECOMP_PLAN_MAGIC 0x5350494f504c414eULL
+#define DECOMP_PLAN_VERSION 2
+
+/* The number of rearranger arrays saved in a decomposition plan :
+ * scount, rcount, rfrom, sindex and rindex */
+#define DECOMP_PLAN_NARRAYS 5
+
+/* The header of a decomposition plan file. The header is followed by
+ * the rearranger arrays, each saved as its length (-1 if the array is
+ * not allocated) followed by its elements, and by the list of I/O
+ * regions and the list of fill regions, each saved as the number of
+ * regions (-1 if there is no list) followed by the loffset, start and
+ * count of each region. The plan files are in the native binary format
+ * and are only meant to be read by the build that wrote them. */
+typedef struct decomp_plan_hdr
+{
+    unsigned long long magic;
+    int version;
+    /* Hash of the decomposition arguments and the iosystem layout */
+    unsigned long long key;
+    int rearranger;
+    int ndof;
+    int nrecvs;
+    int num_aiotasks;
+    int maxregions;
+    int needsfill;
+    int holegridsize;
+    int maxholegridsize;
+    int maxfillregions;
+    /* Color and key used to create the subset communicator */
+    int subset_color;
+    int subset_key;
+    PIO_Offset llen;
+    PIO_Offset maxiobuflen;
+} decomp_plan_hdr_t;
+
+/* A decomposition plan read from a file */
+typedef struct decomp_plan
+{
+    decomp_plan_hdr_t hdr;
+    void *arrays[DECOMP_PLAN_NARRAYS];
+    io_region *firstregion;
+    io_region *fillregion;
+} decomp_plan_t;
+
+/* The size of the elements of the rearranger arrays in a decomposition plan */
+static const size_t decomp_plan_elem_size[DECOMP_PLAN_NARRAYS] = {
+    sizeof(int), sizeof(int), sizeof(int), sizeof(PIO_Offset), sizeof(PIO_Offset)};
+
+/* Get the key of a decomposition plan, from the hash of the
+ * decomposition arguments (see decomp_hash()) and the layout of the
+ * iosystem. */
+static unsigned long long decomp_plan_key(iosystem_desc_t *ios, unsigned long long hash)
+{
+    int layout[] = {ios->union_rank, ios->num_uniontasks, ios->num_comptasks,
+                    ios->num_iotasks};
+
+    hash = decomp_hash_bytes(hash, layout, sizeof(layout));
+    return decomp_hash_bytes(hash, ios->ioranks, ios->num_iotasks * sizeof(int));
+}
+
+/* Get the name of the decomposition plan file of this task */
+static void decomp_plan_filename(iosystem_desc_t *ios, const char *filename,
+                                 char *fname, size_t len)
+{
+    snprintf(fname, len, "%s.%d", filename, ios->union_rank);
+}
+
+/* Get the rearranger arrays of a decomposition and their lengths
+ * (-1 for arrays that are not allocated). */
+static void decomp_plan_arrays(iosystem_desc_t *ios, io_desc_t *iodesc,
+                               void **arrays, PIO_Offset *lens)
+{
+    arrays[0] = iodesc->scount;
+    arrays[1] = iodesc->rcount;
+    arrays[2] = iodesc->rfrom;
+    arrays[3] = iodesc->sindex;
+    arrays[4] = iodesc->rindex;
+
+    if (iodesc->rearranger == PIO_REARR_SUBSET)
+    {
+        lens[0] = 1;
+        lens[1] = iodesc->nrecvs;
+        lens[2] = iodesc->llen;
+        lens[3] = iodesc->scount ? iodesc->scount[0] : 0;
+        lens[4] = iodesc->llen;
+    }
+    else
+    {
+        PIO_Offset totalrecv = 0;
+
+        for (int i = 0; iodesc->rcount && i < iodesc->nrecvs; i++)
+            totalrecv += iodesc->rcount[i];
+
+        lens[0] = ios->num_iotasks;
+        lens[1] = max(1, iodesc->nrecvs);
+        lens[2] = max(1, iodesc->nrecvs);
+        lens[3] = iodesc->ndof;
+        lens[4] = totalrecv;
+    }
+
+    for (int i = 0; i < DECOMP_PLAN_NARRAYS; i++)
+        if (!arrays[i])
+            lens[i] = -1;
+}
+
+/* Write a list of regions to a decomposition plan file */
+static bool write_decomp_plan_regions(FILE *fp, const io_region *region, int ndims)
+{
+    PIO_Offset nregions = region ? 0 : -1;
+
+    for (const io_region *r = region; r; r = r->next)
+        nregions++;
+    if (fwrite(&nregions, sizeof(PIO_Offset), 1, fp) != 1)
+        return false;
+
+    for (; region; region = region->next)
+        if (fwrite(&region->loffset, sizeof(PIO_Offset), 1, fp) != 1 ||
+            fwrite(region->start, sizeof(PIO_Offset), ndims, fp) != (size_t)ndims ||
+            fwrite(region->count, sizeof(PIO_Offset), ndims, fp) != (size_t)ndims)
+            return false;
+
+    return true;
+}
+
+/* Read a list of regions from a decomposition plan file. The list
+ * must have at most maxregions regions, and each region must be
+ * within the global dimensions gdimlen and within the first len
+ * elements of the buffer it is read from/written to. */
+static bool read_decomp_plan_regions(iosystem_desc_t *ios, FILE *fp, int ndims,
+                                     const int *gdimlen, int maxregions, PIO_Offset len,
+                                     io_region **regionp)
+{
+    io_region **next = regionp;
+    PIO_Offset nregions;
+
+    if (fread(&nregions, sizeof(PIO_Offset), 1, fp) != 1 || nregions < -1 ||
+        nregions > maxregions)
+        return false;
+
+    for (PIO_Offset i = 0; i < nregions; i++)
+    {
+        PIO_Offset size = 1;
+
+        if (alloc_region2(ios, ndims, next))
+            return false;
+        if (fread(&(*next)->loffset, sizeof(PIO_Offset), 1, fp) != 1 ||
+            fread((*next)->start, sizeof(PIO_Offset), ndims, fp) != (size_t)ndims ||
+            fread((*next)->count, sizeof(PIO_Offset), ndims, fp) != (size_t)ndims)
+            return false;
+        for (int d = 0; d < ndims; d++)
+        {
+            if ((*next)->start[d] < 0 || (*next)->count[d] < 0 ||
+                (*next)->start[d] + (*next)->count[d] > gdimlen[d])
+                return false;
+            size *= (*next)->count[d];
+        }
+        if ((*next)->loffset < 0 || (*next)->loffset + size > len)
+            return false;
+        next = &(*next)->next;
+    }
+
+    return true;
+}
+
+/* Free the arrays and regions of a decomposition plan read from a file */
+static void free_decomp_plan(decomp_plan_t *plan)
+{
+    for (int i = 0; i < DECOMP_PLAN_NARRAYS; i++)
+        free(plan->arrays[i]);
+    free_region_list(plan->firstregion);
+    free_region_list(plan->fillregion);
+}
+
+/* Check that all the values of an array of a decomposition plan are
+ * in [0, max). */
+static bool check_decomp_plan_values(const void *array, size_t elem_size, PIO_Offset len,
+                                     PIO_Offset max)
+{
+    for (PIO_Offset i = 0; i < len; i++)
+    {
+        PIO_Offset v = (elem_size == sizeof(int)) ? ((const int *)array)[i] :
+            ((const PIO_Offset *)array)[i];
+
+        if (v < 0 || v >= max)
+            return false;
+    }
+
+    return true;
+}
+
+/* Check the lengths and the values of the rearranger arrays of a
+ * decomposition plan against the sizes in its header (see
+ * decomp_plan_arrays()), so that a plan that does not match the
+ * decomposition is not used to index the data buffers. */
+static bool check_decomp_plan_arrays(iosystem_desc_t *ios, decomp_plan_t *plan,
+                                     const PIO_Offset *lens)
+{
+    decomp_plan_hdr_t *hdr = &plan->hdr;
+    const int *scount = plan->arrays[0];
+    const int *rcount = plan->arrays[1];
+    PIO_Offset expected[DECOMP_PLAN_NARRAYS];
+    PIO_Offset maxval[DECOMP_PLAN_NARRAYS];
+    PIO_Offset totalsend = 0;
+    PIO_Offset totalrecv = 0;
+
+    if (hdr->nrecvs < 0 || hdr->num_aiotasks < 0 || hdr->num_aiotasks > ios->num_iotasks ||
+        hdr->maxregions < 0 || hdr->maxfillregions < 0 || hdr->holegridsize < 0 ||
+        hdr->maxholegridsize < hdr->holegridsize || hdr->llen < 0 ||
+        hdr->maxiobuflen < 0)
+        return false;
+
+    /* The counts must not be negative. */
+    if ((scount && !check_decomp_plan_values(scount, sizeof(int), lens[0], INT_MAX)) ||
+        (rcount && !check_decomp_plan_values(rcount, sizeof(int), lens[1], INT_MAX)))
+        return false;
+    for (PIO_Offset i = 0; scount && i < lens[0]; i++)
+        totalsend += scount[i];
+    for (PIO_Offset i = 0; rcount && i < min(lens[1], hdr->nrecvs); i++)
+        totalrecv += rcount[i];
+
+    if (hdr->rearranger == PIO_REARR_SUBSET)
+    {
+        expected[0] = 1;
+        expected[1] = hdr->nrecvs;
+        expected[2] = hdr->llen;
+        expected[3] = totalsend;
+        expected[4] = hdr->llen;
+        if (totalrecv > hdr->llen)
+            return false;
+    }
+    else
+    {
+        expected[0] = ios->num_iotasks;
+        expected[1] = max(1, hdr->nrecvs);
+        expected[2] = max(1, hdr->nrecvs);
+        expected[3] = hdr->ndof;
+        expected[4] = totalrecv;
+        if (totalsend > hdr->ndof)
+            return false;
+    }
+
+    /* The ranks (or subset ranks) the data is received from, and the
+     * indices in the local data and in the IO buffer. */
+    maxval[0] = INT_MAX;
+    maxval[1] = INT_MAX;
+    maxval[2] = (hdr->rearranger == PIO_REARR_SUBSET) ? max(1, hdr->nrecvs) : ios->num_uniontasks;
+    maxval[3] = hdr->ndof;
+    maxval[4] = hdr->llen;
+
+    for (int i = 0; i < DECOMP_PLAN_NARRAYS; i++)
+    {
+        if (lens[i] < 0)
+            continue;
+        if (lens[i] != expected[i] ||
+            !check_decomp_plan_values(plan->arrays[i], decomp_plan_elem_size[i], lens[i],
+                                      maxval[i]))
+            return false;
+    }
+
+    return true;
+}
+
+/* Result of read_decomp_plan() */
+#define DECOMP_PLAN_INVALID -1 /* The plan does not match its header */
+#define DECOMP_PLAN_NONE 0     /* The plan is for another decomposition */
+#define DECOMP_PLAN_VALID 1
+
+/* Read a decomposition plan file. Returns DECOMP_PLAN_NONE if the
+ * file is not a plan for the decomposition with the given key, and
+ * DECOMP_PLAN_INVALID if it is, but its arrays or regions are
+ * truncated or do not match the sizes in its header. */
+static int read_decomp_plan(iosystem_desc_t *ios, FILE *fp, unsigned long long key,
+                            int rearranger, int ndims, const int *gdimlen, int maplen,
+                            decomp_plan_t *plan)
+{
+    decomp_plan_hdr_t *hdr = &plan->hdr;
+    PIO_Offset lens[DECOMP_PLAN_NARRAYS];
+
+    if (fread(hdr, sizeof(decomp_plan_hdr_t), 1, fp) != 1 ||
+        hdr->magic != DECOMP_PLAN_MAGIC || hdr->version != DECOMP_PLAN_VERSION ||
+        hdr->key != key || hdr->rearranger != rearranger || hdr->ndof != maplen)
+        return DECOMP_PLAN_NONE;
+
+    for (int i = 0; i < DECOMP_PLAN_NARRAYS; i++)
+    {
+        if (fread(&lens[i], sizeof(PIO_Offset), 1, fp) != 1 || lens[i] < -1 ||
+            lens[i] > INT_MAX)
+            return DECOMP_PLAN_INVALID;
+        if (lens[i] < 0)
+            continue;
+        if (!(plan->arrays[i] = malloc(max(1, lens[i]) * decomp_plan_elem_size[i])))
+            return DECOMP_PLAN_INVALID;
+        if (fread(plan->arrays[i], decomp_plan_elem_size[i], lens[i], fp) != (size_t)lens[i])
+            return DECOMP_PLAN_INVALID;
+    }
+
+    if (!check_decomp_plan_arrays(ios, plan, lens))
+        return DECOMP_PLAN_INVALID;
+
+    if (!read_decomp_plan_regions(ios, fp, ndims, gdimlen, hdr->maxregions, hdr->llen,
+                                  &plan->firstregion) ||
+        !read_decomp_plan_regions(ios, fp, ndims, gdimlen, hdr->maxfillregions,
+                                  hdr->holegridsize, &plan->fillregion))
+        return DECOMP_PLAN_INVALID;
+
+    /* The plan must end here. */
+    return (fgetc(fp) == EOF) ? DECOMP_PLAN_VALID : DECOMP_PLAN_INVALID;
+}
+
+/**
+ * Save the rearranger plan of a decomposition, i.e. everything
+ * computed when its rearranger is created, so that the decomposition
+ * can be recreated with PIOc_load_decomp_plan(), without exchanging
+ * data between the tasks. Each task writes its part of the plan to
+ * its own file, named filename.rank where rank is the rank of the
+ * task in the iosystem. The plan is only valid for the same
+ * decomposition arguments and the same iosystem layout.
+ *
+ * Plans of decompositions using the PIO_REARR_BOX_HIER rearranger, or
+ * created on iosystems using async I/O, cannot be saved.
+ *
+ * @param iosysid the IO system ID.
+ * @param ioid the ID of the decomposition.
+ * @param filename the prefix of the names of the plan files.
+ * @returns 0 on success, error code otherwise.
+ * @ingroup PIO_initdecomp
+ */
+int PIOc_save_decomp_plan(int iosysid, int ioid, const char *filename)
+{
+    iosystem_desc_t *ios;
+    io_desc_t *iodesc;
+    decomp_plan_hdr_t hdr;
+    void *arrays[DECOMP_PLAN_NARRAYS];
+    PIO_Offset lens[DECOMP_PLAN_NARRAYS];
+    char fname[PIO_MAX_NAME];
+    FILE *fp;
+    bool ok;
+    int mpierr = MPI_SUCCESS;
+
+    LOG((1, "PIOc_save_decomp_plan iosysid = %d ioid = %d", iosysid, ioid));
+
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+    {
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Saving the rearranger plan of the I/O decomposition failed. Invalid iosystem id (%d) provided", iosysid);
+    }
+
+    if (!(iodesc = pio_get_iodesc_from_id(ioid)))
+    {
+        return pio_err(ios, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Saving the rearranger plan of the I/O decomposition failed. Invalid io descriptor id (%d) provided (iosysid=%d)", ioid, iosysid);
+    }
+
+    if (!filename)
+    {
+        return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__,
+                        "Saving the rearranger plan of the I/O decomposition (ioid=%d) failed. Invalid file name (NULL) provided", ioid);
+    }
+
+    if (ios->async || iodesc->rearranger == PIO_REARR_BOX_HIER)
+    {
+        return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__,
+                        "Saving the rearranger plan of the I/O decomposition (ioid=%d) failed. Saving plans is not supported with async I/O or with the hierarchical BOX rearranger", ioid);
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = DECOMP_PLAN_MAGIC;
+    hdr.version = DECOMP_PLAN_VERSION;
+    hdr.key = decomp_plan_key(ios, iodesc->dedup_hash);
+    hdr.rearranger = iodesc->rearranger;
+    hdr.ndof = iodesc->ndof;
+    hdr.nrecvs = iodesc->nrecvs;
+    hdr.num_aiotasks = iodesc->num_aiotasks;
+    hdr.maxregions = iodesc->maxregions;
+    hdr.needsfill = iodesc->needsfill;
+    hdr.holegridsize = iodesc->holegridsize;
+    hdr.maxholegridsize = iodesc->maxholegridsize;
+    hdr.maxfillregions = iodesc->maxfillregions;
+    hdr.llen = iodesc->llen;
+    hdr.maxiobuflen = iodesc->maxiobuflen;
+
+    /* The subset communicator is recreated with the (comp_comm) rank
+     * of its IO task as the color, and the rank in it as the key. */
+    if (iodesc->rearranger == PIO_REARR_SUBSET)
+    {
+        MPI_Group subset_group, comp_group;
+        int ioroot = 0;
+
+        if ((mpierr = MPI_Comm_rank(iodesc->subset_comm, &hdr.subset_key)))
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        if ((mpierr = MPI_Comm_group(iodesc->subset_comm, &subset_group)))
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        if ((mpierr = MPI_Comm_group(ios->comp_comm, &comp_group)))
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        if ((mpierr = MPI_Group_translate_ranks(subset_group, 1, &ioroot, comp_group,
+                                                &hdr.subset_color)))
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        MPI_Group_free(&subset_group);
+        MPI_Group_free(&comp_group);
+    }
+
+    decomp_plan_arrays(ios, iodesc, arrays, lens);
+
+    decomp_plan_filename(ios, filename, fname, sizeof(fname));
+    LOG((2, "Saving the rearranger plan of ioid = %d to %s", ioid, fname));
+    if (!(fp = fopen(fname, "wb")))
+    {
+        return pio_err(ios, NULL, PIO_EIO, __FILE__, __LINE__,
+                        "Saving the rearranger plan of the I/O decomposition (ioid=%d) failed. Opening the file (%s) failed", ioid, fname);
+    }
+
+    ok = (fwrite(&hdr, sizeof(hdr), 1, fp) == 1);
+    for (int i = 0; ok && i < DECOMP_PLAN_NARRAYS; i++)
+        ok = (fwrite(&lens[i], sizeof(PIO_Offset), 1, fp) == 1) &&
+            (lens[i] <= 0 ||
+             fwrite(arrays[i], decomp_plan_elem_size[i], lens[i], fp) == (size_t)lens[i]);
+    ok = ok && write_decomp_plan_regions(fp, iodesc->firstregion, iodesc->ndims) &&
+        write_decomp_plan_regions(fp, iodesc->fillregion, iodesc->ndims);
+    if (fclose(fp))
+        ok = false;
+
+    if (!ok)
+    {
+        return pio_err(ios, NULL, PIO_EIO, __FILE__, __LINE__,
+                        "Saving the rearranger plan of the I/O decomposition (ioid=%d) failed. Writing to the file (%s) failed", ioid, fname);
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Initialize a decomposition from a rearranger plan saved with
+ * PIOc_save_decomp_plan(). The arguments are the same as for
+ * PIOc_InitDecomp(), and the plan files are only used if they were
+ * saved for a decomposition with the same arguments on an iosystem
+ * with the same layout, on all tasks. The decomposition is then
+ * created without exchanging data between the tasks. Otherwise the
+ * decomposition is created with PIOc_InitDecomp(), so a typical use
+ * is to load the plan and save it if it was not loaded.
+ *
+ * @param iosysid the IO system ID.
+ * @param filename the prefix of the names of the plan files.
+ * @param pio_type the basic PIO data type used.
+ * @param ndims the number of dimensions in the variable, not
+ * including the unlimited dimension.
+ * @param gdimlen an array length ndims with the sizes of the global
+ * dimensions.
+ * @param maplen the local length of the compmap array.
+ * @param compmap a 1 based array of offsets into the array record on
+ * file. A 0 in this array indicates a value which should not be
+ * transfered.
+ * @param ioidp pointer that will get the io description ID.
+ * @param rearranger pointer to the rearranger to be used for this
+ * decomp or NULL to use the default.
+ * @param iostart An array of start values for the decomposition, or
+ * NULL (see PIOc_InitDecomp()).
+ * @param iocount An array of count values for the decomposition, or
+ * NULL (see PIOc_InitDecomp()).
+ * @param loadedp pointer that gets true if the decomposition was
+ * created from the saved plan. Ignored if NULL.
+ * @returns 0 on success, PIO_EINVAL if the plan files were saved for
+ * this decomposition but are truncated or their arrays and regions do
+ * not match the sizes of the decomposition, error code otherwise
+ * @ingroup PIO_initdecomp
+ */
+int PIOc_load_decomp_plan(int iosysid, const char *filename, int pio_type, int ndims,
+                          const int *gdimlen, int maplen, const PIO_Offset *compmap,
+                          int *ioidp, const int *rearranger, const PIO_Offset *iostart,
+                          const PIO_Offset *iocount, bool *loadedp)
+{
+    iosystem_desc_t *ios;
+    io_desc_t *iodesc;
+    decomp_plan_t plan;
+    unsigned long long hash = 0;
+    char fname[PIO_MAX_NAME];
+    int loaded = DECOMP_PLAN_NONE;
+    int rearr;
+    int existing_ioid = -1;
+    FILE *fp;
+    int mpierr = MPI_SUCCESS;
+    int ierr;
+
+    GPTLstart("PIO:PIOc_load_decomp_plan");
+    LOG((1, "PIOc_load_decomp_plan iosysid = %d pio_type = %d ndims = %d maplen = %d",
+         iosysid, pio_type, ndims, maplen));
+
+    if (loadedp)
+        *loadedp = false;
+
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+    {
+        GPTLstop("PIO:PIOc_load_decomp_plan");
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Loading the rearranger plan of the I/O decomposition failed. Invalid io system id (%d) provided", iosysid);
+    }
+    spio_ltimer_start(ios->io_fstats->tot_timer_name);
+
+    if (!filename || !gdimlen || !compmap || !ioidp)
+    {
+        GPTLstop("PIO:PIOc_load_decomp_plan");
+        spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+        return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__,
+                        "Loading the rearranger plan of the I/O decomposition failed. Invalid pointers (NULL) to filename(%s) or gdimlen(%s) or compmap(%s) or ioidp (%s) provided", (filename) ? "not NULL" : "NULL", (gdimlen) ? "not NULL" : "NULL", (compmap) ? "not NULL" : "NULL", (ioidp) ? "not NULL" : "NULL");
+    }
+
+    rearr = (rearranger) ? (*rearranger) : ios->default_rearranger;
+    if (!ios->async && rearr != PIO_REARR_BOX_HIER)
+    {
+        hash = decomp_hash(ios, pio_type, ndims, gdimlen, maplen, compmap, rearr,
+                           iostart, iocount);
+
+        /* Reuse an existing identical decomposition, if any. */
+        if ((ierr = find_identical_decomp(ios, hash, pio_type, ndims, gdimlen, maplen,
+                                          compmap, rearr, iostart, iocount,
+                                          &existing_ioid)))
+        {
+            GPTLstop("PIO:PIOc_load_decomp_plan");
+            spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+            return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                            "Loading the rearranger plan of the I/O decomposition failed. Error searching for an identical I/O decomposition");
+        }
+
+        if (existing_ioid < 0)
+        {
+            memset(&plan, 0, sizeof(plan));
+            decomp_plan_filename(ios, filename, fname, sizeof(fname));
+            if ((fp = fopen(fname, "rb")))
+            {
+                loaded = read_decomp_plan(ios, fp, decomp_plan_key(ios, hash), rearr,
+                                          ndims, gdimlen, maplen, &plan);
+                fclose(fp);
+            }
+
+            /* The plan is only used if it is valid on all tasks. */
+            if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &loaded, 1, MPI_INT, MPI_MIN,
+                                        ios->my_comm)))
+            {
+                free_decomp_plan(&plan);
+                GPTLstop("PIO:PIOc_load_decomp_plan");
+                spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+                return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+            }
+            if (loaded != DECOMP_PLAN_VALID)
+                free_decomp_plan(&plan);
+            if (loaded == DECOMP_PLAN_INVALID)
+            {
+                GPTLstop("PIO:PIOc_load_decomp_plan");
+                spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+                return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__,
+                                "Loading the rearranger plan of the I/O decomposition failed. The plan files (%s.*) are truncated or do not match the sizes of the decomposition", filename);
+            }
+        }
+    }
+
+    if (existing_ioid >= 0 || loaded != DECOMP_PLAN_VALID)
+    {
+        LOG((2, "No valid rearranger plan in %s, initializing the decomposition", filename));
+        GPTLstop("PIO:PIOc_load_decomp_plan");
+        spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+        return PIOc_InitDecomp(iosysid, pio_type, ndims, gdimlen, maplen, compmap, ioidp,
+                               rearranger, iostart, iocount);
+    }
+
+    if ((ierr = malloc_iodesc(ios, pio_type, ndims, &iodesc)))
+    {
+        free_decomp_plan(&plan);
+        GPTLstop("PIO:PIOc_load_decomp_plan");
+        spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+        return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                        "Loading the rearranger plan of the I/O decomposition failed. Out of memory allocating memory for I/O descriptor");
+    }
+
+    iodesc->dedup_hash = hash;
+    if ((ierr = set_decomp_inputs(ios, iodesc, iostart, iocount)))
+    {
+        free_decomp_plan(&plan);
+        GPTLstop("PIO:PIOc_load_decomp_plan");
+        spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+        return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                        "Loading the rearranger plan of the I/O decomposition failed. Error saving the inputs of the I/O decomposition");
+    }
+    iodesc->maplen = maplen;
+    iodesc->map = malloc(sizeof(PIO_Offset) * max(1, maplen));
+    iodesc->dimlen = malloc(sizeof(int) * max(1, ndims));
+    if (!iodesc->map || !iodesc->dimlen)
+    {
+        free_decomp_plan(&plan);
+        GPTLstop("PIO:PIOc_load_decomp_plan");
+        spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                        "Loading the rearranger plan of the I/O decomposition failed. Out of memory allocating %lld bytes to store I/O decomposition map", (unsigned long long) (sizeof(PIO_Offset) * maplen));
+    }
+    memcpy(iodesc->map, compmap, sizeof(PIO_Offset) * maplen);
+    memcpy(iodesc->dimlen, gdimlen, sizeof(int) * ndims);
+
+    /* Restore the rearranger from the plan. The arrays and regions
+     * are now owned by the iodesc. */
+    iodesc->rearranger = plan.hdr.rearranger;
+    iodesc->ndof = plan.hdr.ndof;
+    iodesc->nrecvs = plan.hdr.nrecvs;
+    iodesc->num_aiotasks = plan.hdr.num_aiotasks;
+    iodesc->maxregions = plan.hdr.maxregions;
+    iodesc->needsfill = plan.hdr.needsfill;
+    iodesc->holegridsize = plan.hdr.holegridsize;
+    iodesc->maxholegridsize = plan.hdr.maxholegridsize;
+    iodesc->maxfillregions = plan.hdr.maxfillregions;
+    iodesc->llen = plan.hdr.llen;
+    iodesc->maxiobuflen = plan.hdr.maxiobuflen;
+    iodesc->scount = plan.arrays[0];
+    iodesc->rcount = plan.arrays[1];
+    iodesc->rfrom = plan.arrays[2];
+    iodesc->sindex = plan.arrays[3];
+    iodesc->rindex = plan.arrays[4];
+    free_region_list(iodesc->firstregion);
+    iodesc->firstregion = plan.firstregion;
+    iodesc->fillregion = plan.fillregion;
+
+    if (iodesc->rearranger == PIO_REARR_SUBSET)
+    {
+        if ((mpierr = MPI_Comm_split(ios->comp_comm, plan.hdr.subset_color,
+                                     plan.hdr.subset_key, &iodesc->subset_comm)))
+        {
+            GPTLstop("PIO:PIOc_load_decomp_plan");
+            spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        }
+    }
+
+    /* The maximum number of bytes cached depends on the current
+     * buffer size limits. */
+    if ((ierr = compute_maxaggregate_bytes(ios, iodesc)))
+    {
+        GPTLstop("PIO:PIOc_load_decomp_plan");
+        spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+        return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                        "Loading the rearranger plan of the I/O decomposition failed. Unable to calculate the max aggregate bytes across all processes");
+    }
+
+    if ((ierr = add_decomp(ios, iodesc, ioidp)))
+    {
+        GPTLstop("PIO:PIOc_load_decomp_plan");
+        spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+        return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                        "Loading the rearranger plan of the I/O decomposition failed. Adding the I/O decomposition to the list of decompositions failed");
+    }
+    LOG((2, "Loaded the rearranger plan from %s, ioid = %d", filename, *ioidp));
+
+    if (loadedp)
+        *loadedp = true;
+
+    GPTLstop("PIO:PIOc_load_decomp_plan");
+    spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+    return PIO_NOERR;
+}
+
 /**
  * This is a simplified initdecomp which can be used if the memory
  * order of the data can be expressed in terms of start and count on
@@ -983,7 +1964,7 @@ unsigned long get_adios2_io_cnt()
  * <li>On IO tasks, create an IO communicator (ios->io_comm).
  * <li>Assign an iosystemid, and put this iosystem_desc_t into the
  * list of open iosystems.
- * <li>Initialize the bget buffer, unless PIO_USE_MALLOC was used.
+ * <li>Initialize the buffer arena (see pio_arena.c).
  * </ul>
  *
  * When complete, there are three MPI communicators (ios->comp_comm,
@@ -992,8 +1973,11 @@ unsigned long get_adios2_io_cnt()
  *
  * @param comp_comm the MPI_Comm of the compute tasks.
  * @param num_iotasks the number of io tasks to use.
- * @param stride the offset between io tasks in the comp_comm.
- * @param base the comp_comm index of the first io task.
+ * @param stride the offset between io tasks in the comp_comm. Ignored
+ * if the IO tasks are placed across the nodes (see
+ * PIOc_set_iotask_placement()).
+ * @param base the comp_comm index of the first io task. Ignored if
+ * the IO tasks are placed across the nodes.
  * @param rearr the rearranger to use by default, this may be
  * overriden in the PIO_init_decomp(). The rearranger is not used
  * until the decomposition is initialized.
@@ -1148,8 +2132,22 @@ int PIOc_Init_Intracomm(MPI_Comm comp_comm, int num_iotasks, int stride, int bas
                         "PIO Init failed. Out of memory allocating %lld bytes for array of I/O process ranks in the I/O descriptor", (unsigned long long) (ios->num_iotasks * sizeof(int)));
     }
     for (int i = 0; i < ios->num_iotasks; i++)
-    {
         ios->ioranks[i] = (base + i * ustride) % ios->num_comptasks;
+
+    /* Move the IO tasks around the nodes if requested, and find the
+     * layout of the IO tasks across the nodes. */
+    ios->iotask_placement = iotask_placement;
+    if ((ret = place_iotasks(ios->comp_comm, ios->iotask_placement, ios->num_iotasks,
+                             iotask_max_per_node, ios->ioranks, &ios->num_nodes,
+                             &ios->num_io_nodes, &ios->max_iotasks_per_node)))
+    {
+        GPTLstop("PIO:PIOc_Init_Intracomm");
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "PIO Init failed. Placing %d I/O processes among the compute processes failed", ios->num_iotasks);
+    }
+
+    for (int i = 0; i < ios->num_iotasks; i++)
+    {
         if (ios->ioranks[i] == ios->comp_rank)
             ios->ioproc = true;
         LOG((3, "ios->ioranks[%d] = %d", i, ios->ioranks[i]));
@@ -1499,6 +2497,11 @@ int PIOc_finalize(int iosysid)
                         "PIO Finalize failed on iosytem (%d). Unable to delete iosystem from internal list", iosysid);
     }
 
+    /* Return the buffers cached for reuse to the system, after the
+     * last iosystem is finalized. */
+    if (niosysid == 1)
+        pio_arena_trim();
+
     return PIO_NOERR;
 }
 
@@ -1683,11 +2686,12 @@ int PIOc_init_async(MPI_Comm world, int num_io_procs, int *io_proc_list,
 
     /* Check input parameters. */
     if (num_io_procs < 1 || component_count < 1 || !num_procs_per_comp || !iosysidp ||
-        (rearranger != PIO_REARR_BOX && rearranger != PIO_REARR_SUBSET))
+        (rearranger != PIO_REARR_BOX && rearranger != PIO_REARR_SUBSET &&
+         rearranger != PIO_REARR_BOX_HIER))
     {
         GPTLstop("PIO:PIOc_init_async");
         return pio_err(NULL, NULL, PIO_EINVAL, __FILE__, __LINE__,
-                        "PIO Init (async) failed. Invalid arguments provided, num_io_procs=%d (expected >= 1), component_count=%d (expected >= 1), num_procs_per_comp is %s (expected not NULL), iosysidp is %s (expected not NULL), rearranger=%s (expected PIO_REARR_BOX or PIO_REARR_SUBSET)", num_io_procs, component_count, (num_procs_per_comp) ? "not NULL" : "NULL", (iosysidp) ? "not NULL" : "NULL", (rearranger == PIO_REARR_BOX) ? "PIO_REARR_BOX" : ((rearranger == PIO_REARR_SUBSET) ? "PIO_REARR_SUBSET" : "UNKNOWN REARRANGER"));
+                        "PIO Init (async) failed. Invalid arguments provided, num_io_procs=%d (expected >= 1), component_count=%d (expected >= 1), num_procs_per_comp is %s (expected not NULL), iosysidp is %s (expected not NULL), rearranger=%s (expected PIO_REARR_BOX, PIO_REARR_SUBSET or PIO_REARR_BOX_HIER)", num_io_procs, component_count, (num_procs_per_comp) ? "not NULL" : "NULL", (iosysidp) ? "not NULL" : "NULL", (rearranger == PIO_REARR_BOX) ? "PIO_REARR_BOX" : ((rearranger == PIO_REARR_SUBSET) ? "PIO_REARR_SUBSET" : ((rearranger == PIO_REARR_BOX_HIER) ? "PIO_REARR_BOX_HIER" : "UNKNOWN REARRANGER")));
     }
 
     /* Temporarily limit to one computational component. */
@@ -2251,12 +3255,13 @@ int PIOc_init_intercomm(int component_count, const MPI_Comm peer_comm,
     GPTLstart("PIO:PIOc_init_intercomm");
     assert((component_count > 0) && ucomp_comms && iosysidps);
     if((component_count <= 0) || (ucomp_comms == NULL) ||
-        ((rearranger != PIO_REARR_BOX) && (rearranger != PIO_REARR_SUBSET)) ||
+        ((rearranger != PIO_REARR_BOX) && (rearranger != PIO_REARR_SUBSET) &&
+         (rearranger != PIO_REARR_BOX_HIER)) ||
         (iosysidps == NULL))
     {
         GPTLstop("PIO:PIOc_init_intercomm");
         return pio_err(NULL, NULL, PIO_EINVAL, __FILE__, __LINE__,
-                        "PIO Init (async) failed. Invalid arguments provided, component_count=%d (expected > 0), ucomp_comms is %s (expected not NULL), rearranger=%s (expected PIO_REARR_BOX or PIO_REARR_SUBSET), iosysidps is %s (expected not NULL)", component_count, (ucomp_comms) ? "not NULL" : "NULL", (rearranger == PIO_REARR_BOX) ? "PIO_REARR_BOX" : ((rearranger == PIO_REARR_SUBSET) ? "PIO_REARR_SUBSET" : "UNKNOWN REARRANGER"), (iosysidps) ? "not NULL" : "NULL");
+                        "PIO Init (async) failed. Invalid arguments provided, component_count=%d (expected > 0), ucomp_comms is %s (expected not NULL), rearranger=%s (expected PIO_REARR_BOX, PIO_REARR_SUBSET or PIO_REARR_BOX_HIER), iosysidps is %s (expected not NULL)", component_count, (ucomp_comms) ? "not NULL" : "NULL", (rearranger == PIO_REARR_BOX) ? "PIO_REARR_BOX" : ((rearranger == PIO_REARR_SUBSET) ? "PIO_REARR_SUBSET" : ((rearranger == PIO_REARR_BOX_HIER) ? "PIO_REARR_BOX_HIER" : "UNKNOWN REARRANGER")), (iosysidps) ? "not NULL" : "NULL");
     }
 
     /* Turn on the logging system for PIO. */
@@ -2881,3 +3886,32 @@ int PIOc_set_blocksize(int newblocksize)
     blocksize = newblocksize;
     return PIO_NOERR;
 }
+
+/**
+ * Set the method used to place the IO tasks among the computation
+ * tasks. The method applies to the IO systems subsequently created
+ * with PIOc_Init_Intracomm().
+ *
+ * With PIO_IOTASK_PLACEMENT_NODE the IO tasks are spread evenly
+ * across the (shared memory) nodes, and the stride and base passed
+ * to PIOc_Init_Intracomm() are ignored.
+ *
+ * @param placement the placement method, see PIO_IOTASK_PLACEMENT.
+ * @param max_iotasks_per_node the maximum number of IO tasks on a
+ * node with PIO_IOTASK_PLACEMENT_NODE, 0 for no limit.
+ * @returns 0 for success.
+ * @ingroup PIO_set_iotask_placement
+ */
+int PIOc_set_iotask_placement(int placement, int max_iotasks_per_node)
+{
+    if ((placement != PIO_IOTASK_PLACEMENT_STRIDE && placement != PIO_IOTASK_PLACEMENT_NODE) ||
+        max_iotasks_per_node < 0)
+    {
+        return pio_err(NULL, NULL, PIO_EINVAL, __FILE__, __LINE__,
+                        "Setting the I/O task placement failed. Invalid arguments provided, placement=%d (expected PIO_IOTASK_PLACEMENT_STRIDE or PIO_IOTASK_PLACEMENT_NODE), max_iotasks_per_node=%d (expected >= 0)", placement, max_iotasks_per_node);
+    }
+
+    iotask_placement = placement;
+    iotask_max_per_node = max_iotasks_per_node;
+    return PIO_NOERR;
+}
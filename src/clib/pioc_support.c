@@ -913,6 +913,26 @@ int malloc_iodesc(iosystem_desc_t *ios, int piotype, int ndims,
     /* Set the swap memory settings to defaults for this IO system. */
     (*iodesc)->rearr_opts = ios->rearr_opts;
 
+    /* The neighborhood/node communicators are created with the
+     * rearranger. */
+    (*iodesc)->neigh_comm = MPI_COMM_NULL;
+    (*iodesc)->node_comm = MPI_COMM_NULL;
+    (*iodesc)->node_win = MPI_WIN_NULL;
+
+    /* The decomposition is referenced once, by its creator. */
+    (*iodesc)->iosysid = ios->iosysid;
+    (*iodesc)->refcnt = 1;
+
+    /* Tune the rearranger options online, if requested. */
+    if (ios->rearr_autotune)
+    {
+        if ((ret = rearr_autotune_init(*iodesc)))
+        {
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                            "Internal error while allocating memory for iodesc. Out of memory allocating %lld bytes for the rearranger autotuner", (unsigned long long) sizeof(rearr_autotune_t));
+        }
+    }
+
 #if PIO_SAVE_DECOMPS
     /* The descriptor is not yet saved to disk */
     (*iodesc)->is_saved = false;
@@ -990,15 +1010,78 @@ int PIOc_freedecomp(int iosysid, int ioid)
         }
     }
 
+    /* Decompositions returned by more than one PIOc_InitDecomp() call
+     * (see PIOc_InitDecomp()) are only freed with the last reference. */
+    if (--iodesc->refcnt > 0)
+    {
+        LOG((2, "PIOc_freedecomp ioid = %d still has %d references", ioid, iodesc->refcnt));
+        GPTLstop("PIO:PIOc_freedecomp");
+        spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+        return PIO_NOERR;
+    }
+
     /* Free the map. */
     free(iodesc->map);
 
     /* Free the dimlens. */
     free(iodesc->dimlen);
 
+    /* Free the iostart/iocount used to create the decomposition. */
+    free(iodesc->dedup_iostart);
+    free(iodesc->dedup_iocount);
+
     if (iodesc->rfrom)
         free(iodesc->rfrom);
 
+    /* Free the cached communication plans (and the MPI types owned
+     * by them) before the types they are based on. */
+    if ((ret = free_rearr_comm_plans(iodesc->comp2io_plans)) ||
+        (ret = free_rearr_comm_plans(iodesc->io2comp_plans)))
+    {
+        GPTLstop("PIO:PIOc_freedecomp");
+        spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Freeing PIO decomposition failed (iosysid = %d, ioid=%d). Error freeing cached rearranger communication plans", iosysid, ioid);
+    }
+    iodesc->comp2io_plans = NULL;
+    iodesc->io2comp_plans = NULL;
+
+    /* Free the pack lists. */
+    free_rearr_pack_list(iodesc->spack);
+    free_rearr_pack_list(iodesc->rpack);
+    iodesc->spack = NULL;
+    iodesc->rpack = NULL;
+
+    if (iodesc->neigh_comm != MPI_COMM_NULL)
+        if ((mpierr = MPI_Comm_free(&iodesc->neigh_comm)))
+        {
+            GPTLstop("PIO:PIOc_freedecomp");
+            spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        }
+    free(iodesc->neighbors);
+
+    free(iodesc->autotune);
+
+    if (iodesc->node_win != MPI_WIN_NULL)
+    {
+        if ((mpierr = MPI_Win_unlock_all(iodesc->node_win)) ||
+            (mpierr = MPI_Win_free(&iodesc->node_win)))
+        {
+            GPTLstop("PIO:PIOc_freedecomp");
+            spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        }
+    }
+
+    if (iodesc->node_comm != MPI_COMM_NULL)
+        if ((mpierr = MPI_Comm_free(&iodesc->node_comm)))
+        {
+            GPTLstop("PIO:PIOc_freedecomp");
+            spio_ltimer_stop(ios->io_fstats->tot_timer_name);
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        }
+
     if (iodesc->rtype)
     {
         for (int i = 0; i < iodesc->nrecvs; i++)
@@ -2257,6 +2340,7 @@ int PIOc_createfile_int(int iosysid, int *ncidp, int *iotype, const char *filena
     /* Fill in some file values. */
     file->fh = -1;
     strncpy(file->fname, filename, PIO_MAX_NAME);
+    file->buffer_size_limit = pio_buffer_size_limit;
     ierr = pio_create_uniq_str(ios, NULL, tname, SPIO_TIMER_MAX_NAME, "tmp_", "_file");
     if(ierr != PIO_NOERR)
     {
@@ -2274,7 +2358,6 @@ int PIOc_createfile_int(int iosysid, int *ncidp, int *iotype, const char *filena
 
     file->iosystem = ios;
     file->iotype = *iotype;
-    file->buffer.ioid = -1;
     /*
     file->num_unlim_dimids = 0;
     file->unlim_dimids = NULL;
@@ -2291,6 +2374,7 @@ int PIOc_createfile_int(int iosysid, int *ncidp, int *iotype, const char *filena
         file->varlist[i].nreqs = 0;
         file->varlist[i].fillvalue = NULL;
         file->varlist[i].pio_type = PIO_NAT;
+        file->varlist[i].ndims = -1;
         file->varlist[i].type_size = 0;
         file->varlist[i].vrsize = 0;
         file->varlist[i].rb_pend = 0;
@@ -2901,6 +2985,7 @@ int PIOc_openfile_retry(int iosysid, int *ncidp, int *iotype, const char *filena
     /* Fill in some file values. */
     file->fh = -1;
     strncpy(file->fname, filename, PIO_MAX_NAME);
+    file->buffer_size_limit = pio_buffer_size_limit;
     ierr = pio_create_uniq_str(ios, NULL, tname, SPIO_TIMER_MAX_NAME, "tmp_", "_file");
     if(ierr != PIO_NOERR)
     {
@@ -2953,6 +3038,7 @@ int PIOc_openfile_retry(int iosysid, int *ncidp, int *iotype, const char *filena
         file->varlist[i].nreqs = 0;
         file->varlist[i].fillvalue = NULL;
         file->varlist[i].pio_type = PIO_NAT;
+        file->varlist[i].ndims = -1;
         file->varlist[i].type_size = 0;
         file->varlist[i].vrsize = 0;
         file->varlist[i].rb_pend = 0;
@@ -3521,6 +3607,13 @@ int check_and_reset_rearr_opts(rearr_opt_t *rearr_opt)
         def_coll_comm_fc_opts,
         def_coll_comm_fc_opts
     };
+    /* Flow control is not used with neighborhood collectives */
+    const rearr_opt_t def_neighbor_rearr_opts = {
+        PIO_REARR_COMM_NEIGHBOR,
+        PIO_REARR_COMM_FC_2D_DISABLE,
+        def_coll_comm_fc_opts,
+        def_coll_comm_fc_opts
+    };
 
     assert(rearr_opt);
 
@@ -3532,7 +3625,15 @@ int check_and_reset_rearr_opts(rearr_opt_t *rearr_opt)
         /* Hard reset flow control options. */
         *rearr_opt = def_coll_rearr_opts;
     }
-    else if (rearr_opt->comm_type == PIO_REARR_COMM_P2P)
+    else if (rearr_opt->comm_type == PIO_REARR_COMM_NEIGHBOR)
+    {
+        /* Compare and log the user and default rearr opts for neighbor. */
+        cmp_rearr_opts(rearr_opt, &def_neighbor_rearr_opts);
+        /* Hard reset flow control options. */
+        *rearr_opt = def_neighbor_rearr_opts;
+    }
+    else if ((rearr_opt->comm_type == PIO_REARR_COMM_P2P) ||
+             (rearr_opt->comm_type == PIO_REARR_COMM_SPARSE))
     {
         if (rearr_opt->fcd == PIO_REARR_COMM_FC_2D_DISABLE)
         {
@@ -3594,6 +3695,10 @@ int check_and_reset_rearr_opts(rearr_opt_t *rearr_opt)
  * Possible values are :
  * PIO_REARR_COMM_P2P (Point to point communication)
  * PIO_REARR_COMM_COLL (Collective communication)
+ * PIO_REARR_COMM_NEIGHBOR (Neighborhood collective communication,
+ * flow control options are ignored)
+ * PIO_REARR_COMM_SPARSE (Point to point communication only with the
+ * tasks exchanging data, same flow control options as P2P)
  * @param fcd Flow control direction for the rearranger.
  * See PIO_REARR_COMM_FC_DIR for more detail.
  * Possible values are :
@@ -3659,6 +3764,235 @@ int PIOc_set_rearr_opts(int iosysid, int comm_type, int fcd, bool enable_hs_c2i,
     return ret;
 }
 
+/**
+ * Enable or disable online tuning of the rearranger options for the
+ * decompositions created (after this call) on an iosystem.
+ *
+ * When enabled, the first few rearrangements of data from compute to
+ * IO tasks (writes) of each decomposition are timed with different
+ * rearranger options (comm type, flow control direction, handshake,
+ * isend and max pending requests). The fastest options, agreed on by
+ * all tasks in the rearranger communicator, are then used for the
+ * decomposition. The options set with PIOc_set_rearr_opts() are only
+ * used for the first (untimed) write of each decomposition.
+ *
+ * @param iosysid index of the defined system descriptor
+ * @param enable true to enable tuning, false to disable it.
+ * @return 0 on success, otherwise a PIO error code.
+ */
+int PIOc_set_rearr_autotune(int iosysid, bool enable)
+{
+    iosystem_desc_t *ios;
+
+    /* Get the IO system info. */
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+    {
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Setting rearranger autotuning failed. Invalid iosystem id (%d) provided", iosysid);
+    }
+
+    ios->rearr_autotune = enable;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Enable or disable packing of the data exchanged by the rearrangers
+ * of an iosystem.
+ *
+ * By default the rearrangers describe the data sent and received
+ * with MPI derived (indexed) datatypes. When packing is enabled the
+ * data is instead copied into (and out of) contiguous buffers, using
+ * gather lists precomputed for each decomposition, and exchanged as
+ * plain bytes. Depending on the MPI library and the decomposition
+ * either data path can be faster. The setting applies to all the
+ * (blocking) rearrangements done after this call.
+ *
+ * @param iosysid index of the defined system descriptor
+ * @param enable true to pack the data, false to use MPI datatypes.
+ * @return 0 on success, otherwise a PIO error code.
+ */
+int PIOc_set_rearr_pack(int iosysid, bool enable)
+{
+    iosystem_desc_t *ios;
+
+    /* Get the IO system info. */
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+    {
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Setting rearranger data packing failed. Invalid iosystem id (%d) provided", iosysid);
+    }
+
+    ios->rearr_pack = enable;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Enable or disable flushing the data written to files in the
+ * background, on the IO tasks of an iosystem.
+ *
+ * By default, when the data cached exceeds the buffer size limit
+ * (see PIOc_set_buffer_size_limit()), the write call that hit the
+ * limit waits for the data to be written to disk (with PnetCDF). With
+ * background flushes enabled the IO tasks hand the pending requests,
+ * and the buffers they write from, to a thread that waits on them
+ * while the application caches (and rearranges) more data. At most
+ * one flush per file is in flight: the next flush, PIOc_sync(),
+ * PIOc_closefile() and any other call that accesses the file wait
+ * for it to complete first.
+ *
+ * The thread calls PnetCDF while the application calls PIO (and
+ * PnetCDF, on the other files), so background flushes need MPI
+ * initialized with MPI_THREAD_MULTIPLE and a thread-safe PnetCDF
+ * (built with --enable-thread-safe). PnetCDF is not called on the
+ * file being flushed until the flush completes. If MPI or PnetCDF
+ * are not thread-safe, the library was built without threads, or
+ * async is in use, a warning is printed and the data is flushed in
+ * the foreground. This function is collective across the tasks of
+ * the iosystem when enabling background flushes.
+ *
+ * @param iosysid index of the defined system descriptor
+ * @param enable true to flush in the background, false to flush in
+ * the foreground.
+ * @return 0 on success, otherwise a PIO error code.
+ */
+int PIOc_set_bg_flush(int iosysid, bool enable)
+{
+    iosystem_desc_t *ios;
+    const char *reason = NULL;
+
+    /* Get the IO system info. */
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+    {
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Setting background flushes failed. Invalid iosystem id (%d) provided", iosysid);
+    }
+
+    ios->bg_flush = false;
+    if (!enable)
+        return PIO_NOERR;
+
+#if PIO_BG_FLUSH
+    if (ios->async)
+    {
+        reason = "not supported with async";
+    }
+    else
+    {
+        int provided;
+        int mpierr;
+
+        /* The tasks fall back to the foreground together. */
+        if ((mpierr = MPI_Query_thread(&provided)))
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &provided, 1, MPI_INT, MPI_MIN,
+                                    ios->union_comm)))
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        if (provided < MPI_THREAD_MULTIPLE)
+            reason = "MPI was not initialized with MPI_THREAD_MULTIPLE";
+#if !defined(PNETCDF_THREAD_SAFE) || !PNETCDF_THREAD_SAFE
+        else
+            reason = "PnetCDF was not built thread-safe (--enable-thread-safe)";
+#endif
+    }
+#else
+    reason = "the library was built without thread (or PnetCDF) support";
+#endif
+
+    if (reason)
+    {
+        if (ios->union_rank == 0)
+            printf("PIO: WARNING: Flushing data to disk in the background is disabled, %s. Data is flushed in the foreground\n", reason);
+        return PIO_NOERR;
+    }
+
+    ios->bg_flush = true;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Set the method used to partition the computation tasks among the
+ * IO tasks, for the decompositions created (after this call) on an
+ * iosystem with the subset rearranger.
+ *
+ * The default method, PIO_SUBSET_PARTITION_RANK, assigns the same
+ * number of computation tasks to each IO task. With irregular
+ * decompositions the IO tasks can then receive very different data
+ * volumes. The PIO_SUBSET_PARTITION_VOLUME and
+ * PIO_SUBSET_PARTITION_VOLUME_LOCALITY methods balance the data
+ * volume received by the IO tasks instead.
+ *
+ * @param iosysid index of the defined system descriptor
+ * @param partition the partition method, see PIO_SUBSET_PARTITION.
+ * @return 0 on success, otherwise a PIO error code.
+ */
+int PIOc_set_subset_partition(int iosysid, int partition)
+{
+    iosystem_desc_t *ios;
+
+    /* Get the IO system info. */
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+    {
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Setting the subset partition method failed. Invalid iosystem id (%d) provided", iosysid);
+    }
+
+    if (partition != PIO_SUBSET_PARTITION_RANK && partition != PIO_SUBSET_PARTITION_VOLUME &&
+        partition != PIO_SUBSET_PARTITION_VOLUME_LOCALITY)
+    {
+        return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__,
+                        "Setting the subset partition method failed. Invalid partition method (%d) provided (expected PIO_SUBSET_PARTITION_RANK, PIO_SUBSET_PARTITION_VOLUME or PIO_SUBSET_PARTITION_VOLUME_LOCALITY)", partition);
+    }
+
+    ios->subset_partition = partition;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Set the policy used to decide when the data written to the files
+ * of an iosystem is flushed, from the compute tasks to the IO tasks
+ * and from the IO tasks to disk.
+ *
+ * With PIO_FLUSH_POLICY_LEGACY (the default) the data is flushed when
+ * the buffer size limits are reached (see PIOc_set_buffer_size_limit()
+ * and PIOc_set_file_buffer_size()). With PIO_FLUSH_POLICY_MODEL the
+ * time taken by the flushes of a file is fitted to a model, a
+ * latency plus a time per byte (the inverse of the bandwidth), and
+ * the data is also flushed before a limit is reached when the model
+ * predicts that the cost per byte of flushing now is within
+ * PIO_FLUSH_MODEL_SLACK of the cost per byte of flushing at the
+ * limit. The limits apply with both policies. The policy can be
+ * changed at any time, the same policy must be set on all tasks.
+ *
+ * @param iosysid index of the defined system descriptor
+ * @param policy the flush policy (see PIO_FLUSH_POLICY).
+ * @return 0 on success, otherwise a PIO error code.
+ */
+int PIOc_set_flush_policy(int iosysid, int policy)
+{
+    iosystem_desc_t *ios;
+
+    /* Get the IO system info. */
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+    {
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Setting the flush policy failed. Invalid iosystem id (%d) provided", iosysid);
+    }
+
+    if (policy != PIO_FLUSH_POLICY_LEGACY && policy != PIO_FLUSH_POLICY_MODEL)
+    {
+        return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__,
+                        "Setting the flush policy failed. Invalid flush policy (%d) provided (expected PIO_FLUSH_POLICY_LEGACY or PIO_FLUSH_POLICY_MODEL)", policy);
+    }
+
+    ios->flush_policy = policy;
+
+    return PIO_NOERR;
+}
+
 /* Calculate and cache the variable record size 
  * for the variable corresponding to varid
  * Note: Since this function calls many PIOc_* functions
@@ -343,6 +343,7 @@ static std::string file_names_to_ios_name(iosystem_desc_t *ios,
 /* Cache or write I/O system I/O performance statistics */
 static int cache_or_print_stats(iosystem_desc_t *ios, int root_proc,
   PIO_Util::IO_Summary_Util::IO_summary_stats_t &iosys_gio_sstats,
+  double subset_imbalance,
   std::vector<std::string> &file_names,
   std::vector<PIO_Util::IO_Summary_Util::IO_summary_stats_t> &file_gio_sstats)
 {
@@ -354,6 +355,10 @@ static int cache_or_print_stats(iosystem_desc_t *ios, int root_proc,
    * I/O statistics cache above, cached_ios_gio_sstats
    */
   static std::vector<std::string> cached_ios_names;
+  /* Static cache of the layout of the I/O tasks of the I/O systems, these have a one
+   * to one correspondence with the I/O statistics cache above, cached_ios_gio_sstats
+   */
+  static std::vector<std::vector<std::pair<std::string, std::string> > > cached_ios_layouts;
   /* Static cache of I/O statistics for files */
   static std::vector<std::vector<PIO_Util::IO_Summary_Util::IO_summary_stats_t> >
           cached_file_gio_sstats;
@@ -387,6 +392,25 @@ static int cache_or_print_stats(iosystem_desc_t *ios, int root_proc,
 
     cached_ios_gio_sstats.push_back(iosys_gio_sstats);
     cached_ios_names.push_back(file_names_to_ios_name(ios, file_names));
+
+    std::vector<std::pair<std::string, std::string> > layout_vals;
+    PIO_Util::Serializer_Utils::serialize_pack("iotask_placement",
+      std::string((ios->async) ? "async" :
+        ((ios->iotask_placement == PIO_IOTASK_PLACEMENT_NODE) ? "node" : "stride")),
+      layout_vals);
+    PIO_Util::Serializer_Utils::serialize_pack("num_iotasks", ios->num_iotasks, layout_vals);
+    PIO_Util::Serializer_Utils::serialize_pack("num_nodes", ios->num_nodes, layout_vals);
+    PIO_Util::Serializer_Utils::serialize_pack("num_io_nodes", ios->num_io_nodes, layout_vals);
+    PIO_Util::Serializer_Utils::serialize_pack("max_iotasks_per_node",
+      ios->max_iotasks_per_node, layout_vals);
+    PIO_Util::Serializer_Utils::serialize_pack("subset_partition",
+      std::string((ios->subset_partition == PIO_SUBSET_PARTITION_VOLUME) ? "volume" :
+        ((ios->subset_partition == PIO_SUBSET_PARTITION_VOLUME_LOCALITY) ?
+          "volume_locality" : "rank")),
+      layout_vals);
+    PIO_Util::Serializer_Utils::serialize_pack("subset_imbalance", subset_imbalance,
+      layout_vals);
+    cached_ios_layouts.push_back(layout_vals);
     cached_file_gio_sstats.push_back(file_gio_sstats);
     cached_file_names.push_back(file_names);
   }
@@ -410,6 +434,7 @@ static int cache_or_print_stats(iosystem_desc_t *ios, int root_proc,
     const std::string sfname_json_suffix(".json");
 
     assert(cached_ios_gio_sstats.size() == cached_ios_names.size());
+    assert(cached_ios_gio_sstats.size() == cached_ios_layouts.size());
 
     /* Create TEXT and JSON serializers */
     std::unique_ptr<PIO_Util::SPIO_serializer> spio_ser =
@@ -489,6 +514,10 @@ static int cache_or_print_stats(iosystem_desc_t *ios, int root_proc,
       PIO_Util::Serializer_Utils::serialize_pack("tot_wtime",
         cached_ios_gio_sstats[i].ttime_max, comp_vals);
 
+      /* Add the layout of the I/O tasks of the component */
+      comp_vals.insert(comp_vals.end(), cached_ios_layouts[i].begin(),
+        cached_ios_layouts[i].end());
+
       comp_vvals.push_back(comp_vals);
     }
     spio_ser->serialize(id, "ModelComponentIOStatistics", comp_vvals, comp_vvals_ids);
@@ -675,19 +704,32 @@ int spio_write_io_summary(iosystem_desc_t *ios)
             "Freeing MPI reduction operation for reducing I/O summary statistics failed for I/O system (iosysid=%d)",
             ios->iosysid);
   }
+
+  /* The subset rearranger imbalance is only set on the I/O processes */
+  double subset_imbalance = 0.0;
+  ierr = MPI_Reduce(&(ios->subset_imbalance), &subset_imbalance, 1, MPI_DOUBLE, MPI_MAX,
+                      ROOT_PROC, comm);
+  if(ierr != PIO_NOERR){
+    LOG((1, "Reducing the subset rearranger imbalance failed"));
+    return pio_err(ios, NULL, PIO_EINTERNAL, __FILE__, __LINE__,
+            "MPI reduction operation for reducing the subset rearranger imbalance failed for I/O system (iosysid=%d)",
+            ios->iosysid);
+  }
 #else
   /* For MPI serial library, i.e., one MPI process, copy file I/O stats and component I/O stats to global I/O stats */
   assert(gio_sstats.size() == tmp_sstats.size());
   for(std::size_t i = 0 ; i < tmp_sstats.size(); i++){
     gio_sstats[i] = tmp_sstats[i];
   }
+  double subset_imbalance = ios->subset_imbalance;
 #endif
 
   /* Retrieve the global I/O performance statistics for the I/O system */
   PIO_Util::IO_Summary_Util::IO_summary_stats_t iosys_gio_stats = gio_sstats.back();
   gio_sstats.pop_back();
 
-  ierr = cache_or_print_stats(ios, ROOT_PROC, iosys_gio_stats, filenames, gio_sstats);
+  ierr = cache_or_print_stats(ios, ROOT_PROC, iosys_gio_stats, subset_imbalance, filenames,
+          gio_sstats);
   if(ierr != PIO_NOERR){
     return pio_err(ios, NULL, PIO_EINTERNAL, __FILE__, __LINE__,
             "Caching/printing I/O statistics failed (iosysid=%d)", ios->iosysid);
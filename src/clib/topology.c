@@ -1,3 +1,188 @@
+/**
+ * @file
+ * Functions to find the layout of the tasks on the compute nodes and
+ * to place the IO tasks accordingly.
+ */
+#include <pio_config.h>
+#include <pio.h>
+#include <pio_internal.h>
+
+/**
+ * Pick the ranks of the IO tasks and find how they are laid out
+ * across the (shared memory) nodes. This function is collective
+ * across all tasks in comm.
+ *
+ * With PIO_IOTASK_PLACEMENT_STRIDE, ioranks is expected to contain
+ * the ranks computed from the user provided stride and base, and is
+ * left unchanged. With PIO_IOTASK_PLACEMENT_NODE, the IO tasks are
+ * assigned round-robin to the nodes, at most max_per_node on each
+ * node, and the IO tasks on a node are spread evenly over its
+ * tasks. With the usual block binding of ranks to cores this puts
+ * the IO tasks of a node on distinct sockets. The resulting ioranks
+ * are sorted in ascending order.
+ *
+ * @param comm the communicator of the computation tasks.
+ * @param placement the IO task placement method, see
+ * PIO_IOTASK_PLACEMENT.
+ * @param num_iotasks the number of IO tasks.
+ * @param max_per_node the maximum number of IO tasks on a node with
+ * PIO_IOTASK_PLACEMENT_NODE, 0 for no limit.
+ * @param ioranks array of length num_iotasks with the ranks (in comm)
+ * of the IO tasks.
+ * @param num_nodes pointer that gets the number of nodes spanned by
+ * comm.
+ * @param num_io_nodes pointer that gets the number of nodes with at
+ * least one IO task.
+ * @param max_iotasks_per_node pointer that gets the maximum number of
+ * IO tasks on a node.
+ * @returns 0 for success, error code otherwise.
+ */
+int place_iotasks(MPI_Comm comm, int placement, int num_iotasks, int max_per_node,
+                  int *ioranks, int *num_nodes, int *num_io_nodes,
+                  int *max_iotasks_per_node)
+{
+    int rank;                 /* Rank of this task in comm. */
+    int size;                 /* Size of comm. */
+    int leader;               /* Rank (in comm) of the leader of this node. */
+    int *leaders;             /* Rank of the node leader of each task. */
+    int *node_idx;            /* Node index of each task. */
+    int *node_ntasks;         /* Number of tasks on each node. */
+    int *node_niotasks;       /* Number of IO tasks on each node. */
+    int *node_nseen;          /* Number of tasks of each node seen so far. */
+    int *node_npicked;        /* Number of IO tasks picked on each node so far. */
+    int nnodes = 0;
+    int mpierr;
+
+    pioassert(ioranks && num_nodes && num_io_nodes && max_iotasks_per_node,
+              "invalid input", __FILE__, __LINE__);
+
+    if ((mpierr = MPI_Comm_rank(comm, &rank)))
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Comm_size(comm, &size)))
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+
+    /* Find the leader (the lowest rank in comm) of the node of this
+     * task. */
+    leader = 0;
+#if !PIO_USE_MPISERIAL
+    {
+        MPI_Comm node_comm;
+
+        if ((mpierr = MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL,
+                                          &node_comm)))
+            return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+        leader = rank;
+        if ((mpierr = MPI_Bcast(&leader, 1, MPI_INT, 0, node_comm)))
+            return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+        if ((mpierr = MPI_Comm_free(&node_comm)))
+            return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    }
+#endif /* !PIO_USE_MPISERIAL */
+
+    if (!(leaders = malloc(6 * size * sizeof(int))))
+        return pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                        "Placing the IO tasks failed. Out of memory allocating %lld bytes for the node layout of the tasks", (unsigned long long) (6 * size * sizeof(int)));
+    node_idx = leaders + size;
+    node_ntasks = node_idx + size;
+    node_niotasks = node_ntasks + size;
+    node_nseen = node_niotasks + size;
+    node_npicked = node_nseen + size;
+
+    if ((mpierr = MPI_Allgather(&leader, 1, MPI_INT, leaders, 1, MPI_INT, comm)))
+    {
+        free(leaders);
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    }
+
+    /* Number the nodes in the order of their leaders. The split
+     * preserves the order of the ranks, so the leader of a node is
+     * seen before all other tasks on that node. */
+    for (int i = 0; i < size; i++)
+    {
+        if (leaders[i] == i)
+        {
+            node_ntasks[nnodes] = 0;
+            node_niotasks[nnodes] = 0;
+            node_idx[i] = nnodes++;
+        }
+        else
+            node_idx[i] = node_idx[leaders[i]];
+        node_ntasks[node_idx[i]]++;
+    }
+
+    if (placement == PIO_IOTASK_PLACEMENT_NODE)
+    {
+        int nslots = 0;
+        int nassigned = 0;
+
+        for (int n = 0; n < nnodes; n++)
+            nslots += (max_per_node > 0 && max_per_node < node_ntasks[n]) ?
+                max_per_node : node_ntasks[n];
+        if (nslots < num_iotasks)
+        {
+            free(leaders);
+            return pio_err(NULL, NULL, PIO_EINVAL, __FILE__, __LINE__,
+                            "Placing the IO tasks failed. Cannot place %d IO tasks on %d nodes with at most %d IO tasks per node", num_iotasks, nnodes, max_per_node);
+        }
+
+        /* Deal the IO tasks to the nodes, one per node at a time. */
+        while (nassigned < num_iotasks)
+            for (int n = 0; n < nnodes && nassigned < num_iotasks; n++)
+                if (node_niotasks[n] < node_ntasks[n] &&
+                    (max_per_node <= 0 || node_niotasks[n] < max_per_node))
+                {
+                    node_niotasks[n]++;
+                    nassigned++;
+                }
+
+        /* Spread the IO tasks of each node evenly over the tasks of
+         * the node. */
+        int k = 0;
+        for (int n = 0; n < nnodes; n++)
+        {
+            node_nseen[n] = 0;
+            node_npicked[n] = 0;
+        }
+        for (int i = 0; i < size; i++)
+        {
+            int n = node_idx[i];
+            int local = node_nseen[n]++;
+
+            if (node_npicked[n] < node_niotasks[n] &&
+                local == (int)(((long long)node_npicked[n] * node_ntasks[n]) / node_niotasks[n]))
+            {
+                ioranks[k++] = i;
+                node_npicked[n]++;
+            }
+        }
+        pioassert(k == num_iotasks, "IO tasks not placed", __FILE__, __LINE__);
+    }
+
+    /* Find the layout of the IO tasks across the nodes. */
+    for (int n = 0; n < nnodes; n++)
+        node_niotasks[n] = 0;
+    for (int k = 0; k < num_iotasks; k++)
+        node_niotasks[node_idx[ioranks[k]]]++;
+
+    *num_nodes = nnodes;
+    *num_io_nodes = 0;
+    *max_iotasks_per_node = 0;
+    for (int n = 0; n < nnodes; n++)
+    {
+        if (node_niotasks[n] > 0)
+            (*num_io_nodes)++;
+        if (node_niotasks[n] > *max_iotasks_per_node)
+            *max_iotasks_per_node = node_niotasks[n];
+    }
+    LOG((2, "place_iotasks placement = %d num_iotasks = %d num_nodes = %d num_io_nodes = %d "
+         "max_iotasks_per_node = %d", placement, num_iotasks, nnodes, *num_io_nodes,
+         *max_iotasks_per_node));
+
+    free(leaders);
+
+    return PIO_NOERR;
+}
+
 #if defined(BGQDONT)
 
 #include <pio.h>
@@ -138,6 +138,7 @@ int pio_test_init(int argc, char **argv, int *my_rank, int *ntasks,
 int pio_test_init2(int argc, char **argv, int *my_rank, int *ntasks,
                    int min_ntasks, int max_ntasks, int log_level, MPI_Comm *comm)
 {
+    int mpi_initialized; /* Non-zero if the test initialized MPI. */
     int ret; /* Return value. */
 
 #ifdef TIMING
@@ -148,8 +149,11 @@ int pio_test_init2(int argc, char **argv, int *my_rank, int *ntasks,
 #endif
 #endif
 
-    /* Initialize MPI. */
-    if ((ret = MPI_Init(&argc, &argv)))
+    /* Initialize MPI, unless the test already did (e.g. to request a
+     * thread support level). */
+    if ((ret = MPI_Initialized(&mpi_initialized)))
+        MPIERR(ret);
+    if (!mpi_initialized && (ret = MPI_Init(&argc, &argv)))
         MPIERR(ret);
 
     /* Learn my rank and the total number of processors. */
@@ -683,6 +683,454 @@ int test_darray_fill_unlim(int iosysid, int ioid, int pio_type, int num_flavors,
     return PIO_NOERR;
 }
 
+/* The number of records written by the test of the nonblocking
+ * writes. */
+#define NUM_INT_RECS 3
+
+/**
+ * Create a file with one int variable with an unlimited dimension,
+ * for the tests of the nonblocking and the not copied writes.
+ *
+ * @param iosysid the IO system ID.
+ * @param iotype the iotype of the file.
+ * @param filename the name of the file.
+ * @param ncidp pointer that gets the ncid of the file.
+ * @param varidp pointer that gets the ID of the variable.
+ * @returns 0 for success, error code otherwise.
+ */
+int create_unlim_int_file(int iosysid, int iotype, const char *filename, int *ncidp,
+                          int *varidp)
+{
+    int dimid[NDIM2];
+    int ret;
+
+    if ((ret = PIOc_createfile(iosysid, ncidp, &iotype, filename, PIO_CLOBBER)))
+        return ret;
+    if ((ret = PIOc_set_fill(*ncidp, NC_FILL, NULL)))
+        return ret;
+    if ((ret = PIOc_def_dim(*ncidp, DIM_NAME, NC_UNLIMITED, &dimid[0])))
+        return ret;
+    if ((ret = PIOc_def_dim(*ncidp, DIM_NAME_2, DIM_LEN, &dimid[1])))
+        return ret;
+    if ((ret = PIOc_def_var(*ncidp, VAR_NAME, PIO_INT, NDIM2, dimid, varidp)))
+        return ret;
+    if ((ret = PIOc_enddef(*ncidp)))
+        return ret;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Check the records of the int variable of a file created with
+ * create_unlim_int_file(). The first four values of record r are
+ * 100 * r, 100 * r + 1, 100 * r + 2, 100 * r + 3, and the rest are
+ * the default fill value.
+ *
+ * @param iosysid the IO system ID.
+ * @param iotype the iotype of the file.
+ * @param filename the name of the file.
+ * @param nrecs the number of records.
+ * @returns 0 for success, error code otherwise.
+ */
+int check_unlim_int_file(int iosysid, int iotype, const char *filename, int nrecs)
+{
+    int data_in[DIM_LEN * nrecs];
+    PIO_Offset nrecs_in;
+    int dimid;
+    int ncid;
+    int varid;
+    int ret;
+
+    if ((ret = PIOc_openfile(iosysid, &ncid, &iotype, filename, PIO_NOWRITE)))
+        return ret;
+    if ((ret = PIOc_inq_varid(ncid, VAR_NAME, &varid)))
+        return ret;
+    if ((ret = PIOc_inq_unlimdim(ncid, &dimid)))
+        return ret;
+    if ((ret = PIOc_inq_dimlen(ncid, dimid, &nrecs_in)))
+        return ret;
+    if (nrecs_in != nrecs)
+        return ERR_WRONG;
+    if ((ret = PIOc_get_var_int(ncid, varid, data_in)))
+        return ret;
+    for (int e = 0; e < DIM_LEN * nrecs; e++)
+        if (data_in[e] != (e % DIM_LEN < 4 ? 100 * (e / DIM_LEN) + e % DIM_LEN : NC_FILL_INT))
+            return ERR_WRONG;
+    if ((ret = PIOc_closefile(ncid)))
+        return ret;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Test the nonblocking writes of darrays (PIOc_write_darray_nb(),
+ * PIOc_test_darray() and PIOc_wait_darray()). Several records are
+ * written with requests in flight together, the last request is
+ * completed by closing the file.
+ *
+ * @param iosysid the IO system ID.
+ * @param ioid the ID of the decomposition, of PIO_INT data.
+ * @param num_flavors the number of IOTYPES available in this build.
+ * @param flavor array of available iotypes.
+ * @param my_rank rank of this task.
+ * @returns 0 for success, error code otherwise.
+ */
+int test_darray_nb(int iosysid, int ioid, int num_flavors, int *flavor, int my_rank)
+{
+    char filename[PIO_MAX_NAME + 1];
+    int fillvalue = NC_FILL_INT;
+    int data[NUM_INT_RECS][2];
+    int request[NUM_INT_RECS];
+    int ncid;
+    int varid;
+    int flag;
+    int ret;
+
+    for (int fmt = 0; fmt < num_flavors; fmt++)
+    {
+        sprintf(filename, "data_%s_iotype_%d_nb.nc", TEST_NAME, flavor[fmt]);
+        if ((ret = create_unlim_int_file(iosysid, flavor[fmt], filename, &ncid, &varid)))
+            return ret;
+
+        /* Start the writes of all the records. The arrays must not be
+         * modified until the writes are complete. */
+        for (int r = 0; r < NUM_INT_RECS; r++)
+        {
+            data[r][0] = data[r][1] = 100 * r + my_rank;
+            if ((ret = PIOc_setframe(ncid, varid, r)))
+                ERR(ret);
+            if ((ret = PIOc_write_darray_nb(ncid, varid, ioid, 2, data[r], &fillvalue,
+                                            &request[r])))
+                ERR(ret);
+            if (request[r] == PIO_REQ_NULL)
+                return ERR_WRONG;
+        }
+
+        /* The null request is always complete. */
+        if ((ret = PIOc_test_darray(ncid, PIO_REQ_NULL, &flag)))
+            ERR(ret);
+        if (!flag)
+            return ERR_WRONG;
+        if ((ret = PIOc_wait_darray(ncid, PIO_REQ_NULL)))
+            ERR(ret);
+
+        /* Complete the first writes, oldest first, and wait for a
+         * request again. The last write is completed by the close. */
+        if ((ret = PIOc_test_darray(ncid, request[0], &flag)))
+            ERR(ret);
+        for (int r = 0; r < NUM_INT_RECS - 1; r++)
+            if ((ret = PIOc_wait_darray(ncid, request[r])))
+                ERR(ret);
+        if ((ret = PIOc_wait_darray(ncid, request[0])))
+            ERR(ret);
+        if ((ret = PIOc_test_darray(ncid, request[0], &flag)))
+            ERR(ret);
+        if (!flag)
+            return ERR_WRONG;
+        if ((ret = PIOc_closefile(ncid)))
+            ERR(ret);
+
+        if ((ret = check_unlim_int_file(iosysid, flavor[fmt], filename, NUM_INT_RECS)))
+            return ret;
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Test the writes of darrays that are not copied
+ * (PIOc_write_darray_nocopy() and PIOc_darray_complete()). The
+ * records are written to the same write multi buffer with copied and
+ * registered arrays, and the registered array is reused for another
+ * record once the writes are complete.
+ *
+ * @param iosysid the IO system ID.
+ * @param ioid the ID of the decomposition, of PIO_INT data.
+ * @param num_flavors the number of IOTYPES available in this build.
+ * @param flavor array of available iotypes.
+ * @param my_rank rank of this task.
+ * @returns 0 for success, error code otherwise.
+ */
+int test_darray_nocopy(int iosysid, int ioid, int num_flavors, int *flavor, int my_rank)
+{
+#define NUM_NOCOPY_RECS 4
+    char filename[PIO_MAX_NAME + 1];
+    int fillvalue = NC_FILL_INT;
+    int copied[2];     /* Data copied by the writes. */
+    int registered[2]; /* Data registered by the writes. */
+    int ncid;
+    int varid;
+    int ret;
+
+    for (int fmt = 0; fmt < num_flavors; fmt++)
+    {
+        sprintf(filename, "data_%s_iotype_%d_nocopy.nc", TEST_NAME, flavor[fmt]);
+        if ((ret = create_unlim_int_file(iosysid, flavor[fmt], filename, &ncid, &varid)))
+            return ret;
+
+        /* There is nothing to complete yet. */
+        if ((ret = PIOc_darray_complete(ncid)))
+            ERR(ret);
+
+        /* Records 0 and 2 are copied, the array is modified right
+         * after each write. Record 1 is registered in between, in
+         * the same write multi buffer. */
+        for (int r = 0; r < 3; r++)
+        {
+            if ((ret = PIOc_setframe(ncid, varid, r)))
+                ERR(ret);
+            if (r == 1)
+            {
+                registered[0] = registered[1] = 100 * r + my_rank;
+                if ((ret = PIOc_write_darray_nocopy(ncid, varid, ioid, 2, registered,
+                                                    &fillvalue)))
+                    ERR(ret);
+            }
+            else
+            {
+                copied[0] = copied[1] = 100 * r + my_rank;
+                if ((ret = PIOc_write_darray(ncid, varid, ioid, 2, copied, &fillvalue)))
+                    ERR(ret);
+                copied[0] = copied[1] = -1;
+            }
+        }
+        if ((ret = PIOc_darray_complete(ncid)))
+            ERR(ret);
+
+        /* The registered array can be reused once the writes are
+         * complete, record 1 keeps its data. */
+        registered[0] = registered[1] = 300 + my_rank;
+        if ((ret = PIOc_setframe(ncid, varid, 3)))
+            ERR(ret);
+        if ((ret = PIOc_write_darray_nocopy(ncid, varid, ioid, 2, registered, &fillvalue)))
+            ERR(ret);
+        if ((ret = PIOc_darray_complete(ncid)))
+            ERR(ret);
+        registered[0] = registered[1] = -1;
+
+        /* Nothing is left to complete. */
+        if ((ret = PIOc_darray_complete(ncid)))
+            ERR(ret);
+        if ((ret = PIOc_closefile(ncid)))
+            ERR(ret);
+
+        if ((ret = check_unlim_int_file(iosysid, flavor[fmt], filename, NUM_NOCOPY_RECS)))
+            return ret;
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Test writing the data and the fill values of a decomposition with
+ * holes between the elements written (the even elements are written,
+ * the odd ones are holes). Several variables with their own fill
+ * values are written together, in several records, and the data and
+ * the fill values are read back. With the SUBSET rearranger and
+ * pnetcdf the data and the fill values are written with one request
+ * per variable (see write_darray_multi_par_fill()).
+ *
+ * @param iosysid the IO system ID.
+ * @param num_flavors the number of IOTYPES available in this build.
+ * @param flavor array of available iotypes.
+ * @param my_rank rank of this task.
+ * @returns 0 for success, error code otherwise.
+ */
+int test_darray_holes(int iosysid, int num_flavors, int *flavor, int my_rank)
+{
+#define NUM_HOLES_VARS 2
+#define NUM_HOLES_RECS 2
+    char filename[PIO_MAX_NAME + 1];
+    int dim_len_1d[NDIM] = {DIM_LEN};
+    PIO_Offset compdof[EXPECTED_MAPLEN] = {2 * my_rank + 1, 0};
+    int fillvalue[NUM_HOLES_VARS] = {-99, -77};
+    int data[NUM_HOLES_VARS][NUM_HOLES_RECS][EXPECTED_MAPLEN];
+    int data_in[NUM_HOLES_RECS * DIM_LEN];
+    int dimid[NDIM2];
+    int varid[NUM_HOLES_VARS];
+    int ioid;
+    int ncid;
+    int ret;
+
+    if ((ret = PIOc_InitDecomp(iosysid, PIO_INT, NDIM, dim_len_1d, EXPECTED_MAPLEN, compdof,
+                               &ioid, NULL, NULL, NULL)))
+        ERR(ret);
+
+    for (int fmt = 0; fmt < num_flavors; fmt++)
+    {
+        sprintf(filename, "data_%s_iotype_%d_holes.nc", TEST_NAME, flavor[fmt]);
+        if ((ret = PIOc_createfile(iosysid, &ncid, &flavor[fmt], filename, PIO_CLOBBER)))
+            ERR(ret);
+        if ((ret = PIOc_def_dim(ncid, DIM_NAME, NC_UNLIMITED, &dimid[0])))
+            ERR(ret);
+        if ((ret = PIOc_def_dim(ncid, DIM_NAME_2, DIM_LEN, &dimid[1])))
+            ERR(ret);
+        for (int v = 0; v < NUM_HOLES_VARS; v++)
+        {
+            char var_name[PIO_MAX_NAME + 1];
+
+            sprintf(var_name, "%s_%d", VAR_NAME, v);
+            if ((ret = PIOc_def_var(ncid, var_name, PIO_INT, NDIM2, dimid, &varid[v])))
+                ERR(ret);
+            if ((ret = PIOc_def_var_fill(ncid, varid[v], NC_FILL, &fillvalue[v])))
+                ERR(ret);
+        }
+        if ((ret = PIOc_enddef(ncid)))
+            ERR(ret);
+
+        /* The variables are cached together, and written together
+         * when the file is closed. */
+        for (int r = 0; r < NUM_HOLES_RECS; r++)
+        {
+            for (int v = 0; v < NUM_HOLES_VARS; v++)
+            {
+                data[v][r][0] = data[v][r][1] = 1000 * v + 100 * r + my_rank;
+                if ((ret = PIOc_setframe(ncid, varid[v], r)))
+                    ERR(ret);
+                if ((ret = PIOc_write_darray(ncid, varid[v], ioid, EXPECTED_MAPLEN, data[v][r],
+                                             &fillvalue[v])))
+                    ERR(ret);
+            }
+        }
+        if ((ret = PIOc_closefile(ncid)))
+            ERR(ret);
+
+        /* Check the data of the even elements and the fill values of
+         * the odd ones. */
+        if ((ret = PIOc_openfile(iosysid, &ncid, &flavor[fmt], filename, PIO_NOWRITE)))
+            ERR(ret);
+        for (int v = 0; v < NUM_HOLES_VARS; v++)
+        {
+            if ((ret = PIOc_get_var_int(ncid, varid[v], data_in)))
+                ERR(ret);
+            for (int e = 0; e < NUM_HOLES_RECS * DIM_LEN; e++)
+            {
+                int x = e % DIM_LEN;
+                int expected = (x % 2) ? fillvalue[v] : 1000 * v + 100 * (e / DIM_LEN) + x / 2;
+
+                if (data_in[e] != expected)
+                    return ERR_WRONG;
+            }
+        }
+        if ((ret = PIOc_closefile(ncid)))
+            ERR(ret);
+    }
+
+    if ((ret = PIOc_freedecomp(iosysid, ioid)))
+        ERR(ret);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Test writing distributed arrays to variables of types different
+ * from the type of the data in memory. Data of type double is
+ * written to a float and an int variable, and read back. With pnetcdf
+ * data out of the range of the type of a short variable is also
+ * written, the write (here flushed when the file is closed) returns
+ * PIO_ERANGE and the values out of range are written as the fill
+ * value of the variable.
+ *
+ * @param iosysid the IO system ID.
+ * @param num_flavors the number of IOTYPES available in this build.
+ * @param flavor array of available iotypes.
+ * @param my_rank rank of this task.
+ * @returns 0 for success, error code otherwise.
+ */
+int test_darray_convert(int iosysid, int num_flavors, int *flavor, int my_rank)
+{
+#define NUM_CONVERT_VARS 3
+    char filename[PIO_MAX_NAME + 1];
+    int dim_len_1d[NDIM] = {DIM_LEN};
+    PIO_Offset compdof[EXPECTED_MAPLEN] = {2 * my_rank + 1, 2 * my_rank + 2};
+    int var_type[NUM_CONVERT_VARS] = {PIO_FLOAT, PIO_INT, PIO_SHORT};
+    short short_fill = -999;
+    double data[EXPECTED_MAPLEN];
+    double range_data[EXPECTED_MAPLEN];
+    float float_in[DIM_LEN];
+    int int_in[DIM_LEN];
+    short short_in[DIM_LEN];
+    int dimid;
+    int varid[NUM_CONVERT_VARS];
+    int ioid;
+    int ncid;
+    int ret;
+
+    if ((ret = PIOc_InitDecomp(iosysid, PIO_DOUBLE, NDIM, dim_len_1d, EXPECTED_MAPLEN, compdof,
+                               &ioid, NULL, NULL, NULL)))
+        ERR(ret);
+
+    /* The values are in the range of all the types, every other
+     * value is out of the range of a short. */
+    for (int i = 0; i < EXPECTED_MAPLEN; i++)
+    {
+        data[i] = 2 * my_rank + i + 0.5;
+        range_data[i] = i ? 2 * my_rank + i : 100000.0;
+    }
+
+    for (int fmt = 0; fmt < num_flavors; fmt++)
+    {
+        /* Only pnetcdf converts the data out of range and goes on
+         * with the write. */
+        int nvars = (flavor[fmt] == PIO_IOTYPE_PNETCDF) ? NUM_CONVERT_VARS : NUM_CONVERT_VARS - 1;
+
+        sprintf(filename, "data_%s_iotype_%d_convert.nc", TEST_NAME, flavor[fmt]);
+        if ((ret = PIOc_createfile(iosysid, &ncid, &flavor[fmt], filename, PIO_CLOBBER)))
+            ERR(ret);
+        if ((ret = PIOc_def_dim(ncid, DIM_NAME, DIM_LEN, &dimid)))
+            ERR(ret);
+        for (int v = 0; v < nvars; v++)
+        {
+            char var_name[PIO_MAX_NAME + 1];
+
+            sprintf(var_name, "%s_%d", VAR_NAME, v);
+            if ((ret = PIOc_def_var(ncid, var_name, var_type[v], NDIM, &dimid, &varid[v])))
+                ERR(ret);
+        }
+        if (nvars == NUM_CONVERT_VARS &&
+            (ret = PIOc_def_var_fill(ncid, varid[2], NC_FILL, &short_fill)))
+            ERR(ret);
+        if ((ret = PIOc_enddef(ncid)))
+            ERR(ret);
+
+        for (int v = 0; v < nvars; v++)
+            if ((ret = PIOc_write_darray(ncid, varid[v], ioid, EXPECTED_MAPLEN,
+                                         (var_type[v] == PIO_SHORT) ? range_data : data, NULL)))
+                ERR(ret);
+
+        /* The cached data is written when the file is closed. */
+        ret = PIOc_closefile(ncid);
+        if (ret != ((nvars == NUM_CONVERT_VARS) ? PIO_ERANGE : PIO_NOERR))
+            ERR(ERR_WRONG);
+
+        /* Check the converted data. */
+        if ((ret = PIOc_openfile(iosysid, &ncid, &flavor[fmt], filename, PIO_NOWRITE)))
+            ERR(ret);
+        if ((ret = PIOc_get_var_float(ncid, varid[0], float_in)))
+            ERR(ret);
+        if ((ret = PIOc_get_var_int(ncid, varid[1], int_in)))
+            ERR(ret);
+        for (int x = 0; x < DIM_LEN; x++)
+            if (float_in[x] != x + 0.5f || int_in[x] != x)
+                ERR(ERR_WRONG);
+        if (nvars == NUM_CONVERT_VARS)
+        {
+            if ((ret = PIOc_get_var_short(ncid, varid[2], short_in)))
+                ERR(ret);
+            for (int x = 0; x < DIM_LEN; x++)
+                if (short_in[x] != ((x % 2) ? x : short_fill))
+                    ERR(ERR_WRONG);
+        }
+        if ((ret = PIOc_closefile(ncid)))
+            ERR(ret);
+    }
+
+    if ((ret = PIOc_freedecomp(iosysid, ioid)))
+        ERR(ret);
+
+    return PIO_NOERR;
+}
+
 /**
  * Test the decomp read/write functionality.
  *
@@ -877,11 +1325,31 @@ int main(int argc, char **argv)
                                                   flavor, my_rank, test_comm)))
                     return ret;
 
+                /* Test the nonblocking writes. */
+                if (test_type[t] == PIO_INT &&
+                    (ret = test_darray_nb(iosysid, ioid, num_flavors, flavor, my_rank)))
+                    return ret;
+
+                /* Test the writes that are not copied. */
+                if (test_type[t] == PIO_INT &&
+                    (ret = test_darray_nocopy(iosysid, ioid, num_flavors, flavor, my_rank)))
+                    return ret;
+
                 /* Free the PIO decomposition. */
                 if ((ret = PIOc_freedecomp(iosysid, ioid)))
                     ERR(ret);
             }
 
+            /* Test the data and fill values of a decomposition with
+             * holes. */
+            if ((ret = test_darray_holes(iosysid, num_flavors, flavor, my_rank)))
+                return ret;
+
+            /* Test the conversion of the data to the types of the
+             * variables. */
+            if ((ret = test_darray_convert(iosysid, num_flavors, flavor, my_rank)))
+                return ret;
+
             /* Finalize PIO system. */
             if ((ret = PIOc_finalize(iosysid)))
                 return ret;
@@ -0,0 +1,226 @@
+/*
+ * Tests for flushing distributed arrays to disk in the background
+ * (see PIOc_set_bg_flush()). The buffer size limit is set so low that
+ * every write flushes the data cached so far, so the writes overlap
+ * with the flushes in flight. If MPI does not provide
+ * MPI_THREAD_MULTIPLE, or PnetCDF is not thread-safe, the data is
+ * flushed in the foreground, and the test checks the same results.
+ */
+#include <pio.h>
+#include <pio_internal.h>
+#include <pio_tests.h>
+
+/* The number of tasks this test should run on. */
+#define TARGET_NTASKS 4
+
+/* The minimum number of tasks this test should run on. */
+#define MIN_NTASKS 4
+
+/* The name of this test. */
+#define TEST_NAME "test_darray_bg_flush"
+
+/* Number of processors that will do IO. */
+#define NUM_IO_PROCS 2
+
+/* The number of dimensions of the variables (time, x). */
+#define NDIM 2
+
+/* The number of dimensions of the decomposition. */
+#define NDIM1 1
+
+/* The length of the x dimension. */
+#define X_DIM_LEN 16
+
+/* The number of records written. */
+#define NUM_REC 4
+
+/* The number of variables in the test file. */
+#define NUM_VAR 3
+
+/* The buffer size limit used in the test (in bytes). */
+#define BG_FLUSH_BUFFER_LIMIT 1
+
+/* The rearrangers tested. */
+#define NUM_REARRANGERS_TO_TEST 2
+
+/* The dimension names. */
+char dim_name[NDIM][PIO_MAX_NAME + 1] = {"time", "x"};
+
+/* The var names. */
+char var_name[NUM_VAR][PIO_MAX_NAME + 1] = {"u", "v", "w"};
+
+/* The value written for element i (of this task) of record rec of
+ * variable v. */
+static int test_value(int my_rank, int rec, int v, int i)
+{
+    return rec * 1000 + v * 100 + my_rank * (X_DIM_LEN / TARGET_NTASKS) + i;
+}
+
+/**
+ * Write NUM_REC records of NUM_VAR variables, syncing the file after
+ * half of the records, and read them back.
+ *
+ * @param iosysid the IO system ID.
+ * @param ioid the ID of the decomposition.
+ * @param num_flavors the number of IOTYPES available in this build.
+ * @param flavor array of available iotypes.
+ * @param my_rank rank of this task.
+ * @param rearranger the rearranger in use.
+ * @returns 0 for success, error code otherwise.
+ */
+int test_bg_flush(int iosysid, int ioid, int num_flavors, int *flavor, int my_rank,
+                  int rearranger)
+{
+    char filename[PIO_MAX_NAME + 1];
+    int dim_len[NDIM] = {NC_UNLIMITED, X_DIM_LEN};
+    PIO_Offset arraylen = X_DIM_LEN / TARGET_NTASKS;
+    int dimids[NDIM];
+    int varid[NUM_VAR];
+    int data[arraylen];
+    int ncid;
+    int ret;
+
+    for (int fmt = 0; fmt < num_flavors; fmt++)
+    {
+        sprintf(filename, "%s_iotype_%d_rearr_%d.nc", TEST_NAME, flavor[fmt], rearranger);
+        if ((ret = PIOc_createfile(iosysid, &ncid, &flavor[fmt], filename, PIO_CLOBBER)))
+            ERR(ret);
+        for (int d = 0; d < NDIM; d++)
+            if ((ret = PIOc_def_dim(ncid, dim_name[d], (PIO_Offset)dim_len[d], &dimids[d])))
+                ERR(ret);
+        for (int v = 0; v < NUM_VAR; v++)
+            if ((ret = PIOc_def_var(ncid, var_name[v], PIO_INT, NDIM, dimids, &varid[v])))
+                ERR(ret);
+        if ((ret = PIOc_enddef(ncid)))
+            ERR(ret);
+
+        /* Write the records, each write flushes the data cached
+         * before it. */
+        for (int rec = 0; rec < NUM_REC; rec++)
+        {
+            for (int v = 0; v < NUM_VAR; v++)
+            {
+                for (int i = 0; i < arraylen; i++)
+                    data[i] = test_value(my_rank, rec, v, i);
+                if ((ret = PIOc_setframe(ncid, varid[v], rec)))
+                    ERR(ret);
+                if ((ret = PIOc_write_darray(ncid, varid[v], ioid, arraylen, data, NULL)))
+                    ERR(ret);
+            }
+
+            /* Wait for the flushes in flight half way through. */
+            if (rec == NUM_REC / 2 - 1 && (ret = PIOc_sync(ncid)))
+                ERR(ret);
+        }
+
+        if ((ret = PIOc_closefile(ncid)))
+            ERR(ret);
+
+        /* Check the file contents. */
+        if ((ret = PIOc_openfile(iosysid, &ncid, &flavor[fmt], filename, PIO_NOWRITE)))
+            ERR(ret);
+        for (int v = 0; v < NUM_VAR; v++)
+        {
+            if ((ret = PIOc_inq_varid(ncid, var_name[v], &varid[v])))
+                ERR(ret);
+            for (int rec = 0; rec < NUM_REC; rec++)
+            {
+                if ((ret = PIOc_setframe(ncid, varid[v], rec)))
+                    ERR(ret);
+                if ((ret = PIOc_read_darray(ncid, varid[v], ioid, arraylen, data)))
+                    ERR(ret);
+                for (int i = 0; i < arraylen; i++)
+                    if (data[i] != test_value(my_rank, rec, v, i))
+                        return ERR_WRONG;
+            }
+        }
+        if ((ret = PIOc_closefile(ncid)))
+            ERR(ret);
+    }
+
+    return PIO_NOERR;
+}
+
+/* Run tests for flushing darrays in the background. */
+int main(int argc, char **argv)
+{
+    int rearranger[NUM_REARRANGERS_TO_TEST] = {PIO_REARR_BOX, PIO_REARR_SUBSET};
+    int my_rank;
+    int ntasks;
+    int provided;            /* Thread support level provided by MPI. */
+    int num_flavors;         /* Number of PIO netCDF flavors in this build. */
+    int flavor[NUM_FLAVORS]; /* iotypes for the supported netCDF IO flavors. */
+    MPI_Comm test_comm;      /* A communicator for this test. */
+    int ret;                 /* Return code. */
+
+    /* The IO tasks wait on the flushes in threads. */
+    if ((ret = MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided)))
+        MPIERR(ret);
+
+    /* Initialize test. */
+    if ((ret = pio_test_init2(argc, argv, &my_rank, &ntasks, MIN_NTASKS, MIN_NTASKS,
+                              3, &test_comm)))
+        ERR(ERR_INIT);
+
+    if ((ret = PIOc_set_iosystem_error_handling(PIO_DEFAULT, PIO_RETURN_ERROR, NULL)))
+        return ret;
+
+    /* Only do something on max_ntasks tasks. */
+    if (my_rank < TARGET_NTASKS)
+    {
+        PIO_Offset compdof[X_DIM_LEN / TARGET_NTASKS];
+        int gdimlen[NDIM1] = {X_DIM_LEN};
+        PIO_Offset oldlimit;
+        int iosysid;
+        int ioid;
+
+        if ((ret = get_iotypes(&num_flavors, flavor)))
+            ERR(ret);
+        printf("%d MPI thread support level %d, running tests for %d flavors\n", my_rank,
+               provided, num_flavors);
+
+        for (int i = 0; i < X_DIM_LEN / TARGET_NTASKS; i++)
+            compdof[i] = my_rank * (X_DIM_LEN / TARGET_NTASKS) + i + 1;
+
+        for (int r = 0; r < NUM_REARRANGERS_TO_TEST; r++)
+        {
+            if ((ret = PIOc_Init_Intracomm(test_comm, NUM_IO_PROCS, 1, 0, rearranger[r],
+                                           &iosysid)))
+                return ret;
+            if ((ret = PIOc_set_bg_flush(iosysid, true)))
+                return ret;
+
+            /* Without MPI_THREAD_MULTIPLE the flushes must not run in
+             * the background. */
+            iosystem_desc_t *ios = pio_get_iosystem_from_id(iosysid);
+            if (!ios || (provided < MPI_THREAD_MULTIPLE && ios->bg_flush))
+                ERR(ERR_WRONG);
+            oldlimit = PIOc_set_buffer_size_limit(BG_FLUSH_BUFFER_LIMIT);
+
+            if ((ret = PIOc_init_decomp(iosysid, PIO_INT, NDIM1, gdimlen,
+                                        X_DIM_LEN / TARGET_NTASKS, compdof, &ioid,
+                                        rearranger[r], NULL, NULL)))
+                return ret;
+
+            printf("%d running background flush tests with rearranger %d\n", my_rank,
+                   rearranger[r]);
+            if ((ret = test_bg_flush(iosysid, ioid, num_flavors, flavor, my_rank,
+                                     rearranger[r])))
+                return ret;
+
+            PIOc_set_buffer_size_limit(oldlimit);
+            if ((ret = PIOc_freedecomp(iosysid, ioid)))
+                return ret;
+            if ((ret = PIOc_finalize(iosysid)))
+                return ret;
+        }
+    } /* endif my_rank < TARGET_NTASKS */
+
+    /* Finalize the MPI library. */
+    printf("%d %s Finalizing...\n", my_rank, TEST_NAME);
+    if ((ret = pio_test_finalize(&test_comm)))
+        return ret;
+
+    printf("%d %s SUCCESS!!\n", my_rank, TEST_NAME);
+    return 0;
+}
@@ -0,0 +1,218 @@
+/*
+ * Tests for the per file limits on the cached data (see
+ * PIOc_set_file_buffer_size()). Two files are written at the same
+ * time, one with a limit so low that every write flushes the data
+ * cached before it, and one with a limit large enough to cache all
+ * the writes. The data cached for the second file must not be
+ * flushed by the writes to the first file.
+ */
+#include <pio.h>
+#include <pio_internal.h>
+#include <pio_tests.h>
+
+/* The number of tasks this test should run on. */
+#define TARGET_NTASKS 4
+
+/* The minimum number of tasks this test should run on. */
+#define MIN_NTASKS 4
+
+/* The name of this test. */
+#define TEST_NAME "test_darray_buffer_size"
+
+/* Number of processors that will do IO. */
+#define NUM_IO_PROCS 2
+
+/* The number of dimensions of the variables (time, x). */
+#define NDIM 2
+
+/* The number of dimensions of the decomposition. */
+#define NDIM1 1
+
+/* The length of the x dimension. */
+#define X_DIM_LEN 16
+
+/* The number of records written. */
+#define NUM_REC 4
+
+/* The number of files written at the same time. */
+#define NUM_FILES 2
+
+/* The buffer size limits of the files (in bytes). */
+#define SMALL_LIMIT 1
+#define LARGE_LIMIT (1 << 24)
+
+/* The dimension names. */
+char dim_name[NDIM][PIO_MAX_NAME + 1] = {"time", "x"};
+
+/* The value written for element i (of this task) of record rec of
+ * file f. */
+static int test_value(int my_rank, int rec, int f, int i)
+{
+    return rec * 1000 + f * 100 + my_rank * (X_DIM_LEN / TARGET_NTASKS) + i;
+}
+
+/**
+ * Write NUM_REC records to two files with different buffer size
+ * limits, check the data cached for each file, and read the data
+ * back.
+ *
+ * @param iosysid the IO system ID.
+ * @param ioid the ID of the decomposition.
+ * @param num_flavors the number of IOTYPES available in this build.
+ * @param flavor array of available iotypes.
+ * @param my_rank rank of this task.
+ * @returns 0 for success, error code otherwise.
+ */
+int test_file_buffer_size(int iosysid, int ioid, int num_flavors, int *flavor, int my_rank)
+{
+    PIO_Offset limit[NUM_FILES] = {SMALL_LIMIT, LARGE_LIMIT};
+    char filename[NUM_FILES][PIO_MAX_NAME + 1];
+    int dim_len[NDIM] = {NC_UNLIMITED, X_DIM_LEN};
+    PIO_Offset arraylen = X_DIM_LEN / TARGET_NTASKS;
+    int dimids[NDIM];
+    int varid[NUM_FILES];
+    int ncid[NUM_FILES];
+    int data[arraylen];
+    int ret;
+
+    for (int fmt = 0; fmt < num_flavors; fmt++)
+    {
+        for (int f = 0; f < NUM_FILES; f++)
+        {
+            sprintf(filename[f], "%s_iotype_%d_file_%d.nc", TEST_NAME, flavor[fmt], f);
+            if ((ret = PIOc_createfile(iosysid, &ncid[f], &flavor[fmt], filename[f],
+                                       PIO_CLOBBER)))
+                ERR(ret);
+            for (int d = 0; d < NDIM; d++)
+                if ((ret = PIOc_def_dim(ncid[f], dim_name[d], (PIO_Offset)dim_len[d], &dimids[d])))
+                    ERR(ret);
+            if ((ret = PIOc_def_var(ncid[f], "u", PIO_INT, NDIM, dimids, &varid[f])))
+                ERR(ret);
+            if ((ret = PIOc_enddef(ncid[f])))
+                ERR(ret);
+
+            /* The limit must be > 0. */
+            if (PIOc_set_file_buffer_size(ncid[f], 0) != PIO_EINVAL)
+                ERR(ERR_WRONG);
+            if ((ret = PIOc_set_file_buffer_size(ncid[f], limit[f])))
+                ERR(ret);
+        }
+
+        /* Write the records to both files, alternating between them. */
+        for (int rec = 0; rec < NUM_REC; rec++)
+        {
+            for (int f = 0; f < NUM_FILES; f++)
+            {
+                for (int i = 0; i < arraylen; i++)
+                    data[i] = test_value(my_rank, rec, f, i);
+                if ((ret = PIOc_setframe(ncid[f], varid[f], rec)))
+                    ERR(ret);
+                if ((ret = PIOc_write_darray(ncid[f], varid[f], ioid, arraylen, data, NULL)))
+                    ERR(ret);
+            }
+        }
+
+        /* Each write to the first file flushed the data cached
+         * before it, all the records of the second file are still
+         * cached. */
+        for (int f = 0; f < NUM_FILES; f++)
+        {
+            file_desc_t *file;
+            wmulti_buffer *wmb;
+
+            if ((ret = pio_get_file(ncid[f], &file)))
+                ERR(ret);
+            if (!(wmb = pio_get_wmb(file, ioid, 1)))
+                ERR(ERR_WRONG);
+            if (wmb->num_arrays != (f ? NUM_REC : 1) || file->wmb_usage <= 0)
+                ERR(ERR_WRONG);
+        }
+
+        for (int f = 0; f < NUM_FILES; f++)
+            if ((ret = PIOc_closefile(ncid[f])))
+                ERR(ret);
+
+        /* Check the file contents. */
+        for (int f = 0; f < NUM_FILES; f++)
+        {
+            if ((ret = PIOc_openfile(iosysid, &ncid[f], &flavor[fmt], filename[f], PIO_NOWRITE)))
+                ERR(ret);
+            if ((ret = PIOc_inq_varid(ncid[f], "u", &varid[f])))
+                ERR(ret);
+            for (int rec = 0; rec < NUM_REC; rec++)
+            {
+                if ((ret = PIOc_setframe(ncid[f], varid[f], rec)))
+                    ERR(ret);
+                if ((ret = PIOc_read_darray(ncid[f], varid[f], ioid, arraylen, data)))
+                    ERR(ret);
+                for (int i = 0; i < arraylen; i++)
+                    if (data[i] != test_value(my_rank, rec, f, i))
+                        return ERR_WRONG;
+            }
+            if ((ret = PIOc_closefile(ncid[f])))
+                ERR(ret);
+        }
+    }
+
+    return PIO_NOERR;
+}
+
+/* Run tests for the per file buffer size limits. */
+int main(int argc, char **argv)
+{
+    int my_rank;
+    int ntasks;
+    int num_flavors;         /* Number of PIO netCDF flavors in this build. */
+    int flavor[NUM_FLAVORS]; /* iotypes for the supported netCDF IO flavors. */
+    MPI_Comm test_comm;      /* A communicator for this test. */
+    int ret;                 /* Return code. */
+
+    /* Initialize test. */
+    if ((ret = pio_test_init2(argc, argv, &my_rank, &ntasks, MIN_NTASKS, MIN_NTASKS,
+                              3, &test_comm)))
+        ERR(ERR_INIT);
+
+    if ((ret = PIOc_set_iosystem_error_handling(PIO_DEFAULT, PIO_RETURN_ERROR, NULL)))
+        return ret;
+
+    /* Only do something on max_ntasks tasks. */
+    if (my_rank < TARGET_NTASKS)
+    {
+        PIO_Offset compdof[X_DIM_LEN / TARGET_NTASKS];
+        int gdimlen[NDIM1] = {X_DIM_LEN};
+        int iosysid;
+        int ioid;
+
+        if ((ret = get_iotypes(&num_flavors, flavor)))
+            ERR(ret);
+
+        for (int i = 0; i < X_DIM_LEN / TARGET_NTASKS; i++)
+            compdof[i] = my_rank * (X_DIM_LEN / TARGET_NTASKS) + i + 1;
+
+        if ((ret = PIOc_Init_Intracomm(test_comm, NUM_IO_PROCS, 1, 0, PIO_REARR_BOX,
+                                       &iosysid)))
+            return ret;
+        if ((ret = PIOc_init_decomp(iosysid, PIO_INT, NDIM1, gdimlen,
+                                    X_DIM_LEN / TARGET_NTASKS, compdof, &ioid,
+                                    PIO_REARR_BOX, NULL, NULL)))
+            return ret;
+
+        printf("%d running per file buffer size tests for %d flavors\n", my_rank,
+               num_flavors);
+        if ((ret = test_file_buffer_size(iosysid, ioid, num_flavors, flavor, my_rank)))
+            return ret;
+
+        if ((ret = PIOc_freedecomp(iosysid, ioid)))
+            return ret;
+        if ((ret = PIOc_finalize(iosysid)))
+            return ret;
+    } /* endif my_rank < TARGET_NTASKS */
+
+    /* Finalize the MPI library. */
+    printf("%d %s Finalizing...\n", my_rank, TEST_NAME);
+    if ((ret = pio_test_finalize(&test_comm)))
+        return ret;
+
+    printf("%d %s SUCCESS!!\n", my_rank, TEST_NAME);
+    return 0;
+}
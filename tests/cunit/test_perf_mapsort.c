@@ -0,0 +1,147 @@
+/*
+ * This program benchmarks the sort of the subset rearranger map
+ * (sort_mapsort()) against qsort() with compare_offsets(), and
+ * checks that both produce the same order.
+ */
+#include <pio.h>
+#include <pio_tests.h>
+#include <pio_internal.h>
+
+/* The number of tasks this test should run on. */
+#define TARGET_NTASKS 1
+
+/* The minimum number of tasks this test should run on. */
+#define MIN_NTASKS 1
+
+/* The name of this test. */
+#define TEST_NAME "test_perf_mapsort"
+
+/* The number of map points sorted. */
+#define NMAP (1 << 20)
+
+/* The number of compute tasks contributing (sorted) runs to the map. */
+#define NRUNS 256
+
+/* The number of times each sort is timed. */
+#define NREPS 3
+
+/* The map layouts benchmarked. */
+#define NUM_LAYOUTS 2
+#define LAYOUT_SORTED_RUNS 0
+#define LAYOUT_RANDOM 1
+
+/* Compare two map points, for qsort(). Unlike compare_offsets(),
+ * this does not truncate the difference of the offsets. */
+static int compare_mapsort(const void *a, const void *b)
+{
+    const mapsort *x = (const mapsort *)a;
+    const mapsort *y = (const mapsort *)b;
+    return (x->iomap > y->iomap) - (x->iomap < y->iomap);
+}
+
+/* Initialize a map of NMAP points. With LAYOUT_SORTED_RUNS the map
+ * is made of NRUNS sorted runs interleaved across the global index
+ * space, like the map gathered from compute tasks with a round-robin
+ * decomposition. With LAYOUT_RANDOM the offsets are random. */
+static void init_map(mapsort *map, int *runlen, int layout)
+{
+    int runsize = NMAP / NRUNS;
+
+    srand(42);
+    for (int r = 0; r < NRUNS; r++)
+    {
+        runlen[r] = runsize;
+        for (int i = 0; i < runsize; i++)
+        {
+            mapsort *m = &map[r * runsize + i];
+            m->rfrom = r;
+            m->soffset = i;
+            if (layout == LAYOUT_SORTED_RUNS)
+                m->iomap = (PIO_Offset)i * NRUNS + r + 1;
+            else
+                m->iomap = ((PIO_Offset)rand() << 16 ^ rand()) + 1;
+        }
+    }
+}
+
+/* Run the benchmark. */
+int run_mapsort_benchmark(int my_rank)
+{
+    const char *layout_name[NUM_LAYOUTS] = {"sorted runs", "random"};
+    mapsort *map, *qmap;
+    int runlen[NRUNS];
+    int ret;
+
+    if (!(map = malloc(NMAP * sizeof(mapsort))))
+        return PIO_ENOMEM;
+    if (!(qmap = malloc(NMAP * sizeof(mapsort))))
+        return PIO_ENOMEM;
+
+    for (int l = 0; l < NUM_LAYOUTS; l++)
+    {
+        double qsort_time = 0, sort_time = 0;
+
+        for (int rep = 0; rep < NREPS; rep++)
+        {
+            double t;
+
+            init_map(qmap, runlen, l);
+            t = MPI_Wtime();
+            qsort(qmap, NMAP, sizeof(mapsort), compare_mapsort);
+            qsort_time += MPI_Wtime() - t;
+
+            init_map(map, runlen, l);
+            t = MPI_Wtime();
+            if ((ret = sort_mapsort(map, NMAP, runlen, NRUNS)))
+                return ret;
+            sort_time += MPI_Wtime() - t;
+
+            /* Both sorts must agree on the offsets. */
+            for (int i = 0; i < NMAP; i++)
+                if (map[i].iomap != qmap[i].iomap)
+                    return ERR_WRONG;
+            for (int i = 1; i < NMAP; i++)
+                if (map[i].iomap == map[i - 1].iomap && map[i].rfrom < map[i - 1].rfrom)
+                    return ERR_WRONG;
+        }
+
+        printf("%d %s: %d map points (%s), qsort %.4f s, sort_mapsort %.4f s, speedup %.2f\n",
+               my_rank, TEST_NAME, NMAP, layout_name[l], qsort_time / NREPS,
+               sort_time / NREPS, (sort_time > 0) ? qsort_time / sort_time : 0.0);
+    }
+
+    free(map);
+    free(qmap);
+
+    return 0;
+}
+
+/* Run the benchmark. */
+int main(int argc, char **argv)
+{
+    int my_rank; /* Zero-based rank of processor. */
+    int ntasks;  /* Number of processors involved in current execution. */
+    MPI_Comm test_comm; /* A communicator for this test. */
+    int ret;     /* Return code. */
+
+    /* Initialize test. */
+    if ((ret = pio_test_init2(argc, argv, &my_rank, &ntasks, MIN_NTASKS,
+                              TARGET_NTASKS, 0, &test_comm)))
+        ERR(ERR_INIT);
+
+    if (my_rank < TARGET_NTASKS)
+    {
+        printf("%d running mapsort benchmark\n", my_rank);
+        if ((ret = run_mapsort_benchmark(my_rank)))
+            return ret;
+    }
+
+    /* Finalize the MPI library. */
+    printf("%d %s Finalizing...\n", my_rank, TEST_NAME);
+    if ((ret = pio_test_finalize(&test_comm)))
+        return ret;
+
+    printf("%d %s SUCCESS!!\n", my_rank, TEST_NAME);
+
+    return 0;
+}
@@ -0,0 +1,226 @@
+/*
+ * This program benchmarks the rearrangement of data from compute to
+ * IO tasks and back with the data packed into contiguous buffers (see
+ * PIOc_set_rearr_pack()) against the rearrangement with MPI derived
+ * datatypes, and checks that both move the same data.
+ */
+#include <pio.h>
+#include <pio_tests.h>
+#include <pio_internal.h>
+
+/* The number of tasks this test should run on. */
+#define TARGET_NTASKS 4
+
+/* The minimum number of tasks this test should run on. */
+#define MIN_NTASKS 4
+
+/* The name of this test. */
+#define TEST_NAME "test_perf_rearr_pack"
+
+/* The number of dimensions of the decompositions. */
+#define NDIM1 1
+
+/* The number of IO tasks. */
+#define NUM_IO_TASKS 2
+
+/* The number of data elements of a variable on each compute task. */
+#define MAPLEN (1 << 18)
+
+/* The number of variables rearranged together. */
+#define NVARS 4
+
+/* The number of times each rearrangement is timed. */
+#define NREPS 5
+
+/* The rearrangers benchmarked. */
+#define NUM_REARRANGERS 2
+
+/* The map layouts benchmarked. */
+#define NUM_LAYOUTS 2
+#define LAYOUT_BLOCKS 0
+#define LAYOUT_ROUND_ROBIN 1
+
+/* Initialize the map of this task. With LAYOUT_BLOCKS each task has
+ * a contiguous block of the global array (the data is copied in runs
+ * when packed), with LAYOUT_ROUND_ROBIN the elements are dealt to the
+ * tasks one by one (the data is copied element by element). */
+static void init_map(PIO_Offset *compmap, int my_rank, int layout)
+{
+    for (int i = 0; i < MAPLEN; i++)
+    {
+        if (layout == LAYOUT_BLOCKS)
+            compmap[i] = (PIO_Offset)my_rank * MAPLEN + i + 1;
+        else
+            compmap[i] = (PIO_Offset)i * TARGET_NTASKS + my_rank + 1;
+    }
+}
+
+/* Time the rearrangement of NVARS variables to the IO tasks and back,
+ * with or without packing. Returns the times (max across tasks) in
+ * c2i_time and i2c_time. */
+static int time_rearrange(int iosysid, io_desc_t *iodesc, MPI_Comm test_comm, bool pack,
+                          int *sbuf, int *iobuf, int *rbuf, double *c2i_time,
+                          double *i2c_time)
+{
+    iosystem_desc_t *ios;
+    double c2i = 0, i2c = 0;
+    int mpierr;
+    int ret;
+
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+        return ERR_WRONG;
+    if ((ret = PIOc_set_rearr_pack(iosysid, pack)))
+        return ret;
+
+    /* The first (untimed) rearrangement creates the datatypes, pack
+     * lists and communication plans. */
+    for (int rep = 0; rep <= NREPS; rep++)
+    {
+        double t;
+
+        if ((mpierr = MPI_Barrier(test_comm)))
+            return mpierr;
+        t = MPI_Wtime();
+        if ((ret = rearrange_comp2io(ios, iodesc, sbuf, iobuf, NVARS)))
+            return ret;
+        if (rep > 0)
+            c2i += MPI_Wtime() - t;
+
+        if ((mpierr = MPI_Barrier(test_comm)))
+            return mpierr;
+        t = MPI_Wtime();
+        if ((ret = rearrange_io2comp(ios, iodesc, iobuf, rbuf)))
+            return ret;
+        if (rep > 0)
+            i2c += MPI_Wtime() - t;
+    }
+
+    if ((mpierr = MPI_Allreduce(&c2i, c2i_time, 1, MPI_DOUBLE, MPI_MAX, test_comm)))
+        return mpierr;
+    if ((mpierr = MPI_Allreduce(&i2c, i2c_time, 1, MPI_DOUBLE, MPI_MAX, test_comm)))
+        return mpierr;
+    *c2i_time /= NREPS;
+    *i2c_time /= NREPS;
+
+    return PIO_NOERR;
+}
+
+/* Run the benchmark. */
+int run_rearr_pack_benchmark(int iosysid, int my_rank, MPI_Comm test_comm)
+{
+    const char *layout_name[NUM_LAYOUTS] = {"blocks", "round robin"};
+    int rearranger[NUM_REARRANGERS] = {PIO_REARR_BOX, PIO_REARR_SUBSET};
+    const char *rearranger_name[NUM_REARRANGERS] = {"box", "subset"};
+    int gdimlen[NDIM1] = {TARGET_NTASKS * MAPLEN};
+    PIO_Offset *compmap;
+    int *sbuf, *rbuf;
+    int ret;
+
+    if (!(compmap = malloc(MAPLEN * sizeof(PIO_Offset))))
+        return PIO_ENOMEM;
+    if (!(sbuf = malloc(NVARS * MAPLEN * sizeof(int))))
+        return PIO_ENOMEM;
+    if (!(rbuf = malloc(MAPLEN * sizeof(int))))
+        return PIO_ENOMEM;
+
+    for (int r = 0; r < NUM_REARRANGERS; r++)
+    {
+        for (int l = 0; l < NUM_LAYOUTS; l++)
+        {
+            double c2i_time[2], i2c_time[2];
+            int *iobuf[2];
+            io_desc_t *iodesc;
+            int ioid;
+
+            init_map(compmap, my_rank, l);
+            for (int v = 0; v < NVARS; v++)
+                for (int i = 0; i < MAPLEN; i++)
+                    sbuf[v * MAPLEN + i] = v * 1000 + compmap[i];
+
+            if ((ret = PIOc_init_decomp(iosysid, PIO_INT, NDIM1, gdimlen, MAPLEN, compmap,
+                                        &ioid, rearranger[r], NULL, NULL)))
+                return ret;
+            if (!(iodesc = pio_get_iodesc_from_id(ioid)))
+                return ERR_WRONG;
+
+            /* Time the datatype path (p = 0) and the packed path (p = 1). */
+            for (int p = 0; p < 2; p++)
+            {
+                if (!(iobuf[p] = calloc(NVARS * (iodesc->llen ? iodesc->llen : 1), sizeof(int))))
+                    return PIO_ENOMEM;
+                if ((ret = time_rearrange(iosysid, iodesc, test_comm, p == 1, sbuf, iobuf[p],
+                                          rbuf, &c2i_time[p], &i2c_time[p])))
+                    return ret;
+
+                /* The data must make the round trip. */
+                for (int i = 0; i < MAPLEN; i++)
+                    if (rbuf[i] != sbuf[i])
+                        return ERR_WRONG;
+            }
+
+            /* Both paths must move the same data to the IO tasks. */
+            for (int i = 0; i < NVARS * iodesc->llen; i++)
+                if (iobuf[1][i] != iobuf[0][i])
+                    return ERR_WRONG;
+
+            if (!my_rank)
+                printf("%d %s: %s rearranger, %s, %d vars of %d elements per task: "
+                       "comp2io datatypes %.4f s packed %.4f s, "
+                       "io2comp datatypes %.4f s packed %.4f s\n", my_rank, TEST_NAME,
+                       rearranger_name[r], layout_name[l], NVARS, MAPLEN, c2i_time[0],
+                       c2i_time[1], i2c_time[0], i2c_time[1]);
+
+            for (int p = 0; p < 2; p++)
+                free(iobuf[p]);
+            if ((ret = PIOc_freedecomp(iosysid, ioid)))
+                return ret;
+        }
+    }
+
+    free(compmap);
+    free(sbuf);
+    free(rbuf);
+
+    return 0;
+}
+
+/* Run the benchmark. */
+int main(int argc, char **argv)
+{
+    int my_rank; /* Zero-based rank of processor. */
+    int ntasks;  /* Number of processors involved in current execution. */
+    MPI_Comm test_comm; /* A communicator for this test. */
+    int ret;     /* Return code. */
+
+    /* Initialize test. */
+    if ((ret = pio_test_init2(argc, argv, &my_rank, &ntasks, MIN_NTASKS,
+                              TARGET_NTASKS, 0, &test_comm)))
+        ERR(ERR_INIT);
+    if ((ret = PIOc_set_iosystem_error_handling(PIO_DEFAULT, PIO_RETURN_ERROR, NULL)))
+        return ret;
+
+    if (my_rank < TARGET_NTASKS)
+    {
+        int iosysid;
+
+        if ((ret = PIOc_Init_Intracomm(test_comm, NUM_IO_TASKS, 1, 0, PIO_REARR_BOX,
+                                       &iosysid)))
+            return ret;
+
+        printf("%d running rearranger packing benchmark\n", my_rank);
+        if ((ret = run_rearr_pack_benchmark(iosysid, my_rank, test_comm)))
+            return ret;
+
+        if ((ret = PIOc_finalize(iosysid)))
+            return ret;
+    }
+
+    /* Finalize the MPI library. */
+    printf("%d %s Finalizing...\n", my_rank, TEST_NAME);
+    if ((ret = pio_test_finalize(&test_comm)))
+        return ret;
+
+    printf("%d %s SUCCESS!!\n", my_rank, TEST_NAME);
+
+    return 0;
+}
@@ -24,6 +24,10 @@
 /* For maplens of 2. */
 #define MAPLEN2 2
 
+/* Number of rearranger comm types tested with rearrange_comp2io()
+ * and rearrange_io2comp(). */
+#define NUM_COMM_TYPES 3
+
 /* Name of test var. (Name of a Welsh town.)*/
 #define VAR_NAME "Llanfairpwllgwyngyllgogerychwyrndrobwllllantysiliogogogoch"
 
@@ -69,6 +73,19 @@ int test_rearranger_opts1(int iosysid)
         ios->rearr_opts.comp2io.max_pend_req != TEST_VAL_42)
         return ERR_WRONG;
 
+    /* Flow control options are reset for neighborhood collectives. */
+    if ((ret = PIOc_set_rearr_opts(iosysid, PIO_REARR_COMM_NEIGHBOR,
+                                   PIO_REARR_COMM_FC_2D_ENABLE, true,
+                                   true, TEST_VAL_42, true, true, TEST_VAL_42 + 1)))
+        return ret;
+    if (ios->rearr_opts.comm_type != PIO_REARR_COMM_NEIGHBOR ||
+        ios->rearr_opts.fcd != PIO_REARR_COMM_FC_2D_DISABLE ||
+        ios->rearr_opts.comp2io.hs || ios->rearr_opts.comp2io.isend ||
+        ios->rearr_opts.comp2io.max_pend_req != 0 ||
+        ios->rearr_opts.io2comp.hs || ios->rearr_opts.io2comp.isend ||
+        ios->rearr_opts.io2comp.max_pend_req != 0)
+        return ERR_WRONG;
+
     return 0;
 }
 
@@ -439,6 +456,92 @@ int test_get_regions(int my_rank)
     return 0;
 }
 
+/* Test get_regions() on a fragmented decomposition (a 3D ocean grid
+ * with a land mask). The regions must be the same as the ones found
+ * by calling find_region() repeatedly on the map. */
+int test_get_regions_fragmented(int my_rank)
+{
+#define NDIM3_FRAG 3
+#define NLEV_FRAG 16
+#define NLAT_FRAG 96
+#define NLON_FRAG 192
+    const int gdimlen[NDIM3_FRAG] = {NLEV_FRAG, NLAT_FRAG, NLON_FRAG};
+    PIO_Offset *map;
+    int maplen = 0;
+    int nregions = 0;
+    int maxregions;
+    io_region *ior1, *ref_ior1 = NULL, **ref_next = &ref_ior1;
+    io_region *region, *ref_region;
+    double t, ref_time, time;
+    int ret;
+
+    if (!(map = malloc(NLEV_FRAG * NLAT_FRAG * NLON_FRAG * sizeof(PIO_Offset))))
+        return PIO_ENOMEM;
+
+    /* Skip the land points: an island, and a shelf that grows with
+     * depth at the end of the grid. Map is 1-based. */
+    for (int k = 0; k < NLEV_FRAG; k++)
+        for (int j = 0; j < NLAT_FRAG; j++)
+            for (int i = 0; i < NLON_FRAG; i++)
+                if (!(j > 40 && j < 60 && i > 50 && i < 90) &&
+                    !(j >= NLAT_FRAG - k && i < k * 4))
+                    map[maplen++] = ((PIO_Offset)k * NLAT_FRAG + j) * NLON_FRAG + i + 1;
+
+    /* Find the regions by calling find_region() repeatedly. */
+    t = MPI_Wtime();
+    for (int n = 0; n < maplen; nregions++)
+    {
+        if ((ret = alloc_region2(NULL, NDIM3_FRAG, ref_next)))
+            return ret;
+        (*ref_next)->loffset = n;
+        n += find_region(NDIM3_FRAG, gdimlen, maplen - n, &map[n], (*ref_next)->start,
+                         (*ref_next)->count);
+        ref_next = &(*ref_next)->next;
+    }
+    ref_time = MPI_Wtime() - t;
+
+    /* Find the regions with get_regions(). */
+    if ((ret = alloc_region2(NULL, NDIM3_FRAG, &ior1)))
+        return ret;
+    t = MPI_Wtime();
+    if ((ret = get_regions(NDIM3_FRAG, gdimlen, maplen, map, &maxregions, ior1)))
+        return ret;
+    time = MPI_Wtime() - t;
+    printf("%d get_regions: %d map points, %d regions, find_region %.6f s, get_regions %.6f s, speedup %.2f\n",
+           my_rank, maplen, maxregions, ref_time, time, (time > 0) ? ref_time / time : 0.0);
+    if (maxregions != nregions)
+        return ERR_WRONG;
+
+    /* Compare the regions. */
+    for (region = ior1, ref_region = ref_ior1; ref_region;
+         region = region->next, ref_region = ref_region->next)
+    {
+        if (!region || region->loffset != ref_region->loffset)
+            return ERR_WRONG;
+        for (int d = 0; d < NDIM3_FRAG; d++)
+            if (region->start[d] != ref_region->start[d] ||
+                region->count[d] != ref_region->count[d])
+                return ERR_WRONG;
+    }
+
+    /* Free resources. */
+    for (int l = 0; l < 2; l++)
+    {
+        region = l ? ref_ior1 : ior1;
+        while (region)
+        {
+            io_region *next = region->next;
+            free(region->start);
+            free(region->count);
+            free(region);
+            region = next;
+        }
+    }
+    free(map);
+
+    return 0;
+}
+
 /* Run tests for find_region() function. */
 int test_find_region()
 {
@@ -1005,8 +1108,8 @@ int test_default_subset_partition(MPI_Comm test_comm, int my_rank)
     return 0;
 }
 
-/* Test function rearrange_comp2io. */
-int test_rearrange_comp2io(MPI_Comm test_comm, int my_rank)
+/* Test function rearrange_comp2io with the given rearranger comm type. */
+int test_rearrange_comp2io(MPI_Comm test_comm, int my_rank, int comm_type)
 {
     iosystem_desc_t *ios;
     io_desc_t *iodesc;
@@ -1021,10 +1124,11 @@ int test_rearrange_comp2io(MPI_Comm test_comm, int my_rank)
     int mpierr;
     int ret;
 
-    /* Allocate some space for data. */
-    if (!(sbuf = calloc(4, sizeof(int))))
+    /* Allocate some space for data, for up to PIO_MAX_REARR_PLANS + 1
+     * variables. */
+    if (!(sbuf = calloc(8 * (PIO_MAX_REARR_PLANS + 1), sizeof(int))))
         return PIO_ENOMEM;
-    if (!(rbuf = calloc(4, sizeof(int))))
+    if (!(rbuf = calloc(8 * (PIO_MAX_REARR_PLANS + 1), sizeof(int))))
         return PIO_ENOMEM;
 
     /* Allocate IO system info struct for this test. */
@@ -1054,7 +1158,7 @@ int test_rearrange_comp2io(MPI_Comm test_comm, int my_rank)
     int num_send_types = iodesc->rearranger == PIO_REARR_BOX ? ios->num_iotasks : 1;
 
     /* Default rearranger options. */
-    iodesc->rearr_opts.comm_type = PIO_REARR_COMM_COLL;
+    iodesc->rearr_opts.comm_type = comm_type;
     iodesc->rearr_opts.fcd = PIO_REARR_COMM_FC_2D_DISABLE;
 
     /* Set up for determine_fill(). */
@@ -1090,11 +1194,73 @@ int test_rearrange_comp2io(MPI_Comm test_comm, int my_rank)
     if ((ret = box_rearrange_create(ios, maplen, compmap, gdimlen, ndims, iodesc)))
         return ret;
 
+    /* Create the neighborhood communicator, if needed. Only the
+     * neighbors are needed with the sparse comm type. */
+    iodesc->neigh_comm = MPI_COMM_NULL;
+    if (comm_type == PIO_REARR_COMM_NEIGHBOR)
+    {
+        if ((ret = create_neighbor_comm(ios, iodesc)))
+            return ret;
+        if (iodesc->neigh_comm == MPI_COMM_NULL || iodesc->nneighbors < 1)
+            return ERR_WRONG;
+    }
+    else if (comm_type == PIO_REARR_COMM_SPARSE)
+    {
+        if ((ret = create_neighbor_comm(ios, iodesc)))
+            return ret;
+        if (iodesc->neigh_comm != MPI_COMM_NULL || iodesc->nneighbors < 1)
+            return ERR_WRONG;
+    }
+
     /* Run the function to test. */
     if ((ret = rearrange_comp2io(ios, iodesc, sbuf, rbuf, nvars)))
         return ret;
     printf("returned from rearrange_comp2io\n");
 
+    /* Rearrange again, the cached communication plan is reused. */
+    if ((ret = rearrange_comp2io(ios, iodesc, sbuf, rbuf, nvars)))
+        return ret;
+    if (!iodesc->comp2io_plans || iodesc->comp2io_plans->next ||
+        iodesc->comp2io_plans->nvars != nvars)
+        return ERR_WRONG;
+
+    /* Tune the rearranger, all tasks must pick the same options. */
+    if ((ret = rearr_autotune_init(iodesc)))
+        return ret;
+    for (int t = 0; t <= PIO_REARR_AUTOTUNE_NCANDIDATES; t++)
+        if ((ret = rearrange_comp2io(ios, iodesc, sbuf, rbuf, nvars)))
+            return ret;
+    if (iodesc->autotune)
+        return ERR_WRONG;
+    int tuned_opts[2] = {iodesc->rearr_opts.comm_type, iodesc->rearr_opts.comp2io.max_pend_req};
+    int max_tuned_opts[2];
+    if ((mpierr = MPI_Allreduce(tuned_opts, max_tuned_opts, 2, MPI_INT, MPI_MAX, test_comm)))
+        MPIERR(mpierr);
+    if (tuned_opts[0] != max_tuned_opts[0] || tuned_opts[1] != max_tuned_opts[1])
+        return ERR_WRONG;
+
+    /* Rearrange with the tuned options. */
+    if ((ret = rearrange_comp2io(ios, iodesc, sbuf, rbuf, nvars)))
+        return ret;
+
+    /* Only the most recently used plans are cached. */
+    for (int nv = 1; nv <= PIO_MAX_REARR_PLANS + 1; nv++)
+        if ((ret = rearrange_comp2io(ios, iodesc, sbuf, rbuf, nv)))
+            return ret;
+    int nplans = 0;
+    for (rearr_comm_plan_t *p = iodesc->comp2io_plans; p; p = p->next)
+    {
+        if (p->nvars == 1 || p->nusers)
+            return ERR_WRONG;
+        nplans++;
+    }
+    if (nplans != PIO_MAX_REARR_PLANS || iodesc->comp2io_plans->nvars != PIO_MAX_REARR_PLANS + 1)
+        return ERR_WRONG;
+
+    /* Free the cached communication plans. */
+    if ((ret = free_rearr_comm_plans(iodesc->comp2io_plans)))
+        return ret;
+
     /* We created send types, so free them. */
     for (int st = 0; st < num_send_types; st++)
         if (iodesc->stype[st] != PIO_DATATYPE_NULL)
@@ -1109,6 +1275,10 @@ int test_rearrange_comp2io(MPI_Comm test_comm, int my_rank)
                     MPIERR(mpierr);
 
     /* Free resources allocated in library code. */
+    if (iodesc->neigh_comm != MPI_COMM_NULL)
+        if ((mpierr = MPI_Comm_free(&iodesc->neigh_comm)))
+            MPIERR(mpierr);
+    free(iodesc->neighbors);
     free(iodesc->rtype);
     free(iodesc->sindex);
     free(iodesc->scount);
@@ -1131,8 +1301,8 @@ int test_rearrange_comp2io(MPI_Comm test_comm, int my_rank)
     return 0;
 }
 
-/* Test function rearrange_io2comp. */
-int test_rearrange_io2comp(MPI_Comm test_comm, int my_rank)
+/* Test function rearrange_io2comp with the given rearranger comm type. */
+int test_rearrange_io2comp(MPI_Comm test_comm, int my_rank, int comm_type)
 {
     iosystem_desc_t *ios;
     io_desc_t *iodesc;
@@ -1179,7 +1349,7 @@ int test_rearrange_io2comp(MPI_Comm test_comm, int my_rank)
     int num_send_types = iodesc->rearranger == PIO_REARR_BOX ? ios->num_iotasks : 1;
 
     /* Default rearranger options. */
-    iodesc->rearr_opts.comm_type = PIO_REARR_COMM_COLL;
+    iodesc->rearr_opts.comm_type = comm_type;
     iodesc->rearr_opts.fcd = PIO_REARR_COMM_FC_2D_DISABLE;
 
     /* Set up for determine_fill(). */
@@ -1219,11 +1389,39 @@ int test_rearrange_io2comp(MPI_Comm test_comm, int my_rank)
     if ((ret = box_rearrange_create(ios, maplen, compmap, gdimlen, ndims, iodesc)))
         return ret;
 
+    /* Create the neighborhood communicator, if needed. Only the
+     * neighbors are needed with the sparse comm type. */
+    iodesc->neigh_comm = MPI_COMM_NULL;
+    if (comm_type == PIO_REARR_COMM_NEIGHBOR)
+    {
+        if ((ret = create_neighbor_comm(ios, iodesc)))
+            return ret;
+        if (iodesc->neigh_comm == MPI_COMM_NULL || iodesc->nneighbors < 1)
+            return ERR_WRONG;
+    }
+    else if (comm_type == PIO_REARR_COMM_SPARSE)
+    {
+        if ((ret = create_neighbor_comm(ios, iodesc)))
+            return ret;
+        if (iodesc->neigh_comm != MPI_COMM_NULL || iodesc->nneighbors < 1)
+            return ERR_WRONG;
+    }
+
     /* Run the function to test. */
     if ((ret = rearrange_io2comp(ios, iodesc, sbuf, rbuf)))
         return ret;
     printf("returned from rearrange_comp2io\n");
 
+    /* Rearrange again, the cached communication plan is reused. */
+    if ((ret = rearrange_io2comp(ios, iodesc, sbuf, rbuf)))
+        return ret;
+    if (!iodesc->io2comp_plans || iodesc->io2comp_plans->next)
+        return ERR_WRONG;
+
+    /* Free the cached communication plans. */
+    if ((ret = free_rearr_comm_plans(iodesc->io2comp_plans)))
+        return ret;
+
     /* We created send types, so free them. */
     for (int st = 0; st < num_send_types; st++)
         if (iodesc->stype[st] != PIO_DATATYPE_NULL)
@@ -1238,6 +1436,10 @@ int test_rearrange_io2comp(MPI_Comm test_comm, int my_rank)
                     MPIERR(mpierr);
 
     /* Free resources allocated in library code. */
+    if (iodesc->neigh_comm != MPI_COMM_NULL)
+        if ((mpierr = MPI_Comm_free(&iodesc->neigh_comm)))
+            MPIERR(mpierr);
+    free(iodesc->neighbors);
     free(iodesc->rtype);
     free(iodesc->sindex);
     free(iodesc->scount);
@@ -1260,6 +1462,81 @@ int test_rearrange_io2comp(MPI_Comm test_comm, int my_rank)
     return 0;
 }
 
+/* Test the placement of the IO tasks across the nodes. */
+int test_iotask_placement(MPI_Comm test_comm, int my_rank)
+{
+#define NUMIO_PLACED 2
+    int iosysid;
+    iosystem_desc_t *ios;
+    int ntasks;
+    int ret;
+
+    if ((ret = MPI_Comm_size(test_comm, &ntasks)))
+        return ret;
+
+    /* Invalid placement options are rejected. */
+    if (PIOc_set_iotask_placement(PIO_IOTASK_PLACEMENT_NODE + 1, 0) != PIO_EINVAL)
+        return ERR_WRONG;
+    if (PIOc_set_iotask_placement(PIO_IOTASK_PLACEMENT_NODE, -1) != PIO_EINVAL)
+        return ERR_WRONG;
+
+    /* With the default placement the user stride is used. */
+    if ((ret = PIOc_Init_Intracomm(test_comm, NUMIO_PLACED, 1, 0, PIO_REARR_BOX, &iosysid)))
+        return ret;
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+        return ERR_WRONG;
+    if (ios->iotask_placement != PIO_IOTASK_PLACEMENT_STRIDE ||
+        ios->ioranks[0] != 0 || ios->ioranks[1] != 1 ||
+        ios->num_nodes < 1 || ios->num_io_nodes < 1 || ios->max_iotasks_per_node < 1)
+        return ERR_WRONG;
+    if ((ret = PIOc_finalize(iosysid)))
+        return ret;
+
+    /* Spread the IO tasks across the nodes. */
+    if ((ret = PIOc_set_iotask_placement(PIO_IOTASK_PLACEMENT_NODE, 0)))
+        return ret;
+    if ((ret = PIOc_Init_Intracomm(test_comm, NUMIO_PLACED, 1, 0, PIO_REARR_BOX, &iosysid)))
+        return ret;
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+        return ERR_WRONG;
+    if (ios->iotask_placement != PIO_IOTASK_PLACEMENT_NODE ||
+        ios->ioranks[0] >= ios->ioranks[1])
+        return ERR_WRONG;
+    if (ios->num_nodes == 1)
+    {
+        /* Both IO tasks are on the only node, spread out evenly. */
+        if (ios->num_io_nodes != 1 || ios->max_iotasks_per_node != NUMIO_PLACED ||
+            ios->ioranks[0] != 0 || ios->ioranks[1] != ntasks / NUMIO_PLACED)
+            return ERR_WRONG;
+    }
+    else if (ios->num_io_nodes != NUMIO_PLACED || ios->max_iotasks_per_node != 1)
+        return ERR_WRONG;
+    if ((ret = PIOc_finalize(iosysid)))
+        return ret;
+
+    /* Limit the number of IO tasks per node. */
+    if ((ret = PIOc_set_iotask_placement(PIO_IOTASK_PLACEMENT_NODE, 1)))
+        return ret;
+    ret = PIOc_Init_Intracomm(test_comm, NUMIO_PLACED, 1, 0, PIO_REARR_BOX, &iosysid);
+    if (!ret)
+    {
+        if (!(ios = pio_get_iosystem_from_id(iosysid)))
+            return ERR_WRONG;
+        if (ios->num_io_nodes != NUMIO_PLACED || ios->max_iotasks_per_node != 1)
+            return ERR_WRONG;
+        if ((ret = PIOc_finalize(iosysid)))
+            return ret;
+    }
+    else if (ret != PIO_EINVAL)
+        return ERR_WRONG;
+
+    /* Restore the default placement. */
+    if ((ret = PIOc_set_iotask_placement(PIO_IOTASK_PLACEMENT_STRIDE, 0)))
+        return ret;
+
+    return 0;
+}
+
 /* These tests do not need an iosysid. */
 int run_no_iosys_tests(int my_rank, MPI_Comm test_comm)
 {
@@ -1293,6 +1570,10 @@ int run_no_iosys_tests(int my_rank, MPI_Comm test_comm)
     if ((ret = test_get_regions(my_rank)))
         return ret;
 
+    printf("%d running tests for get_regions() on a fragmented decomposition\n", my_rank);
+    if ((ret = test_get_regions_fragmented(my_rank)))
+        return ret;
+
     printf("%d running create_mpi_datatypes tests\n", my_rank);
     if ((ret = test_create_mpi_datatypes()))
         return ret;
@@ -1324,13 +1605,22 @@ int run_no_iosys_tests(int my_rank, MPI_Comm test_comm)
     if ((ret = test_default_subset_partition(test_comm, my_rank)))
         return ret;
 
-    printf("%d running tests for rearrange_comp2io\n", my_rank);
-    if ((ret = test_rearrange_comp2io(test_comm, my_rank)))
+    printf("%d running tests for IO task placement\n", my_rank);
+    if ((ret = test_iotask_placement(test_comm, my_rank)))
         return ret;
 
-    printf("%d running tests for rearrange_io2comp\n", my_rank);
-    if ((ret = test_rearrange_io2comp(test_comm, my_rank)))
-        return ret;
+    int comm_type[NUM_COMM_TYPES] = {PIO_REARR_COMM_COLL, PIO_REARR_COMM_NEIGHBOR,
+                                      PIO_REARR_COMM_SPARSE};
+    for (int c = 0; c < NUM_COMM_TYPES; c++)
+    {
+        printf("%d running tests for rearrange_comp2io comm_type = %d\n", my_rank, comm_type[c]);
+        if ((ret = test_rearrange_comp2io(test_comm, my_rank, comm_type[c])))
+            return ret;
+
+        printf("%d running tests for rearrange_io2comp comm_type = %d\n", my_rank, comm_type[c]);
+        if ((ret = test_rearrange_io2comp(test_comm, my_rank, comm_type[c])))
+            return ret;
+    }
 
      return 0;
 }
@@ -1552,6 +1842,785 @@ int test_scalar(int numio, int iosysid, MPI_Comm test_comm, int my_rank,
     return 0;
 }
 
+/* Test that identical decompositions are shared. */
+int test_decomp_dedup(int iosysid, int my_rank)
+{
+    PIO_Offset compmap[MAPLEN2] = {my_rank * 2 + 1, my_rank * 2 + 2};
+    PIO_Offset compmap2[MAPLEN2] = {my_rank * 2 + 2, my_rank * 2 + 1};
+    const int gdimlen[NDIM1] = {8};
+    int ioid, ioid_same, ioid_diff;
+    io_desc_t *iodesc;
+    int ret;
+
+    if ((ret = PIOc_init_decomp(iosysid, PIO_INT, NDIM1, gdimlen, MAPLEN2,
+                                compmap, &ioid, PIO_REARR_BOX, NULL, NULL)))
+        return ret;
+
+    /* An identical decomposition returns the same decomposition. */
+    if ((ret = PIOc_init_decomp(iosysid, PIO_INT, NDIM1, gdimlen, MAPLEN2,
+                                compmap, &ioid_same, PIO_REARR_BOX, NULL, NULL)))
+        return ret;
+    if (ioid_same != ioid)
+        return ERR_WRONG;
+    if (!(iodesc = pio_get_iodesc_from_id(ioid)))
+        return ERR_WRONG;
+    if (iodesc->refcnt != 2)
+        return ERR_WRONG;
+
+    /* A decomposition with the same hash but created with a different
+     * blocksize or iocount (e.g. a hash collision) is not shared. */
+    iodesc->dedup_blocksize++;
+    if ((ret = PIOc_init_decomp(iosysid, PIO_INT, NDIM1, gdimlen, MAPLEN2,
+                                compmap, &ioid_diff, PIO_REARR_BOX, NULL, NULL)))
+        return ret;
+    iodesc->dedup_blocksize--;
+    if (ioid_diff == ioid)
+        return ERR_WRONG;
+    if ((ret = PIOc_freedecomp(iosysid, ioid_diff)))
+        return ret;
+    if (!(iodesc->dedup_iocount = calloc(NDIM1, sizeof(PIO_Offset))))
+        return PIO_ENOMEM;
+    if ((ret = PIOc_init_decomp(iosysid, PIO_INT, NDIM1, gdimlen, MAPLEN2,
+                                compmap, &ioid_diff, PIO_REARR_BOX, NULL, NULL)))
+        return ret;
+    free(iodesc->dedup_iocount);
+    iodesc->dedup_iocount = NULL;
+    if (ioid_diff == ioid)
+        return ERR_WRONG;
+    if ((ret = PIOc_freedecomp(iosysid, ioid_diff)))
+        return ret;
+
+    /* Different maps, types or rearrangers create new decompositions. */
+    if ((ret = PIOc_init_decomp(iosysid, PIO_INT, NDIM1, gdimlen, MAPLEN2,
+                                compmap2, &ioid_diff, PIO_REARR_BOX, NULL, NULL)))
+        return ret;
+    if (ioid_diff == ioid)
+        return ERR_WRONG;
+    if ((ret = PIOc_freedecomp(iosysid, ioid_diff)))
+        return ret;
+    if ((ret = PIOc_init_decomp(iosysid, PIO_DOUBLE, NDIM1, gdimlen, MAPLEN2,
+                                compmap, &ioid_diff, PIO_REARR_BOX, NULL, NULL)))
+        return ret;
+    if (ioid_diff == ioid)
+        return ERR_WRONG;
+    if ((ret = PIOc_freedecomp(iosysid, ioid_diff)))
+        return ret;
+    if ((ret = PIOc_init_decomp(iosysid, PIO_INT, NDIM1, gdimlen, MAPLEN2,
+                                compmap, &ioid_diff, PIO_REARR_SUBSET, NULL, NULL)))
+        return ret;
+    if (ioid_diff == ioid)
+        return ERR_WRONG;
+    if ((ret = PIOc_freedecomp(iosysid, ioid_diff)))
+        return ret;
+
+    /* The decomposition is freed with the last reference. */
+    if ((ret = PIOc_freedecomp(iosysid, ioid)))
+        return ret;
+    if (!(iodesc = pio_get_iodesc_from_id(ioid)))
+        return ERR_WRONG;
+    if (iodesc->refcnt != 1)
+        return ERR_WRONG;
+    if ((ret = PIOc_freedecomp(iosysid, ioid)))
+        return ret;
+    if (pio_get_iodesc_from_id(ioid))
+        return ERR_WRONG;
+
+    return 0;
+}
+
+/* Corrupt a decomposition plan file, by overwriting its last value
+ * with a value out of range, or by removing its last byte. */
+static int corrupt_plan_file(const char *fname, bool truncate_file)
+{
+    PIO_Offset bad = (PIO_Offset)1 << 40;
+    char *buf;
+    long size;
+    FILE *fp;
+
+    if (!(fp = fopen(fname, "rb")))
+        return ERR_WRONG;
+    if (fseek(fp, 0, SEEK_END) || (size = ftell(fp)) < (long)sizeof(PIO_Offset) ||
+        fseek(fp, 0, SEEK_SET))
+        return ERR_WRONG;
+    if (!(buf = malloc(size)))
+        return PIO_ENOMEM;
+    if (fread(buf, 1, size, fp) != (size_t)size || fclose(fp))
+        return ERR_WRONG;
+
+    if (truncate_file)
+        size--;
+    else
+        memcpy(buf + size - sizeof(PIO_Offset), &bad, sizeof(PIO_Offset));
+
+    if (!(fp = fopen(fname, "wb")))
+        return ERR_WRONG;
+    if (fwrite(buf, 1, size, fp) != (size_t)size || fclose(fp))
+        return ERR_WRONG;
+    free(buf);
+
+    return 0;
+}
+
+/* Test saving and loading rearranger plans. Data rearranged with a
+ * decomposition loaded from a plan must match the data rearranged
+ * with the decomposition the plan was saved from. */
+int test_decomp_plan(int iosysid, int my_rank)
+{
+#define NUM_PLAN_REARRANGERS 2
+#define PLAN_FILE "test_rearr_plan"
+    int rearranger[NUM_PLAN_REARRANGERS] = {PIO_REARR_BOX, PIO_REARR_SUBSET};
+    PIO_Offset compmap[MAPLEN2] = {my_rank * 2 + 2, my_rank ? my_rank * 2 + 1 : 0};
+    const int gdimlen[NDIM1] = {8};
+    const int gdimlen2[NDIM1] = {16};
+    char plan_file[PIO_MAX_NAME + 1];
+    int sbuf[MAPLEN2];
+    int rbuf[MAPLEN2];
+    int *iobuf[2];
+    iosystem_desc_t *ios;
+    io_desc_t *iodesc;
+    int ioid;
+    bool loaded;
+    int ret;
+
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+        return ERR_WRONG;
+    snprintf(plan_file, PIO_MAX_NAME, "%s.%d", PLAN_FILE, ios->union_rank);
+
+    for (int i = 0; i < MAPLEN2; i++)
+        sbuf[i] = compmap[i];
+
+    for (int r = 0; r < NUM_PLAN_REARRANGERS; r++)
+    {
+        PIO_Offset llen;
+        int nrecvs, maxregions, maxfillregions;
+        bool needsfill;
+
+        /* No plan is saved yet, the decomposition is created. */
+        if ((ret = PIOc_load_decomp_plan(iosysid, PLAN_FILE, PIO_INT, NDIM1, gdimlen, MAPLEN2,
+                                         compmap, &ioid, &rearranger[r], NULL, NULL, &loaded)))
+            return ret;
+        if (loaded)
+            return ERR_WRONG;
+        if ((ret = PIOc_save_decomp_plan(iosysid, ioid, PLAN_FILE)))
+            return ret;
+        if (!(iodesc = pio_get_iodesc_from_id(ioid)))
+            return ERR_WRONG;
+        llen = iodesc->llen;
+        nrecvs = iodesc->nrecvs;
+        maxregions = iodesc->maxregions;
+        maxfillregions = iodesc->maxfillregions;
+        needsfill = iodesc->needsfill;
+        if (!(iobuf[0] = calloc(llen ? llen : 1, sizeof(int))))
+            return PIO_ENOMEM;
+        if ((ret = rearrange_comp2io(ios, iodesc, sbuf, iobuf[0], 1)))
+            return ret;
+        if ((ret = PIOc_freedecomp(iosysid, ioid)))
+            return ret;
+
+        /* The decomposition is now loaded from the plan. */
+        if ((ret = PIOc_load_decomp_plan(iosysid, PLAN_FILE, PIO_INT, NDIM1, gdimlen, MAPLEN2,
+                                         compmap, &ioid, &rearranger[r], NULL, NULL, &loaded)))
+            return ret;
+        if (!loaded)
+            return ERR_WRONG;
+        if (!(iodesc = pio_get_iodesc_from_id(ioid)))
+            return ERR_WRONG;
+        if (iodesc->rearranger != rearranger[r] || iodesc->llen != llen ||
+            iodesc->nrecvs != nrecvs || iodesc->maxregions != maxregions ||
+            iodesc->maxfillregions != maxfillregions || iodesc->needsfill != needsfill)
+            return ERR_WRONG;
+        if (!(iobuf[1] = calloc(llen ? llen : 1, sizeof(int))))
+            return PIO_ENOMEM;
+        if ((ret = rearrange_comp2io(ios, iodesc, sbuf, iobuf[1], 1)))
+            return ret;
+        for (int i = 0; i < llen; i++)
+            if (iobuf[1][i] != iobuf[0][i])
+                return ERR_WRONG;
+        for (int i = 0; i < MAPLEN2; i++)
+            rbuf[i] = -1;
+        if ((ret = rearrange_io2comp(ios, iodesc, iobuf[1], rbuf)))
+            return ret;
+        for (int i = 0; i < MAPLEN2; i++)
+            if (compmap[i] && rbuf[i] != sbuf[i])
+                return ERR_WRONG;
+        if ((ret = PIOc_freedecomp(iosysid, ioid)))
+            return ret;
+        free(iobuf[0]);
+        free(iobuf[1]);
+
+        /* A plan with a value out of range, or a truncated plan, on
+         * one task is rejected on all tasks. */
+        for (int t = 0; t < 2; t++)
+        {
+            if (!my_rank && (ret = corrupt_plan_file(plan_file, t)))
+                return ret;
+            if (PIOc_load_decomp_plan(iosysid, PLAN_FILE, PIO_INT, NDIM1, gdimlen, MAPLEN2,
+                                      compmap, &ioid, &rearranger[r], NULL, NULL,
+                                      &loaded) != PIO_EINVAL || loaded)
+                return ERR_WRONG;
+        }
+
+        /* The plan is not used for a different decomposition. */
+        if ((ret = PIOc_load_decomp_plan(iosysid, PLAN_FILE, PIO_INT, NDIM1, gdimlen2, MAPLEN2,
+                                         compmap, &ioid, &rearranger[r], NULL, NULL, &loaded)))
+            return ret;
+        if (loaded)
+            return ERR_WRONG;
+        if ((ret = PIOc_freedecomp(iosysid, ioid)))
+            return ret;
+
+        if (remove(plan_file))
+            return ERR_WRONG;
+    }
+
+    return 0;
+}
+
+/* Test the subset partition methods. The last task has most of the
+ * data, and the map offsets are in reverse rank order. The data
+ * volume received by the IO tasks must be better balanced with the
+ * volume partitions than with the rank partition. */
+int test_subset_partition(int iosysid, int my_rank)
+{
+#define NUM_SUBSET_PARTITIONS 3
+#define SP_SMALL_MAPLEN 2
+#define SP_LARGE_MAPLEN 10
+    int partition[NUM_SUBSET_PARTITIONS] = {PIO_SUBSET_PARTITION_RANK,
+                                            PIO_SUBSET_PARTITION_VOLUME,
+                                            PIO_SUBSET_PARTITION_VOLUME_LOCALITY};
+    int maplen = (my_rank == TARGET_NTASKS - 1) ? SP_LARGE_MAPLEN : SP_SMALL_MAPLEN;
+    int gdimlen[NDIM1] = {(TARGET_NTASKS - 1) * SP_SMALL_MAPLEN + SP_LARGE_MAPLEN};
+    PIO_Offset compmap[SP_LARGE_MAPLEN];
+    int sbuf[SP_LARGE_MAPLEN];
+    int rbuf[SP_LARGE_MAPLEN];
+    double imbalance[NUM_SUBSET_PARTITIONS];
+    iosystem_desc_t *ios;
+    io_desc_t *iodesc;
+    int ioid;
+    int ret;
+
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+        return ERR_WRONG;
+
+    for (int i = 0; i < maplen; i++)
+    {
+        compmap[i] = gdimlen[0] - (my_rank + 1) * SP_SMALL_MAPLEN + i + 1;
+        if (my_rank == TARGET_NTASKS - 1)
+            compmap[i] = i + 1;
+        sbuf[i] = compmap[i];
+    }
+
+    for (int p = 0; p < NUM_SUBSET_PARTITIONS; p++)
+    {
+        int *iobuf;
+
+        if ((ret = PIOc_set_subset_partition(iosysid, partition[p])))
+            return ret;
+        ios->subset_imbalance = 0;
+        if ((ret = PIOc_InitDecomp(iosysid, PIO_INT, NDIM1, gdimlen, maplen, compmap, &ioid,
+                                   &(int){PIO_REARR_SUBSET}, NULL, NULL)))
+            return ret;
+        if (!(iodesc = pio_get_iodesc_from_id(ioid)))
+            return ERR_WRONG;
+
+        /* Rearrange the data to the IO tasks and back. */
+        if (!(iobuf = calloc(iodesc->llen ? iodesc->llen : 1, sizeof(int))))
+            return PIO_ENOMEM;
+        if ((ret = rearrange_comp2io(ios, iodesc, sbuf, iobuf, 1)))
+            return ret;
+        for (int i = 0; i < maplen; i++)
+            rbuf[i] = -1;
+        if ((ret = rearrange_io2comp(ios, iodesc, iobuf, rbuf)))
+            return ret;
+        for (int i = 0; i < maplen; i++)
+            if (rbuf[i] != sbuf[i])
+                return ERR_WRONG;
+        free(iobuf);
+
+        imbalance[p] = ios->subset_imbalance;
+        if ((ret = PIOc_freedecomp(iosysid, ioid)))
+            return ret;
+    }
+
+    if (ios->ioproc)
+    {
+        printf("%d subset partition imbalance with %d IO tasks: rank %.2f volume %.2f "
+               "volume_locality %.2f\n", my_rank, ios->num_iotasks, imbalance[0],
+               imbalance[1], imbalance[2]);
+        for (int p = 0; p < NUM_SUBSET_PARTITIONS; p++)
+            if (imbalance[p] < 1 || imbalance[p] > imbalance[0])
+                return ERR_WRONG;
+    }
+
+    ios->subset_imbalance = 0;
+    if ((ret = PIOc_set_subset_partition(iosysid, PIO_SUBSET_PARTITION_RANK)))
+        return ret;
+
+    return 0;
+}
+
+/* Test that the box rearranger is the same when the decomposition
+ * map is processed in chunks (see PIOc_set_rearr_setup_buffer_limit()). */
+int test_box_rearrange_chunked(int iosysid, int my_rank)
+{
+#define NUM_SETUP_LIMITS 3
+#define CHUNKED_MAPLEN 8
+#define CHUNKED_NDIMS 2
+    /* Chunks of 1 and 3 map elements, and the default limit. */
+    PIO_Offset limit[NUM_SETUP_LIMITS] = {1, 3 * CHUNKED_NDIMS * sizeof(PIO_Offset), 0};
+    const int gdimlen[CHUNKED_NDIMS] = {TARGET_NTASKS, CHUNKED_MAPLEN};
+    PIO_Offset compmap[CHUNKED_MAPLEN];
+    PIO_Offset *sindex[NUM_SETUP_LIMITS], *rindex[NUM_SETUP_LIMITS];
+    int scount[NUM_SETUP_LIMITS][TARGET_NTASKS];
+    int nrecvs[NUM_SETUP_LIMITS];
+    PIO_Offset totalrecv[NUM_SETUP_LIMITS];
+    int nsend[NUM_SETUP_LIMITS];
+    PIO_Offset oldlimit;
+    io_desc_t *iodesc;
+    int ioid;
+    int ret;
+
+    /* Each task has a column of the array, in reverse order, with a
+     * hole. */
+    for (int i = 0; i < CHUNKED_MAPLEN; i++)
+        compmap[i] = (CHUNKED_MAPLEN - 1 - i) * TARGET_NTASKS + my_rank + 1;
+    compmap[my_rank] = 0;
+
+    oldlimit = PIOc_set_rearr_setup_buffer_limit(0);
+    limit[NUM_SETUP_LIMITS - 1] = oldlimit;
+    for (int l = 0; l < NUM_SETUP_LIMITS; l++)
+    {
+        PIOc_set_rearr_setup_buffer_limit(limit[l]);
+        if ((ret = PIOc_InitDecomp(iosysid, PIO_INT, CHUNKED_NDIMS, gdimlen, CHUNKED_MAPLEN, compmap,
+                                   &ioid, &(int){PIO_REARR_BOX}, NULL, NULL)))
+            return ret;
+        if (!(iodesc = pio_get_iodesc_from_id(ioid)))
+            return ERR_WRONG;
+
+        nrecvs[l] = iodesc->nrecvs;
+        totalrecv[l] = 0;
+        for (int i = 0; iodesc->rcount && i < iodesc->nrecvs; i++)
+            totalrecv[l] += iodesc->rcount[i];
+        nsend[l] = 0;
+        memset(scount[l], 0, sizeof(scount[l]));
+        for (int i = 0; i < iodesc->num_aiotasks && i < TARGET_NTASKS; i++)
+        {
+            scount[l][i] = iodesc->scount[i];
+            nsend[l] += iodesc->scount[i];
+        }
+        if (!(sindex[l] = malloc(CHUNKED_MAPLEN * sizeof(PIO_Offset))) ||
+            !(rindex[l] = malloc((totalrecv[l] ? totalrecv[l] : 1) * sizeof(PIO_Offset))))
+            return PIO_ENOMEM;
+        if (nsend[l])
+            memcpy(sindex[l], iodesc->sindex, nsend[l] * sizeof(PIO_Offset));
+        if (totalrecv[l])
+            memcpy(rindex[l], iodesc->rindex, totalrecv[l] * sizeof(PIO_Offset));
+
+        if ((ret = PIOc_freedecomp(iosysid, ioid)))
+            return ret;
+    }
+    PIOc_set_rearr_setup_buffer_limit(oldlimit);
+
+    /* The chunked setups must match the default setup. */
+    for (int l = 0; l < NUM_SETUP_LIMITS - 1; l++)
+    {
+        int d = NUM_SETUP_LIMITS - 1;
+
+        if (nrecvs[l] != nrecvs[d] || totalrecv[l] != totalrecv[d] ||
+            memcmp(scount[l], scount[d], sizeof(scount[l])) ||
+            nsend[l] != nsend[d] ||
+            memcmp(sindex[l], sindex[d], nsend[d] * sizeof(PIO_Offset)) ||
+            memcmp(rindex[l], rindex[d], totalrecv[d] * sizeof(PIO_Offset)))
+            return ERR_WRONG;
+    }
+
+    for (int l = 0; l < NUM_SETUP_LIMITS; l++)
+    {
+        free(sindex[l]);
+        free(rindex[l]);
+    }
+
+    return 0;
+}
+
+/* Test the hierarchical box rearranger. Data rearranged with the
+ * hierarchical box rearranger must match the data rearranged with the
+ * box rearranger. */
+int test_box_hier_rearrange(int iosysid, MPI_Comm test_comm, int my_rank)
+{
+#define NUM_BOX_REARRANGERS 2
+#define NVARS_HIER 2
+    int rearranger[NUM_BOX_REARRANGERS] = {PIO_REARR_BOX, PIO_REARR_BOX_HIER};
+    PIO_Offset compmap[MAPLEN2] = {my_rank * 2 + 1, my_rank * 2 + 2};
+    const int gdimlen[NDIM1] = {8};
+    int sbuf[NVARS_HIER * MAPLEN2];
+    int rbuf[MAPLEN2];
+    int *iobuf[NUM_BOX_REARRANGERS] = {NULL, NULL};
+    int llen[NUM_BOX_REARRANGERS];
+    int ioid[NUM_BOX_REARRANGERS];
+    iosystem_desc_t *ios;
+    io_desc_t *iodesc;
+    int ret;
+
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+        return ERR_WRONG;
+
+    for (int v = 0; v < NVARS_HIER; v++)
+        for (int i = 0; i < MAPLEN2; i++)
+            sbuf[v * MAPLEN2 + i] = v * 100 + compmap[i];
+
+    for (int r = 0; r < NUM_BOX_REARRANGERS; r++)
+    {
+        if ((ret = PIOc_init_decomp(iosysid, PIO_INT, NDIM1, gdimlen, MAPLEN2,
+                                    compmap, &ioid[r], rearranger[r], NULL, NULL)))
+            return ret;
+        if (!(iodesc = pio_get_iodesc_from_id(ioid[r])))
+            return ERR_WRONG;
+        if (iodesc->rearranger != rearranger[r] || iodesc->ndof != MAPLEN2)
+            return ERR_WRONG;
+
+        /* Rearrange the data to the IO tasks. */
+        llen[r] = iodesc->llen;
+        if (!(iobuf[r] = calloc(NVARS_HIER * (llen[r] ? llen[r] : 1), sizeof(int))))
+            return PIO_ENOMEM;
+        if ((ret = rearrange_comp2io(ios, iodesc, sbuf, iobuf[r], NVARS_HIER)))
+            return ret;
+
+        /* Rearrange the data of the first variable back. */
+        for (int i = 0; i < MAPLEN2; i++)
+            rbuf[i] = -1;
+        if ((ret = rearrange_io2comp(ios, iodesc, iobuf[r], rbuf)))
+            return ret;
+        for (int i = 0; i < MAPLEN2; i++)
+            if (rbuf[i] != sbuf[i])
+                return ERR_WRONG;
+    }
+
+    /* The data on the IO tasks is the same for both rearrangers. */
+    if (llen[0] != llen[1])
+        return ERR_WRONG;
+    for (int i = 0; i < NVARS_HIER * llen[0]; i++)
+        if (iobuf[0][i] != iobuf[1][i])
+            return ERR_WRONG;
+
+    for (int r = 0; r < NUM_BOX_REARRANGERS; r++)
+    {
+        free(iobuf[r]);
+        if ((ret = PIOc_freedecomp(iosysid, ioid[r])))
+            return ret;
+    }
+
+    return 0;
+}
+
+/* Test rearranging the data of several box rearranger decompositions
+ * in one exchange. The data rearranged together must match the data
+ * rearranged one decomposition at a time. */
+int test_rearrange_comp2io_fused(int iosysid, int my_rank)
+{
+#define NUM_FUSED_DECOMPS 2
+    PIO_Offset compmap[NUM_FUSED_DECOMPS][MAPLEN2] = {{my_rank * 2 + 1, my_rank * 2 + 2},
+                                                      {my_rank + 1, 0}};
+    const int gdimlen[NUM_FUSED_DECOMPS][NDIM1] = {{8}, {4}};
+    int nvars[NUM_FUSED_DECOMPS] = {2, 1};
+    int sbuf[NUM_FUSED_DECOMPS][2 * MAPLEN2];
+    int *iobuf[NUM_FUSED_DECOMPS];
+    int *fused_iobuf[NUM_FUSED_DECOMPS];
+    io_desc_t *iodesc[NUM_FUSED_DECOMPS];
+    int ioid[NUM_FUSED_DECOMPS];
+    iosystem_desc_t *ios;
+    int ret;
+
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+        return ERR_WRONG;
+
+    /* The fused exchange uses the default communication type. */
+    if ((ret = PIOc_set_rearr_opts(iosysid, PIO_REARR_COMM_COLL, PIO_REARR_COMM_FC_2D_DISABLE,
+                                   false, false, PIO_REARR_COMM_UNLIMITED_PEND_REQ, false,
+                                   false, PIO_REARR_COMM_UNLIMITED_PEND_REQ)))
+        return ret;
+
+    for (int d = 0; d < NUM_FUSED_DECOMPS; d++)
+    {
+        for (int v = 0; v < nvars[d]; v++)
+            for (int i = 0; i < MAPLEN2; i++)
+                sbuf[d][v * MAPLEN2 + i] = d * 1000 + v * 100 + compmap[d][i];
+
+        if ((ret = PIOc_init_decomp(iosysid, PIO_INT, NDIM1, gdimlen[d], MAPLEN2,
+                                    compmap[d], &ioid[d], PIO_REARR_BOX, NULL, NULL)))
+            return ret;
+        if (!(iodesc[d] = pio_get_iodesc_from_id(ioid[d])))
+            return ERR_WRONG;
+        if (!rearr_comp2io_fusable(ios, iodesc[d]))
+            return ERR_WRONG;
+        if (!(iobuf[d] = calloc(nvars[d] * (iodesc[d]->llen ? iodesc[d]->llen : 1), sizeof(int))))
+            return PIO_ENOMEM;
+        if (!(fused_iobuf[d] = calloc(nvars[d] * (iodesc[d]->llen ? iodesc[d]->llen : 1), sizeof(int))))
+            return PIO_ENOMEM;
+
+        if ((ret = rearrange_comp2io(ios, iodesc[d], sbuf[d], iobuf[d], nvars[d])))
+            return ret;
+    }
+
+    /* The fused exchange is not used with the neighbor or sparse
+     * communication types, or with packing. */
+    int comm_type = iodesc[0]->rearr_opts.comm_type;
+    iodesc[0]->rearr_opts.comm_type = PIO_REARR_COMM_NEIGHBOR;
+    if (rearr_comp2io_fusable(ios, iodesc[0]) || rearr_comp2io_segmentable(ios, iodesc[0]))
+        return ERR_WRONG;
+    iodesc[0]->rearr_opts.comm_type = PIO_REARR_COMM_SPARSE;
+    if (rearr_comp2io_fusable(ios, iodesc[0]))
+        return ERR_WRONG;
+    iodesc[0]->rearr_opts.comm_type = comm_type;
+    ios->rearr_pack = true;
+    if (rearr_comp2io_fusable(ios, iodesc[0]) || rearr_comp2io_segmentable(ios, iodesc[0]))
+        return ERR_WRONG;
+    ios->rearr_pack = false;
+
+    void *sbufs[NUM_FUSED_DECOMPS] = {sbuf[0], sbuf[1]};
+    void *rbufs[NUM_FUSED_DECOMPS] = {fused_iobuf[0], fused_iobuf[1]};
+    if ((ret = rearrange_comp2io_fused(ios, NUM_FUSED_DECOMPS, iodesc, sbufs, rbufs, nvars)))
+        return ret;
+
+    for (int d = 0; d < NUM_FUSED_DECOMPS; d++)
+    {
+        for (int i = 0; i < nvars[d] * iodesc[d]->llen; i++)
+            if (fused_iobuf[d][i] != iobuf[d][i])
+                return ERR_WRONG;
+        free(iobuf[d]);
+        free(fused_iobuf[d]);
+        if ((ret = PIOc_freedecomp(iosysid, ioid[d])))
+            return ret;
+    }
+
+    return 0;
+}
+
+/* Test moving the variables of a decomposition held in several
+ * buffers (segments) with one exchange, as done for the segments of
+ * a write multi buffer. The tasks split the variables differently. */
+int test_rearrange_comp2io_segments(int iosysid, int my_rank)
+{
+#define NUM_SEG_REARRANGERS 2
+#define SEG_NVARS 3
+    int rearranger[NUM_SEG_REARRANGERS] = {PIO_REARR_BOX, PIO_REARR_SUBSET};
+    PIO_Offset compmap[MAPLEN2] = {my_rank * 2 + 1, my_rank * 2 + 2};
+    const int gdimlen[NDIM1] = {TARGET_NTASKS * MAPLEN2};
+    int sbuf[SEG_NVARS * MAPLEN2];
+    int *iobuf, *seg_iobuf;
+    iosystem_desc_t *ios;
+    io_desc_t *iodesc;
+    int ioid;
+    int ret;
+
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+        return ERR_WRONG;
+
+    /* The fused exchange uses the default communication type. */
+    if ((ret = PIOc_set_rearr_opts(iosysid, PIO_REARR_COMM_COLL, PIO_REARR_COMM_FC_2D_DISABLE,
+                                   false, false, PIO_REARR_COMM_UNLIMITED_PEND_REQ, false,
+                                   false, PIO_REARR_COMM_UNLIMITED_PEND_REQ)))
+        return ret;
+
+    for (int v = 0; v < SEG_NVARS; v++)
+        for (int i = 0; i < MAPLEN2; i++)
+            sbuf[v * MAPLEN2 + i] = v * 100 + compmap[i];
+
+    for (int r = 0; r < NUM_SEG_REARRANGERS; r++)
+    {
+        if ((ret = PIOc_init_decomp(iosysid, PIO_INT, NDIM1, gdimlen, MAPLEN2, compmap, &ioid,
+                                    rearranger[r], NULL, NULL)))
+            return ret;
+        if (!(iodesc = pio_get_iodesc_from_id(ioid)))
+            return ERR_WRONG;
+        if (!rearr_comp2io_segmentable(ios, iodesc))
+            return ERR_WRONG;
+        if (!(iobuf = calloc(SEG_NVARS * (iodesc->llen ? iodesc->llen : 1), sizeof(int))))
+            return PIO_ENOMEM;
+        if (!(seg_iobuf = calloc(SEG_NVARS * (iodesc->llen ? iodesc->llen : 1), sizeof(int))))
+            return PIO_ENOMEM;
+
+        if ((ret = rearrange_comp2io(ios, iodesc, sbuf, iobuf, SEG_NVARS)))
+            return ret;
+
+        /* Even tasks hold 1 + 2 variables, odd tasks 2 + 1. */
+        int nvars[2] = {(my_rank % 2) ? 2 : 1, (my_rank % 2) ? 1 : 2};
+        io_desc_t *iodescs[2] = {iodesc, iodesc};
+        void *sbufs[2] = {sbuf, sbuf + nvars[0] * MAPLEN2};
+        void *rbufs[2] = {seg_iobuf, seg_iobuf + nvars[0] * iodesc->llen};
+        if ((ret = rearrange_comp2io_fused(ios, 2, iodescs, sbufs, rbufs, nvars)))
+            return ret;
+
+        for (int i = 0; i < SEG_NVARS * iodesc->llen; i++)
+            if (seg_iobuf[i] != iobuf[i])
+                return ERR_WRONG;
+        free(iobuf);
+        free(seg_iobuf);
+        if ((ret = PIOc_freedecomp(iosysid, ioid)))
+            return ret;
+    }
+
+    return 0;
+}
+
+/* Test moving data from compute to IO tasks without blocking. The
+ * data must match the data rearranged with rearrange_comp2io(), with
+ * both the box and subset rearrangers. */
+int test_rearrange_comp2io_start(int iosysid, int my_rank)
+{
+#define NUM_NB_REARRANGERS 2
+    int rearranger[NUM_NB_REARRANGERS] = {PIO_REARR_BOX, PIO_REARR_SUBSET};
+    PIO_Offset compmap[MAPLEN2] = {my_rank * 2 + 1, my_rank * 2 + 2};
+    const int gdimlen[NDIM1] = {8};
+    int sbuf[MAPLEN2 * (PIO_MAX_REARR_PLANS + 1)];
+    int *iobuf[2];
+    iosystem_desc_t *ios;
+    io_desc_t *iodesc;
+    pio_swapm_req_t *req;
+    rearr_comm_plan_t *plan;
+    int ioid;
+    int flag;
+    int ret;
+
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+        return ERR_WRONG;
+
+    for (int i = 0; i < MAPLEN2 * (PIO_MAX_REARR_PLANS + 1); i++)
+        sbuf[i] = compmap[i % MAPLEN2];
+
+    for (int r = 0; r < NUM_NB_REARRANGERS; r++)
+    {
+        if ((ret = PIOc_init_decomp(iosysid, PIO_INT, NDIM1, gdimlen, MAPLEN2,
+                                    compmap, &ioid, rearranger[r], NULL, NULL)))
+            return ret;
+        if (!(iodesc = pio_get_iodesc_from_id(ioid)))
+            return ERR_WRONG;
+        for (int b = 0; b < 2; b++)
+            if (!(iobuf[b] = calloc((iodesc->llen ? iodesc->llen : 1) * (PIO_MAX_REARR_PLANS + 1),
+                                    sizeof(int))))
+                return PIO_ENOMEM;
+
+        if ((ret = rearrange_comp2io(ios, iodesc, sbuf, iobuf[0], 1)))
+            return ret;
+        if ((ret = rearrange_comp2io_start(ios, iodesc, sbuf, iobuf[1], 1, 0, &req, &plan)))
+            return ret;
+        if ((ret = pio_swapm_test(req, &flag)))
+            return ret;
+
+        /* The plan in use is not evicted by the plans created for
+         * more variables, while the exchange is in progress. */
+        if (plan->nusers != 1)
+            return ERR_WRONG;
+        for (int nv = 2; nv <= PIO_MAX_REARR_PLANS + 1; nv++)
+            if ((ret = rearrange_comp2io(ios, iodesc, sbuf, iobuf[0], nv)))
+                return ret;
+        rearr_comm_plan_t *p;
+        for (p = iodesc->comp2io_plans; p && p != plan; p = p->next)
+            ;
+        if (!p)
+            return ERR_WRONG;
+        if ((ret = rearrange_comp2io(ios, iodesc, sbuf, iobuf[0], 1)))
+            return ret;
+
+        if ((ret = pio_swapm_wait(req)))
+            return ret;
+        plan->nusers--;
+
+        for (int i = 0; i < iodesc->llen; i++)
+            if (iobuf[1][i] != iobuf[0][i])
+                return ERR_WRONG;
+
+        for (int b = 0; b < 2; b++)
+            free(iobuf[b]);
+        if ((ret = PIOc_freedecomp(iosysid, ioid)))
+            return ret;
+    }
+
+    return 0;
+}
+
+/* Test packing the data exchanged by the rearrangers (see
+ * PIOc_set_rearr_pack()). The data moved to the IO tasks and back
+ * must match the data moved with MPI datatypes, for the box and
+ * subset rearrangers, with a contiguous map (copied in runs) and a
+ * strided map (copied element by element). */
+int test_rearrange_pack(int iosysid, int my_rank)
+{
+#define NUM_PACK_REARRANGERS 2
+#define NUM_PACK_MAPS 2
+#define PACK_MAPLEN 4
+#define PACK_NVARS 2
+    int rearranger[NUM_PACK_REARRANGERS] = {PIO_REARR_BOX, PIO_REARR_SUBSET};
+    const int gdimlen[NDIM1] = {TARGET_NTASKS * PACK_MAPLEN};
+    PIO_Offset compmap[NUM_PACK_MAPS][PACK_MAPLEN];
+    int sbuf[PACK_NVARS * PACK_MAPLEN];
+    int rbuf[2][PACK_MAPLEN];
+    int *iobuf[2];
+    iosystem_desc_t *ios;
+    io_desc_t *iodesc;
+    int ioid;
+    int ret;
+
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+        return ERR_WRONG;
+
+    /* A contiguous map, and a map strided across the tasks. */
+    for (int i = 0; i < PACK_MAPLEN; i++)
+    {
+        compmap[0][i] = my_rank * PACK_MAPLEN + i + 1;
+        compmap[1][i] = i * TARGET_NTASKS + my_rank + 1;
+    }
+
+    for (int r = 0; r < NUM_PACK_REARRANGERS; r++)
+    {
+        for (int m = 0; m < NUM_PACK_MAPS; m++)
+        {
+            for (int v = 0; v < PACK_NVARS; v++)
+                for (int i = 0; i < PACK_MAPLEN; i++)
+                    sbuf[v * PACK_MAPLEN + i] = v * 100 + compmap[m][i];
+
+            if ((ret = PIOc_init_decomp(iosysid, PIO_INT, NDIM1, gdimlen, PACK_MAPLEN,
+                                        compmap[m], &ioid, rearranger[r], NULL, NULL)))
+                return ret;
+            if (!(iodesc = pio_get_iodesc_from_id(ioid)))
+                return ERR_WRONG;
+
+            /* Rearrange with MPI datatypes (b = 0), then packed (b = 1). */
+            for (int b = 0; b < 2; b++)
+            {
+                if ((ret = PIOc_set_rearr_pack(iosysid, b == 1)))
+                    return ret;
+                if (!(iobuf[b] = calloc(PACK_NVARS * (iodesc->llen ? iodesc->llen : 1),
+                                        sizeof(int))))
+                    return PIO_ENOMEM;
+                if ((ret = rearrange_comp2io(ios, iodesc, sbuf, iobuf[b], PACK_NVARS)))
+                    return ret;
+                for (int i = 0; i < PACK_MAPLEN; i++)
+                    rbuf[b][i] = -1;
+                if ((ret = rearrange_io2comp(ios, iodesc, iobuf[b], rbuf[b])))
+                    return ret;
+            }
+
+            for (int i = 0; i < PACK_NVARS * iodesc->llen; i++)
+                if (iobuf[1][i] != iobuf[0][i])
+                    return ERR_WRONG;
+            for (int i = 0; i < PACK_MAPLEN; i++)
+                if (rbuf[1][i] != rbuf[0][i] || rbuf[1][i] != sbuf[i])
+                    return ERR_WRONG;
+
+            for (int b = 0; b < 2; b++)
+                free(iobuf[b]);
+            if ((ret = PIOc_freedecomp(iosysid, ioid)))
+                return ret;
+        }
+    }
+
+    if ((ret = PIOc_set_rearr_pack(iosysid, false)))
+        return ret;
+
+    return 0;
+}
+
 /* These tests are run with different rearrangers and numbers of IO
  * tasks. */
 int run_iosys_tests(int numio, int iosysid, int my_rank, MPI_Comm test_comm,
@@ -1567,6 +2636,42 @@ int run_iosys_tests(int numio, int iosysid, int my_rank, MPI_Comm test_comm,
     if ((ret = test_init_decomp(iosysid, test_comm, my_rank)))
         return ret;
 
+    printf("%d running test for hierarchical box rearranger\n", my_rank);
+    if ((ret = test_box_hier_rearrange(iosysid, test_comm, my_rank)))
+        return ret;
+
+    printf("%d running test for decomposition deduplication\n", my_rank);
+    if ((ret = test_decomp_dedup(iosysid, my_rank)))
+        return ret;
+
+    printf("%d running test for decomposition plans\n", my_rank);
+    if ((ret = test_decomp_plan(iosysid, my_rank)))
+        return ret;
+
+    printf("%d running test for subset partitions\n", my_rank);
+    if ((ret = test_subset_partition(iosysid, my_rank)))
+        return ret;
+
+    printf("%d running test for chunked box rearranger setup\n", my_rank);
+    if ((ret = test_box_rearrange_chunked(iosysid, my_rank)))
+        return ret;
+
+    printf("%d running test for fused rearrangement\n", my_rank);
+    if ((ret = test_rearrange_comp2io_fused(iosysid, my_rank)))
+        return ret;
+
+    printf("%d running test for rearrangement of segments\n", my_rank);
+    if ((ret = test_rearrange_comp2io_segments(iosysid, my_rank)))
+        return ret;
+
+    printf("%d running test for nonblocking rearrangement\n", my_rank);
+    if ((ret = test_rearrange_comp2io_start(iosysid, my_rank)))
+        return ret;
+
+    printf("%d running test for packed rearrangement\n", my_rank);
+    if ((ret = test_rearrange_pack(iosysid, my_rank)))
+        return ret;
+
     printf("%d running test for init_decomp\n", my_rank);
     if ((ret = test_scalar(numio, iosysid, test_comm, my_rank, num_flavors, flavor)))
         return ret;
@@ -7,6 +7,7 @@
 #include <pio.h>
 #include <pio_tests.h>
 #include <pio_internal.h>
+#include <math.h>
 
 /* The number of tasks this test should run on. */
 #define TARGET_NTASKS 4
@@ -140,6 +141,240 @@ int run_spmd_tests(MPI_Comm test_comm)
     return 0;
 }
 
+/* Test pio_sparse_exchange() and pio_sparse_swapm(). Each task sends
+ * data to itself and to the next task.
+ *
+ * @param test_comm the MPI communicator that the test code is running on.
+ * @returns 0 for success, error code otherwise.
+ */
+int run_sparse_spmd_tests(MPI_Comm test_comm)
+{
+    int my_rank;  /* 0-based rank in test_comm. */
+    int ntasks;   /* Number of tasks in test_comm. */
+    int next, prev; /* Tasks data is sent to and received from. */
+    int nrecv;
+    int *recvranks, *recvvals;
+    int mpierr;   /* Return value from MPI calls. */
+    int ret;      /* Return value. */
+
+    /* Learn rank and size. */
+    if ((mpierr = MPI_Comm_size(test_comm, &ntasks)))
+        MPIERR(mpierr);
+    if ((mpierr = MPI_Comm_rank(test_comm, &my_rank)))
+        MPIERR(mpierr);
+    next = (my_rank + 1) % ntasks;
+    prev = (my_rank + ntasks - 1) % ntasks;
+
+    /* Tell the next task (and this task) how much data to expect. */
+    int nsend = (next == my_rank) ? 1 : 2;
+    int sendranks[2] = {my_rank, next};
+    int sendvals[2] = {my_rank * 10 + my_rank, my_rank * 10 + next};
+
+    if ((ret = pio_sparse_exchange(nsend, sendranks, sendvals, test_comm, &nrecv,
+                                   &recvranks, &recvvals)))
+        return ret;
+    if (nrecv != nsend)
+        return ERR_WRONG;
+    for (int i = 0; i < nrecv; i++)
+    {
+        if ((i > 0 && recvranks[i] <= recvranks[i - 1]) ||
+            (recvranks[i] != my_rank && recvranks[i] != prev) ||
+            recvvals[i] != recvranks[i] * 10 + my_rank)
+            return ERR_WRONG;
+    }
+    free(recvranks);
+    free(recvvals);
+
+    int sbuf[ntasks];
+    int rbuf[ntasks];
+    int sendcounts[ntasks];
+    int recvcounts[ntasks];
+    int sdispls[ntasks];
+    int rdispls[ntasks];
+    MPI_Datatype sendtypes[ntasks];
+    MPI_Datatype recvtypes[ntasks];
+    int peers[3] = {prev, my_rank, next};
+
+    for (int i = 0; i < ntasks; i++)
+    {
+        sbuf[i] = my_rank;
+        sendcounts[i] = 0;
+        recvcounts[i] = 0;
+        sdispls[i] = i * sizeof(int);
+        rdispls[i] = i * sizeof(int);
+        sendtypes[i] = MPI_INT;
+        recvtypes[i] = MPI_INT;
+    }
+    sendcounts[my_rank] = sendcounts[next] = 1;
+    recvcounts[my_rank] = recvcounts[prev] = 1;
+
+    /* Try the flow control options (max_pend_req 0 is unlimited). */
+    rearr_comm_fc_opt_t fc[NUM_TEST_CASES] = {
+        {false, false, 0}, {true, true, 1}, {false, true, 64}, {true, false, 2},
+        {true, true, PIO_REARR_COMM_UNLIMITED_PEND_REQ}};
+    for (int itest = 0; itest < NUM_TEST_CASES; itest++)
+    {
+        for (int i = 0; i < ntasks; i++)
+            rbuf[i] = -999;
+
+        if ((ret = pio_sparse_swapm(sbuf, sendcounts, sdispls, sendtypes, rbuf, recvcounts,
+                                    rdispls, recvtypes, test_comm, 3, peers, &fc[itest])))
+            return ret;
+
+        /* Only the data from this task and the previous task is received. */
+        for (int i = 0; i < ntasks; i++)
+            if (rbuf[i] != ((i == my_rank || i == prev) ? i : -999))
+                return ERR_WRONG;
+    }
+
+    return 0;
+}
+
+/* Test pio_swapm_start(), pio_swapm_test() and pio_swapm_wait(). Two
+ * nonblocking exchanges (task i sends i + 1 items to each task) and a
+ * blocking exchange are in progress at the same time.
+ *
+ * @param test_comm the MPI communicator that the test code is running on.
+ * @returns 0 for success, error code otherwise.
+ */
+int run_nb_spmd_tests(MPI_Comm test_comm)
+{
+#define NUM_NB_EXCHANGES 2
+    int my_rank;  /* 0-based rank in test_comm. */
+    int ntasks;   /* Number of tasks in test_comm. */
+    int mpierr;   /* Return value from MPI calls. */
+    int ret;      /* Return value. */
+
+    /* Learn rank and size. */
+    if ((mpierr = MPI_Comm_size(test_comm, &ntasks)))
+        MPIERR(mpierr);
+    if ((mpierr = MPI_Comm_rank(test_comm, &my_rank)))
+        MPIERR(mpierr);
+
+    int sbuf[NUM_NB_EXCHANGES + 1][ntasks * (my_rank + 1)];
+    int rbuf[NUM_NB_EXCHANGES + 1][ntasks * (ntasks + 1)];
+    int sendcounts[ntasks];
+    int recvcounts[ntasks];
+    int sdispls[ntasks];
+    int rdispls[ntasks];
+    MPI_Datatype sendtypes[ntasks];
+    MPI_Datatype recvtypes[ntasks];
+    pio_swapm_req_t *req[NUM_NB_EXCHANGES];
+    int flag;
+
+    for (int p = 0; p < ntasks; p++)
+    {
+        sendcounts[p] = my_rank + 1;
+        sdispls[p] = p * (my_rank + 1) * sizeof(int);
+        recvcounts[p] = p + 1;
+        rdispls[p] = (p * (p + 1) / 2) * sizeof(int);
+        sendtypes[p] = MPI_INT;
+        recvtypes[p] = MPI_INT;
+    }
+
+    /* Try the flow control options (max_pend_req 0 is MPI_Ialltoallw). */
+    rearr_comm_fc_opt_t fc[NUM_TEST_CASES] = {
+        {false, false, 0}, {true, true, 1}, {false, true, 64}, {true, false, 2},
+        {true, true, PIO_REARR_COMM_UNLIMITED_PEND_REQ}};
+    for (int itest = 0; itest < NUM_TEST_CASES; itest++)
+    {
+        for (int x = 0; x < NUM_NB_EXCHANGES + 1; x++)
+        {
+            for (int p = 0; p < ntasks; p++)
+                for (int i = 0; i < my_rank + 1; i++)
+                    sbuf[x][p * (my_rank + 1) + i] = x * 1000 + my_rank * 100 + p;
+            for (int i = 0; i < ntasks * (ntasks + 1); i++)
+                rbuf[x][i] = -999;
+        }
+
+        for (int x = 0; x < NUM_NB_EXCHANGES; x++)
+            if ((ret = pio_swapm_start(sbuf[x], sendcounts, sdispls, sendtypes, rbuf[x],
+                                       recvcounts, rdispls, recvtypes, test_comm, &fc[itest],
+                                       x, &req[x])))
+                return ret;
+
+        /* A blocking exchange while the nonblocking ones are in
+         * progress. */
+        if ((ret = pio_swapm(sbuf[NUM_NB_EXCHANGES], sendcounts, sdispls, sendtypes,
+                             rbuf[NUM_NB_EXCHANGES], recvcounts, rdispls, recvtypes, test_comm,
+                             &fc[itest])))
+            return ret;
+        if ((ret = pio_swapm_test(req[0], &flag)))
+            return ret;
+
+        /* Complete the nonblocking exchanges, the last one first. */
+        for (int x = NUM_NB_EXCHANGES - 1; x >= 0; x--)
+            if ((ret = pio_swapm_wait(req[x])))
+                return ret;
+
+        /* Task p sent p + 1 items to this task. */
+        for (int x = 0; x < NUM_NB_EXCHANGES + 1; x++)
+            for (int p = 0; p < ntasks; p++)
+                for (int i = 0; i < p + 1; i++)
+                    if (rbuf[x][p * (p + 1) / 2 + i] != x * 1000 + p * 100 + my_rank)
+                        return ERR_WRONG;
+    }
+
+    return 0;
+}
+
+/* Test pio_gatherv_large() and pio_scatterv_large(). Task p has p + 1
+ * elements, gathered on the root in reverse order of the tasks and
+ * scattered back. */
+int run_large_gatherv_tests(MPI_Comm test_comm)
+{
+    int my_rank;  /* 0-based rank in test_comm. */
+    int ntasks;   /* Number of tasks in test_comm. */
+    int mpierr;   /* Return value from MPI calls. */
+    int ret;      /* Return value. */
+
+    /* Learn rank and size. */
+    if ((mpierr = MPI_Comm_size(test_comm, &ntasks)))
+        MPIERR(mpierr);
+    if ((mpierr = MPI_Comm_rank(test_comm, &my_rank)))
+        MPIERR(mpierr);
+
+    PIO_Offset sbuf[my_rank + 1];
+    PIO_Offset rbuf[my_rank + 1];
+    PIO_Offset rootbuf[ntasks * (ntasks + 1) / 2];
+    int counts[ntasks];
+    PIO_Offset displs[ntasks];
+    PIO_Offset pos = 0;
+
+    for (int p = ntasks - 1; p >= 0; p--)
+    {
+        counts[p] = p + 1;
+        displs[p] = pos;
+        pos += counts[p];
+    }
+    for (int i = 0; i < my_rank + 1; i++)
+    {
+        sbuf[i] = my_rank * 100 + i;
+        rbuf[i] = -999;
+    }
+
+    for (int root = 0; root < ntasks; root++)
+    {
+        if ((ret = pio_gatherv_large(sbuf, my_rank + 1, MPI_OFFSET, rootbuf, counts, displs,
+                                     root, test_comm)))
+            return ret;
+        if (my_rank == root)
+            for (int p = 0; p < ntasks; p++)
+                for (int i = 0; i < p + 1; i++)
+                    if (rootbuf[displs[p] + i] != p * 100 + i)
+                        return ERR_WRONG;
+
+        if ((ret = pio_scatterv_large(rootbuf, counts, displs, MPI_OFFSET, rbuf, my_rank + 1,
+                                      root, test_comm)))
+            return ret;
+        for (int i = 0; i < my_rank + 1; i++)
+            if (rbuf[i] != sbuf[i])
+                return ERR_WRONG;
+    }
+
+    return 0;
+}
+
 /* Test some of the functions in the file pioc_sc.c. 
  *
  * @param test_comm the MPI communicator that the test code is running on. 
@@ -349,6 +584,283 @@ int test_misc()
     return 0;
 }
 
+/* Test the lookup of the write multi buffers of a file. */
+int test_wmb_lookup()
+{
+#define NUM_WMB_IOIDS 20
+    file_desc_t *file;
+    wmulti_buffer *wmb;
+    int ret;
+
+    if (!(file = calloc(1, sizeof(file_desc_t))))
+        return PIO_ENOMEM;
+
+    /* A file without buffers. */
+    if (pio_get_wmb(file, PIO_IODESC_START_ID, 0))
+        return ERR_WRONG;
+
+    /* Add the buffers in decreasing order of the ioids, with a
+     * buffer for the record variables for every other ioid. */
+    for (int i = NUM_WMB_IOIDS - 1; i >= 0; i--)
+        for (int rec = 0; rec < 1 + i % 2; rec++)
+        {
+            if ((ret = pio_add_wmb(file, PIO_IODESC_START_ID + i, rec, &wmb)))
+                return ret;
+            if (wmb->ioid != PIO_IODESC_START_ID + i || wmb->recordvar != rec ||
+                wmb->num_arrays || wmb->nsegs)
+                return ERR_WRONG;
+        }
+
+    /* The buffers are found, and kept in the order they were added. */
+    if (file->nwmbs != NUM_WMB_IOIDS + NUM_WMB_IOIDS / 2)
+        return ERR_WRONG;
+    for (int i = 0; i < NUM_WMB_IOIDS; i++)
+        for (int rec = 0; rec < 2; rec++)
+        {
+            wmb = pio_get_wmb(file, PIO_IODESC_START_ID + i, rec);
+            if (rec && !(i % 2))
+            {
+                if (wmb)
+                    return ERR_WRONG;
+            }
+            else if (!wmb || wmb->ioid != PIO_IODESC_START_ID + i || wmb->recordvar != rec)
+                return ERR_WRONG;
+        }
+    if (file->wmbs[0]->ioid != PIO_IODESC_START_ID + NUM_WMB_IOIDS - 1 ||
+        file->wmbs[file->nwmbs - 1]->ioid != PIO_IODESC_START_ID)
+        return ERR_WRONG;
+    if (pio_get_wmb(file, PIO_IODESC_START_ID + NUM_WMB_IOIDS, 0) ||
+        pio_get_wmb(file, PIO_IODESC_START_ID - 1, 1))
+        return ERR_WRONG;
+
+    pio_free_wmbs(file);
+    if (file->nwmbs || pio_get_wmb(file, PIO_IODESC_START_ID, 0))
+        return ERR_WRONG;
+    free(file);
+
+    return 0;
+}
+
+/* Test the buffer arena (bget(), brel()). */
+int test_arena()
+{
+#define NUM_ARENA_BUFS 5
+    bufsize size[NUM_ARENA_BUFS] = {0, 24, 1000, 100000, 100000000};
+    char *buf[NUM_ARENA_BUFS];
+    pio_arena_stats_t stats0, stats;
+
+    pio_arena_stats(&stats0);
+
+    /* Small (carved from slabs), large and huge buffers. */
+    for (int i = 0; i < NUM_ARENA_BUFS; i++)
+    {
+        if (!(buf[i] = bget(size[i])))
+            return ERR_WRONG;
+        if ((size_t)buf[i] % 16)
+            return ERR_WRONG;
+        memset(buf[i], i, size[i]);
+    }
+    pio_arena_stats(&stats);
+    if (stats.curalloc != stats0.curalloc + 24 + 1000 + 100000 + 100000000 ||
+        stats.peakalloc < stats.curalloc || stats.sysalloc < stats.curalloc ||
+        stats.nget != stats0.nget + NUM_ARENA_BUFS)
+        return ERR_WRONG;
+
+    /* Growing a buffer keeps its data. */
+    if (!(buf[1] = bgetr(buf[1], 2000)))
+        return ERR_WRONG;
+    for (int j = 0; j < 24; j++)
+        if (buf[1][j] != 1)
+            return ERR_WRONG;
+    for (int i = 2; i < NUM_ARENA_BUFS; i++)
+        if (buf[i][size[i] - 1] != i)
+            return ERR_WRONG;
+
+    for (int i = 0; i < NUM_ARENA_BUFS; i++)
+        brel(buf[i]);
+    pio_arena_stats(&stats);
+    if (stats.curalloc != stats0.curalloc)
+        return ERR_WRONG;
+
+    if (!(buf[1] = bgetz(1000)))
+        return ERR_WRONG;
+    for (int j = 0; j < 1000; j++)
+        if (buf[1][j])
+            return ERR_WRONG;
+
+#if !PIO_USE_MALLOC
+    /* A freed block is reused. */
+    buf[0] = bget(1000);
+    brel(buf[0]);
+    if (bget(1000) != buf[0])
+        return ERR_WRONG;
+    brel(buf[0]);
+#endif /* !PIO_USE_MALLOC */
+    brel(buf[1]);
+
+    return 0;
+}
+
+/* Test the model of the cost of the flushes used by the flush
+ * policies. */
+int test_flush_model(int iosysid)
+{
+#define FLUSH_LAT 1e-3
+#define FLUSH_TPB 1e-9
+#define FLUSH_LIMIT 100000000
+    pio_cost_fit fit = {0};
+    int old_method;
+
+    /* The policy must be valid. */
+    if (PIOc_set_iosystem_error_handling(iosysid, PIO_RETURN_ERROR, &old_method))
+        return ERR_WRONG;
+    if (PIOc_set_flush_policy(iosysid, TEST_VAL_42) != PIO_EINVAL)
+        return ERR_WRONG;
+    if (PIOc_set_iosystem_error_handling(iosysid, old_method, NULL))
+        return ERR_WRONG;
+    if (PIOc_set_flush_policy(iosysid, PIO_FLUSH_POLICY_MODEL) ||
+        PIOc_set_flush_policy(iosysid, PIO_FLUSH_POLICY_LEGACY))
+        return ERR_WRONG;
+
+    /* Flushes with a latency of 1 ms at 1 GB/s. There is no
+     * prediction until enough flushes are measured. */
+    for (int i = 0; i < PIO_FLUSH_MODEL_MIN_SAMPLES; i++)
+    {
+        PIO_Offset bytes = (i + 1) * 1000000;
+
+        if (pio_cost_fit_flush_now(&fit, FLUSH_LIMIT / 2, FLUSH_LIMIT))
+            return ERR_WRONG;
+        pio_cost_fit_add(&fit, bytes, FLUSH_LAT + bytes * FLUSH_TPB);
+    }
+
+    /* The latency is amortized (within the slack) above lat / (tpb *
+     * slack) = 10 MB. */
+    if (pio_cost_fit_flush_now(&fit, 5000000, FLUSH_LIMIT) ||
+        !pio_cost_fit_flush_now(&fit, 20000000, FLUSH_LIMIT))
+        return ERR_WRONG;
+
+    /* Nothing to flush, or at the limit already. */
+    if (pio_cost_fit_flush_now(&fit, 0, FLUSH_LIMIT) ||
+        pio_cost_fit_flush_now(&fit, FLUSH_LIMIT, FLUSH_LIMIT))
+        return ERR_WRONG;
+
+    /* Flushes of the same size, the latency can not be identified,
+     * so the data is not flushed early. */
+    memset(&fit, 0, sizeof(fit));
+    for (int i = 0; i < PIO_FLUSH_MODEL_MIN_SAMPLES; i++)
+        pio_cost_fit_add(&fit, 1000000, FLUSH_LAT + 1000000 * FLUSH_TPB);
+    if (pio_cost_fit_flush_now(&fit, 1000, FLUSH_LIMIT) ||
+        pio_cost_fit_flush_now(&fit, FLUSH_LIMIT / 2, FLUSH_LIMIT))
+        return ERR_WRONG;
+
+    /* Noisy flushes fitting a negative latency are not flushed
+     * early either. */
+    memset(&fit, 0, sizeof(fit));
+    for (int i = 0; i < PIO_FLUSH_MODEL_MIN_SAMPLES; i++)
+    {
+        PIO_Offset bytes = (i + 1) * 1000000;
+
+        pio_cost_fit_add(&fit, bytes, bytes * FLUSH_TPB * (i + 1));
+    }
+    if (pio_cost_fit_flush_now(&fit, 1000, FLUSH_LIMIT) ||
+        pio_cost_fit_flush_now(&fit, FLUSH_LIMIT / 2, FLUSH_LIMIT))
+        return ERR_WRONG;
+
+    return 0;
+}
+
+/* Test the type conversion of the data written (pio_convert()). */
+int test_convert()
+{
+#define NUM_CONV_TYPES 10
+#define NUM_CONV_VALS 5
+    int type[NUM_CONV_TYPES] = {PIO_BYTE, PIO_SHORT, PIO_INT, PIO_FLOAT, PIO_DOUBLE,
+                                PIO_UBYTE, PIO_USHORT, PIO_UINT, PIO_INT64, PIO_UINT64};
+    long long zero_fill = 0;
+    PIO_Offset nerange;
+
+    /* Convert 42 between all the pairs of types, through int. */
+    for (int f = 0; f < NUM_CONV_TYPES; f++)
+    {
+        for (int t = 0; t < NUM_CONV_TYPES; t++)
+        {
+            long long from_buf, to_buf;
+            int val = 42, back = 0;
+
+            if (!pio_convert_supported(type[f], type[t]))
+                return ERR_WRONG;
+            if (pio_convert(PIO_INT, type[f], &val, &from_buf, 1, NULL, &zero_fill, NULL) ||
+                pio_convert(type[f], type[t], &from_buf, &to_buf, 1, NULL, &zero_fill, NULL) ||
+                pio_convert(type[t], PIO_INT, &to_buf, &back, 1, NULL, &zero_fill, NULL))
+                return ERR_WRONG;
+            if (back != val)
+                return ERR_WRONG;
+        }
+    }
+
+    /* Text and strings are not converted. */
+    if (pio_convert_supported(PIO_CHAR, PIO_INT) || pio_convert_supported(PIO_INT, PIO_STRING))
+        return ERR_WRONG;
+    if (pio_convert(PIO_CHAR, PIO_INT, "a", &zero_fill, 1, NULL, &zero_fill, NULL) != PIO_EBADTYPE)
+        return ERR_WRONG;
+
+    /* The fill value of the data is converted to the fill value of
+     * the variable, and the values out of range are written as the
+     * fill value of the variable. */
+    {
+        double dsrc[NUM_CONV_VALS] = {1.5, -1.0, 1e39, -1e39, NAN};
+        float fdst[NUM_CONV_VALS];
+        double dfill = -1.0;
+        float ffill = PIO_FILL_FLOAT;
+
+        if (pio_convert(PIO_DOUBLE, PIO_FLOAT, dsrc, fdst, NUM_CONV_VALS, &dfill, &ffill,
+                        &nerange) != PIO_ERANGE || nerange != 2)
+            return ERR_WRONG;
+        if (fdst[0] != 1.5f || fdst[1] != ffill || fdst[2] != ffill || fdst[3] != ffill ||
+            !isnan(fdst[4]))
+            return ERR_WRONG;
+    }
+    {
+        int isrc[NUM_CONV_VALS] = {1, -40000, 40000, SHRT_MIN, 7};
+        short sdst[NUM_CONV_VALS];
+        int ifill = 7;
+        short sfill = PIO_FILL_SHORT;
+
+        if (pio_convert(PIO_INT, PIO_SHORT, isrc, sdst, NUM_CONV_VALS, &ifill, &sfill,
+                        &nerange) != PIO_ERANGE || nerange != 2)
+            return ERR_WRONG;
+        if (sdst[0] != 1 || sdst[1] != sfill || sdst[2] != sfill || sdst[3] != SHRT_MIN ||
+            sdst[4] != sfill)
+            return ERR_WRONG;
+    }
+    {
+        double dsrc[NUM_CONV_VALS] = {-1.0, 3.9, NAN, 4294967295.0, 4294967296.0};
+        unsigned int udst[NUM_CONV_VALS];
+        unsigned int ufill = PIO_FILL_UINT;
+
+        if (pio_convert(PIO_DOUBLE, PIO_UINT, dsrc, udst, NUM_CONV_VALS, NULL, &ufill,
+                        &nerange) != PIO_ERANGE || nerange != 3)
+            return ERR_WRONG;
+        if (udst[0] != ufill || udst[1] != 3 || udst[2] != ufill || udst[3] != UINT_MAX ||
+            udst[4] != ufill)
+            return ERR_WRONG;
+    }
+    {
+        unsigned long long usrc[NUM_CONV_VALS] = {ULLONG_MAX, 5, LLONG_MAX, 0, 1ULL << 63};
+        long long ldst[NUM_CONV_VALS];
+        long long lfill = PIO_FILL_INT64;
+
+        if (pio_convert(PIO_UINT64, PIO_INT64, usrc, ldst, NUM_CONV_VALS, NULL, &lfill,
+                        &nerange) != PIO_ERANGE || nerange != 2)
+            return ERR_WRONG;
+        if (ldst[0] != lfill || ldst[1] != 5 || ldst[2] != LLONG_MAX || ldst[3] != 0 ||
+            ldst[4] != lfill)
+            return ERR_WRONG;
+    }
+
+    return 0;
+}
+
 /* Test the CalcStartandCount() function for the BOX rearranger */
 int test_CalcStartandCount()
 {
@@ -816,6 +1328,18 @@ int main(int argc, char **argv)
         if ((ret = run_spmd_tests(test_comm)))
             return ret;
         
+        printf("%d running sparse spmd test code\n", my_rank);
+        if ((ret = run_sparse_spmd_tests(test_comm)))
+            return ret;
+
+        printf("%d running nonblocking spmd test code\n", my_rank);
+        if ((ret = run_nb_spmd_tests(test_comm)))
+            return ret;
+
+        printf("%d running large gatherv/scatterv test code\n", my_rank);
+        if ((ret = run_large_gatherv_tests(test_comm)))
+            return ret;
+
         printf("%d running CalcStartandCount test code\n", my_rank);
         if ((ret = test_CalcStartandCount()))
             return ret;
@@ -836,6 +1360,22 @@ int main(int argc, char **argv)
         if ((ret = test_misc()))
             return ret;
 
+        printf("%d running write multi buffer lookup tests\n", my_rank);
+        if ((ret = test_wmb_lookup()))
+            return ret;
+
+        printf("%d running buffer arena tests\n", my_rank);
+        if ((ret = test_arena()))
+            return ret;
+
+        printf("%d running flush model tests\n", my_rank);
+        if ((ret = test_flush_model(iosysid)))
+            return ret;
+
+        printf("%d running type conversion tests\n", my_rank);
+        if ((ret = test_convert()))
+            return ret;
+
         /* Finalize PIO system. */
         if ((ret = PIOc_finalize(iosysid)))
             return ret;